@@ -0,0 +1,189 @@
+/*
+ * Copyright (C) 2013 Red Hat, Inc.
+ * Written by Florian Weimer <fweimer@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <deque>
+#include <stdexcept>
+
+#include <pthread.h>
+#include <time.h>
+
+namespace cxxll {
+
+// Bounded FIFO queue for passing items between threads.  Producers
+// block while the queue is full, and consumers block while it is
+// empty.  The time spent blocking is recorded, so that pipeline
+// stalls can be reported.
+template <class T>
+class bounded_queue {
+  pthread_mutex_t mutex_;
+  pthread_cond_t cond_;		// signaled on every state change
+  std::deque<T> items_;
+  size_t capacity_;
+  bool closed_;
+  size_t peak_;
+  unsigned long long push_wait_ms_;
+  unsigned long long pop_wait_ms_;
+
+  bounded_queue(const bounded_queue &); // not implemented
+  bounded_queue &operator=(const bounded_queue &); // not implemented
+
+  static unsigned long long now_ms();
+  void wait(unsigned long long &counter);
+public:
+  // CAPACITY must be positive.
+  explicit bounded_queue(size_t capacity);
+  ~bounded_queue();
+
+  // Adds the item at the end of the queue, blocking while the queue
+  // is full.  Throws std::logic_error if the queue has been closed.
+  void push(const T &);
+
+  // Removes the first item and writes it to the argument, blocking
+  // while the queue is empty.  Returns false if the queue has been
+  // closed and is empty.
+  bool pop(T &);
+
+  // Like pop(), but returns false immediately if the queue is empty.
+  bool try_pop(T &);
+
+  // Signals that no more items will be pushed.  Blocked consumers
+  // are woken up.
+  void close();
+
+  struct statistics {
+    size_t peak;		// maximum number of items in the queue
+    unsigned long long push_wait_ms; // total time push() blocked
+    unsigned long long pop_wait_ms; // total time pop() blocked
+  };
+  statistics stats();
+};
+
+template <class T>
+bounded_queue<T>::bounded_queue(size_t capacity)
+  : capacity_(capacity), closed_(false), peak_(0),
+    push_wait_ms_(0), pop_wait_ms_(0)
+{
+  if (capacity == 0) {
+    throw std::logic_error("bounded_queue capacity must be positive");
+  }
+  pthread_mutex_init(&mutex_, NULL);
+  pthread_cond_init(&cond_, NULL);
+}
+
+template <class T>
+bounded_queue<T>::~bounded_queue()
+{
+  pthread_cond_destroy(&cond_);
+  pthread_mutex_destroy(&mutex_);
+}
+
+template <class T> unsigned long long
+bounded_queue<T>::now_ms()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000ULL + ts.tv_nsec / 1000000;
+}
+
+template <class T> void
+bounded_queue<T>::wait(unsigned long long &counter)
+{
+  unsigned long long start = now_ms();
+  pthread_cond_wait(&cond_, &mutex_);
+  counter += now_ms() - start;
+}
+
+template <class T> void
+bounded_queue<T>::push(const T &item)
+{
+  pthread_mutex_lock(&mutex_);
+  while (items_.size() >= capacity_ && !closed_) {
+    wait(push_wait_ms_);
+  }
+  if (closed_) {
+    pthread_mutex_unlock(&mutex_);
+    throw std::logic_error("push to closed bounded_queue");
+  }
+  try {
+    items_.push_back(item);
+  } catch (...) {
+    pthread_mutex_unlock(&mutex_);
+    throw;
+  }
+  if (items_.size() > peak_) {
+    peak_ = items_.size();
+  }
+  pthread_cond_broadcast(&cond_);
+  pthread_mutex_unlock(&mutex_);
+}
+
+template <class T> bool
+bounded_queue<T>::pop(T &item)
+{
+  pthread_mutex_lock(&mutex_);
+  while (items_.empty() && !closed_) {
+    wait(pop_wait_ms_);
+  }
+  bool result = !items_.empty();
+  if (result) {
+    item = items_.front();
+    items_.pop_front();
+    pthread_cond_broadcast(&cond_);
+  }
+  pthread_mutex_unlock(&mutex_);
+  return result;
+}
+
+template <class T> bool
+bounded_queue<T>::try_pop(T &item)
+{
+  pthread_mutex_lock(&mutex_);
+  bool result = !items_.empty();
+  if (result) {
+    item = items_.front();
+    items_.pop_front();
+    pthread_cond_broadcast(&cond_);
+  }
+  pthread_mutex_unlock(&mutex_);
+  return result;
+}
+
+template <class T> void
+bounded_queue<T>::close()
+{
+  pthread_mutex_lock(&mutex_);
+  closed_ = true;
+  pthread_cond_broadcast(&cond_);
+  pthread_mutex_unlock(&mutex_);
+}
+
+template <class T> typename bounded_queue<T>::statistics
+bounded_queue<T>::stats()
+{
+  pthread_mutex_lock(&mutex_);
+  statistics s;
+  s.peak = peak_;
+  s.push_wait_ms = push_wait_ms_;
+  s.pop_wait_ms = pop_wait_ms_;
+  pthread_mutex_unlock(&mutex_);
+  return s;
+}
+
+} // namespace cxxll
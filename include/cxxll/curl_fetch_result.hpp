@@ -21,6 +21,8 @@
 #include <string>
 #include <vector>
 
+struct curl_slist;
+
 namespace cxxll {
 
 class curl_handle;
@@ -31,6 +33,27 @@ struct curl_fetch_result {
   sink *target;	             // receives the data
   long http_date;	     // last modification date, -1 if not available
   long long http_size;	     // file size on the server, -1 if not available
+  double download_speed;     // average bytes per second of the transfer
+  std::string etag;	     // entity tag sent by the server, or empty
+
+  // Validators for a conditional GET.  If the resource has not
+  // changed, no data is written to the target and not_modified is
+  // set instead.  Both are reset to their defaults by the
+  // constructor only, so the object can be reused for retries.
+  long if_modified_since;    // -1 if not used
+  std::string if_none_match; // empty if not used
+  bool not_modified;	     // set if the validators matched
+
+  // Offset at which the transfer starts (with a range request), for
+  // resuming an interrupted transfer.  0 requests the whole resource.
+  long long resume_from;
+
+  // Last byte requested (inclusive), together with resume_from.  -1
+  // requests the data up to the end of the resource.  If set, only
+  // partial responses (206) are accepted, and a server which ignores
+  // the range is treated as an error before any data is written to
+  // the target.
+  long long range_end;
 
   curl_fetch_result(sink *); // initializes target
   ~curl_fetch_result();
@@ -45,13 +68,27 @@ struct curl_fetch_result {
   // the http_status/error fields.
   void head(const char *url);
 
+  // Prepares the handle for a GET request for the URL, for use with
+  // the libcurl multi interface.  The transfer result has to be
+  // passed to complete().
+  void prepare(curl_handle &, const char *url);
+
+  // Processes the result CODE (a CURLcode value) of a transfer set
+  // up with prepare().  Throws curl_exception on errors.
+  void complete(curl_handle &, const char *url, int code);
+
   // Initialize and deinitialze libcurl.
   static void global_init();
   static void global_deinit();
 
 private:
   std::string error;		// records errors from the callback
+  curl_slist *headers;	// additional request headers
+  long response_status;	// from the last HTTP status line, or 0
   static size_t write_function(char *, size_t, size_t, void *userdata);
+  static size_t header_function(char *, size_t, size_t, void *userdata);
+  curl_fetch_result(const curl_fetch_result &); // not implemented
+  curl_fetch_result &operator=(const curl_fetch_result &); // not implemented
   void init(curl_handle &, const char *url);
   void perform(curl_handle &, const char *url);
 };
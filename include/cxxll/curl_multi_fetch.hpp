@@ -0,0 +1,125 @@
+/*
+ * Copyright (C) 2013 Red Hat, Inc.
+ * Written by Florian Weimer <fweimer@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include <string>
+#include <tr1/memory>
+#include <vector>
+
+namespace cxxll {
+
+class curl_exception;
+struct curl_fetch_result;
+class sink;
+
+// Performs many GET requests concurrently, using the libcurl multi
+// interface.  Transfers are started largest first, subject to limits
+// on the number of concurrent transfers overall and per host.  A
+// transfer can name several candidate URLs, and each attempt uses the
+// most preferred one whose host is not busy.  Failed transfers are
+// retried with exponential backoff.  All callbacks are
+// invoked on the thread which calls run().
+class curl_multi_fetch {
+  struct impl;
+  std::tr1::shared_ptr<impl> impl_;
+  curl_multi_fetch(const curl_multi_fetch &); // not implemented
+  curl_multi_fetch &operator=(const curl_multi_fetch &); // not implemented
+public:
+  struct limits {
+    unsigned transfers;		// concurrent transfers (default 4)
+    unsigned per_host;		// concurrent transfers per host (default 2)
+    unsigned attempts;		// attempts per transfer (default 3)
+    unsigned retry_delay;	// delay before the first retry, in ms
+    limits();
+  };
+
+  // Receives the data and the outcome of a single transfer.
+  class transfer {
+  public:
+    virtual ~transfer();
+
+    // Called before each attempt.  Returns the sink for the response
+    // body, which has to remain valid until finished() or failed()
+    // is called.  If NULL is returned, the transfer is skipped, and
+    // no further callbacks are invoked.
+    virtual sink *start() = 0;
+
+    // Called after start() has returned a sink.  Returns the number
+    // of bytes the sink already holds, so that only the remaining
+    // data is requested.  The default implementation returns 0.
+    virtual long long resume_offset();
+
+    // Called after start() has returned a sink.  Returns the last
+    // byte to request (inclusive), or -1 for the data up to the end.
+    // Replies which are not partial are treated as errors, see
+    // curl_fetch_result::range_end.  The default implementation
+    // returns -1.
+    virtual long long range_end();
+
+    // Called once before each attempt, when the transfer is queued
+    // (that is, before start()).  URLS initially contains the URL
+    // passed to add() for the first attempt, and the URL of the
+    // previous attempt otherwise.  It can be replaced with a list of
+    // candidate locations for the same data (such as mirrors), in
+    // order of preference.  The attempt uses the first candidate
+    // whose host is below the per-host limit when the transfer is
+    // started.  The default implementation leaves URLS unchanged.
+    virtual void select_urls(std::vector<std::string> &urls);
+
+    // Called before start() with the index of the URL (in the list
+    // produced by select_urls()) which is used for this attempt.
+    // The default implementation does nothing.
+    virtual void url_selected(size_t index);
+
+    // Called after a successful attempt.  Returning false rejects the
+    // data (after a checksum mismatch, for instance), and the
+    // transfer is retried if attempts remain.
+    virtual bool finished(const curl_fetch_result &) = 0;
+
+    // Called after a failed attempt.  RETRY is true if another
+    // attempt will be made after a delay (independently of
+    // restart()).
+    virtual void failed(const curl_exception &, bool retry) = 0;
+
+    // Called after finished() has returned false or after failed().
+    // If it returns true, the transfer is started again without
+    // delay, and the attempt does not count against the limit (for
+    // example, because the next attempt requests different data).
+    // The default implementation returns false.
+    virtual bool restart();
+  };
+
+  explicit curl_multi_fetch(const limits & = limits());
+  ~curl_multi_fetch();
+
+  // Queues a transfer of URL.  SIZE is the expected size in bytes
+  // (or -1 if unknown) and determines the order of the transfers.
+  // Transfers of equal size are started in the order they were
+  // added.  The transfer object must remain valid until run()
+  // returns.
+  void add(const char *url, long long size, transfer *);
+
+  // Performs all queued transfers.  Exceptions thrown by the
+  // callbacks are propagated, and the remaining transfers are
+  // aborted.
+  void run();
+};
+
+} // namespace cxxll
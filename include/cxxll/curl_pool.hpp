@@ -0,0 +1,86 @@
+/*
+ * Copyright (C) 2013 Red Hat, Inc.
+ * Written by Florian Weimer <fweimer@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include <string>
+#include <tr1/memory>
+
+namespace cxxll {
+
+struct curl_handle;
+
+// Pool of libcurl easy handles.  Idle handles are kept per host and
+// handed out again for requests to the same host, so that their open
+// connections can be reused.  All handles share the DNS cache, the
+// TLS session cache and, if libcurl supports it, the connection
+// cache.
+class curl_pool {
+  struct impl;
+  std::tr1::shared_ptr<impl> impl_;
+  curl_pool(const curl_pool &); // not implemented
+  curl_pool &operator=(const curl_pool &); // not implemented
+public:
+  // IDLE_PER_HOST is the maximum number of idle handles kept for each
+  // host.  Surplus handles are closed when they are returned.
+  explicit curl_pool(unsigned idle_per_host = 4);
+  ~curl_pool();
+
+  // Borrows a handle for a request to the host of URL.  The handle
+  // has its options reset to the libcurl defaults (but stays attached
+  // to the shared caches).  The destructor returns it to the pool.
+  class lease {
+    curl_pool &pool_;
+    std::string host_;
+    curl_handle *handle_;
+    lease(const lease &); // not implemented
+    lease &operator=(const lease &); // not implemented
+  public:
+    lease(curl_pool &, const char *url);
+    ~lease();
+
+    curl_handle &operator*() const;
+    curl_handle *operator->() const;
+  };
+
+  // Returns the number of idle handles in the pool.
+  size_t idle() const;
+
+  // The process-wide pool, created on first use.
+  static curl_pool &global();
+
+  // Deallocates the process-wide pool, closing its connections.
+  // Must be called before libcurl is deinitialized, if at all, and
+  // the pool must not be used afterwards.
+  static void global_deinit();
+};
+
+inline curl_handle &
+curl_pool::lease::operator*() const
+{
+  return *handle_;
+}
+
+inline curl_handle *
+curl_pool::lease::operator->() const
+{
+  return handle_;
+}
+
+} // namespace cxxll
@@ -32,6 +32,12 @@ struct elf_symbol_definition : elf_symbol {
   // Returns true if xsection is actually present.
   bool has_xsection() const;
 
+  // Returns true if the symbol can be bound by other objects: it is
+  // defined, not local, and has default or protected visibility.
+  // The view symboldb.elf_exported_definition applies the same
+  // condition in the database.
+  bool exported() const;
+
   elf_symbol_definition();
   ~elf_symbol_definition();
 };
@@ -44,9 +44,16 @@ public:
   // file name to PATH.
   bool lookup_path(const checksum &, std::string &path);
 
-  // Adds the digests of the cached files to the vector.
+  // Adds the digests of the cached files to the vector.  Partial
+  // files are not included.
   void digests(std::vector<std::vector<unsigned char> > &);
 
+  // Removes the partial files left by resumable add_sink objects
+  // which have not been written to for MAX_AGE seconds, or whose
+  // download has been completed by other means.  Returns the number
+  // of removed files.
+  unsigned expire_partial(unsigned max_age);
+
   // Adds the data to the cache if it does not exist yet (after
   // verifying that the checksum matches).  Updates PATH with the file
   // name.  Returns true on success, false on error (ERROR is
@@ -60,12 +67,27 @@ public:
     struct add_impl;
     std::tr1::shared_ptr<add_impl> impl_;
   public:
-    add_sink(file_cache &, const checksum &);
+    // If RESUME is true, the data is written to a partial file with a
+    // name derived from the checksum, which is kept if the sink is
+    // destroyed before finish() succeeds.  Data left by an earlier
+    // sink is hashed again and appended to, see offset().  Partial
+    // files which are not shorter than the expected length are
+    // discarded.
+    add_sink(file_cache &, const checksum &, bool resume = false);
     ~add_sink();
 
     void write(const unsigned char *, size_t);
 
-    // Performs checksum validation
+    // Returns the number of bytes in the file, including data from
+    // an earlier attempt.
+    unsigned long long offset() const;
+
+    // Discards all data written so far, including data from earlier
+    // attempts.
+    void discard();
+
+    // Performs checksum validation.  On a mismatch, the partial file
+    // is deleted, so that it is not resumed.
     void finish(std::string &path);
   };
 
@@ -0,0 +1,44 @@
+/*
+ * Copyright (C) 2013 Red Hat, Inc.
+ * Written by Florian Weimer <fweimer@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "checksum.hpp"
+
+#include <string>
+#include <vector>
+
+namespace cxxll {
+
+// The description of a single file in a metalink document (version
+// 3, as produced by MirrorManager for repomd.xml).
+struct metalink {
+  std::string name;		// file name
+  checksum csum;		// strongest supported hash (if any) and size
+  std::vector<std::string> urls; // by decreasing preference
+
+  metalink();
+  ~metalink();
+
+  // Parses the metalink document and extracts the first file.
+  // Returns true on success, false otherwise (and updates error).
+  // Hash types which hash_sink does not support are ignored.
+  bool parse(const unsigned char *, size_t, std::string &error);
+};
+
+} // namespace cxxll
@@ -0,0 +1,78 @@
+/*
+ * Copyright (C) 2013 Red Hat, Inc.
+ * Written by Florian Weimer <fweimer@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <string>
+#include <tr1/memory>
+#include <vector>
+
+namespace cxxll {
+
+// A set of mirrors (base URLs) which serve the same data.  Transfer
+// outcomes are recorded per mirror and used to select the mirror for
+// the next transfer: mirrors with fewer consecutive failures are
+// preferred, then mirrors which have not been measured yet (among
+// the first few in list order), and then the fastest mirror.
+// Copies share the same statistics.
+class mirror_set {
+  struct impl;
+  std::tr1::shared_ptr<impl> impl_;
+public:
+  mirror_set();
+  ~mirror_set();
+
+  // Adds a mirror.  A slash is appended to URL if it is missing.
+  // Mirrors added earlier are preferred while there are no
+  // measurements.
+  void add(const std::string &url);
+
+  // Adds the mirrors in a yum-style mirror list (one URL per line,
+  // with # comments).
+  void add_mirrorlist(const std::vector<unsigned char> &);
+
+  // Number of mirrors.
+  size_t size() const;
+
+  // Returns the base URL of the mirror at INDEX.
+  const std::string &url(size_t index) const;
+
+  // Returns the index of the mirror for the next transfer.  Throws
+  // std::logic_error if the set is empty.
+  size_t select() const;
+
+  // Stores the indices of all mirrors in RESULT, in the order of
+  // preference used by select() (which returns the first element).
+  void ranking(std::vector<size_t> &result) const;
+
+  // Records a successful transfer from the mirror at INDEX, with the
+  // observed throughput in bytes per second.
+  void success(size_t index, double bytes_per_second);
+
+  // Records a failed transfer (or a transfer with bad data).
+  void failure(size_t index);
+
+  // Returns the number of failures since the last success.
+  unsigned failures(size_t index) const;
+
+  // Returns the smoothed throughput in bytes per second, or 0 if the
+  // mirror has not been measured yet.
+  double throughput(size_t index) const;
+};
+
+} // namespace cxxll
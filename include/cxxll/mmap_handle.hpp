@@ -0,0 +1,73 @@
+/*
+ * Copyright (C) 2013 Red Hat, Inc.
+ * Written by Florian Weimer <fweimer@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include <cstddef>
+
+namespace cxxll {
+
+// Read-only memory mapping of a file which is unmapped on scope
+// exit.
+class mmap_handle {
+  void *raw;
+  size_t size_;
+  mmap_handle(const mmap_handle &); // not implemented
+  mmap_handle &operator=(const mmap_handle &); // not implemented
+public:
+  // Creates an empty mapping.
+  mmap_handle();
+
+  // Unmaps the file if necessary.
+  ~mmap_handle();
+
+  // Maps the file at PATH into memory, replacing the current mapping.
+  // Throws os_exception on error.
+  void map_read_only(const char *path);
+
+  // Unmaps the file, leaving an empty mapping.
+  void reset() throw();
+
+  // Returns a pointer to the mapped data.  An empty file results in
+  // a NULL pointer.
+  const unsigned char *data() const throw();
+
+  // Returns the length of the mapping.
+  size_t size() const throw();
+};
+
+inline
+mmap_handle::mmap_handle()
+  : raw(0), size_(0)
+{
+}
+
+inline const unsigned char *
+mmap_handle::data() const throw()
+{
+  return static_cast<const unsigned char *>(raw);
+}
+
+inline size_t
+mmap_handle::size() const throw()
+{
+  return size_;
+}
+
+} // namespace cxxll
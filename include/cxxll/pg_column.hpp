@@ -0,0 +1,47 @@
+/*
+ * Copyright (C) 2013 Red Hat, Inc.
+ * Written by Florian Weimer <fweimer@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+namespace cxxll {
+
+class pgresult_handle;
+class string_pool;
+
+// Column-at-a-time decoding of query results.  The column type and
+// format are checked once, and then the values of all rows are
+// appended to the output vector.  Throws pg_exception on format
+// mismatches and NULL values.
+
+void pg_column(pgresult_handle &, int col, std::vector<int> &);
+void pg_column(pgresult_handle &, int col, std::vector<long long> &);
+void pg_column(pgresult_handle &, int col, std::vector<std::string> &);
+void pg_column(pgresult_handle &, int col,
+	       std::vector<std::vector<unsigned char> > &);
+
+// Interns the values of a TEXT column in POOL and appends their
+// indexes.  This is intended for columns with few distinct values,
+// such as architectures or sonames.
+void pg_column(pgresult_handle &, int col,
+	       string_pool &, std::vector<unsigned> &);
+
+} // namespace cxxll
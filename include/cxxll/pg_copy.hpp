@@ -0,0 +1,46 @@
+/*
+ * Copyright (C) 2013 Red Hat, Inc.
+ * Written by Florian Weimer <fweimer@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include "pgconn_handle.hpp"
+
+#include <string>
+#include <vector>
+
+namespace cxxll {
+
+// Helpers for building the input of COPY ... FROM STDIN in the text
+// format.  Fields are separated by '\t', and rows are terminated by
+// '\n', which the caller has to add.
+
+// Appends FIELD to BUF, escaped for the COPY text format.
+void pg_copy_append(std::vector<char> &buf, const char *field);
+
+// Appends the decimal representation of VALUE to BUF.
+void pg_copy_append(std::vector<char> &buf, int value);
+
+// Appends a NULL marker to BUF.
+void pg_copy_append_null(std::vector<char> &buf);
+
+// Copies ROWS into TABLE.  Throws pg_exception on error.
+void pg_copy_rows(pgconn_handle &, const std::string &table,
+		  const std::vector<char> &rows);
+
+} // namespace cxxll
@@ -0,0 +1,111 @@
+/*
+ * Copyright (C) 2013 Red Hat, Inc.
+ * Written by Florian Weimer <fweimer@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include "pg_query.hpp"
+
+#include <string>
+
+namespace cxxll {
+
+// Server-side cursor which retrieves the result of a query in
+// chunks, so that client memory usage does not depend on the size of
+// the result set.  The cursor must be used within a transaction.
+// Results are fetched in binary format.
+class pg_cursor {
+  pgconn_handle &conn_;
+  std::string name_;
+  bool open_;
+  pg_cursor(const pg_cursor &); // not implemented
+  pg_cursor &operator=(const pg_cursor &); // not implemented
+
+  std::string declare(const char *query) const;
+public:
+  // Declares the cursor NAME for QUERY.  Throws pg_exception on
+  // error.
+  pg_cursor(pgconn_handle &, const char *name, const char *query);
+  template <class T1>
+  pg_cursor(pgconn_handle &, const char *name, const char *query,
+	    const T1 &);
+  template <class T1, class T2>
+  pg_cursor(pgconn_handle &, const char *name, const char *query,
+	    const T1 &, const T2 &);
+  template <class T1, class T2, class T3>
+  pg_cursor(pgconn_handle &, const char *name, const char *query,
+	    const T1 &, const T2 &, const T3 &);
+  template <class T1, class T2, class T3, class T4>
+  pg_cursor(pgconn_handle &, const char *name, const char *query,
+	    const T1 &, const T2 &, const T3 &, const T4 &);
+
+  // Closes the cursor if the transaction is still active.  Errors
+  // are ignored.
+  ~pg_cursor();
+
+  // Fetches up to COUNT further rows into RES.  Returns false (and
+  // closes the cursor) if the result set has been exhausted.
+  bool fetch(pgresult_handle &res, int count = 10000);
+
+  // Closes the cursor.  Throws pg_exception on error.
+  void close();
+};
+
+template <class T1>
+pg_cursor::pg_cursor(pgconn_handle &conn, const char *name,
+		     const char *query, const T1 &t1)
+  : conn_(conn), name_(name), open_(false)
+{
+  pgresult_handle res;
+  pg_query(conn_, res, declare(query).c_str(), t1);
+  open_ = true;
+}
+
+template <class T1, class T2>
+pg_cursor::pg_cursor(pgconn_handle &conn, const char *name,
+		     const char *query, const T1 &t1, const T2 &t2)
+  : conn_(conn), name_(name), open_(false)
+{
+  pgresult_handle res;
+  pg_query(conn_, res, declare(query).c_str(), t1, t2);
+  open_ = true;
+}
+
+template <class T1, class T2, class T3>
+pg_cursor::pg_cursor(pgconn_handle &conn, const char *name,
+		     const char *query,
+		     const T1 &t1, const T2 &t2, const T3 &t3)
+  : conn_(conn), name_(name), open_(false)
+{
+  pgresult_handle res;
+  pg_query(conn_, res, declare(query).c_str(), t1, t2, t3);
+  open_ = true;
+}
+
+template <class T1, class T2, class T3, class T4>
+pg_cursor::pg_cursor(pgconn_handle &conn, const char *name,
+		     const char *query,
+		     const T1 &t1, const T2 &t2, const T3 &t3, const T4 &t4)
+  : conn_(conn), name_(name), open_(false)
+{
+  pgresult_handle res;
+  pg_query(conn_, res, declare(query).c_str(), t1, t2, t3, t4);
+  open_ = true;
+}
+
+} // namespace cxxll
@@ -125,6 +125,52 @@ namespace pg_private {
     : dispatch<std::vector<unsigned char> > {
   };
 
+  // Binary representation of a one-dimensional array without NULL
+  // elements.  The array dispatchers below use this as their argument
+  // type, so that the encoded array lives as long as the query.
+  template <class T>
+  class array_arg {
+    std::vector<char> data_;
+  public:
+    array_arg(const std::vector<T> &);
+    const char *data() const { return data_.data(); }
+    int size() const { return data_.size(); }
+  };
+
+  // Common implementation of the array dispatchers.  store() and
+  // length() take a non-const reference, which means that pointers to
+  // arrays (SQL NULL arrays) are not supported.  load() requires the
+  // binary result format.
+  template <class T>
+  struct array_dispatch {
+    typedef array_arg<T> arg;
+    static const int storage = 0;
+    static const char *store(char *, array_arg<T> &arr) { return arr.data(); }
+    static int length(array_arg<T> &arr) { return arr.size(); }
+    static void load(PGresult *, int row, int col, std::vector<T> &);
+  };
+
+  template <>
+  struct dispatch<std::vector<int> > : array_dispatch<int> {
+    static const Oid oid = 1007; // INT4[]
+  };
+
+  template <>
+  struct dispatch<std::vector<long long> > : array_dispatch<long long> {
+    static const Oid oid = 1016; // INT8[]
+  };
+
+  template <>
+  struct dispatch<std::vector<std::string> > : array_dispatch<std::string> {
+    static const Oid oid = 1009; // TEXT[]
+  };
+
+  template <>
+  struct dispatch<std::vector<std::vector<unsigned char> > >
+    : array_dispatch<std::vector<unsigned char> > {
+    static const Oid oid = 1001; // BYTEA[]
+  };
+
   template <class T>
   struct dispatch<T *> {
     typedef const T *arg;
@@ -193,6 +239,35 @@ namespace pg_private {
     return str.data();
   }
 
+  template <class T> const int array_dispatch<T>::storage;
+
+  template <class T>
+  array_arg<T>::array_arg(const std::vector<T> &vec)
+  {
+    // Header: number of dimensions, NULL flag, element type, and the
+    // size and lower bound of the single dimension.
+    unsigned header[5] = {
+      cpu_to_be_32(vec.empty() ? 0 : 1),
+      0,
+      cpu_to_be_32(dispatch<T>::oid),
+      cpu_to_be_32(length_check(vec.size())),
+      cpu_to_be_32(1)
+    };
+    const char *hptr = reinterpret_cast<const char *>(header);
+    data_.assign(hptr, hptr + (vec.empty() ? 12 : sizeof(header)));
+    for (typename std::vector<T>::const_iterator
+	   p = vec.begin(), end = vec.end(); p != end; ++p) {
+      char buffer[dispatch<T>::storage];
+      int len = dispatch<T>::length(*p);
+      const char *ptr = dispatch<T>::store(buffer, *p);
+      unsigned belen = cpu_to_be_32(len);
+      const char *lptr = reinterpret_cast<const char *>(&belen);
+      data_.insert(data_.end(), lptr, lptr + sizeof(belen));
+      data_.insert(data_.end(), ptr, ptr + len);
+    }
+    length_check(data_.size());
+  }
+
   template <class T> const Oid dispatch<T *>::oid;
   template <class T> const int dispatch<T *>::storage;
 
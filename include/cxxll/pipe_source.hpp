@@ -0,0 +1,65 @@
+/*
+ * Copyright (C) 2013 Red Hat, Inc.
+ * Written by Florian Weimer <fweimer@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include "sink.hpp"
+#include "source.hpp"
+
+#include <tr1/memory>
+
+namespace cxxll {
+
+// Bounded in-memory pipe between two threads.  The producer writes
+// data through the sink interface and calls close() when done, the
+// consumer reads it through the source interface.  Both sides block
+// if the buffer is full or empty, respectively.
+class pipe_source : public source {
+  struct impl;
+  std::tr1::shared_ptr<impl> impl_;
+  pipe_source(const pipe_source &); // not implemented
+  pipe_source &operator=(const pipe_source &); // not implemented
+public:
+  // CAPACITY is the size of the buffer, in bytes.
+  explicit pipe_source(size_t capacity = 256 * 1024);
+  ~pipe_source();
+
+  // Returns 0 once close() has been called and all data has been
+  // read.
+  size_t read(unsigned char *, size_t);
+
+  // Called by the consumer to stop the transfer early.  Subsequent
+  // (and currently blocked) writes throw std::runtime_error.
+  // Returns true if the producer had already closed the pipe.
+  bool abort();
+
+  // Sink for the producer.  Does not take ownership of the pipe.
+  class writer : public sink {
+    pipe_source &pipe_;
+  public:
+    explicit writer(pipe_source &);
+    ~writer();
+    void write(const unsigned char *, size_t);
+
+    // Signals the end of the data to the consumer.
+    void close();
+  };
+};
+
+} // namespace cxxll
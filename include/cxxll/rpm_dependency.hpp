@@ -0,0 +1,64 @@
+/*
+ * Copyright (C) 2013 Red Hat, Inc.
+ * Written by Florian Weimer <fweimer@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include <string>
+
+namespace cxxll {
+
+// A Requires or Provides entry from an RPM header.
+struct rpm_dependency {
+  enum kind_type {
+    require = 1,
+    provide
+  };
+
+  // Bits in flags.  These have the same values as RPMSENSE_LESS,
+  // RPMSENSE_GREATER and RPMSENSE_EQUAL.
+  enum {
+    less = 2,
+    greater = 4,
+    equal = 8
+  };
+
+  kind_type kind;
+  std::string capability;
+  unsigned flags;		// 0 if unversioned
+  std::string version;		// [EPOCH:]VERSION[-RELEASE], or empty
+
+  rpm_dependency();
+  ~rpm_dependency();
+
+  // Returns the comparison operator for flags ("<", "<=", "=", ">=",
+  // ">"), or the empty string for unversioned dependencies.
+  const char *op() const;
+
+  // Sets flags from the comparison operator returned by op().
+  // Returns false if the operator is not recognized.
+  bool set_op(const std::string &);
+
+  // Returns true if the version ranges of this dependency and the
+  // other one overlap, using the RPM rules.  Unversioned
+  // dependencies overlap with everything.  The capability names are
+  // not compared.
+  bool overlaps(const rpm_dependency &) const;
+};
+
+} // namespace cxxll
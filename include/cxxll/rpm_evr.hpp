@@ -29,8 +29,20 @@ struct rpm_evr {
   std::string release;
 
   rpm_evr();
+
+  // Parses [EPOCH:]VERSION[-RELEASE].  A missing epoch is stored as
+  // "0", a missing release as the empty string.
+  explicit rpm_evr(const std::string &);
   ~rpm_evr();
 
+  // Returns a negative value, zero, or a positive value if this
+  // version is less than, equal to, or greater than the other
+  // version.  Epochs are compared as decimal numbers, versions and
+  // releases with rpmvercmp().  If RELEASE_OPTIONAL, the releases
+  // are only compared if both are non-empty (as in version
+  // comparisons of RPM dependencies).
+  int compare(const rpm_evr &other, bool release_optional = false) const;
+
   bool operator<(const rpm_evr &other) const;
 };
 
@@ -0,0 +1,58 @@
+/*
+ * Copyright (C) 2013 Red Hat, Inc.
+ * Written by Florian Weimer <fweimer@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+namespace cxxll {
+
+class sink;
+
+// Offsets of the parts of an RPM file, computed from the lead and the
+// header structures (without librpm).  The main header spans
+// [header_start, payload_start), and the compressed payload follows
+// it.  The SHA-1 digest of the main header is the SHA1HEADER value.
+struct rpm_file_layout {
+  unsigned long long header_start;
+  unsigned long long payload_start;
+
+  rpm_file_layout();
+  ~rpm_file_layout();
+
+  // Parses the start of an RPM file.  Returns false if the data is
+  // malformed or does not contain the complete main header.
+  bool parse(const unsigned char *, size_t);
+};
+
+// Reconstructs a re-signed RPM file from HEADER (the new file up to
+// the end of its main header) and the payload of CACHED (another
+// file of the same package), and writes it to TARGET.  The main
+// header of HEADER has to have the SHA-1 hash MAIN_HEADER_HASH (the
+// SHA1HEADER of CACHED) because it contains the payload digest.
+// Returns false without writing anything if either file is malformed,
+// if the main header differs, or if the result would not be LENGTH
+// bytes long.
+bool rpm_splice(const std::vector<unsigned char> &header,
+		const unsigned char *cached, size_t cached_size,
+		const std::vector<unsigned char> &main_header_hash,
+		unsigned long long length, sink &target);
+
+} // namespace cxxll
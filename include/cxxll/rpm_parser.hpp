@@ -27,6 +27,7 @@
 namespace cxxll {
 
 class rpm_package_info;
+struct rpm_dependency;
 
 // This needs to be called once before creating any rpm_parser_state
 // objects.
@@ -54,6 +55,9 @@ public:
   const char *nevra() const;
   const rpm_package_info &package() const;
 
+  // Requires and Provides entries from the header.
+  const std::vector<rpm_dependency> &dependencies() const;
+
   // Reads the next payload entry.  Returns true if an entry has been
   // read, false on EOF.  Throws rpm_parser_exception on read errors.
   bool read_file(rpm_file_entry &);
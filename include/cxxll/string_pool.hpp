@@ -0,0 +1,68 @@
+/*
+ * Copyright (C) 2013 Red Hat, Inc.
+ * Written by Florian Weimer <fweimer@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <tr1/unordered_map>
+
+namespace cxxll {
+
+// Assigns dense indexes (starting at 0) to strings.  Each distinct
+// string is stored only once.
+class string_pool {
+  typedef std::tr1::unordered_map<std::string, unsigned> map;
+  map map_;
+  std::vector<const std::string *> strings_;
+  string_pool(const string_pool &); // not implemented
+  string_pool &operator=(const string_pool &); // not implemented
+public:
+  string_pool();
+  ~string_pool();
+
+  // Returns the index of the string, adding it to the pool if
+  // necessary.
+  unsigned intern(const std::string &);
+  unsigned intern(const char *, size_t);
+
+  // Returns true if the string has been interned before, and sets
+  // INDEX to its index.
+  bool find(const std::string &, unsigned &index) const;
+
+  // Returns the string at INDEX, which must be less than size().
+  const std::string &operator[](unsigned index) const;
+
+  // Returns the number of distinct strings.
+  size_t size() const;
+};
+
+inline const std::string &
+string_pool::operator[](unsigned index) const
+{
+  return *strings_[index];
+}
+
+inline size_t
+string_pool::size() const
+{
+  return strings_.size();
+}
+
+} // namespace cxxll
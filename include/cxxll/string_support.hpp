@@ -27,6 +27,11 @@ namespace cxxll {
 // sequences.  Does not include the surrounding quote characters.
 std::string quote(const std::string &);
 
+// Returns the string as a JSON string literal, including the
+// surrounding quote characters.  Valid UTF-8 sequences are copied
+// unchanged, invalid bytes are replaced with U+FFFD.
+std::string json_quote(const std::string &);
+
 // Parses an unsigned long long, ignoring leading and trailing white space.
 bool parse_unsigned_long_long(const std::string &, unsigned long long &value);
 
@@ -0,0 +1,67 @@
+/*
+ * Copyright (C) 2013 Red Hat, Inc.
+ * Written by Florian Weimer <fweimer@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+namespace cxxll {
+
+// Blocked Bloom filter over symbol names.  Each name sets up to four
+// bits within a single 64-bit block, so a membership test loads one
+// word.  The serialized form (little-endian 64-bit words) is stored
+// in the database, so the hash function and bit selection must not
+// change.
+class symbol_bloom {
+  std::vector<unsigned long long> blocks_;
+public:
+  // Hash of a symbol name.  Computing it once allows testing many
+  // filters cheaply.
+  class probe {
+    friend class symbol_bloom;
+    unsigned long long hash_;
+    unsigned long long mask_;
+  public:
+    explicit probe(const std::string &name);
+
+    // Returns the block index in a filter with BLOCKS blocks.
+    size_t block(size_t blocks) const;
+  };
+
+  // Creates an empty filter sized for COUNT names.
+  explicit symbol_bloom(size_t count);
+  ~symbol_bloom();
+
+  void add(const probe &);
+  void add(const std::string &);
+
+  // Returns false if the name has definitely not been added.
+  bool maybe_contains(const probe &) const;
+
+  // Replaces the contents of the vector with the serialized filter.
+  void serialize(std::vector<unsigned char> &) const;
+
+  // Tests a serialized filter.  Returns true if the filter is empty
+  // or its length is not a multiple of the block size.
+  static bool maybe_contains(const std::vector<unsigned char> &,
+			     const probe &);
+};
+
+} // namespace cxxll
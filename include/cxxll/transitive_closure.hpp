@@ -0,0 +1,109 @@
+/*
+ * Copyright (C) 2013 Red Hat, Inc.
+ * Written by Florian Weimer <fweimer@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include <utility>
+#include <vector>
+
+namespace cxxll {
+
+// Directed graph with nodes 0 .. size() - 1, stored in compressed
+// sparse row format.  Duplicate edges are removed, and the successors
+// of each node are sorted.
+class directed_graph {
+  std::vector<unsigned> offsets_;
+  std::vector<unsigned> targets_;
+public:
+  typedef std::pair<unsigned, unsigned> edge;
+
+  // Creates a graph with NODES nodes and the specified edges.  Both
+  // ends of each edge must be less than NODES.
+  directed_graph(unsigned nodes, const std::vector<edge> &);
+  ~directed_graph();
+
+  // Number of nodes.
+  unsigned size() const;
+
+  // Range of successors of NODE.
+  const unsigned *begin(unsigned node) const;
+  const unsigned *end(unsigned node) const;
+};
+
+// Transitive closure of a directed graph.  Strongly connected
+// components are condensed first (using Tarjan's algorithm), and the
+// sets of reachable nodes are then computed once per component, in
+// reverse topological order.  A node is reachable from itself only
+// if it is part of a cycle.
+class transitive_closure {
+  std::vector<unsigned> component_;
+  std::vector<std::vector<unsigned> > reachable_;
+public:
+  explicit transitive_closure(const directed_graph &);
+  ~transitive_closure();
+
+  // Returns the sorted list of nodes reachable from NODE.
+  const std::vector<unsigned> &operator[](unsigned node) const;
+
+  // Number of strongly connected components.
+  unsigned components() const;
+
+  // Returns the component of NODE.  Components are numbered in
+  // reverse topological order: all components reachable from a
+  // component have a smaller number.
+  unsigned component(unsigned node) const;
+};
+
+inline unsigned
+directed_graph::size() const
+{
+  return offsets_.size() - 1;
+}
+
+inline const unsigned *
+directed_graph::begin(unsigned node) const
+{
+  return targets_.data() + offsets_[node];
+}
+
+inline const unsigned *
+directed_graph::end(unsigned node) const
+{
+  return targets_.data() + offsets_[node + 1];
+}
+
+inline const std::vector<unsigned> &
+transitive_closure::operator[](unsigned node) const
+{
+  return reachable_[component_[node]];
+}
+
+inline unsigned
+transitive_closure::components() const
+{
+  return reachable_.size();
+}
+
+inline unsigned
+transitive_closure::component(unsigned node) const
+{
+  return component_[node];
+}
+
+} // namespace cxxll
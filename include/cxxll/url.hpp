@@ -26,4 +26,9 @@ namespace cxxll {
 // broken and does not follow Section 5.2 of RFC 3986).
 std::string url_combine_yum(const char *base, const char *relative);
 
+// Returns the host part of URL, including the port (if present), but
+// without user information.  Returns an empty string if the URL does
+// not have a host part (for example, file:///path).
+std::string url_host(const char *url);
+
 } // namespace cxxll
@@ -25,6 +25,11 @@ namespace cxxll {
 // Returns true if the string is proper UTF-8.
 bool is_valid_utf8(const std::string &);
 
+// Returns the length of the UTF-8 character at the start of the byte
+// range [FIRST, LAST), or zero if the range does not start with a
+// valid character.
+size_t utf8_character_length(const char *first, const char *last);
+
 // Converts from ISO-8859-1 to UTF-8.
 std::string latin1_to_utf8(const std::string &);
 
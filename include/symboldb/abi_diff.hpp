@@ -0,0 +1,60 @@
+/*
+ * Copyright (C) 2013 Red Hat, Inc.
+ * Written by Florian Weimer <fweimer@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include "database.hpp"
+#include <cxxll/pgconn_handle.hpp>
+
+#include <string>
+#include <vector>
+
+// A difference in the exported ABI between two package sets.
+struct abi_difference {
+  typedef enum {
+    added = 1,			// present only in the new set
+    removed,			// present only in the old set
+    changed			// symbol type, binding or visibility changed
+  } kind;
+
+  kind change;
+  std::string soname;
+  std::string arch;
+
+  // Empty if the entire shared object was added or removed.
+  std::string symbol;
+  std::string version;		// empty if unversioned
+
+  // Orders by soname, architecture, symbol and version.
+  bool operator<(const abi_difference &) const;
+
+  static const char *to_string(kind);
+};
+
+// Appends the differences in the exported symbols of the shared
+// objects in the package sets OLD_SET and NEW_SET to RESULT.  Shared
+// objects are paired by soname and architecture.  If a set contains
+// several files with the same soname and architecture, the file with
+// the lexicographically smallest path is used.  Pairs with identical
+// symbol fingerprints are skipped without loading their symbols.
+// The result is sorted by soname, architecture, symbol and version.
+void diff_package_set_abi(cxxll::pgconn_handle &,
+			  database::package_set_id old_set,
+			  database::package_set_id new_set,
+			  std::vector<abi_difference> &result);
@@ -23,17 +23,21 @@
 #include <stdexcept>
 #include <string>
 #include <tr1/memory>
+#include <tr1/unordered_map>
 #include <vector>
 
 namespace cxxll {
   class rpm_file_info;
   class rpm_package_info;
+  struct rpm_dependency;
   class elf_image;
   class elf_symbol_definition;
   class elf_symbol_reference;
   class java_class;
 }
 
+struct symbol_collision_filter;
+
 // Database wrapper.
 // Members of this class throw pg_exception on error.
 class database {
@@ -59,6 +63,10 @@ public:
   // Transaction with synchronous_commit = off.
   void txn_begin_no_sync();
 
+  // Transaction which sees a single snapshot of the database
+  // (REPEATABLE READ).
+  void txn_begin_snapshot();
+
   struct advisory_lock_guard {
     virtual ~advisory_lock_guard();
   };
@@ -79,6 +87,10 @@ public:
   // Lock namespace for package sets.
   enum { PACKAGE_SET_LOCK_TAG = 1667369644 };
 
+  // Lock namespace for the staged cache partitions of package sets
+  // (see replace_package_set()).
+  enum { PACKAGE_SET_STAGING_LOCK_TAG = 1667369645 };
+
   struct package_id_tag {};
   typedef cxxll::tagged<int, package_id_tag> package_id;
   struct contents_id_tag {};
@@ -109,10 +121,43 @@ public:
   void add_package_digest(package_id, const std::vector<unsigned char> &digest,
 			  unsigned long long length);
 
+  // Adds the Requires and Provides entries of a newly interned
+  // package.
+  void add_package_dependencies(package_id,
+				const std::vector<cxxll::rpm_dependency> &);
+
   // Looks up a package ID by the external SHA-1 or SHA-256 digest.
   // Returns 0 if the package ID was not found.
   package_id package_by_digest(const std::vector<unsigned char> &digest);
 
+  // Known representation of a package (a file with a particular
+  // signature header).
+  struct package_representation {
+    std::vector<unsigned char> digest;
+    unsigned long long length;
+    std::vector<unsigned char> hash; // SHA1HEADER of the package
+  };
+
+  // Adds the representations of the packages which have the same
+  // name, epoch, version, release and architecture as INFO.
+  void package_representations(const cxxll::rpm_package_info &,
+			       std::vector<package_representation> &);
+
+  // Hash function for digests.  Digests are already uniformly
+  // distributed, so this just uses the leading bytes.
+  struct digest_hash {
+    size_t operator()(const std::vector<unsigned char> &) const;
+  };
+  typedef std::tr1::unordered_map<std::vector<unsigned char>, package_id,
+				  digest_hash> package_digest_map;
+
+  // Looks up the package IDs for all DIGESTS using a single query,
+  // and adds them to RESULT.  Digests which are not found are not
+  // added to RESULT.
+  void packages_by_digests
+    (const std::vector<std::vector<unsigned char> > &digests,
+     package_digest_map &result);
+
   file_id add_file(package_id, const std::string &name, bool normalized,
 		   long long mtime, int inode, contents_id);
   void add_file(package_id, const cxxll::rpm_file_info &,
@@ -131,8 +176,12 @@ public:
 
   // Populates the elf_file table.  Uses fallback_arch (from the RPM
   // header) in case we cannot determine the architecture from the ELF
-  // header.
-  void add_elf_image(contents_id, const cxxll::elf_image &, const char *soname);
+  // header.  symbol_filter is the serialized cxxll::symbol_bloom of
+  // the exported symbol names, and symbol_fingerprint is a hash over
+  // the sorted exported symbols and their attributes.
+  void add_elf_image(contents_id, const cxxll::elf_image &, const char *soname,
+		     const std::vector<unsigned char> &symbol_filter,
+		     const std::vector<unsigned char> &symbol_fingerprint);
 
   void add_elf_symbol_definition(contents_id,
 				 const cxxll::elf_symbol_definition &);
@@ -163,29 +212,81 @@ public:
   // Remove all members from the package set.
   void empty_package_set(package_set_id);
 
+  // Packages added to and removed from a package set.
+  struct package_set_delta {
+    std::vector<package_id> added;
+    std::vector<package_id> removed;
+  };
+
   // Replaces the contents of the package set with the package IDs in
   // the vector.  Returns true if there were actual changes.
   bool update_package_set(package_set_id, const std::vector<package_id> &);
   template <class InputIterator> bool
   update_package_set(package_set_id, InputIterator first, InputIterator last);
 
+  // Like the above, but the changes are recorded in DELTA.
+  bool update_package_set(package_set_id, const std::vector<package_id> &,
+			  package_set_delta &delta);
+
+  // Computes the changes needed to turn the contents of the package
+  // set into the package IDs in the vector, without applying them.
+  // Returns true if there are any changes.
+  bool diff_package_set(package_set_id, const std::vector<package_id> &,
+			package_set_delta &delta);
+
+  // Replaces the contents of the package set and updates the package
+  // set caches.  The caches are computed from a snapshot without the
+  // package set lock, and the partitioned ones are committed as
+  // staged partitions.  The lock is held only while the members,
+  // the ELF closure and the staged partitions are put in place, in a
+  // single transaction.  Must be called outside a transaction.
+  // Returns true if there were actual changes.
+  bool replace_package_set(package_set_id, const std::vector<package_id> &);
+
   // Update packet-set-wide helper tables (such as ELF linkage).
   void update_package_set_caches(package_set_id);
 
-  // Returns true if the URL has been cached with expected length and
-  // modification time, and overwrites data.  Returns false otherwise.
-  bool url_cache_fetch(const char *url, size_t expected_length,
-		       long long expected_time,
-		       std::vector<unsigned char> &data);
-
-  // Returns true if the URL has been cached, and overwrites data.
-  // Returns false otherwise.
-  bool url_cache_fetch(const char *url, std::vector<unsigned char> &data);
+  // State of a repository from which a package set was updated.
+  struct package_set_repository {
+    std::string url;		// as specified on the command line
+    std::string revision;	// from repomd.xml, possibly empty
+    std::vector<unsigned char> primary_digest;
+    std::string exclude_name;	// symboldb_options::exclude_name_regexp()
+  };
 
-  // Updates the cached data for this URL.
+  // Adds the repositories recorded for the package set, sorted by
+  // URL.
+  void package_set_repositories(package_set_id,
+				std::vector<package_set_repository> &);
+
+  // Replaces the repositories recorded for the package set.  All
+  // functions which change the members of a package set discard the
+  // recorded repositories, so this has to be called afterwards.
+  void replace_package_set_repositories
+    (package_set_id, const std::vector<package_set_repository> &);
+
+  // Like replace_package_set(), but if REPOS is not NULL, it is
+  // recorded as the repositories of the package set, in the
+  // transaction which puts the new members in place.  If there are no
+  // changes, REPOS is recorded after checking the members again under
+  // the package set lock.
+  bool replace_package_set(package_set_id, const std::vector<package_id> &,
+			   const std::vector<package_set_repository> *repos);
+
+  // Returns true if the URL has been cached, and overwrites the
+  // SHA-256 digest of the cached data, the HTTP modification time (-1
+  // if unknown) and the entity tag (empty if unknown).  Returns false
+  // otherwise.  The data itself is stored outside the database.
+  bool url_cache_fetch(const char *url, std::vector<unsigned char> &digest,
+		       long long &http_time, std::string &etag);
+
+  // Updates the cached digest for this URL.  ETAG can be empty.
   void url_cache_update(const char *url,
-			const std::vector<unsigned char> &data,
-			long long time);
+			const std::vector<unsigned char> &digest,
+			long long time, const std::string &etag);
+
+  // Adds the (sorted) digests of the cached URL data to the vector.
+  void url_cache_digests(std::vector<std::vector<unsigned char> > &);
 
   void referenced_package_digests(std::vector<std::vector<unsigned char> > &);
 
@@ -193,9 +294,43 @@ public:
   void expire_packages();
   void expire_file_contents();
   void expire_java_classes();
+  void expire_rpm_capabilities();
+
+  // Removes URL cache entries which have not changed for 30 days.
+  void expire_url_cache();
+
+  // Output format of the reports printed below.
+  struct report_format {
+    // Print records sorted by file name instead of in the order they
+    // are found.
+    bool sorted;
+
+    // Print one JSON object per line instead of plain text.
+    bool json;
+
+    report_format();
+  };
 
   // Debugging functions.
-  void print_elf_soname_conflicts(package_set_id);
+  void print_elf_soname_conflicts(package_set_id,
+				  const report_format & = report_format());
+
+  // Prints the symbols defined by shared objects with different
+  // sonames.  These are always sorted by symbol name.
+  void print_symbol_collisions(package_set_id,
+			       const symbol_collision_filter &,
+			       const report_format & = report_format());
+
+  // Prints the exported definitions of the named symbols in the
+  // package set, sorted by symbol name.
+  void print_symbol_definitions(package_set_id,
+				const std::vector<std::string> &names,
+				const report_format & = report_format());
+
+  // Prints the differences in the exported symbols of the shared
+  // objects in the two package sets, sorted by soname.
+  void print_abi_diff(package_set_id old_set, package_set_id new_set,
+		      const report_format & = report_format());
 
   // Trap door into the database.
   void exec_sql(const char *command);
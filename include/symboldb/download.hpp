@@ -20,9 +20,15 @@
 
 #include <string>
 #include <vector>
+#include <tr1/memory>
 
 #include <cxxll/sink.hpp>
 
+namespace cxxll {
+  class file_cache;
+  class mmap_handle;
+}
+
 class database;
 
 struct download_options {
@@ -33,9 +39,27 @@ struct download_options {
     only_cache			// only use the cache, no network
   } cache_mode;
 
+  // Content-addressed store for the cached data.  The database only
+  // records the digest.  Must be set unless cache_mode is no_cache.
+  std::tr1::shared_ptr<cxxll::file_cache> cache;
+
   download_options();
+  ~download_options();
 };
 
+// Looks up URL in the URL cache.  Returns true and maps the cached
+// data into DATA if it is available, and updates HTTP_TIME and ETAG.
+// Returns false otherwise.
+bool download_cache_lookup(const download_options &, database &,
+			   const char *url, cxxll::mmap_handle &data,
+			   long long &http_time, std::string &etag);
+
+// Stores DATA as the cached contents of URL.
+void download_cache_update(const download_options &, database &,
+			   const char *url,
+			   const std::vector<unsigned char> &data,
+			   long long http_time, const std::string &etag);
+
 // Tries to download URL and sends its contents to SINK.  Throws
 // pg_exception or curl_exception on errors, or whatever SINK throws.
 void download(const download_options &, database &,
@@ -32,3 +32,13 @@ int symboldb_download_repo(const symboldb_options &opt, database &db,
 void finalize_package_set(const symboldb_options &opt, database &db,
 			  database::package_set_id set);
 
+// Replaces the contents of the package set SET with PIDS and updates
+// the package set caches.  Must be called outside a transaction.  The
+// package set lock is only held while writing the result.  If REPOS
+// is not NULL, it is recorded together with the members (see
+// database::replace_package_set()).  Returns true if the package set
+// changed.
+bool replace_package_set
+  (const symboldb_options &opt, database &db, database::package_set_id set,
+   const std::vector<database::package_id> &pids,
+   const std::vector<database::package_set_repository> *repos);
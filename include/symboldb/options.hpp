@@ -19,6 +19,7 @@
 #pragma once
 
 #include "download.hpp"
+#include <cxxll/curl_multi_fetch.hpp>
 #include <cxxll/file_cache.hpp>
 #include <cxxll/regex_handle.hpp>
 
@@ -29,6 +30,8 @@
 
 class symboldb_options {
   std::vector<std::string> exclude_names_;
+  std::vector<std::string> ignore_symbols_;
+  std::string symbol_collision_path_;
 public:
   enum {
     standard, verbose, quiet
@@ -45,6 +48,22 @@ public:
   // Randomize the download order.
   bool randomize;
 
+  // Number of concurrent RPM downloads, overall and per host.
+  unsigned download_jobs;
+  unsigned connections_per_host;
+
+  // Number of threads which load downloaded RPMs into the database
+  // (each with its own database connection).
+  unsigned load_jobs;
+
+  // If false, the built-in list of ignored symbols (such as _init and
+  // _fini) is not used by --show-symbol-collisions.
+  bool default_ignore_symbols;
+
+  // Report output: sorted records and JSON instead of plain text.
+  bool sort_report;
+  bool json_report;
+
   symboldb_options();
   ~symboldb_options();
 
@@ -55,9 +74,40 @@ public:
   // Returns a regular expression combining all excluded names.
   cxxll::regex_handle exclude_name() const;
 
+  // Returns the source of the exclude_name() regular expression, or
+  // the empty string if add_exclude_name has not been called.
+  std::string exclude_name_regexp() const;
+
   // Returns true if add_exclude_name has been called.
   bool exclude_name_present() const;
 
+  // Adds a regular expression to ignore_symbol.  Throws usage_error
+  // if the expression is invalid.
+  void add_ignore_symbol(const char *);
+
+  // Returns a regular expression matching the symbol names which are
+  // not reported as symbol collisions.
+  cxxll::regex_handle ignore_symbol() const;
+
+  // Sets the regular expression for the paths of the shared objects
+  // examined for symbol collisions.  Throws usage_error if the
+  // expression is invalid.
+  void set_symbol_collision_path(const char *);
+
+  // Defaults to the shared objects directly in /usr/lib and
+  // /usr/lib64.
+  cxxll::regex_handle symbol_collision_path() const;
+
+  // Set download_jobs, connections_per_host and load_jobs from a
+  // command line argument.  Throw usage_error if it is not a
+  // positive number.
+  void set_download_jobs(const char *);
+  void set_connections_per_host(const char *);
+  void set_load_jobs(const char *);
+
+  // Concurrency limits for RPM downloads.
+  cxxll::curl_multi_fetch::limits download_limits() const;
+
   download_options download() const;
 
   // cache_only or always_cache, depending on no_net.
@@ -67,6 +117,11 @@ public:
 
   std::string rpm_cache_path() const;
 
+  // Content-addressed store for the data in the URL cache.
+  std::tr1::shared_ptr<cxxll::file_cache> url_cache() const;
+
+  std::string url_cache_path() const;
+
   class usage_error : public std::exception {
     std::string what_;
   public:
@@ -0,0 +1,71 @@
+/*
+ * Copyright (C) 2013 Red Hat, Inc.
+ * Written by Florian Weimer <fweimer@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include "database.hpp"
+#include <cxxll/pgconn_handle.hpp>
+
+#include <string>
+#include <vector>
+
+// Tables which are partitioned by package set.  The rows of a package
+// set are stored in the table symboldb.PARENT_<set_id>, which
+// inherits from symboldb.PARENT and has a CHECK constraint on its
+// set_id column.  INDEXED is a NULL-terminated list of columns which
+// receive single-column indexes in each partition.
+
+// Creates a new, empty partition table for the package set, which
+// does not replace the existing partition yet.  A leftover table from
+// an earlier call is dropped first.  Returns its qualified name, for
+// use with COPY.
+std::string package_set_partition_create(cxxll::pgconn_handle &,
+					 const char *parent,
+					 database::package_set_id);
+
+// Indexes the table created by package_set_partition_create() and
+// puts it in place of the existing partition, which is dropped.
+// This locks the parent table exclusively until the end of the
+// transaction.  Lock waits are bounded by a lock timeout and retried
+// a few times before waiting indefinitely.
+void package_set_partition_replace(cxxll::pgconn_handle &,
+				   const char *parent,
+				   database::package_set_id,
+				   const char *const *indexed);
+
+// Creates the partition for the package set unless it already
+// exists.  Returns its qualified name.
+std::string package_set_partition_ensure(cxxll::pgconn_handle &,
+					 const char *parent,
+					 database::package_set_id,
+					 const char *const *indexed);
+
+// The members of the package set after a package_set_delta has been
+// applied, as a FROM item with the alias psm.  $1 is the set ID, $2
+// the removed, and $3 the added package IDs, as returned by
+// package_set_delta_ids().  This allows computing the package set
+// caches before the member changes are written.
+#define PACKAGE_SET_MEMBERS_AFTER_DELTA \
+  "(SELECT package_id FROM symboldb.package_set_member" \
+  " WHERE set_id = $1 AND package_id <> ALL ($2)" \
+  " UNION SELECT UNNEST ($3::integer[])) psm"
+
+// Stores the package IDs of the delta in REMOVED and ADDED.
+void package_set_delta_ids(const database::package_set_delta &,
+			   std::vector<int> &removed, std::vector<int> &added);
@@ -19,6 +19,7 @@
 #pragma once
 
 #include <cxxll/checksum.hpp>
+#include <cxxll/mirror_set.hpp>
 #include <cxxll/rpm_package_info.hpp>
 #include <cxxll/source.hpp>
 
@@ -41,6 +42,9 @@ struct repomd {
   };
 
   std::string base_url;         // base URL for repodata/repomd.xml
+
+  // All known mirrors of the repository, including base_url.
+  std::tr1::shared_ptr<cxxll::mirror_set> mirrors;
   std::string revision;		// revision number (or 0 if not present)
   std::vector<entry> entries;
 
@@ -55,7 +59,10 @@ struct repomd {
   // Downloads the repodata/repomd.xml file relative to the passed
   // URL.  (A slash is appended to it if it is missng.)  Parses the
   // result.  An error message is written to ERROR, and false is
-  // returned on failure.
+  // returned on failure.  "metalink=URL" and "mirrorlist=URL" load
+  // the list of mirrors from URL first, and the mirrors are tried in
+  // order until one succeeds.  With a metalink, repomd.xml is
+  // verified against the checksum in the metalink.
   void acquire(const download_options &, database &, const char *url);
 
   // Source which provides access to the primary.XML file for the
@@ -69,7 +76,11 @@ struct repomd {
     // Download the primary.xml file from the repository.  You can use
     // download_options::always_cache because usually, the file name
     // embeds a hash of the file, so if we have a matching entry in
-    // the cache, we know that it has the right contents.
+    // the cache, we know that it has the right contents.  The data is
+    // downloaded in the background while it is being read.  The
+    // checksum is verified (and the URL cache updated) when read()
+    // reaches the end of the data, so a mismatch is reported by the
+    // final read() call.  The database is not used concurrently.
     primary_xml(const repomd &, const download_options &, database &);
     ~primary_xml();
 
@@ -101,5 +112,9 @@ struct repomd {
     // From <location>, Already combined with the base URL or the
     // xml:base algorithm, accordingq to the yum algorithm.
     const std::string &href() const;
+
+    // From <rpm:header-range>, the offset of the end of the RPM
+    // header (that is, of the start of the payload), or 0 if missing.
+    unsigned long long header_end() const;
   };
 };
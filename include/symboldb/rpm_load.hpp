@@ -29,7 +29,9 @@ class symboldb_options;
 // Loads the RPM file PATH into the database and returns metadata in
 // INFO.  Reports some errors on standard error.  The database must
 // not have an open transaction.  The return value is the package ID,
-// or 0 on error.
+// or 0 on error.  This can be called from several threads, with
+// separate database objects.  The RPM and ELF parsing is serialized
+// internally.
 database::package_id rpm_load(const symboldb_options &opt, database &db,
 			      const char *path, cxxll::rpm_package_info &info,
 			      const cxxll::checksum *expected);
@@ -0,0 +1,66 @@
+/*
+ * Copyright (C) 2013 Red Hat, Inc.
+ * Written by Florian Weimer <fweimer@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include "database.hpp"
+#include <cxxll/pgconn_handle.hpp>
+#include <cxxll/regex_handle.hpp>
+
+#include <string>
+#include <vector>
+
+// Restricts the shared objects and symbols considered by
+// find_symbol_collisions().
+struct symbol_collision_filter {
+  // Only files whose path matches this expression are examined.
+  cxxll::regex_handle path;
+
+  // Symbols whose name matches this expression are not reported.
+  cxxll::regex_handle ignore;
+
+  symbol_collision_filter(const cxxll::regex_handle &path,
+			  const cxxll::regex_handle &ignore);
+};
+
+// A symbol defined by shared objects with different sonames for the
+// same architecture.
+struct symbol_collision {
+  struct definition {
+    std::string soname;
+    std::string file;
+    std::string nevra;
+    bool operator<(const definition &) const;
+  };
+
+  std::string name;
+  std::string arch;
+
+  // Sorted by soname, file name and package.
+  std::vector<definition> definitions;
+
+  bool operator<(const symbol_collision &) const;
+};
+
+// Appends the symbol collisions in the package set to RESULT, sorted
+// by symbol name and architecture.  Only exported definitions are
+// considered, and collisions within a single package are ignored.
+void find_symbol_collisions(cxxll::pgconn_handle &, database::package_set_id,
+			    const symbol_collision_filter &,
+			    std::vector<symbol_collision> &result);
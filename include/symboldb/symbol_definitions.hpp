@@ -0,0 +1,48 @@
+/*
+ * Copyright (C) 2013 Red Hat, Inc.
+ * Written by Florian Weimer <fweimer@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include "database.hpp"
+#include <cxxll/pgconn_handle.hpp>
+
+#include <string>
+#include <vector>
+
+// An exported definition of a symbol in a package set.
+struct symbol_definition_info {
+  std::string name;
+  std::string version;		// empty if unversioned
+  std::string arch;		// empty if unknown
+  std::string soname;		// empty if not present
+  std::string file;
+  std::string nevra;
+
+  bool operator<(const symbol_definition_info &) const;
+};
+
+// Appends the exported definitions of the symbols NAMES in the
+// package set to RESULT, sorted by symbol name, version, file and
+// package.  The per-file symbol filters in the elf_file table are
+// used to skip files which cannot define any of the symbols, so that
+// only a small part of the elf_definition table is accessed.
+void find_symbol_definitions(cxxll::pgconn_handle &,
+			     database::package_set_id,
+			     const std::vector<std::string> &names,
+			     std::vector<symbol_definition_info> &result);
@@ -22,7 +22,9 @@
 #include <cxxll/pgconn_handle.hpp>
 
 #include <string>
+#include <utility>
 #include <vector>
+#include <tr1/memory>
 
 struct update_elf_closure_conflicts {
   // Called to indicate that the soname NEEDED_NAME could not be
@@ -45,3 +47,42 @@ struct update_elf_closure_conflicts {
 // If CONFLICTS is not NULL, conflicts encountered are recorded there.
 void update_elf_closure(cxxll::pgconn_handle &, database::package_set_id,
 			update_elf_closure_conflicts *conflicts);
+
+// Resolves the DT_NEEDED entries of the ELF files in the package set,
+// after the changes in DELTA, and appends the direct dependencies to
+// EDGES, as pairs of the needing and the needed file ID.  The
+// dependencies of each file are adjacent and sorted by DT_NEEDED
+// name.
+void resolve_elf_needed(cxxll::pgconn_handle &, database::package_set_id,
+			const database::package_set_delta &delta,
+			std::vector<std::pair<int, int> > &edges);
+
+// A closure which is computed in one transaction and written to the
+// database in another one.  This allows the computation to run on a
+// snapshot, without holding the package set lock.
+class elf_closure_update {
+  struct impl;
+  std::tr1::shared_ptr<impl> impl_;
+public:
+  elf_closure_update();
+  ~elf_closure_update();
+
+  // Computes the closure of the whole package set.  If CONFLICTS is
+  // not NULL, conflicts encountered are recorded there.
+  void compute(cxxll::pgconn_handle &, database::package_set_id,
+	       update_elf_closure_conflicts *conflicts);
+
+  // Computes the closure of the package set after the changes in
+  // DELTA.  The stored closure must match the members before DELTA,
+  // but DELTA may already have been applied to the members.
+  void compute(cxxll::pgconn_handle &, database::package_set_id,
+	       const database::package_set_delta &delta);
+
+  // Returns true if the package set members are still those seen by
+  // compute().
+  bool current(cxxll::pgconn_handle &) const;
+
+  // Writes the computed closure.  The caller has to make sure that
+  // current() is true.
+  void apply(cxxll::pgconn_handle &) const;
+};
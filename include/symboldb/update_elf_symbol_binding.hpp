@@ -0,0 +1,42 @@
+/*
+ * Copyright (C) 2013 Red Hat, Inc.
+ * Written by Florian Weimer <fweimer@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include "database.hpp"
+#include <cxxll/pgconn_handle.hpp>
+
+// Resolves the undefined symbols of the ELF files in the package set,
+// after the changes in DELTA, to the shared objects which define
+// them, and writes the result to a new symboldb.elf_symbol_binding
+// partition.  The existing partition is not replaced until
+// replace_elf_symbol_binding() is called.
+void prepare_elf_symbol_binding(cxxll::pgconn_handle &,
+				database::package_set_id,
+				const database::package_set_delta &delta);
+
+// Replaces the symbol binding partition of the package set with the
+// one written by prepare_elf_symbol_binding().
+void replace_elf_symbol_binding(cxxll::pgconn_handle &,
+				database::package_set_id);
+
+// Calls prepare_elf_symbol_binding() and
+// replace_elf_symbol_binding().
+void update_elf_symbol_binding(cxxll::pgconn_handle &,
+			       database::package_set_id);
@@ -0,0 +1,40 @@
+/*
+ * Copyright (C) 2013 Red Hat, Inc.
+ * Written by Florian Weimer <fweimer@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include "database.hpp"
+#include <cxxll/pgconn_handle.hpp>
+
+// Resolves the Requires of the packages in the package set, after
+// the changes in DELTA, to the packages which provide them (through
+// Provides or file names), and computes the transitive install
+// closure.  The results are written to new
+// symboldb.package_require_provider and
+// symboldb.package_install_closure partitions, which do not replace
+// the existing partitions until replace_rpm_closure() is called.
+void prepare_rpm_closure(cxxll::pgconn_handle &, database::package_set_id,
+			 const database::package_set_delta &delta);
+
+// Replaces the partitions of the package set with the ones written
+// by prepare_rpm_closure().
+void replace_rpm_closure(cxxll::pgconn_handle &, database::package_set_id);
+
+// Calls prepare_rpm_closure() and replace_rpm_closure().
+void update_rpm_closure(cxxll::pgconn_handle &, database::package_set_id);
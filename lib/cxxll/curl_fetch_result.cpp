@@ -17,11 +17,18 @@
  */
 
 #include <cxxll/curl_handle.hpp>
+#include <cxxll/curl_pool.hpp>
 #include <cxxll/curl_fetch_result.hpp>
 #include <cxxll/curl_exception.hpp>
 #include <cxxll/sink.hpp>
 
+#include "symboldb_config.h"
+
+#include <cstdio>
+#include <cstdlib>
 #include <cstring>
+#include <new>
+#include <strings.h>
 
 using namespace cxxll;
 
@@ -31,6 +38,12 @@ curl_fetch_result::write_function(char *ptr, size_t size, size_t nmemb,
 {
   curl_fetch_result &r(*static_cast<curl_fetch_result *>(userdata));
   size = size * nmemb;
+  if (r.range_end >= 0 && r.response_status != 0
+      && r.response_status != 206) {
+    // The server ignored the range request.  Abort the transfer
+    // instead of reading the entire resource.
+    return 0;
+  }
   if (r.error.empty()) {
     try {
       r.target->write(reinterpret_cast<unsigned char *>(ptr), size);
@@ -42,13 +55,55 @@ curl_fetch_result::write_function(char *ptr, size_t size, size_t nmemb,
   return size;
 }
 
+size_t
+curl_fetch_result::header_function(char *ptr, size_t size, size_t nmemb,
+				   void *userdata)
+{
+  curl_fetch_result &r(*static_cast<curl_fetch_result *>(userdata));
+  size = size * nmemb;
+  try {
+    std::string line(ptr, size);
+    while (!line.empty() && (line[line.size() - 1] == '\n'
+			     || line[line.size() - 1] == '\r')) {
+      line.resize(line.size() - 1);
+    }
+    if (line.compare(0, 5, "HTTP/") == 0) {
+      // Start of a new response (after a redirect, for example).
+      r.etag.clear();
+      size_t space = line.find(' ');
+      r.response_status = 0;
+      if (space != std::string::npos) {
+	r.response_status = strtol(line.c_str() + space + 1, NULL, 10);
+      }
+    } else if (line.size() > 5 && strncasecmp(line.c_str(), "etag:", 5) == 0) {
+      size_t start = line.find_first_not_of(" \t", 5);
+      if (start != std::string::npos) {
+	r.etag = line.substr(start);
+      }
+    }
+  } catch (std::exception &e) {
+    if (r.error.empty()) {
+      r.error = e.what();
+    }
+  }
+  return size;
+}
+
 void
 curl_fetch_result::init(curl_handle &h, const char *url)
 {
   error.clear();
   effective_url.clear();
+  etag.clear();
   http_date = -1;
   http_size = -1;
+  download_speed = 0;
+  not_modified = false;
+  response_status = 0;
+  if (headers != NULL) {
+    curl_slist_free_all(headers);
+    headers = NULL;
+  }
 
   CURLcode ret;
   ret = curl_easy_setopt(h.raw, CURLOPT_URL, url);
@@ -80,10 +135,61 @@ curl_fetch_result::init(curl_handle &h, const char *url)
   if (ret != CURLE_OK) {
     throw curl_exception(curl_easy_strerror(ret)).url(url);
   }
+  ret = curl_easy_setopt(h.raw, CURLOPT_HEADERFUNCTION, header_function);
+  if (ret != CURLE_OK) {
+    throw curl_exception(curl_easy_strerror(ret)).url(url);
+  }
+  ret = curl_easy_setopt(h.raw, CURLOPT_HEADERDATA, this);
+  if (ret != CURLE_OK) {
+    throw curl_exception(curl_easy_strerror(ret)).url(url);
+  }
   ret = curl_easy_setopt(h.raw, CURLOPT_USERAGENT, "symboldb/0.0");
   if (ret != CURLE_OK) {
     throw curl_exception(curl_easy_strerror(ret)).url(url);
   }
+  if (if_modified_since >= 0) {
+    ret = curl_easy_setopt(h.raw, CURLOPT_TIMECONDITION,
+			   static_cast<long>(CURL_TIMECOND_IFMODSINCE));
+    if (ret != CURLE_OK) {
+      throw curl_exception(curl_easy_strerror(ret)).url(url);
+    }
+    ret = curl_easy_setopt(h.raw, CURLOPT_TIMEVALUE, if_modified_since);
+    if (ret != CURLE_OK) {
+      throw curl_exception(curl_easy_strerror(ret)).url(url);
+    }
+  }
+  if (range_end >= 0) {
+    char range[64];
+    snprintf(range, sizeof(range), "%lld-%lld", resume_from, range_end);
+    ret = curl_easy_setopt(h.raw, CURLOPT_RANGE, range);
+    if (ret != CURLE_OK) {
+      throw curl_exception(curl_easy_strerror(ret)).url(url);
+    }
+  } else if (resume_from > 0) {
+    ret = curl_easy_setopt(h.raw, CURLOPT_RESUME_FROM_LARGE,
+			   static_cast<curl_off_t>(resume_from));
+    if (ret != CURLE_OK) {
+      throw curl_exception(curl_easy_strerror(ret)).url(url);
+    }
+  }
+  if (!if_none_match.empty()) {
+    std::string header("If-None-Match: ");
+    header += if_none_match;
+    headers = curl_slist_append(NULL, header.c_str());
+    if (headers == NULL) {
+      throw std::bad_alloc();
+    }
+    ret = curl_easy_setopt(h.raw, CURLOPT_HTTPHEADER, headers);
+    if (ret != CURLE_OK) {
+      throw curl_exception(curl_easy_strerror(ret)).url(url);
+    }
+  }
+#ifdef HAVE_CURL_HTTP2
+  // Use HTTP/2 if the server offers it during the TLS handshake.
+  // This is only a preference, so errors are ignored.
+  curl_easy_setopt(h.raw, CURLOPT_HTTP_VERSION,
+		   static_cast<long>(CURL_HTTP_VERSION_2TLS));
+#endif
 
   // The following settings should detect connectivity issues.  The
   // throughput limit is fairly low, but it should allow us to detect
@@ -105,10 +211,19 @@ curl_fetch_result::init(curl_handle &h, const char *url)
 void
 curl_fetch_result::perform(curl_handle &h, const char *url)
 {
-  CURLcode ret;
+  complete(h, url, curl_easy_perform(h.raw));
+}
 
+void
+curl_fetch_result::prepare(curl_handle &h, const char *url)
+{
+  init(h, url);
+}
 
-  ret = curl_easy_perform(h.raw);
+void
+curl_fetch_result::complete(curl_handle &h, const char *url, int code)
+{
+  CURLcode ret = static_cast<CURLcode>(code);
   char *effective_url_c = NULL;
   curl_easy_getinfo(h.raw, CURLINFO_EFFECTIVE_URL, &effective_url_c);
   if (strcmp(url, effective_url_c) != 0) {
@@ -116,9 +231,27 @@ curl_fetch_result::perform(curl_handle &h, const char *url)
   }
   long status;
   curl_easy_getinfo(h.raw, CURLINFO_RESPONSE_CODE, &status);
+  if (ret == CURLE_OK && (if_modified_since >= 0 || !if_none_match.empty())) {
+    // libcurl reports an unmet time condition for file:// URLs and
+    // for 304 responses to If-Modified-Since.  If-None-Match is sent
+    // as a plain header, so check for 304 explicitly.
+    long unmet = 0;
+    curl_easy_getinfo(h.raw, CURLINFO_CONDITION_UNMET, &unmet);
+    if (unmet || status == 304) {
+      not_modified = true;
+      return;
+    }
+  }
   // A response code of 0 is used if the protocol does not support
-  // response codes.
-  if (ret != CURLE_OK || (status != 200 && status != 0)) {
+  // response codes.  Range requests result in 206.
+  bool status_ok;
+  if (range_end >= 0) {
+    status_ok = status == 206 || status == 0;
+  } else {
+    status_ok = status == 200 || status == 0
+      || (resume_from > 0 && status == 206);
+  }
+  if (ret != CURLE_OK || !status_ok) {
     char *primary_ip = NULL;
     curl_easy_getinfo(h.raw, CURLINFO_PRIMARY_IP, &primary_ip);
     long primary_port = 0;
@@ -137,40 +270,56 @@ curl_fetch_result::perform(curl_handle &h, const char *url)
 	.original_url(url).status(status).remote(primary_ip, primary_port);
     }
   }
+  if (!error.empty()) {
+    // The sink rejected the data.
+    throw curl_exception(error.c_str()).url(url);
+  }
   curl_easy_getinfo(h.raw, CURLINFO_FILETIME, &http_date);
   double size;
   curl_easy_getinfo(h.raw, CURLINFO_CONTENT_LENGTH_DOWNLOAD, &size);
   http_size = size;
+#ifdef HAVE_CURL_SPEED_DOWNLOAD_T
+  curl_off_t speed = 0;
+  curl_easy_getinfo(h.raw, CURLINFO_SPEED_DOWNLOAD_T, &speed);
+  download_speed = speed;
+#else
+  curl_easy_getinfo(h.raw, CURLINFO_SPEED_DOWNLOAD, &download_speed);
+#endif
 }
 
 curl_fetch_result::curl_fetch_result(sink *t)
-  : target(t)
+  : target(t), http_date(-1), http_size(-1), download_speed(0),
+    if_modified_since(-1), not_modified(false), resume_from(0),
+    range_end(-1), headers(NULL), response_status(0)
 {
 }
 
 curl_fetch_result::~curl_fetch_result()
 {
+  if (headers != NULL) {
+    curl_slist_free_all(headers);
+  }
 }
 
 void
 curl_fetch_result::get(const char *url)
 {
-  curl_handle h;
-  init(h, url);
-  perform(h, url);
+  curl_pool::lease h(curl_pool::global(), url);
+  init(*h, url);
+  perform(*h, url);
 }
 
 void
 curl_fetch_result::head(const char *url)
 {
-  curl_handle h;
-  init(h, url);
+  curl_pool::lease h(curl_pool::global(), url);
+  init(*h, url);
   CURLcode ret;
-  ret = curl_easy_setopt(h.raw, CURLOPT_NOBODY, 1L);
+  ret = curl_easy_setopt(h->raw, CURLOPT_NOBODY, 1L);
   if (ret != CURLE_OK) {
     throw curl_exception(curl_easy_strerror(ret)).url(url);
   }
-  perform(h, url);
+  perform(*h, url);
 }
 
 void
@@ -184,5 +333,6 @@ curl_fetch_result::global_init()
 void
 curl_fetch_result::global_deinit()
 {
+  curl_pool::global_deinit();
   curl_global_cleanup();
 }
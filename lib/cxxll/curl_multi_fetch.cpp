@@ -0,0 +1,430 @@
+/*
+ * Copyright (C) 2013 Red Hat, Inc.
+ * Written by Florian Weimer <fweimer@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <cxxll/curl_multi_fetch.hpp>
+#include <cxxll/curl_exception.hpp>
+#include <cxxll/curl_fetch_result.hpp>
+#include <cxxll/curl_handle.hpp>
+#include <cxxll/curl_pool.hpp>
+#include <cxxll/url.hpp>
+
+#include "symboldb_config.h"
+
+#include <algorithm>
+#include <map>
+#include <new>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <time.h>
+
+using namespace cxxll;
+
+curl_multi_fetch::limits::limits()
+  : transfers(4), per_host(2), attempts(3), retry_delay(1000)
+{
+}
+
+curl_multi_fetch::transfer::~transfer()
+{
+}
+
+long long
+curl_multi_fetch::transfer::resume_offset()
+{
+  return 0;
+}
+
+long long
+curl_multi_fetch::transfer::range_end()
+{
+  return -1;
+}
+
+void
+curl_multi_fetch::transfer::select_urls(std::vector<std::string> &)
+{
+}
+
+void
+curl_multi_fetch::transfer::url_selected(size_t)
+{
+}
+
+bool
+curl_multi_fetch::transfer::restart()
+{
+  return false;
+}
+
+namespace {
+  // Monotonic time in milliseconds.
+  long long
+  now_ms()
+  {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000LL + ts.tv_nsec / 1000000;
+  }
+
+  void
+  sleep_ms(long long ms)
+  {
+    struct timespec ts;
+    ts.tv_sec = ms / 1000;
+    ts.tv_nsec = (ms % 1000) * 1000000;
+    nanosleep(&ts, NULL);
+  }
+
+  struct entry {
+    std::string url;		// URL of the current attempt
+    std::string host;		// host of url
+    std::vector<std::string> urls;  // candidates for the next attempt
+    std::vector<std::string> hosts; // hosts of the candidates
+    long long size;
+    size_t order;		// position in the add() sequence
+    curl_multi_fetch::transfer *target;
+    unsigned attempts;
+    long long ready_at;
+    std::tr1::shared_ptr<curl_pool::lease> handle;
+    std::tr1::shared_ptr<curl_fetch_result> result;
+  };
+
+  // Larger transfers first, to reduce the overall completion time.
+  // Transfers of equal size are kept in the order they were added.
+  struct larger {
+    bool operator()(const entry *a, const entry *b) const
+    {
+      if (a->size != b->size) {
+	return a->size > b->size;
+      }
+      return a->order < b->order;
+    }
+  };
+
+  // The transfers for a single host.
+  struct host_state {
+    unsigned active;
+    std::set<entry *, larger> pending;
+
+    host_state()
+      : active(0)
+    {
+    }
+  };
+}
+
+struct curl_multi_fetch::impl {
+  limits limits_;
+  CURLM *multi;
+  std::vector<std::tr1::shared_ptr<entry> > entries;
+  std::map<std::string, host_state> hosts;
+  size_t pending;		// number of queued transfers in hosts
+  std::vector<entry *> delayed;	// waiting for a retry
+  std::map<CURL *, entry *> active;
+
+  explicit impl(const limits &);
+  ~impl();
+
+  // Obtains the candidate URLs for the next attempt and queues the
+  // transfer with each of their hosts.
+  void queue(entry *);
+
+  // Starts pending transfers until a limit is reached.  Only the
+  // first transfer queued for each host is considered, so the cost
+  // does not depend on the number of pending transfers.  A transfer
+  // uses its most preferred candidate URL whose host is not busy.
+  void start_transfers();
+  void start(entry *);
+
+  // Processes finished transfers.  Returns true if any transfer
+  // completed.
+  bool process_messages();
+  void complete(entry *, CURLcode);
+  void release(entry *);
+  void retry(entry *);
+
+  // Restarts or retries the transfer after an unsuccessful attempt.
+  // AGAIN indicates whether attempts remain.
+  void reschedule(entry *, bool again);
+
+  // Moves delayed transfers whose retry time has come to the pending
+  // list.  Returns the time until the next delayed transfer is ready,
+  // or -1 if there are no more delayed transfers.
+  long long wake_delayed();
+};
+
+curl_multi_fetch::impl::impl(const limits &l)
+  : limits_(l), multi(curl_multi_init()), pending(0)
+{
+  if (multi == NULL) {
+    throw std::bad_alloc();
+  }
+#ifdef HAVE_CURL_HTTP2
+  curl_multi_setopt(multi, CURLMOPT_PIPELINING, CURLPIPE_MULTIPLEX);
+#endif
+}
+
+curl_multi_fetch::impl::~impl()
+{
+  for (std::map<CURL *, entry *>::iterator
+	 p = active.begin(), end = active.end(); p != end; ++p) {
+    curl_multi_remove_handle(multi, p->first);
+  }
+  curl_multi_cleanup(multi);
+}
+
+void
+curl_multi_fetch::impl::queue(entry *e)
+{
+  // The limit applies to the host of the URL actually used, which is
+  // only chosen when the transfer is started.
+  e->urls.assign(1, e->url);
+  e->target->select_urls(e->urls);
+  if (e->urls.empty()) {
+    e->urls.assign(1, e->url);
+  }
+  e->hosts.clear();
+  for (std::vector<std::string>::const_iterator
+	 p = e->urls.begin(), end = e->urls.end(); p != end; ++p) {
+    e->hosts.push_back(url_host(p->c_str()));
+    hosts[e->hosts.back()].pending.insert(e);
+  }
+  ++pending;
+}
+
+void
+curl_multi_fetch::impl::start_transfers()
+{
+  while (pending > 0 && active.size() < limits_.transfers) {
+    host_state *best = NULL;
+    for (std::map<std::string, host_state>::iterator
+	   p = hosts.begin(), end = hosts.end(); p != end; ++p) {
+      host_state &h(p->second);
+      if (h.pending.empty() || h.active >= limits_.per_host) {
+	continue;
+      }
+      if (best == NULL
+	  || larger()(*h.pending.begin(), *best->pending.begin())) {
+	best = &h;
+      }
+    }
+    if (best == NULL) {
+      // All hosts with pending transfers are busy.
+      break;
+    }
+    entry *e = *best->pending.begin();
+    size_t selected = e->urls.size();
+    for (size_t i = 0, end = e->hosts.size(); i < end; ++i) {
+      host_state &h(hosts[e->hosts[i]]);
+      h.pending.erase(e);
+      if (selected == e->urls.size() && h.active < limits_.per_host) {
+	selected = i;
+      }
+    }
+    --pending;
+    e->url = e->urls[selected];
+    e->host = e->hosts[selected];
+    e->target->url_selected(selected);
+    start(e);
+  }
+}
+
+void
+curl_multi_fetch::impl::start(entry *e)
+{
+  sink *target = e->target->start();
+  if (target == NULL) {
+    return;
+  }
+  ++e->attempts;
+  e->handle.reset(new curl_pool::lease(curl_pool::global(), e->url.c_str()));
+  curl_handle &h(**e->handle);
+  e->result.reset(new curl_fetch_result(target));
+  e->result->resume_from = e->target->resume_offset();
+  e->result->range_end = e->target->range_end();
+  e->result->prepare(h, e->url.c_str());
+#ifdef HAVE_CURL_HTTP2
+  // Prefer waiting for a multiplexed HTTP/2 stream over opening a new
+  // connection.
+  curl_easy_setopt(h.raw, CURLOPT_PIPEWAIT, 1L);
+#endif
+  CURLMcode ret = curl_multi_add_handle(multi, h.raw);
+  if (ret != CURLM_OK) {
+    throw curl_exception(curl_multi_strerror(ret)).url(e->url);
+  }
+  active[h.raw] = e;
+  ++hosts[e->host].active;
+}
+
+bool
+curl_multi_fetch::impl::process_messages()
+{
+  bool completed = false;
+  CURLMsg *msg;
+  int left;
+  while ((msg = curl_multi_info_read(multi, &left)) != NULL) {
+    if (msg->msg != CURLMSG_DONE) {
+      continue;
+    }
+    std::map<CURL *, entry *>::iterator p = active.find(msg->easy_handle);
+    entry *e = p->second;
+    CURLcode code = msg->data.result;
+    curl_multi_remove_handle(multi, msg->easy_handle);
+    active.erase(p);
+    --hosts[e->host].active;
+    complete(e, code);
+    completed = true;
+  }
+  return completed;
+}
+
+void
+curl_multi_fetch::impl::complete(entry *e, CURLcode code)
+{
+  bool again = e->attempts < limits_.attempts;
+  try {
+    e->result->complete(**e->handle, e->url.c_str(), code);
+  } catch (curl_exception &ex) {
+    release(e);
+    e->target->failed(ex, again);
+    reschedule(e, again);
+    return;
+  }
+  bool ok = e->target->finished(*e->result);
+  release(e);
+  if (!ok) {
+    reschedule(e, again);
+  }
+}
+
+void
+curl_multi_fetch::impl::release(entry *e)
+{
+  e->result.reset();
+  e->handle.reset();
+}
+
+void
+curl_multi_fetch::impl::retry(entry *e)
+{
+  long long delay = static_cast<long long>(limits_.retry_delay)
+    << (e->attempts - 1);
+  e->ready_at = now_ms() + delay;
+  delayed.push_back(e);
+}
+
+void
+curl_multi_fetch::impl::reschedule(entry *e, bool again)
+{
+  if (e->target->restart()) {
+    --e->attempts;
+    queue(e);
+  } else if (again) {
+    retry(e);
+  }
+}
+
+long long
+curl_multi_fetch::impl::wake_delayed()
+{
+  if (delayed.empty()) {
+    return -1;
+  }
+  long long now = now_ms();
+  long long next = -1;
+  for (std::vector<entry *>::iterator p = delayed.begin();
+       p != delayed.end(); ) {
+    entry *e = *p;
+    if (e->ready_at <= now) {
+      p = delayed.erase(p);
+      queue(e);
+    } else {
+      if (next < 0 || e->ready_at - now < next) {
+	next = e->ready_at - now;
+      }
+      ++p;
+    }
+  }
+  return next;
+}
+
+curl_multi_fetch::curl_multi_fetch(const limits &l)
+  : impl_(new impl(l))
+{
+  if (l.transfers == 0 || l.per_host == 0 || l.attempts == 0) {
+    throw std::logic_error("invalid curl_multi_fetch limits");
+  }
+}
+
+curl_multi_fetch::~curl_multi_fetch()
+{
+}
+
+void
+curl_multi_fetch::add(const char *url, long long size, transfer *t)
+{
+  std::tr1::shared_ptr<entry> e(new entry);
+  e->url = url;
+  e->size = size;
+  e->order = impl_->entries.size();
+  e->target = t;
+  e->attempts = 0;
+  e->ready_at = 0;
+  impl_->entries.push_back(e);
+}
+
+void
+curl_multi_fetch::run()
+{
+  impl &i(*impl_);
+  for (std::vector<std::tr1::shared_ptr<entry> >::iterator
+	 p = i.entries.begin(), end = i.entries.end(); p != end; ++p) {
+    i.queue(p->get());
+  }
+  while (i.pending > 0 || !i.active.empty() || !i.delayed.empty()) {
+    long long next_retry = i.wake_delayed();
+    i.start_transfers();
+    if (i.active.empty()) {
+      if (next_retry > 0 && i.pending == 0) {
+	sleep_ms(next_retry);
+      }
+      continue;
+    }
+    int running;
+    CURLMcode ret = curl_multi_perform(i.multi, &running);
+    if (ret != CURLM_OK) {
+      throw curl_exception(curl_multi_strerror(ret));
+    }
+    if (!i.process_messages()) {
+      int timeout = 1000;
+      if (next_retry >= 0 && next_retry < timeout) {
+	timeout = next_retry;
+      }
+      ret = curl_multi_wait(i.multi, NULL, 0, timeout, NULL);
+      if (ret != CURLM_OK) {
+	throw curl_exception(curl_multi_strerror(ret));
+      }
+    }
+  }
+  i.entries.clear();
+  i.hosts.clear();
+}
@@ -0,0 +1,208 @@
+/*
+ * Copyright (C) 2013 Red Hat, Inc.
+ * Written by Florian Weimer <fweimer@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <cxxll/curl_pool.hpp>
+#include <cxxll/curl_handle.hpp>
+#include <cxxll/url.hpp>
+
+#include "symboldb_config.h"
+
+#include <map>
+#include <new>
+#include <vector>
+
+#include <pthread.h>
+
+using namespace cxxll;
+
+namespace {
+  // Serializes access to a mutex in its scope.
+  struct mutex_guard {
+    pthread_mutex_t &mutex_;
+    explicit mutex_guard(pthread_mutex_t &mutex)
+      : mutex_(mutex)
+    {
+      pthread_mutex_lock(&mutex_);
+    }
+    ~mutex_guard()
+    {
+      pthread_mutex_unlock(&mutex_);
+    }
+  };
+}
+
+struct curl_pool::impl {
+  unsigned idle_per_host;
+  CURLSH *share;
+  pthread_mutex_t share_locks[CURL_LOCK_DATA_LAST];
+  mutable pthread_mutex_t idle_lock;
+  typedef std::map<std::string, std::vector<curl_handle *> > idle_map;
+  idle_map idle;
+
+  explicit impl(unsigned);
+  ~impl();
+
+  curl_handle *acquire(const std::string &host);
+  void release(const std::string &host, curl_handle *);
+
+  static void lock_function(CURL *, curl_lock_data, curl_lock_access,
+			    void *);
+  static void unlock_function(CURL *, curl_lock_data, void *);
+};
+
+curl_pool::impl::impl(unsigned idle_per_host)
+  : idle_per_host(idle_per_host), share(curl_share_init())
+{
+  if (share == NULL) {
+    throw std::bad_alloc();
+  }
+  for (int i = 0; i < CURL_LOCK_DATA_LAST; ++i) {
+    pthread_mutex_init(share_locks + i, NULL);
+  }
+  pthread_mutex_init(&idle_lock, NULL);
+  curl_share_setopt(share, CURLSHOPT_LOCKFUNC, lock_function);
+  curl_share_setopt(share, CURLSHOPT_UNLOCKFUNC, unlock_function);
+  curl_share_setopt(share, CURLSHOPT_USERDATA, this);
+  curl_share_setopt(share, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+  curl_share_setopt(share, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+#ifdef HAVE_CURL_SHARE_CONNECT
+  curl_share_setopt(share, CURLSHOPT_SHARE, CURL_LOCK_DATA_CONNECT);
+#endif
+}
+
+curl_pool::impl::~impl()
+{
+  for (idle_map::iterator p = idle.begin(), end = idle.end(); p != end; ++p) {
+    for (std::vector<curl_handle *>::iterator
+	   q = p->second.begin(), qend = p->second.end(); q != qend; ++q) {
+      delete *q;
+    }
+  }
+  // All handles using the share must be gone at this point.
+  curl_share_cleanup(share);
+  pthread_mutex_destroy(&idle_lock);
+  for (int i = 0; i < CURL_LOCK_DATA_LAST; ++i) {
+    pthread_mutex_destroy(share_locks + i);
+  }
+}
+
+curl_handle *
+curl_pool::impl::acquire(const std::string &host)
+{
+  {
+    mutex_guard guard(idle_lock);
+    idle_map::iterator p = idle.find(host);
+    if (p != idle.end() && !p->second.empty()) {
+      curl_handle *h = p->second.back();
+      p->second.pop_back();
+      curl_easy_reset(h->raw);
+      return h;
+    }
+  }
+  curl_handle *h = new curl_handle;
+  curl_easy_setopt(h->raw, CURLOPT_SHARE, share);
+  return h;
+}
+
+void
+curl_pool::impl::release(const std::string &host, curl_handle *h)
+{
+  {
+    mutex_guard guard(idle_lock);
+    std::vector<curl_handle *> &vec(idle[host]);
+    if (vec.size() < idle_per_host) {
+      try {
+	vec.push_back(h);
+	return;
+      } catch (std::bad_alloc &) {
+	// Fall through and deallocate the handle.
+      }
+    }
+  }
+  delete h;
+}
+
+void
+curl_pool::impl::lock_function(CURL *, curl_lock_data data,
+			       curl_lock_access, void *userptr)
+{
+  pthread_mutex_lock(static_cast<impl *>(userptr)->share_locks + data);
+}
+
+void
+curl_pool::impl::unlock_function(CURL *, curl_lock_data data, void *userptr)
+{
+  pthread_mutex_unlock(static_cast<impl *>(userptr)->share_locks + data);
+}
+
+curl_pool::curl_pool(unsigned idle_per_host)
+  : impl_(new impl(idle_per_host))
+{
+}
+
+curl_pool::~curl_pool()
+{
+}
+
+size_t
+curl_pool::idle() const
+{
+  mutex_guard guard(impl_->idle_lock);
+  size_t count = 0;
+  for (impl::idle_map::const_iterator
+	 p = impl_->idle.begin(), end = impl_->idle.end(); p != end; ++p) {
+    count += p->second.size();
+  }
+  return count;
+}
+
+namespace {
+  curl_pool *global_pool;
+  pthread_once_t global_pool_once = PTHREAD_ONCE_INIT;
+
+  void
+  create_global_pool()
+  {
+    global_pool = new curl_pool;
+  }
+}
+
+curl_pool &
+curl_pool::global()
+{
+  pthread_once(&global_pool_once, create_global_pool);
+  return *global_pool;
+}
+
+void
+curl_pool::global_deinit()
+{
+  delete global_pool;
+  global_pool = NULL;
+}
+
+curl_pool::lease::lease(curl_pool &pool, const char *url)
+  : pool_(pool), host_(url_host(url)), handle_(pool.impl_->acquire(host_))
+{
+}
+
+curl_pool::lease::~lease()
+{
+  pool_.impl_->release(host_, handle_);
+}
@@ -36,3 +36,11 @@ elf_symbol_definition::has_xsection() const
 {
   return section == SHN_XINDEX;
 }
+
+bool
+elf_symbol_definition::exported() const
+{
+  unsigned char vis = ELF64_ST_VISIBILITY(other);
+  return binding != STB_LOCAL && section != SHN_UNDEF
+    && (vis == STV_DEFAULT || vis == STV_PROTECTED);
+}
@@ -23,15 +23,17 @@
 #include <cxxll/hash.hpp>
 #include <cxxll/os.hpp>
 #include <cxxll/fd_sink.hpp>
-#include <cxxll/tee_sink.hpp>
 #include <cxxll/os_exception.hpp>
 #include <cxxll/dir_handle.hpp>
 
+#include <memory>
+
 #include <errno.h>
 #include <fcntl.h>
 #include <string.h>
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <time.h>
 #include <unistd.h>
 
 using namespace cxxll;
@@ -77,11 +79,9 @@ file_cache::lookup_path(const checksum &csum, std::string &path)
 void
 file_cache::digests(std::vector<std::vector<unsigned char> > &digests)
 {
-  int fd_copy = ::dup(impl_->dirfd.get());
-  if (fd_copy < 0) {
-    throw os_exception().fd(impl_->dirfd.get()).function(dup).defaults();
-  }
-  dir_handle dir(fd_copy);
+  // A duplicate of dirfd would share its directory offset with all
+  // other duplicates, so the directory is opened again.
+  dir_handle dir(impl_->root.c_str());
   std::vector<unsigned char> decoded;
   while (dirent *e = dir.readdir()) {
     decoded.clear();
@@ -95,6 +95,42 @@ file_cache::digests(std::vector<std::vector<unsigned char> > &digests)
   }
 }
 
+unsigned
+file_cache::expire_partial(unsigned max_age)
+{
+  static const char suffix[] = ".part";
+  const size_t suffix_length = sizeof(suffix) - 1;
+  time_t now = time(NULL);
+  std::vector<std::string> expired;
+  {
+    dir_handle dir(impl_->root.c_str());
+    while (dirent *e = dir.readdir()) {
+      size_t length = strlen(e->d_name);
+      if (length <= suffix_length
+	  || strcmp(e->d_name + length - suffix_length, suffix) != 0) {
+	continue;
+      }
+      struct stat64 st;
+      if (fstatat64(impl_->dirfd.get(), e->d_name, &st,
+		    AT_SYMLINK_NOFOLLOW) != 0 || !S_ISREG(st.st_mode)) {
+	continue;
+      }
+      std::string complete(e->d_name, length - suffix_length);
+      struct stat64 complete_st;
+      if (fstatat64(impl_->dirfd.get(), complete.c_str(), &complete_st,
+		    AT_SYMLINK_NOFOLLOW) == 0
+	  || now - st.st_mtime >= static_cast<time_t>(max_age)) {
+	expired.push_back(e->d_name);
+      }
+    }
+  }
+  for (std::vector<std::string>::const_iterator
+	 p = expired.begin(), end = expired.end(); p != end; ++p) {
+    impl_->dirfd.unlinkat(p->c_str(), 0);
+  }
+  return expired.size();
+}
+
 struct file_cache::add_sink::add_impl {
   std::tr1::shared_ptr<file_cache::impl> cache;
   checksum csum;
@@ -102,20 +138,24 @@ struct file_cache::add_sink::add_impl {
   std::string temp_file;
   fd_handle handle;
   fd_sink sink;
-  hash_sink hash;
-  tee_sink tee;
+  std::auto_ptr<hash_sink> hash;
   unsigned long long length;
+  bool keep;			// keep temp_file on destruction
 
   add_impl(const std::tr1::shared_ptr<file_cache::impl> &c,
-	   hash_sink::type hash_type)
-    : cache(c), handle(), sink(), hash(hash_type), tee(&sink, &hash), length(0)
+	   const checksum &cs, bool resume)
+    : cache(c), csum(cs),
+      hex(base16_encode(cs.value.begin(), cs.value.end())),
+      temp_file(hex), handle(), sink(), hash(new hash_sink(cs.type)),
+      length(0), keep(resume)
   {
+    temp_file += resume ? ".part" : ".tmp";
   }
 
   ~add_impl()
   {
     // Clean up the temporary file.
-    if (!temp_file.empty()) {
+    if (!temp_file.empty() && !keep) {
       try {
 	cache->dirfd.unlinkat(temp_file.c_str(), 0);
       } catch (...) {
@@ -123,17 +163,45 @@ struct file_cache::add_sink::add_impl {
       }
     }
   }
+
+  // Hashes the data already present in the file.
+  void rehash()
+  {
+    std::vector<unsigned char> buf(64 * 1024);
+    while (size_t ret = handle.read(buf.data(), buf.size())) {
+      hash->write(buf.data(), ret);
+      length += ret;
+    }
+  }
+
+  void truncate()
+  {
+    if (ftruncate64(handle.get(), 0) != 0) {
+      throw os_exception().function(ftruncate64).fd(handle.get()).defaults();
+    }
+    if (lseek64(handle.get(), 0, SEEK_SET) != 0) {
+      throw os_exception().function(lseek64).fd(handle.get()).defaults();
+    }
+    hash.reset(new hash_sink(csum.type));
+    length = 0;
+  }
 };
 
-file_cache::add_sink::add_sink(file_cache &c, const checksum &csum)
+file_cache::add_sink::add_sink(file_cache &c, const checksum &csum,
+			       bool resume)
+  : impl_(new add_impl(c.impl_, csum, resume))
 {
-  impl_.reset(new add_impl(c.impl_, csum.type));
-  impl_->csum = csum;
-  impl_->hex = base16_encode(csum.value.begin(), csum.value.end());
-  impl_->temp_file = impl_->hex;
-  impl_->temp_file += ".tmp";
-  impl_->handle.openat(c.impl_->dirfd.get(), impl_->temp_file.c_str(),
-		       O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+  if (resume) {
+    impl_->handle.openat(c.impl_->dirfd.get(), impl_->temp_file.c_str(),
+			 O_RDWR | O_CREAT | O_CLOEXEC, 0666);
+    impl_->rehash();
+    if (csum.length != checksum::no_length && impl_->length >= csum.length) {
+      impl_->truncate();
+    }
+  } else {
+    impl_->handle.openat(c.impl_->dirfd.get(), impl_->temp_file.c_str(),
+			 O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+  }
   impl_->sink.raw = impl_->handle.get();
 }
 
@@ -144,21 +212,36 @@ file_cache::add_sink::~add_sink()
 void
 file_cache::add_sink::write(const unsigned char *buf, size_t len)
 {
-  impl_->tee.write(buf, len);
+  impl_->sink.write(buf, len);
+  impl_->hash->write(buf, len);
   impl_->length += len;
 }
 
+unsigned long long
+file_cache::add_sink::offset() const
+{
+  return impl_->length;
+}
+
+void
+file_cache::add_sink::discard()
+{
+  impl_->truncate();
+}
+
 void
 file_cache::add_sink::finish(std::string &path)
 {
   if (impl_->csum.length != checksum::no_length
       && impl_->csum.length != impl_->length) {
+    impl_->keep = false;
     throw checksum_mismatch("length");
   }
 
   std::vector<unsigned char> digest;
-  impl_->hash.digest(digest);
+  impl_->hash->digest(digest);
   if (digest != impl_->csum.value) {
+    impl_->keep = false;
     throw checksum_mismatch("digest");
   }
   impl_->handle.fsync();
@@ -0,0 +1,143 @@
+/*
+ * Copyright (C) 2013 Red Hat, Inc.
+ * Written by Florian Weimer <fweimer@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <cxxll/metalink.hpp>
+#include <cxxll/expat_minidom.hpp>
+#include <cxxll/expat_source.hpp>
+#include <cxxll/memory_range_source.hpp>
+#include <cxxll/string_support.hpp>
+
+#include <algorithm>
+#include <cstdlib>
+
+using namespace cxxll;
+
+namespace {
+  typedef std::vector<std::tr1::shared_ptr<expat_minidom::node> > node_list;
+
+  // Hash types in increasing order of preference.
+  const char *const hash_types[] = {"md5", "sha1", "sha256", NULL};
+
+  int
+  hash_rank(const std::string &type)
+  {
+    for (int i = 0; hash_types[i]; ++i) {
+      if (type == hash_types[i]) {
+	return i;
+      }
+    }
+    return -1;
+  }
+
+  struct resource {
+    long preference;
+    std::string url;
+  };
+
+  struct higher_preference {
+    bool operator()(const resource &a, const resource &b) const
+    {
+      return a.preference > b.preference;
+    }
+  };
+}
+
+metalink::metalink()
+{
+}
+
+metalink::~metalink()
+{
+}
+
+bool
+metalink::parse(const unsigned char *buffer, size_t length,
+		std::string &error)
+{
+  memory_range_source mrsource(buffer, length);
+  expat_source esource(&mrsource);
+  using namespace expat_minidom;
+  std::tr1::shared_ptr<element> root(expat_minidom::parse(esource));
+  if (!root) {
+    error = "empty document";
+    return false;
+  }
+  if (root->name != "metalink") {
+    error = "invalid root element";
+    return false;
+  }
+  element *files = root->first_child("files");
+  element *file = files ? files->first_child("file") : NULL;
+  if (!file) {
+    error = "file element missing";
+    return false;
+  }
+  name = file->attributes["name"];
+
+  unsigned long long size = checksum::no_length;
+  element *size_element = file->first_child("size");
+  if (size_element
+      && !parse_unsigned_long_long(strip(size_element->text()), size)) {
+    error = "size element malformed";
+    return false;
+  }
+
+  csum = checksum();
+  csum.length = size;
+  element *verification = file->first_child("verification");
+  if (verification) {
+    int best = -1;
+    for (node_list::iterator p = verification->children.begin(),
+	   end = verification->children.end(); p != end; ++p) {
+      element *e = dynamic_cast<element *>(p->get());
+      if (e && e->name == "hash") {
+	const std::string &type(e->attributes["type"]);
+	int rank = hash_rank(type);
+	if (rank > best) {
+	  csum.set_hexadecimal(type.c_str(), size, strip(e->text()).c_str());
+	  best = rank;
+	}
+      }
+    }
+  }
+
+  std::vector<resource> resources;
+  element *resources_element = file->first_child("resources");
+  if (resources_element) {
+    for (node_list::iterator p = resources_element->children.begin(),
+	   end = resources_element->children.end(); p != end; ++p) {
+      element *e = dynamic_cast<element *>(p->get());
+      if (e && e->name == "url") {
+	resource r;
+	r.url = strip(e->text());
+	r.preference = std::strtol(e->attributes["preference"].c_str(),
+				   NULL, 10);
+	if (!r.url.empty()) {
+	  resources.push_back(r);
+	}
+      }
+    }
+  }
+  std::stable_sort(resources.begin(), resources.end(), higher_preference());
+  urls.clear();
+  for (std::vector<resource>::const_iterator p = resources.begin(),
+	 end = resources.end(); p != end; ++p) {
+    urls.push_back(p->url);
+  }
+  return true;
+}
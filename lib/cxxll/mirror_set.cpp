@@ -0,0 +1,216 @@
+/*
+ * Copyright (C) 2013 Red Hat, Inc.
+ * Written by Florian Weimer <fweimer@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <cxxll/mirror_set.hpp>
+#include <cxxll/string_support.hpp>
+
+#include <algorithm>
+#include <map>
+#include <stdexcept>
+
+using namespace cxxll;
+
+namespace {
+  struct mirror {
+    std::string url;
+    double throughput;		// 0 if not measured
+    unsigned failures;		// since the last success
+    bool measured;		// at least one success
+  };
+
+  // Number of leading mirrors (in list order) which are tried once
+  // before the measurements are used.
+  const size_t probe_count = 3;
+
+  // Orders mirror indices by preference.
+  struct preferred {
+    const std::vector<mirror> &mirrors;
+    const std::vector<unsigned> &classes;
+
+    preferred(const std::vector<mirror> &m, const std::vector<unsigned> &c)
+      : mirrors(m), classes(c)
+    {
+    }
+
+    bool operator()(size_t a, size_t b) const
+    {
+      if (mirrors[a].failures != mirrors[b].failures) {
+	return mirrors[a].failures < mirrors[b].failures;
+      }
+      if (classes[a] != classes[b]) {
+	return classes[a] < classes[b];
+      }
+      if (classes[a] == 1) {
+	return mirrors[a].throughput > mirrors[b].throughput;
+      }
+      return false;
+    }
+  };
+}
+
+struct mirror_set::impl {
+  std::vector<mirror> mirrors;
+
+  const mirror &get(size_t index) const
+  {
+    if (index >= mirrors.size()) {
+      throw std::logic_error("invalid mirror index");
+    }
+    return mirrors[index];
+  }
+
+  mirror &get(size_t index)
+  {
+    if (index >= mirrors.size()) {
+      throw std::logic_error("invalid mirror index");
+    }
+    return mirrors[index];
+  }
+};
+
+mirror_set::mirror_set()
+  : impl_(new impl)
+{
+}
+
+mirror_set::~mirror_set()
+{
+}
+
+void
+mirror_set::add(const std::string &url)
+{
+  mirror m;
+  m.url = url;
+  if (m.url.empty() || m.url.at(m.url.size() - 1) != '/') {
+    m.url += '/';
+  }
+  m.throughput = 0;
+  m.failures = 0;
+  m.measured = false;
+  impl_->mirrors.push_back(m);
+}
+
+void
+mirror_set::add_mirrorlist(const std::vector<unsigned char> &data)
+{
+  std::vector<unsigned char>::const_iterator p = data.begin(),
+    end = data.end();
+  while (p != end) {
+    std::vector<unsigned char>::const_iterator eol = std::find
+      (p, end, static_cast<unsigned char>('\n'));
+    std::string line(strip(std::string(p, eol)));
+    if (!line.empty() && line.at(0) != '#'
+	&& line.find("://") != std::string::npos) {
+      add(line);
+    }
+    p = eol;
+    if (p != end) {
+      ++p;
+    }
+  }
+}
+
+size_t
+mirror_set::size() const
+{
+  return impl_->mirrors.size();
+}
+
+const std::string &
+mirror_set::url(size_t index) const
+{
+  return impl_->get(index).url;
+}
+
+size_t
+mirror_set::select() const
+{
+  if (impl_->mirrors.empty()) {
+    throw std::logic_error("mirror_set::select on empty set");
+  }
+  std::vector<size_t> order;
+  ranking(order);
+  return order.front();
+}
+
+void
+mirror_set::ranking(std::vector<size_t> &result) const
+{
+  const std::vector<mirror> &mirrors(impl_->mirrors);
+
+  // Among the mirrors with the same number of failures, unmeasured
+  // mirrors are probed first, then the fastest ones are used.
+  // Unmeasured mirrors beyond the probe limit come last.
+  std::vector<unsigned> classes;
+  std::map<unsigned, size_t> group_sizes;
+  for (size_t i = 0, end = mirrors.size(); i < end; ++i) {
+    const mirror &m(mirrors[i]);
+    size_t rank = group_sizes[m.failures]++;
+    if (m.measured) {
+      classes.push_back(1);
+    } else if (rank < probe_count) {
+      classes.push_back(0);
+    } else {
+      classes.push_back(2);
+    }
+  }
+
+  result.clear();
+  for (size_t i = 0, end = mirrors.size(); i < end; ++i) {
+    result.push_back(i);
+  }
+  std::stable_sort(result.begin(), result.end(),
+		   preferred(mirrors, classes));
+}
+
+void
+mirror_set::success(size_t index, double bytes_per_second)
+{
+  mirror &m(impl_->get(index));
+  m.failures = 0;
+  if (bytes_per_second < 0) {
+    bytes_per_second = 0;
+  }
+  if (!m.measured) {
+    m.measured = true;
+    m.throughput = bytes_per_second;
+  } else {
+    // Exponential smoothing, so that the estimate follows changing
+    // network conditions.
+    m.throughput = (3 * m.throughput + bytes_per_second) / 4;
+  }
+}
+
+void
+mirror_set::failure(size_t index)
+{
+  ++impl_->get(index).failures;
+}
+
+unsigned
+mirror_set::failures(size_t index) const
+{
+  return impl_->get(index).failures;
+}
+
+double
+mirror_set::throughput(size_t index) const
+{
+  return impl_->get(index).throughput;
+}
@@ -0,0 +1,69 @@
+/*
+ * Copyright (C) 2013 Red Hat, Inc.
+ * Written by Florian Weimer <fweimer@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <cxxll/mmap_handle.hpp>
+#include <cxxll/fd_handle.hpp>
+#include <cxxll/os_exception.hpp>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+using namespace cxxll;
+
+mmap_handle::~mmap_handle()
+{
+  reset();
+}
+
+void
+mmap_handle::map_read_only(const char *path)
+{
+  fd_handle fd;
+  fd.open_read_only(path);
+  struct stat64 st;
+  if (fstat64(fd.get(), &st) != 0) {
+    throw os_exception().function(fstat64).fd(fd.get()).path(path);
+  }
+  void *ptr = 0;
+  size_t size = st.st_size;
+  if (static_cast<unsigned long long>(size)
+      != static_cast<unsigned long long>(st.st_size)) {
+    throw os_exception().message("file too large to map").path(path);
+  }
+  if (size > 0) {
+    ptr = mmap(0, size, PROT_READ, MAP_SHARED, fd.get(), 0);
+    if (ptr == MAP_FAILED) {
+      throw os_exception().function(mmap).fd(fd.get()).path(path)
+	.length(size);
+    }
+  }
+  reset();
+  raw = ptr;
+  size_ = size;
+}
+
+void
+mmap_handle::reset() throw()
+{
+  if (raw != 0) {
+    munmap(raw, size_);
+    raw = 0;
+  }
+  size_ = 0;
+}
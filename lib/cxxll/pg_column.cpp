@@ -0,0 +1,176 @@
+/*
+ * Copyright (C) 2013 Red Hat, Inc.
+ * Written by Florian Weimer <fweimer@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <cxxll/pg_column.hpp>
+#include <cxxll/pg_response.hpp>
+#include <cxxll/pg_exception.hpp>
+#include <cxxll/string_pool.hpp>
+
+using namespace cxxll;
+
+namespace {
+  // Checks the column type and format.  Returns true for the binary
+  // format.
+  bool
+  check_column(PGresult *res, int col, Oid oid, bool bytea_ok)
+  {
+    Oid actual = PQftype(res, col);
+    switch (PQfformat(res, col)) {
+    case 0:
+      return false;
+    case 1:
+      if (actual != oid
+	  && !(bytea_ok
+	       && actual == pg_private::dispatch
+	       <std::vector<unsigned char> >::oid)) {
+	throw pg_exception("format mismatch for column");
+      }
+      return true;
+    default:
+      throw pg_exception("invalid format type");
+    }
+  }
+
+  void
+  check_not_null(PGresult *res, int row, int col)
+  {
+    if (PQgetisnull(res, row, col)) {
+      throw pg_exception("NULL value in non-null column");
+    }
+  }
+
+  template <class T> void
+  load_integers(pgresult_handle &handle, int col, std::vector<T> &out)
+  {
+    PGresult *res = handle.get();
+    int rows = PQntuples(res);
+    if (!check_column(res, col, pg_private::dispatch<T>::oid, false)) {
+      // Text format.  Use the row-at-a-time decoder.
+      out.reserve(out.size() + rows);
+      for (int row = 0; row < rows; ++row) {
+	T val;
+	pg_private::dispatch<T>::load(res, row, col, val);
+	out.push_back(val);
+      }
+      return;
+    }
+    size_t start = out.size();
+    out.resize(start + rows);
+    T *p = out.data() + start;
+    for (int row = 0; row < rows; ++row, ++p) {
+      check_not_null(res, row, col);
+      if (PQgetlength(res, row, col) != sizeof(T)) {
+	throw pg_exception("format mismatch for integer column");
+      }
+      const char *ptr = PQgetvalue(res, row, col);
+      T val;
+      memcpy(&val, ptr, sizeof(val));
+      if (sizeof(T) == 4) {
+	*p = be_to_cpu_32(val);
+      } else {
+	*p = be_to_cpu_64(val);
+      }
+    }
+  }
+
+  template <class T> void
+  load_strings(pgresult_handle &handle, int col, std::vector<T> &out)
+  {
+    PGresult *res = handle.get();
+    int rows = PQntuples(res);
+    if (!check_column(res, col, pg_private::dispatch<T>::oid, true)) {
+      // Text format (which needs unescaping for BYTEA).
+      out.reserve(out.size() + rows);
+      for (int row = 0; row < rows; ++row) {
+	out.push_back(T());
+	pg_private::dispatch<T>::load(res, row, col, out.back());
+      }
+      return;
+    }
+    size_t start = out.size();
+    out.resize(start + rows);
+    for (int row = 0; row < rows; ++row) {
+      check_not_null(res, row, col);
+      const char *ptr = PQgetvalue(res, row, col);
+      out[start + row].assign(ptr, ptr + PQgetlength(res, row, col));
+    }
+  }
+} // namespace
+
+void
+cxxll::pg_column(pgresult_handle &res, int col, std::vector<int> &out)
+{
+  load_integers<int>(res, col, out);
+}
+
+void
+cxxll::pg_column(pgresult_handle &res, int col, std::vector<long long> &out)
+{
+  load_integers<long long>(res, col, out);
+}
+
+void
+cxxll::pg_column(pgresult_handle &res, int col, std::vector<std::string> &out)
+{
+  load_strings<std::string>(res, col, out);
+}
+
+void
+cxxll::pg_column(pgresult_handle &res, int col,
+		 std::vector<std::vector<unsigned char> > &out)
+{
+  load_strings<std::vector<unsigned char> >(res, col, out);
+}
+
+void
+cxxll::pg_column(pgresult_handle &handle, int col,
+		 string_pool &pool, std::vector<unsigned> &out)
+{
+  PGresult *res = handle.get();
+  int rows = PQntuples(res);
+  if (PQfformat(res, col) == 0 || PQftype(res, col) != 25) {
+    // Falls back to the generic (and slower) code.
+    std::vector<std::string> strings;
+    pg_column(handle, col, strings);
+    out.reserve(out.size() + rows);
+    for (std::vector<std::string>::const_iterator
+	   p = strings.begin(), end = strings.end(); p != end; ++p) {
+      out.push_back(pool.intern(*p));
+    }
+    return;
+  }
+  size_t start = out.size();
+  out.resize(start + rows);
+  // Consecutive rows often have the same value, so avoid hashing in
+  // this case.
+  const char *last_ptr = NULL;
+  int last_length = -1;
+  unsigned last_index = 0;
+  for (int row = 0; row < rows; ++row) {
+    check_not_null(res, row, col);
+    const char *ptr = PQgetvalue(res, row, col);
+    int length = PQgetlength(res, row, col);
+    if (length != last_length || memcmp(ptr, last_ptr, length) != 0) {
+      last_index = pool.intern(ptr, length);
+      last_ptr = ptr;
+      last_length = length;
+    }
+    out[start + row] = last_index;
+  }
+}
@@ -0,0 +1,84 @@
+/*
+ * Copyright (C) 2013 Red Hat, Inc.
+ * Written by Florian Weimer <fweimer@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <cxxll/pg_copy.hpp>
+#include <cxxll/pgresult_handle.hpp>
+
+#include <cstring>
+
+#include <assert.h>
+#include <stdio.h>
+
+using namespace cxxll;
+
+void
+cxxll::pg_copy_append(std::vector<char> &buf, const char *field)
+{
+  for (; *field; ++field) {
+    switch (*field) {
+    case '\\':
+      buf.push_back('\\');
+      buf.push_back('\\');
+      break;
+    case '\t':
+      buf.push_back('\\');
+      buf.push_back('t');
+      break;
+    case '\n':
+      buf.push_back('\\');
+      buf.push_back('n');
+      break;
+    case '\r':
+      buf.push_back('\\');
+      buf.push_back('r');
+      break;
+    default:
+      buf.push_back(*field);
+    }
+  }
+}
+
+void
+cxxll::pg_copy_append(std::vector<char> &buf, int value)
+{
+  char tmp[32];
+  snprintf(tmp, sizeof(tmp), "%d", value);
+  buf.insert(buf.end(), tmp, tmp + strlen(tmp));
+}
+
+void
+cxxll::pg_copy_append_null(std::vector<char> &buf)
+{
+  buf.push_back('\\');
+  buf.push_back('N');
+}
+
+void
+cxxll::pg_copy_rows(pgconn_handle &conn, const std::string &table,
+		    const std::vector<char> &rows)
+{
+  pgresult_handle copy;
+  copy.exec(conn, ("COPY " + table + " FROM STDIN").c_str());
+  assert(copy.resultStatus() == PGRES_COPY_IN);
+  if (!rows.empty()) {
+    conn.putCopyData(rows.data(), rows.size());
+  }
+  conn.putCopyEnd();
+  copy.getresult(conn);
+}
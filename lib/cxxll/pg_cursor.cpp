@@ -0,0 +1,92 @@
+/*
+ * Copyright (C) 2013 Red Hat, Inc.
+ * Written by Florian Weimer <fweimer@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <cxxll/pg_cursor.hpp>
+#include <cxxll/pgconn_handle.hpp>
+#include <cxxll/pg_exception.hpp>
+
+#include <cstdio>
+
+using namespace cxxll;
+
+pg_cursor::pg_cursor(pgconn_handle &conn, const char *name,
+		     const char *query)
+  : conn_(conn), name_(name), open_(false)
+{
+  pgresult_handle res;
+  res.exec(conn_, declare(query).c_str());
+  open_ = true;
+}
+
+pg_cursor::~pg_cursor()
+{
+  if (open_ && conn_.transactionStatus() == PQTRANS_INTRANS) {
+    try {
+      close();
+    } catch (...) {
+      // The cursor will be closed at the end of the transaction.
+    }
+  }
+}
+
+std::string
+pg_cursor::declare(const char *query) const
+{
+  if (conn_.transactionStatus() != PQTRANS_INTRANS) {
+    throw pg_exception("cursor requires a transaction");
+  }
+  std::string sql("DECLARE ");
+  sql += name_;
+  sql += " NO SCROLL CURSOR FOR ";
+  sql += query;
+  return sql;
+}
+
+bool
+pg_cursor::fetch(pgresult_handle &res, int count)
+{
+  if (!open_) {
+    res.close();
+    return false;
+  }
+  char buf[64];
+  snprintf(buf, sizeof(buf), "FETCH %d FROM ", count);
+  std::string sql(buf);
+  sql += name_;
+  res.execBinary(conn_, sql.c_str());
+  int rows = res.ntuples();
+  if (rows < count) {
+    // A short read means that the result set has been exhausted, so
+    // there is no need for another round-trip.
+    close();
+  }
+  return rows > 0;
+}
+
+void
+pg_cursor::close()
+{
+  if (open_) {
+    open_ = false;
+    std::string sql("CLOSE ");
+    sql += name_;
+    pgresult_handle res;
+    res.exec(conn_, sql.c_str());
+  }
+}
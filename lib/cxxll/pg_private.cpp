@@ -41,6 +41,11 @@ const int pg_private::dispatch<const char *>::storage;
 const Oid pg_private::dispatch<std::string>::oid;
 const int pg_private::dispatch<std::string>::storage;
 
+const Oid pg_private::dispatch<std::vector<int> >::oid;
+const Oid pg_private::dispatch<std::vector<long long> >::oid;
+const Oid pg_private::dispatch<std::vector<std::string> >::oid;
+const Oid pg_private::dispatch<std::vector<std::vector<unsigned char> > >::oid;
+
 int
 pg_private::length_check(size_t len)
 {
@@ -238,3 +243,101 @@ pg_private::dispatch<std::vector<unsigned char> >::length
 {
   return length_check(vec.size());
 }
+
+//////////////////////////////////////////////////////////////////////
+// Arrays
+
+static inline unsigned
+load_be_32(const char *ptr)
+{
+  unsigned val;
+  memcpy(&val, ptr, sizeof(val));
+  return be_to_cpu_32(val);
+}
+
+static inline void
+load_element(const char *ptr, int len, int &val)
+{
+  if (len != 4) {
+    throw pg_exception("invalid INT4 array element");
+  }
+  val = load_be_32(ptr);
+}
+
+static inline void
+load_element(const char *ptr, int len, long long &val)
+{
+  if (len != 8) {
+    throw pg_exception("invalid INT8 array element");
+  }
+  memcpy(&val, ptr, sizeof(val));
+  val = be_to_cpu_64(val);
+}
+
+static inline void
+load_element(const char *ptr, int len, std::string &val)
+{
+  val.assign(ptr, ptr + len);
+}
+
+static inline void
+load_element(const char *ptr, int len, std::vector<unsigned char> &val)
+{
+  val.assign(ptr, ptr + len);
+}
+
+template <class T> void
+pg_private::array_dispatch<T>::load(PGresult *res, int row, int col,
+				    std::vector<T> &val)
+{
+  if (!is_binary(res, col)
+      || PQftype(res, col) != dispatch<std::vector<T> >::oid) {
+    throw pg_exception("format mismatch for array column");
+  }
+  if (PQgetisnull(res, row, col)) {
+    throw pg_exception("NULL value in non-null array column");
+  }
+  const char *ptr = PQgetvalue(res, row, col);
+  const char *end = ptr + PQgetlength(res, row, col);
+  if (end - ptr < 12) {
+    throw pg_exception("truncated array header");
+  }
+  unsigned ndim = load_be_32(ptr);
+  if (load_be_32(ptr + 8) != dispatch<T>::oid) {
+    throw pg_exception("array element type mismatch");
+  }
+  ptr += 12;
+  val.clear();
+  if (ndim == 0) {
+    return;
+  }
+  if (ndim != 1 || end - ptr < 8) {
+    throw pg_exception("unsupported array dimensions");
+  }
+  unsigned count = load_be_32(ptr);
+  ptr += 8;
+  if (count > static_cast<size_t>(end - ptr) / 4) {
+    throw pg_exception("invalid array length");
+  }
+  val.resize(count);
+  for (unsigned i = 0; i < count; ++i) {
+    if (end - ptr < 4) {
+      throw pg_exception("truncated array element");
+    }
+    int len = load_be_32(ptr);
+    ptr += 4;
+    if (len < 0) {
+      throw pg_exception("NULL element in array column");
+    }
+    if (end - ptr < len) {
+      throw pg_exception("truncated array element");
+    }
+    load_element(ptr, len, val[i]);
+    ptr += len;
+  }
+}
+
+template struct pg_private::array_dispatch<int>;
+template struct pg_private::array_dispatch<long long>;
+template struct pg_private::array_dispatch<std::string>;
+template struct pg_private::array_dispatch<std::vector<unsigned char> >;
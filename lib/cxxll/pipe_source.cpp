@@ -0,0 +1,154 @@
+/*
+ * Copyright (C) 2013 Red Hat, Inc.
+ * Written by Florian Weimer <fweimer@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <cxxll/pipe_source.hpp>
+
+#include <algorithm>
+#include <stdexcept>
+#include <vector>
+
+#include <pthread.h>
+
+using namespace cxxll;
+
+struct pipe_source::impl {
+  pthread_mutex_t mutex;
+  pthread_cond_t cond;		// signaled on every state change
+  std::vector<unsigned char> buffer;
+  size_t start;			// offset of the first byte in buffer
+  size_t length;		// number of bytes in buffer
+  bool closed;
+  bool aborted;
+
+  explicit impl(size_t capacity)
+    : buffer(std::max(capacity, static_cast<size_t>(1))),
+      start(0), length(0), closed(false), aborted(false)
+  {
+    pthread_mutex_init(&mutex, NULL);
+    pthread_cond_init(&cond, NULL);
+  }
+
+  ~impl()
+  {
+    pthread_cond_destroy(&cond);
+    pthread_mutex_destroy(&mutex);
+  }
+
+  // Serializes access to the pipe state in its scope.
+  struct guard {
+    impl &impl_;
+    explicit guard(impl &i)
+      : impl_(i)
+    {
+      pthread_mutex_lock(&impl_.mutex);
+    }
+    ~guard()
+    {
+      pthread_mutex_unlock(&impl_.mutex);
+    }
+  };
+};
+
+pipe_source::pipe_source(size_t capacity)
+  : impl_(new impl(capacity))
+{
+}
+
+pipe_source::~pipe_source()
+{
+}
+
+size_t
+pipe_source::read(unsigned char *buf, size_t len)
+{
+  impl &i(*impl_);
+  impl::guard g(i);
+  while (i.length == 0 && !i.closed && !i.aborted) {
+    pthread_cond_wait(&i.cond, &i.mutex);
+  }
+  if (i.aborted) {
+    throw std::runtime_error("read from aborted pipe");
+  }
+  size_t count = std::min(len, i.length);
+  size_t first = std::min(count, i.buffer.size() - i.start);
+  std::copy(i.buffer.begin() + i.start, i.buffer.begin() + i.start + first,
+	    buf);
+  std::copy(i.buffer.begin(), i.buffer.begin() + (count - first),
+	    buf + first);
+  i.start = (i.start + count) % i.buffer.size();
+  i.length -= count;
+  if (count > 0) {
+    pthread_cond_broadcast(&i.cond);
+  }
+  return count;
+}
+
+bool
+pipe_source::abort()
+{
+  impl &i(*impl_);
+  impl::guard g(i);
+  i.aborted = true;
+  pthread_cond_broadcast(&i.cond);
+  return i.closed;
+}
+
+pipe_source::writer::writer(pipe_source &pipe)
+  : pipe_(pipe)
+{
+}
+
+pipe_source::writer::~writer()
+{
+}
+
+void
+pipe_source::writer::write(const unsigned char *buf, size_t len)
+{
+  impl &i(*pipe_.impl_);
+  impl::guard g(i);
+  while (len > 0) {
+    while (i.length == i.buffer.size() && !i.aborted) {
+      pthread_cond_wait(&i.cond, &i.mutex);
+    }
+    if (i.aborted) {
+      throw std::runtime_error("write to aborted pipe");
+    }
+    if (i.closed) {
+      throw std::logic_error("write to closed pipe");
+    }
+    size_t end = (i.start + i.length) % i.buffer.size();
+    size_t count = std::min(len, i.buffer.size() - i.length);
+    count = std::min(count, i.buffer.size() - end);
+    std::copy(buf, buf + count, i.buffer.begin() + end);
+    i.length += count;
+    buf += count;
+    len -= count;
+    pthread_cond_broadcast(&i.cond);
+  }
+}
+
+void
+pipe_source::writer::close()
+{
+  impl &i(*pipe_.impl_);
+  impl::guard g(i);
+  i.closed = true;
+  pthread_cond_broadcast(&i.cond);
+}
@@ -0,0 +1,99 @@
+/*
+ * Copyright (C) 2013 Red Hat, Inc.
+ * Written by Florian Weimer <fweimer@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <cxxll/rpm_dependency.hpp>
+#include <cxxll/rpm_evr.hpp>
+
+using namespace cxxll;
+
+rpm_dependency::rpm_dependency()
+  : kind(require), flags(0)
+{
+}
+
+rpm_dependency::~rpm_dependency()
+{
+}
+
+namespace {
+  struct op_entry {
+    const char *op;
+    unsigned flags;
+  };
+
+  const op_entry op_table[] = {
+    {"<", rpm_dependency::less},
+    {"<=", rpm_dependency::less | rpm_dependency::equal},
+    {"=", rpm_dependency::equal},
+    {">=", rpm_dependency::greater | rpm_dependency::equal},
+    {">", rpm_dependency::greater},
+    {NULL, 0}
+  };
+
+  const unsigned sense_mask =
+    rpm_dependency::less | rpm_dependency::greater | rpm_dependency::equal;
+}
+
+const char *
+rpm_dependency::op() const
+{
+  for (const op_entry *p = op_table; p->op; ++p) {
+    if ((flags & sense_mask) == p->flags) {
+      return p->op;
+    }
+  }
+  return "";
+}
+
+bool
+rpm_dependency::set_op(const std::string &op)
+{
+  if (op.empty()) {
+    flags = 0;
+    return true;
+  }
+  for (const op_entry *p = op_table; p->op; ++p) {
+    if (op == p->op) {
+      flags = p->flags;
+      return true;
+    }
+  }
+  return false;
+}
+
+bool
+rpm_dependency::overlaps(const rpm_dependency &other) const
+{
+  // This follows rpmdsCompare().
+  unsigned a = flags & sense_mask;
+  unsigned b = other.flags & sense_mask;
+  if (a == 0 || b == 0 || version.empty() || other.version.empty()) {
+    return true;
+  }
+  int sense = rpm_evr(version).compare(rpm_evr(other.version), true);
+  if (sense < 0) {
+    return (a & greater) || (b & less);
+  } else if (sense > 0) {
+    return (a & less) || (b & greater);
+  } else {
+    return ((a & equal) && (b & equal))
+      || ((a & less) && (b & less))
+      || ((a & greater) && (b & greater));
+  }
+}
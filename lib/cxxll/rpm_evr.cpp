@@ -26,24 +26,51 @@ rpm_evr::rpm_evr()
 {
 }
 
+rpm_evr::rpm_evr(const std::string &evr)
+{
+  size_t start = 0;
+  size_t colon = evr.find(':');
+  if (colon != std::string::npos) {
+    epoch.assign(evr, 0, colon);
+    start = colon + 1;
+  } else {
+    epoch = "0";
+  }
+  size_t dash = evr.rfind('-');
+  if (dash != std::string::npos && dash >= start) {
+    version.assign(evr, start, dash - start);
+    release.assign(evr, dash + 1, std::string::npos);
+  } else {
+    version.assign(evr, start, std::string::npos);
+  }
+}
+
 rpm_evr::~rpm_evr()
 {
 }
 
-bool
-rpm_evr::operator<(const rpm_evr &other) const
+int
+rpm_evr::compare(const rpm_evr &other, bool release_optional) const
 {
-  if (epoch == other.epoch) {
-    int ret = rpmvercmp(version.c_str(), other.version.c_str());
-    if (ret != 0) {
-      return ret < 0;
+  if (epoch != other.epoch) {
+    if (epoch.size() != other.epoch.size()) {
+      return epoch.size() < other.epoch.size() ? -1 : 1;
     }
-    ret = rpmvercmp(release.c_str(), other.release.c_str());
-    return ret < 0;
+    return epoch < other.epoch ? -1 : 1;
   }
-  if (epoch.size() != other.epoch.size()) {
-    return epoch.size() < other.epoch.size();
+  int ret = rpmvercmp(version.c_str(), other.version.c_str());
+  if (ret != 0) {
+    return ret;
   }
-  return epoch < other.epoch;
+  if (release_optional && (release.empty() || other.release.empty())) {
+    return 0;
+  }
+  return rpmvercmp(release.c_str(), other.release.c_str());
+}
+
+bool
+rpm_evr::operator<(const rpm_evr &other) const
+{
+  return compare(other) < 0;
 }
 
@@ -0,0 +1,114 @@
+/*
+ * Copyright (C) 2013 Red Hat, Inc.
+ * Written by Florian Weimer <fweimer@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <cxxll/rpm_file_layout.hpp>
+#include <cxxll/hash.hpp>
+#include <cxxll/sink.hpp>
+
+using namespace cxxll;
+
+namespace {
+  const unsigned lead_size = 96;
+  const unsigned header_intro_size = 16;
+  const unsigned index_entry_size = 16;
+
+  unsigned
+  read_be_32(const unsigned char *p)
+  {
+    return (p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+  }
+
+  // Checks the header structure at OFFSET and stores the offset of
+  // the first byte after it in END.
+  bool
+  header_end(const unsigned char *data, size_t size,
+	     unsigned long long offset, unsigned long long &end)
+  {
+    if (offset + header_intro_size > size) {
+      return false;
+    }
+    const unsigned char *p = data + offset;
+    if (p[0] != 0x8e || p[1] != 0xad || p[2] != 0xe8 || p[3] != 0x01) {
+      return false;
+    }
+    unsigned long long entries = read_be_32(p + 8);
+    unsigned long long store = read_be_32(p + 12);
+    end = offset + header_intro_size + entries * index_entry_size + store;
+    return end <= size;
+  }
+}
+
+rpm_file_layout::rpm_file_layout()
+  : header_start(0), payload_start(0)
+{
+}
+
+rpm_file_layout::~rpm_file_layout()
+{
+}
+
+bool
+rpm_file_layout::parse(const unsigned char *data, size_t size)
+{
+  if (size < lead_size || data[0] != 0xed || data[1] != 0xab
+      || data[2] != 0xee || data[3] != 0xdb) {
+    return false;
+  }
+  unsigned long long signature_end;
+  if (!header_end(data, size, lead_size, signature_end)) {
+    return false;
+  }
+  // The signature header is padded to a multiple of 8 bytes.
+  unsigned long long start = (signature_end + 7) & ~7ULL;
+  unsigned long long end;
+  if (!header_end(data, size, start, end)) {
+    return false;
+  }
+  header_start = start;
+  payload_start = end;
+  return true;
+}
+
+bool
+cxxll::rpm_splice(const std::vector<unsigned char> &header,
+		  const unsigned char *cached, size_t cached_size,
+		  const std::vector<unsigned char> &main_header_hash,
+		  unsigned long long length, sink &target)
+{
+  rpm_file_layout layout;
+  if (header.empty() || !layout.parse(&header.front(), header.size())
+      || layout.payload_start != header.size()) {
+    return false;
+  }
+  std::vector<unsigned char> main_header
+    (header.begin() + layout.header_start, header.end());
+  if (hash(hash_sink::sha1, main_header) != main_header_hash) {
+    return false;
+  }
+  rpm_file_layout cached_layout;
+  if (!cached_layout.parse(cached, cached_size)
+      || header.size() + (cached_size - cached_layout.payload_start)
+	 != length) {
+    return false;
+  }
+  target.write(&header.front(), header.size());
+  target.write(cached + cached_layout.payload_start,
+	       cached_size - cached_layout.payload_start);
+  return true;
+}
@@ -21,6 +21,7 @@
 #include <cxxll/cpio_reader.hpp>
 #include <cxxll/rpm_file_info.hpp>
 #include <cxxll/rpm_package_info.hpp>
+#include <cxxll/rpm_dependency.hpp>
 #include <cxxll/rpmtd_wrapper.hpp>
 
 #include <assert.h>
@@ -71,11 +72,14 @@ struct rpm_parser_state::impl {
 
   rpmtd_wrapper nevra;
   rpm_package_info pkg;
+  std::vector<rpm_dependency> dependencies;
   std::string digest_algo;
 
   typedef std::map<std::string, std::tr1::shared_ptr<rpm_file_info> > file_map;
   file_map files;
   void get_header();
+  void get_dependencies(rpm_dependency::kind_type, const char *what,
+			rpmTagVal name, rpmTagVal flags, rpmTagVal version);
   void get_files_from_header(); // called on demand by open_payload()
   void open_payload(); // called on demand by read_file()
 };
@@ -183,6 +187,56 @@ rpm_parser_state::impl::get_header()
       }
     }
   }
+
+  get_dependencies(rpm_dependency::require, "REQUIRENAME",
+		   RPMTAG_REQUIRENAME, RPMTAG_REQUIREFLAGS,
+		   RPMTAG_REQUIREVERSION);
+  get_dependencies(rpm_dependency::provide, "PROVIDENAME",
+		   RPMTAG_PROVIDENAME, RPMTAG_PROVIDEFLAGS,
+		   RPMTAG_PROVIDEVERSION);
+}
+
+void
+rpm_parser_state::impl::get_dependencies(rpm_dependency::kind_type kind,
+					 const char *what, rpmTagVal name_tag,
+					 rpmTagVal flags_tag,
+					 rpmTagVal version_tag)
+{
+  const headerGetFlags hflags = HEADERGET_ALLOC | HEADERGET_EXT;
+  rpmtd_wrapper names;
+  if (!headerGet(header, name_tag, names.raw, hflags)) {
+    return;
+  }
+  rpmtd_wrapper flags;
+  rpmtd_wrapper versions;
+  if (!headerGet(header, flags_tag, flags.raw, hflags)
+      || !headerGet(header, version_tag, versions.raw, hflags)) {
+    throw rpm_parser_exception(std::string("could not get ")
+			       + what + " flags and versions");
+  }
+  while (true) {
+    const char *name = rpmtdNextString(names.raw);
+    if (name == NULL) {
+      break;
+    }
+    const uint32_t *flag = rpmtdNextUint32(flags.raw);
+    const char *version = rpmtdNextString(versions.raw);
+    if (flag == NULL || version == NULL) {
+      throw rpm_parser_exception(std::string("missing flags or versions for ")
+				 + what + " header");
+    }
+    dependencies.push_back(rpm_dependency());
+    rpm_dependency &dep(dependencies.back());
+    dep.kind = kind;
+    dep.capability = name;
+    dep.version = version;
+    if (dep.version.empty()) {
+      dep.flags = 0;
+    } else {
+      dep.flags = *flag & (rpm_dependency::less | rpm_dependency::greater
+			   | rpm_dependency::equal);
+    }
+  }
 }
 
 void
@@ -377,6 +431,12 @@ rpm_parser_state::package() const
   return impl_->pkg;
 }
 
+const std::vector<rpm_dependency> &
+rpm_parser_state::dependencies() const
+{
+  return impl_->dependencies;
+}
+
 bool
 rpm_parser_state::read_file(rpm_file_entry &file)
 {
@@ -0,0 +1,63 @@
+/*
+ * Copyright (C) 2013 Red Hat, Inc.
+ * Written by Florian Weimer <fweimer@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <cxxll/string_pool.hpp>
+
+using namespace cxxll;
+
+string_pool::string_pool()
+{
+}
+
+string_pool::~string_pool()
+{
+}
+
+unsigned
+string_pool::intern(const std::string &str)
+{
+  std::pair<map::iterator, bool> result
+    (map_.insert(std::make_pair(str, static_cast<unsigned>(strings_.size()))));
+  if (result.second) {
+    try {
+      strings_.push_back(&result.first->first);
+    } catch (...) {
+      map_.erase(result.first);
+      throw;
+    }
+  }
+  return result.first->second;
+}
+
+unsigned
+string_pool::intern(const char *ptr, size_t length)
+{
+  return intern(std::string(ptr, length));
+}
+
+bool
+string_pool::find(const std::string &str, unsigned &index) const
+{
+  map::const_iterator p(map_.find(str));
+  if (p == map_.end()) {
+    return false;
+  }
+  index = p->second;
+  return true;
+}
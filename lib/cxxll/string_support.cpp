@@ -17,6 +17,7 @@
  */
 
 #include <cxxll/string_support.hpp>
+#include <cxxll/utf8.hpp>
 
 #include <cerrno>
 #include <cstdlib>
@@ -69,6 +70,52 @@ cxxll::quote(const std::string &str)
   return str;
 }
 
+std::string
+cxxll::json_quote(const std::string &str)
+{
+  std::string result;
+  result.reserve(str.size() + 2);
+  result += '"';
+  for (const char *p = str.data(), *end = p + str.size(); p != end; ++p) {
+    unsigned char ch = *p;
+    switch (ch) {
+    case '"':
+    case '\\':
+      result += '\\';
+      result += ch;
+      break;
+    case '\n':
+      result += "\\n";
+      break;
+    case '\r':
+      result += "\\r";
+      break;
+    case '\t':
+      result += "\\t";
+      break;
+    default:
+      if (ch < ' ' || ch == 0x7f) {
+	static const char hex[] = "0123456789abcdef";
+	result += "\\u00";
+	result += hex[ch >> 4];
+	result += hex[ch & 15];
+      } else if (ch >= 0x80) {
+	size_t length = utf8_character_length(p, end);
+	if (length == 0) {
+	  result += "\\ufffd";
+	} else {
+	  result.append(p, length);
+	  p += length - 1;
+	}
+      } else {
+	result += ch;
+      }
+    }
+  }
+  result += '"';
+  return result;
+}
+
 namespace {
   const char *
   non_whitespace(const char *first, const char *last)
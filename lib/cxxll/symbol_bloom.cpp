@@ -0,0 +1,116 @@
+/*
+ * Copyright (C) 2013 Red Hat, Inc.
+ * Written by Florian Weimer <fweimer@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <cxxll/symbol_bloom.hpp>
+#include <cxxll/endian.hpp>
+
+#include <cstring>
+
+using namespace cxxll;
+
+namespace {
+  // Filter size in bits per name.  Each name sets four bits within
+  // one 64-bit block (see probe::probe), so a block holds about five
+  // names on average.  Taking the uneven distribution of names over
+  // the blocks into account, this results in a false positive rate
+  // of about 1.1% (a classic Bloom filter with the same size and
+  // four bits per name would reach 0.65%).  The filter is stored in
+  // the database, so changing these parameters requires reloading
+  // all ELF files.
+  const size_t bits_per_name = 12;
+  const size_t block_bytes = 8;
+}
+
+symbol_bloom::probe::probe(const std::string &name)
+{
+  // 64-bit FNV-1a, followed by the MurmurHash3 finalizer to spread
+  // the entropy over all bits.
+  unsigned long long h = 14695981039346656037ULL;
+  for (std::string::const_iterator p = name.begin(), end = name.end();
+       p != end; ++p) {
+    h ^= static_cast<unsigned char>(*p);
+    h *= 1099511628211ULL;
+  }
+  h ^= h >> 33;
+  h *= 0xff51afd7ed558ccdULL;
+  h ^= h >> 33;
+  h *= 0xc4ceb9fe1a85ec53ULL;
+  h ^= h >> 33;
+  hash_ = h;
+  mask_ = (1ULL << (h & 63))
+    | (1ULL << ((h >> 6) & 63))
+    | (1ULL << ((h >> 12) & 63))
+    | (1ULL << ((h >> 18) & 63));
+}
+
+size_t
+symbol_bloom::probe::block(size_t blocks) const
+{
+  return (hash_ >> 32) % blocks;
+}
+
+symbol_bloom::symbol_bloom(size_t count)
+  : blocks_((count * bits_per_name + 63) / 64 + (count == 0))
+{
+}
+
+symbol_bloom::~symbol_bloom()
+{
+}
+
+void
+symbol_bloom::add(const probe &p)
+{
+  blocks_[p.block(blocks_.size())] |= p.mask_;
+}
+
+void
+symbol_bloom::add(const std::string &name)
+{
+  add(probe(name));
+}
+
+bool
+symbol_bloom::maybe_contains(const probe &p) const
+{
+  return (blocks_[p.block(blocks_.size())] & p.mask_) == p.mask_;
+}
+
+void
+symbol_bloom::serialize(std::vector<unsigned char> &result) const
+{
+  result.resize(blocks_.size() * block_bytes);
+  for (size_t i = 0, end = blocks_.size(); i < end; ++i) {
+    unsigned long long word = cpu_to_le_64(blocks_[i]);
+    memcpy(&result[i * block_bytes], &word, block_bytes);
+  }
+}
+
+bool
+symbol_bloom::maybe_contains(const std::vector<unsigned char> &filter,
+			     const probe &p)
+{
+  size_t blocks = filter.size() / block_bytes;
+  if (blocks == 0 || filter.size() % block_bytes != 0) {
+    return true;
+  }
+  unsigned long long word;
+  memcpy(&word, &filter[p.block(blocks) * block_bytes], block_bytes);
+  return (le_to_cpu_64(word) & p.mask_) == p.mask_;
+}
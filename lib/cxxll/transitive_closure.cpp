@@ -0,0 +1,197 @@
+/*
+ * Copyright (C) 2013 Red Hat, Inc.
+ * Written by Florian Weimer <fweimer@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <cxxll/transitive_closure.hpp>
+
+#include <algorithm>
+#include <stdexcept>
+
+using namespace cxxll;
+
+directed_graph::directed_graph(unsigned nodes, const std::vector<edge> &edges)
+  : offsets_(nodes + 1)
+{
+  // Counting sort by source node.
+  for (std::vector<edge>::const_iterator p = edges.begin(), end = edges.end();
+       p != end; ++p) {
+    if (p->first >= nodes || p->second >= nodes) {
+      throw std::logic_error("directed_graph: invalid edge");
+    }
+    ++offsets_[p->first + 1];
+  }
+  for (unsigned i = 0; i < nodes; ++i) {
+    offsets_[i + 1] += offsets_[i];
+  }
+  targets_.resize(edges.size());
+  {
+    std::vector<unsigned> fill(offsets_.begin(), offsets_.end() - 1);
+    for (std::vector<edge>::const_iterator p = edges.begin(),
+	   end = edges.end(); p != end; ++p) {
+      targets_[fill[p->first]++] = p->second;
+    }
+  }
+
+  // Sort the successor lists and remove duplicates, compacting the
+  // target array in place.
+  unsigned out = 0;
+  for (unsigned i = 0; i < nodes; ++i) {
+    unsigned *first = targets_.data() + offsets_[i];
+    unsigned *last = targets_.data() + offsets_[i + 1];
+    std::sort(first, last);
+    last = std::unique(first, last);
+    offsets_[i] = out;
+    for (; first != last; ++first) {
+      targets_[out++] = *first;
+    }
+  }
+  offsets_[nodes] = out;
+  targets_.resize(out);
+}
+
+directed_graph::~directed_graph()
+{
+}
+
+namespace {
+  const unsigned unvisited = ~0U;
+
+  struct frame {
+    unsigned node;
+    const unsigned *next;
+  };
+}
+
+transitive_closure::transitive_closure(const directed_graph &graph)
+{
+  const unsigned nodes = graph.size();
+  component_.resize(nodes, unvisited);
+
+  // Iterative version of Tarjan's algorithm.  Components are
+  // completed in reverse topological order.
+  {
+    std::vector<unsigned> index(nodes, unvisited);
+    std::vector<unsigned> low(nodes);
+    std::vector<unsigned> stack;
+    std::vector<frame> calls;
+    unsigned counter = 0;
+    unsigned components = 0;
+    for (unsigned root = 0; root < nodes; ++root) {
+      if (index[root] != unvisited) {
+	continue;
+      }
+      frame f = {root, graph.begin(root)};
+      calls.push_back(f);
+      index[root] = low[root] = counter++;
+      stack.push_back(root);
+      while (!calls.empty()) {
+	frame &top(calls.back());
+	const unsigned v = top.node;
+	const unsigned *end = graph.end(v);
+	bool descended = false;
+	while (top.next != end) {
+	  unsigned w = *top.next;
+	  ++top.next;
+	  if (index[w] == unvisited) {
+	    index[w] = low[w] = counter++;
+	    stack.push_back(w);
+	    frame g = {w, graph.begin(w)};
+	    calls.push_back(g); // invalidates top
+	    descended = true;
+	    break;
+	  } else if (component_[w] == unvisited) {
+	    // W is still on the stack.
+	    low[v] = std::min(low[v], index[w]);
+	  }
+	}
+	if (descended) {
+	  continue;
+	}
+	if (low[v] == index[v]) {
+	  unsigned w;
+	  do {
+	    w = stack.back();
+	    stack.pop_back();
+	    component_[w] = components;
+	  } while (w != v);
+	  ++components;
+	}
+	calls.pop_back();
+	if (!calls.empty()) {
+	  unsigned parent = calls.back().node;
+	  low[parent] = std::min(low[parent], low[v]);
+	}
+      }
+    }
+    reachable_.resize(components);
+  }
+
+  // List the members of each component.
+  std::vector<unsigned> member_offsets(reachable_.size() + 1);
+  std::vector<unsigned> members(nodes);
+  for (unsigned v = 0; v < nodes; ++v) {
+    ++member_offsets[component_[v] + 1];
+  }
+  for (unsigned c = 0; c < reachable_.size(); ++c) {
+    member_offsets[c + 1] += member_offsets[c];
+  }
+  {
+    std::vector<unsigned> fill(member_offsets.begin(),
+			       member_offsets.end() - 1);
+    for (unsigned v = 0; v < nodes; ++v) {
+      members[fill[component_[v]]++] = v;
+    }
+  }
+
+  // Propagate the reachable sets.  Successor components have smaller
+  // numbers and have already been processed.
+  std::vector<unsigned> seen(reachable_.size(), unvisited);
+  std::vector<unsigned> buffer;
+  for (unsigned c = 0; c < reachable_.size(); ++c) {
+    buffer.clear();
+    const unsigned *mfirst = members.data() + member_offsets[c];
+    const unsigned *mlast = members.data() + member_offsets[c + 1];
+    for (const unsigned *m = mfirst; m != mlast; ++m) {
+      for (const unsigned *p = graph.begin(*m), *end = graph.end(*m);
+	   p != end; ++p) {
+	unsigned d = component_[*p];
+	if (seen[d] == c) {
+	  continue;
+	}
+	seen[d] = c;
+	// Members of the target component (including C itself, if
+	// there is an edge within the component, which implies a
+	// cycle).
+	buffer.insert(buffer.end(),
+		      members.data() + member_offsets[d],
+		      members.data() + member_offsets[d + 1]);
+	if (d != c) {
+	  buffer.insert(buffer.end(),
+			reachable_[d].begin(), reachable_[d].end());
+	}
+      }
+    }
+    std::sort(buffer.begin(), buffer.end());
+    buffer.erase(std::unique(buffer.begin(), buffer.end()), buffer.end());
+    reachable_[c].assign(buffer.begin(), buffer.end());
+  }
+}
+
+transitive_closure::~transitive_closure()
+{
+}
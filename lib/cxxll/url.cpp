@@ -37,3 +37,19 @@ cxxll::url_combine_yum(const char *base, const char *relative)
   }
   return result;
 }
+
+std::string
+cxxll::url_host(const char *url)
+{
+  const char *start = strstr(url, "://");
+  if (start == NULL) {
+    return std::string();
+  }
+  start += 3;
+  const char *end = start + strcspn(start, "/?#");
+  const char *at = static_cast<const char *>(memchr(start, '@', end - start));
+  if (at != NULL) {
+    start = at + 1;
+  }
+  return std::string(start, end);
+}
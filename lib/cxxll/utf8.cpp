@@ -41,6 +41,24 @@ cxxll::is_valid_utf8(const std::string &str)
   return true;
 }
 
+size_t
+cxxll::utf8_character_length(const char *first, const char *last)
+{
+  if (first == last) {
+    return 0;
+  }
+  size_t remaining = last - first;
+  if (remaining > 4) {
+    remaining = 4;
+  }
+  int ret = pg_utf8_verifier
+    (reinterpret_cast<const unsigned char *>(first), remaining);
+  if (ret < 0) {
+    return 0;
+  }
+  return ret;
+}
+
 std::string
 cxxll::latin1_to_utf8(const std::string &str)
 {
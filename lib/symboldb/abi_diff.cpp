@@ -0,0 +1,326 @@
+/*
+ * Copyright (C) 2013 Red Hat, Inc.
+ * Written by Florian Weimer <fweimer@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <symboldb/abi_diff.hpp>
+#include <cxxll/pgresult_handle.hpp>
+#include <cxxll/pg_column.hpp>
+#include <cxxll/pg_cursor.hpp>
+
+#include <algorithm>
+#include <map>
+#include <stdexcept>
+#include <tr1/unordered_map>
+
+using namespace cxxll;
+
+bool
+abi_difference::operator<(const abi_difference &other) const
+{
+  if (soname != other.soname) {
+    return soname < other.soname;
+  }
+  if (arch != other.arch) {
+    return arch < other.arch;
+  }
+  if (symbol != other.symbol) {
+    return symbol < other.symbol;
+  }
+  return version < other.version;
+}
+
+const char *
+abi_difference::to_string(kind k)
+{
+  switch (k) {
+  case added:
+    return "added";
+  case removed:
+    return "removed";
+  case changed:
+    return "changed";
+  }
+  throw std::logic_error("invalid abi_difference::kind");
+}
+
+namespace {
+  struct dso {
+    std::string file;
+    int contents_id;
+    std::vector<unsigned char> fingerprint; // empty if unknown
+  };
+
+  // Shared objects in a package set, by soname and architecture.
+  typedef std::map<std::pair<std::string, std::string>, dso> dso_map;
+
+  void
+  load_dsos(pgconn_handle &conn, database::package_set_id set, dso_map &dsos)
+  {
+    pg_cursor cursor
+      (conn, "abi_diff_files",
+       "SELECT ef.soname, ef.arch::text, f.name, ef.contents_id,"
+       " COALESCE(ef.symbol_fingerprint, '')"
+       " FROM symboldb.package_set_member psm"
+       " JOIN symboldb.file f USING (package_id)"
+       " JOIN symboldb.elf_file ef USING (contents_id)"
+       " WHERE psm.set_id = $1 AND ef.e_type = 3"
+       " AND ef.arch IS NOT NULL AND ef.soname IS NOT NULL", set.value());
+    pgresult_handle res;
+    std::vector<std::string> soname;
+    std::vector<std::string> arch;
+    std::vector<std::string> name;
+    std::vector<int> contents_id;
+    std::vector<std::vector<unsigned char> > fingerprint;
+    while (cursor.fetch(res)) {
+      soname.clear();
+      pg_column(res, 0, soname);
+      arch.clear();
+      pg_column(res, 1, arch);
+      name.clear();
+      pg_column(res, 2, name);
+      contents_id.clear();
+      pg_column(res, 3, contents_id);
+      fingerprint.clear();
+      pg_column(res, 4, fingerprint);
+      for (size_t row = 0, end = soname.size(); row < end; ++row) {
+	std::pair<dso_map::iterator, bool> ins
+	  (dsos.insert(std::make_pair(std::make_pair(soname[row], arch[row]),
+				      dso())));
+	dso &d(ins.first->second);
+	if (ins.second || name[row] < d.file) {
+	  d.file.swap(name[row]);
+	  d.contents_id = contents_id[row];
+	  d.fingerprint.swap(fingerprint[row]);
+	}
+      }
+    }
+  }
+
+  // An exported symbol with its ABI-relevant attributes.
+  struct symbol {
+    std::string name;
+    std::string version;
+    int type;
+    int binding;
+    std::string visibility;
+
+    // Orders by name and version, and then by the attributes, so
+    // that definitions with the same name and version come out in a
+    // canonical order.
+    bool operator<(const symbol &other) const
+    {
+      if (name != other.name) {
+	return name < other.name;
+      }
+      if (version != other.version) {
+	return version < other.version;
+      }
+      if (type != other.type) {
+	return type < other.type;
+      }
+      if (binding != other.binding) {
+	return binding < other.binding;
+      }
+      return visibility < other.visibility;
+    }
+
+    // Compares name and version only.
+    static bool key_less(const symbol &a, const symbol &b)
+    {
+      if (a.name != b.name) {
+	return a.name < b.name;
+      }
+      return a.version < b.version;
+    }
+
+    bool same_attributes(const symbol &other) const
+    {
+      return type == other.type && binding == other.binding
+	&& visibility == other.visibility;
+    }
+  };
+
+  typedef std::tr1::unordered_map<int, std::vector<symbol> > symbol_map;
+
+  // Loads the exported symbols of the listed contents IDs, sorted by
+  // name, version and attributes.
+  void
+  load_symbols(pgconn_handle &conn, const std::vector<int> &contents_ids,
+	       symbol_map &symbols)
+  {
+    pg_cursor cursor
+      (conn, "abi_diff_symbols",
+       "SELECT DISTINCT contents_id, name, COALESCE(version, ''),"
+       " symbol_type::integer, binding::integer, visibility::text"
+       " FROM symboldb.elf_exported_definition"
+       " WHERE contents_id = ANY ($1)", contents_ids);
+    pgresult_handle res;
+    std::vector<int> contents_id;
+    std::vector<std::string> name;
+    std::vector<std::string> version;
+    std::vector<int> type;
+    std::vector<int> binding;
+    std::vector<std::string> visibility;
+    while (cursor.fetch(res)) {
+      contents_id.clear();
+      pg_column(res, 0, contents_id);
+      name.clear();
+      pg_column(res, 1, name);
+      version.clear();
+      pg_column(res, 2, version);
+      type.clear();
+      pg_column(res, 3, type);
+      binding.clear();
+      pg_column(res, 4, binding);
+      visibility.clear();
+      pg_column(res, 5, visibility);
+      for (size_t row = 0, end = contents_id.size(); row < end; ++row) {
+	std::vector<symbol> &vec(symbols[contents_id[row]]);
+	vec.push_back(symbol());
+	symbol &sym(vec.back());
+	sym.name.swap(name[row]);
+	sym.version.swap(version[row]);
+	sym.type = type[row];
+	sym.binding = binding[row];
+	sym.visibility.swap(visibility[row]);
+      }
+    }
+    for (symbol_map::iterator p = symbols.begin(), end = symbols.end();
+	 p != end; ++p) {
+      std::sort(p->second.begin(), p->second.end());
+    }
+  }
+
+  void
+  add_difference(std::vector<abi_difference> &result,
+		 abi_difference::kind change,
+		 const std::pair<std::string, std::string> &key,
+		 const symbol *sym)
+  {
+    result.push_back(abi_difference());
+    abi_difference &diff(result.back());
+    diff.change = change;
+    diff.soname = key.first;
+    diff.arch = key.second;
+    if (sym != NULL) {
+      diff.symbol = sym->name;
+      diff.version = sym->version;
+    }
+  }
+
+  // Sort-merge of two symbol lists.  A symbol can have multiple
+  // definitions with the same name and version (with different
+  // attributes), so the ranges of equal keys are compared as a whole.
+  // The lists are sorted by attributes within these ranges, so the
+  // ranges are equal as sets if they are equal element by element.
+  void
+  merge_symbols(std::vector<abi_difference> &result,
+		const std::pair<std::string, std::string> &key,
+		const std::vector<symbol> &old_syms,
+		const std::vector<symbol> &new_syms)
+  {
+    std::vector<symbol>::const_iterator
+      p = old_syms.begin(), pend = old_syms.end(),
+      q = new_syms.begin(), qend = new_syms.end();
+    while (p != pend || q != qend) {
+      if (q == qend || (p != pend && symbol::key_less(*p, *q))) {
+	add_difference(result, abi_difference::removed, key, &*p);
+	p = std::upper_bound(p, pend, *p, symbol::key_less);
+      } else if (p == pend || symbol::key_less(*q, *p)) {
+	add_difference(result, abi_difference::added, key, &*q);
+	q = std::upper_bound(q, qend, *q, symbol::key_less);
+      } else {
+	std::vector<symbol>::const_iterator
+	  p1 = std::upper_bound(p, pend, *p, symbol::key_less),
+	  q1 = std::upper_bound(q, qend, *q, symbol::key_less);
+	bool same = p1 - p == q1 - q;
+	for (std::vector<symbol>::const_iterator r = p, s = q;
+	     same && r != p1; ++r, ++s) {
+	  same = r->same_attributes(*s);
+	}
+	if (!same) {
+	  add_difference(result, abi_difference::changed, key, &*p);
+	}
+	p = p1;
+	q = q1;
+      }
+    }
+  }
+
+  const std::vector<symbol> &
+  symbols_of(const symbol_map &symbols, int contents_id)
+  {
+    static const std::vector<symbol> empty;
+    symbol_map::const_iterator p = symbols.find(contents_id);
+    if (p == symbols.end()) {
+      return empty;
+    }
+    return p->second;
+  }
+} // namespace
+
+void
+diff_package_set_abi(pgconn_handle &conn,
+		     database::package_set_id old_set,
+		     database::package_set_id new_set,
+		     std::vector<abi_difference> &result)
+{
+  dso_map old_dsos;
+  load_dsos(conn, old_set, old_dsos);
+  dso_map new_dsos;
+  load_dsos(conn, new_set, new_dsos);
+
+  // Pairs whose symbols need to be compared.
+  std::vector<std::pair<dso_map::const_iterator, dso_map::const_iterator> >
+    pairs;
+  std::vector<int> contents_ids;
+  size_t old_size = result.size();
+  for (dso_map::const_iterator
+	 p = old_dsos.begin(), pend = old_dsos.end(),
+	 q = new_dsos.begin(), qend = new_dsos.end(); p != pend || q != qend; ) {
+    if (q == qend || (p != pend && p->first < q->first)) {
+      add_difference(result, abi_difference::removed, p->first, NULL);
+      ++p;
+    } else if (p == pend || q->first < p->first) {
+      add_difference(result, abi_difference::added, q->first, NULL);
+      ++q;
+    } else {
+      const dso &a(p->second);
+      const dso &b(q->second);
+      if (a.contents_id != b.contents_id
+	  && (a.fingerprint.empty() || a.fingerprint != b.fingerprint)) {
+	pairs.push_back(std::make_pair(p, q));
+	contents_ids.push_back(a.contents_id);
+	contents_ids.push_back(b.contents_id);
+      }
+      ++p;
+      ++q;
+    }
+  }
+
+  if (!pairs.empty()) {
+    symbol_map symbols;
+    load_symbols(conn, contents_ids, symbols);
+    for (size_t i = 0, end = pairs.size(); i < end; ++i) {
+      merge_symbols(result, pairs[i].first->first,
+		    symbols_of(symbols, pairs[i].first->second.contents_id),
+		    symbols_of(symbols, pairs[i].second->second.contents_id));
+    }
+  }
+  std::sort(result.begin() + old_size, result.end());
+}
@@ -18,8 +18,15 @@
 
 #include <symboldb/database.hpp>
 #include <symboldb/update_elf_closure.hpp>
+#include <symboldb/update_elf_symbol_binding.hpp>
+#include <symboldb/update_java_class_closure.hpp>
+#include <symboldb/update_rpm_closure.hpp>
+#include <symboldb/abi_diff.hpp>
+#include <symboldb/symbol_collisions.hpp>
+#include <symboldb/symbol_definitions.hpp>
 #include <cxxll/rpm_file_info.hpp>
 #include <cxxll/rpm_package_info.hpp>
+#include <cxxll/rpm_dependency.hpp>
 #include <cxxll/elf_image.hpp>
 #include <cxxll/elf_symbol_definition.hpp>
 #include <cxxll/elf_symbol_reference.hpp>
@@ -28,8 +35,11 @@
 #include <cxxll/pg_exception.hpp>
 #include <cxxll/pg_query.hpp>
 #include <cxxll/pg_response.hpp>
+#include <cxxll/pg_column.hpp>
+#include <cxxll/pg_cursor.hpp>
 #include <cxxll/hash.hpp>
 #include <cxxll/java_class.hpp>
+#include <cxxll/string_support.hpp>
 
 #include <assert.h>
 #include <stdlib.h>
@@ -62,6 +72,7 @@ using namespace cxxll;
 #define ELF_ERROR_TABLE "symboldb.elf_error"
 #define PACKAGE_SET_TABLE "symboldb.package_set"
 #define PACKAGE_SET_MEMBER_TABLE "symboldb.package_set_member"
+#define PACKAGE_SET_REPOSITORY_TABLE "symboldb.package_set_repository"
 #define URL_CACHE_TABLE "symboldb.url_cache"
 
 // Include the schema.sql file.
@@ -117,6 +128,13 @@ database::txn_rollback()
   res.exec(impl_->conn, "ROLLBACK");
 }
 
+void
+database::txn_begin_snapshot()
+{
+  pgresult_handle res;
+  res.exec(impl_->conn, "BEGIN ISOLATION LEVEL REPEATABLE READ");
+}
+
 void
 database::txn_begin_no_sync()
 {
@@ -312,6 +330,38 @@ database::add_package_digest(package_id pkg,
      pkg.value(), digest, static_cast<long long>(length));
 }
 
+void
+database::add_package_dependencies(package_id pkg,
+				   const std::vector<rpm_dependency> &deps)
+{
+  if (deps.empty()) {
+    return;
+  }
+  std::vector<std::string> kinds;
+  std::vector<std::string> names;
+  std::vector<std::string> ops;
+  std::vector<std::string> versions;
+  for (std::vector<rpm_dependency>::const_iterator
+	 p = deps.begin(), end = deps.end(); p != end; ++p) {
+    kinds.push_back(p->kind == rpm_dependency::provide
+		    ? "provides" : "requires");
+    names.push_back(p->capability);
+    ops.push_back(p->op());
+    // The empty string is mapped to NULL below.
+    versions.push_back(ops.back().empty() ? std::string() : p->version);
+  }
+  pgresult_handle res;
+  pg_query
+    (impl_->conn, res,
+     "INSERT INTO symboldb.package_dependency"
+     " (package_id, kind, capability_id, op, version)"
+     " SELECT $1, ($2::text[])[i]::symboldb.rpm_dependency_kind,"
+     " symboldb.intern_rpm_capability (($3::text[])[i]),"
+     " NULLIF(($4::text[])[i], ''), NULLIF(($5::text[])[i], '')"
+     " FROM generate_series(1, array_length($3::text[], 1)) i",
+     pkg.value(), kinds, names, ops, versions);
+}
+
 database::package_id
 database::package_by_digest(const std::vector<unsigned char> &digest)
 {
@@ -326,6 +376,66 @@ database::package_by_digest(const std::vector<unsigned char> &digest)
   return package_id(get_id(res));
 }
 
+void
+database::package_representations
+  (const rpm_package_info &info, std::vector<package_representation> &result)
+{
+  pgresult_handle res;
+  pg_query_binary
+    (impl_->conn, res,
+     "SELECT digest, length, hash FROM " PACKAGE_TABLE
+     " JOIN " PACKAGE_DIGEST_TABLE " USING (package_id)"
+     " WHERE name = $1 AND version = $2 AND release = $3"
+     " AND arch::text = $4 AND COALESCE(epoch, -1) = $5",
+     info.name, info.version, info.release, info.arch, info.epoch);
+  for (int row = 0, end = res.ntuples(); row < end; ++row) {
+    package_representation rep;
+    long long length;
+    pg_response(res, row, rep.digest, length, rep.hash);
+    rep.length = length;
+    result.push_back(rep);
+  }
+}
+
+size_t
+database::digest_hash::operator()(const std::vector<unsigned char> &digest) const
+{
+  size_t h = 0;
+  for (size_t i = 0, end = std::min(digest.size(), sizeof(h)); i < end; ++i) {
+    h = (h << 8) | digest[i];
+  }
+  return h;
+}
+
+void
+database::packages_by_digests
+  (const std::vector<std::vector<unsigned char> > &digests,
+   package_digest_map &result)
+{
+  if (digests.empty()) {
+    return;
+  }
+
+  for (std::vector<std::vector<unsigned char> >::const_iterator
+	 p = digests.begin(), end = digests.end(); p != end; ++p) {
+    if (p->size() < 16) {
+      throw std::logic_error("invalid digest length");
+    }
+  }
+
+  pgresult_handle res;
+  pg_query_binary
+    (impl_->conn, res,
+     "SELECT digest, package_id FROM " PACKAGE_DIGEST_TABLE
+     " WHERE digest = ANY ($1)", digests);
+  std::vector<unsigned char> digest;
+  int pid;
+  for (int row = 0, end = res.ntuples(); row < end; ++row) {
+    pg_response(res, row, digest, pid);
+    result[digest] = package_id(pid);
+  }
+}
+
 database::file_id
 database::add_file(package_id pkg, const std::string &name, bool normalized,
 		   long long mtime, int inode, contents_id cid)
@@ -425,7 +535,9 @@ database::add_symlink(package_id pkg, const rpm_file_info &info,
 
 void
 database::add_elf_image(contents_id cid, const elf_image &image,
-			const char *soname)
+			const char *soname,
+			const std::vector<unsigned char> &symbol_filter,
+			const std::vector<unsigned char> &symbol_fingerprint)
 {
   assert(impl_->conn.transactionStatus() == PQTRANS_INTRANS);
   pgresult_handle res;
@@ -433,8 +545,8 @@ database::add_elf_image(contents_id cid, const elf_image &image,
     (impl_->conn, res,
      "INSERT INTO " ELF_FILE_TABLE
      " (contents_id, ei_class, ei_data, e_type, e_machine, arch, soname,"
-     " build_id)"
-     " VALUES ($1, $2, $3, $4, $5, $6::symboldb.elf_arch, $7, $8)",
+     " build_id, symbol_filter, symbol_fingerprint)"
+     " VALUES ($1, $2, $3, $4, $5, $6::symboldb.elf_arch, $7, $8, $9, $10)",
      cid.value(),
      static_cast<int>(image.ei_class()),
      static_cast<int>(image.ei_data()),
@@ -442,7 +554,8 @@ database::add_elf_image(contents_id cid, const elf_image &image,
      static_cast<int>(image.e_machine()),
      image.arch(),
      soname,
-     image.build_id().empty() ? NULL : &image.build_id());
+     image.build_id().empty() ? NULL : &image.build_id(),
+     &symbol_filter, &symbol_fingerprint);
 }
 
 void
@@ -555,26 +668,34 @@ database::add_java_class(contents_id cid, const cxxll::java_class &jc)
   bool added;
   pg_response(res, 0, classid, added);
   if (added) {
+    std::vector<std::string> interfaces;
     for (unsigned i= 0, end = jc.interface_count(); i < end; ++i) {
-      pg_query
+      interfaces.push_back(jc.interface(i));
+    }
+    if (!interfaces.empty()) {
+      pg_query_binary
 	(impl_->conn, res,
-	 "INSERT INTO symboldb.java_interface (class_id, name) VALUES ($1, $2)",
-	 classid, jc.interface(i));
+	 "INSERT INTO symboldb.java_interface (class_id, name)"
+	 " SELECT $1, UNNEST($2::text[])", classid, interfaces);
     }
     std::vector<std::string> classes(jc.class_references());
     std::sort(classes.begin(), classes.end());
-    std::vector<std::string>::iterator end =
-      std::unique(classes.begin(), classes.end());
-    for (std::vector<std::string>::iterator p = classes.begin();
-	 p != end; ++p) {
+    classes.erase(std::unique(classes.begin(), classes.end()), classes.end());
+    std::vector<std::string> references;
+    for (std::vector<std::string>::iterator p = classes.begin(),
+	   end = classes.end(); p != end; ++p) {
       const std::string &name(*p);
       if (name != "java/lang/Object" && name != "java/lang/String"
 	  && name != this_class) {
-	pg_query(impl_->conn, res,
-		 "INSERT INTO symboldb.java_class_reference (class_id, name)"
-		 " VALUES ($1, $2)", classid, name);
+	references.push_back(name);
       }
     }
+    if (!references.empty()) {
+      pg_query_binary
+	(impl_->conn, res,
+	 "INSERT INTO symboldb.java_class_reference (class_id, name)"
+	 " SELECT $1, UNNEST($2::text[])", classid, references);
+    }
   }
   pg_query
     (impl_->conn, res,
@@ -618,9 +739,24 @@ database::lookup_package_set(const char *name)
   return package_set_id(get_id(res));
 }
 
+// Discards the repositories recorded for the package set because its
+// members are about to change.  Otherwise, a later repository update
+// could be skipped even though the members no longer match the
+// repositories.
+static void
+forget_package_set_repositories(pgconn_handle &conn,
+				database::package_set_id set)
+{
+  pgresult_handle res;
+  pg_query
+    (conn, res, "DELETE FROM " PACKAGE_SET_REPOSITORY_TABLE
+     " WHERE set_id = $1", set.value());
+}
+
 void
 database::add_package_set(package_set_id set, package_id pkg)
 {
+  forget_package_set_repositories(impl_->conn, set);
   pgresult_handle res;
   pg_query
     (impl_->conn, res,
@@ -631,6 +767,7 @@ database::add_package_set(package_set_id set, package_id pkg)
 void
 database::delete_from_package_set(package_set_id set, package_id pkg)
 {
+  forget_package_set_repositories(impl_->conn, set);
   pgresult_handle res;
   pg_query
     (impl_->conn, res,
@@ -642,6 +779,7 @@ database::delete_from_package_set(package_set_id set, package_id pkg)
 void
 database::empty_package_set(package_set_id set)
 {
+  forget_package_set_repositories(impl_->conn, set);
   pgresult_handle res;
   pg_query
     (impl_->conn, res,
@@ -651,9 +789,30 @@ database::empty_package_set(package_set_id set)
 bool
 database::update_package_set(package_set_id set,
 			     const std::vector<package_id> &pids)
+{
+  package_set_delta delta;
+  return update_package_set(set, pids, delta);
+}
+
+// Stores the sorted members of the package set in MEMBERS.
+static void
+package_set_members(pgconn_handle &conn, database::package_set_id set,
+		    std::vector<int> &members)
+{
+  pgresult_handle res;
+  pg_query_binary
+    (conn, res, "SELECT package_id FROM " PACKAGE_SET_MEMBER_TABLE
+     " WHERE set_id = $1 ORDER BY package_id", set.value());
+  members.clear();
+  pg_column(res, 0, members);
+}
+
+bool
+database::diff_package_set(package_set_id set,
+			   const std::vector<package_id> &pids,
+			   package_set_delta &delta)
 {
   assert(impl_->conn.transactionStatus() == PQTRANS_INTRANS);
-  bool changes = false;
 
   std::set<package_id> old;
   {
@@ -670,72 +829,225 @@ database::update_package_set(package_set_id set,
     }
   }
 
+  std::set<package_id> added;
   for (std::vector<package_id>::const_iterator
 	 p = pids.begin(), end = pids.end(); p != end; ++p) {
     package_id pkg = *p;
     if (old.erase(pkg) == 0) {
       // New package set member.
-      add_package_set(set, pkg);
-      changes = true;
+      added.insert(pkg);
     }
   }
 
   // Remaining old entries have to be deleted.
-  for (std::set<package_id>::const_iterator
-	 p = old.begin(), end = old.end(); p != end; ++p) {
-    delete_from_package_set(set, *p);
-    changes = true;
+  delta.added.assign(added.begin(), added.end());
+  delta.removed.assign(old.begin(), old.end());
+  return !(delta.added.empty() && delta.removed.empty());
+}
+
+bool
+database::update_package_set(package_set_id set,
+			     const std::vector<package_id> &pids,
+			     package_set_delta &delta)
+{
+  if (!diff_package_set(set, pids, delta)) {
+    return false;
   }
+  forget_package_set_repositories(impl_->conn, set);
 
-  return changes;
+  pgresult_handle res;
+  if (!delta.added.empty()) {
+    std::vector<int> added;
+    for (std::vector<package_id>::const_iterator
+	   p = delta.added.begin(), end = delta.added.end(); p != end; ++p) {
+      added.push_back(p->value());
+    }
+    pg_query_binary
+      (impl_->conn, res,
+       "INSERT INTO " PACKAGE_SET_MEMBER_TABLE " (set_id, package_id)"
+       " SELECT $1, UNNEST($2::integer[])", set.value(), added);
+  }
+  if (!delta.removed.empty()) {
+    std::vector<int> removed;
+    for (std::vector<package_id>::const_iterator
+	   p = delta.removed.begin(), end = delta.removed.end();
+	 p != end; ++p) {
+      removed.push_back(p->value());
+    }
+    pg_query_binary
+      (impl_->conn, res,
+       "DELETE FROM " PACKAGE_SET_MEMBER_TABLE
+       " WHERE set_id = $1 AND package_id = ANY ($2)", set.value(), removed);
+  }
+  return true;
 }
 
 void
 database::update_package_set_caches(package_set_id set)
 {
+  // Waits for replace_package_set() to finish with its staged
+  // partitions.
+  advisory_lock staging(lock(PACKAGE_SET_STAGING_LOCK_TAG, set.value()));
   update_elf_closure(impl_->conn, set, NULL);
+  update_elf_symbol_binding(impl_->conn, set);
+  update_java_class_closure(impl_->conn, set);
+  update_rpm_closure(impl_->conn, set);
 }
 
 bool
-database::url_cache_fetch(const char *url, size_t expected_length,
-			  long long expected_time,
-			  std::vector<unsigned char> &data)
+database::replace_package_set(package_set_id set,
+			      const std::vector<package_id> &pids)
 {
-  if (expected_length > 1U << 30) {
-    return false;
+  return replace_package_set(set, pids, NULL);
+}
+
+bool
+database::replace_package_set
+  (package_set_id set, const std::vector<package_id> &pids,
+   const std::vector<package_set_repository> *repos)
+{
+  assert(impl_->conn.transactionStatus() == PQTRANS_IDLE);
+  // The partitions staged below are committed before the package set
+  // lock is acquired, so they have to be protected separately.
+  advisory_lock staging(lock(PACKAGE_SET_STAGING_LOCK_TAG, set.value()));
+  // After this many attempts, the lock is held during the whole
+  // computation, so that concurrent updates cannot starve us.
+  const unsigned attempts = 3;
+  for (unsigned attempt = 1; ; ++attempt) {
+    bool locked = attempt >= attempts;
+    try {
+      advisory_lock guard;
+      if (locked) {
+	txn_begin();
+	guard = lock(PACKAGE_SET_LOCK_TAG, set.value());
+      } else {
+	txn_begin_snapshot();
+      }
+      package_set_delta delta;
+      if (!diff_package_set(set, pids, delta)) {
+	if (repos == NULL) {
+	  txn_rollback();
+	  return false;
+	}
+	if (!locked) {
+	  txn_rollback();
+	  txn_begin();
+	  guard = lock(PACKAGE_SET_LOCK_TAG, set.value());
+	  if (diff_package_set(set, pids, delta)) {
+	    // The package set was changed concurrently.
+	    txn_rollback();
+	    continue;
+	  }
+	}
+	replace_package_set_repositories(set, *repos);
+	txn_commit();
+	return false;
+      }
+      // All caches are computed from the same snapshot.  The
+      // reference tables are staged in new partitions.
+      elf_closure_update closure;
+      closure.compute(impl_->conn, set, delta);
+      prepare_elf_symbol_binding(impl_->conn, set, delta);
+      prepare_java_class_closure(impl_->conn, set, delta);
+      prepare_rpm_closure(impl_->conn, set, delta);
+      if (!locked) {
+	// This only commits the staged partitions.
+	txn_commit();
+	txn_begin();
+	guard = lock(PACKAGE_SET_LOCK_TAG, set.value());
+	if (!closure.current(impl_->conn)) {
+	  // The package set was changed concurrently.
+	  txn_rollback();
+	  continue;
+	}
+      }
+      update_package_set(set, pids, delta);
+      closure.apply(impl_->conn);
+      replace_elf_symbol_binding(impl_->conn, set);
+      replace_java_class_closure(impl_->conn, set);
+      replace_rpm_closure(impl_->conn, set);
+      if (repos != NULL) {
+	replace_package_set_repositories(set, *repos);
+      }
+      txn_commit();
+      return true;
+    } catch (...) {
+      if (impl_->conn.transactionStatus() != PQTRANS_IDLE) {
+	txn_rollback();
+      }
+      throw;
+    }
   }
+}
+
+void
+database::package_set_repositories
+  (package_set_id set, std::vector<package_set_repository> &repos)
+{
   pgresult_handle res;
   pg_query_binary
-    (impl_->conn, res, "SELECT data FROM " URL_CACHE_TABLE
-     " WHERE url = $1 AND LENGTH(data) = $2 AND http_time = $3",
-     url, static_cast<int>(expected_length), expected_time);
-  if (res.ntuples() != 1) {
-    return false;
-  } else {
-    pg_response(res, 0, data);
-    return true;
+    (impl_->conn, res,
+     "SELECT url, revision, primary_digest, exclude_name FROM "
+     PACKAGE_SET_REPOSITORY_TABLE " WHERE set_id = $1 ORDER BY url",
+     set.value());
+  for (int row = 0, end = res.ntuples(); row < end; ++row) {
+    package_set_repository repo;
+    pg_response(res, row, repo.url, repo.revision, repo.primary_digest,
+		repo.exclude_name);
+    repos.push_back(repo);
+  }
+}
+
+void
+database::replace_package_set_repositories
+  (package_set_id set, const std::vector<package_set_repository> &repos)
+{
+  bool own_txn = impl_->conn.transactionStatus() == PQTRANS_IDLE;
+  if (own_txn) {
+    txn_begin();
+  }
+  try {
+    forget_package_set_repositories(impl_->conn, set);
+    pgresult_handle res;
+    for (std::vector<package_set_repository>::const_iterator
+	   p = repos.begin(), end = repos.end(); p != end; ++p) {
+      pg_query
+	(impl_->conn, res, "INSERT INTO " PACKAGE_SET_REPOSITORY_TABLE
+	 " (set_id, url, revision, primary_digest, exclude_name)"
+	 " VALUES ($1, $2, $3, $4, $5)",
+	 set.value(), p->url, p->revision, p->primary_digest,
+	 p->exclude_name);
+    }
+  } catch (...) {
+    if (own_txn) {
+      txn_rollback();
+    }
+    throw;
+  }
+  if (own_txn) {
+    txn_commit();
   }
 }
 
 bool
-database::url_cache_fetch(const char *url,
-			  std::vector<unsigned char> &data)
+database::url_cache_fetch(const char *url, std::vector<unsigned char> &digest,
+			  long long &http_time, std::string &etag)
 {
   pgresult_handle res;
   pg_query_binary
-    (impl_->conn, res,
-     "SELECT data FROM " URL_CACHE_TABLE " WHERE url = $1", url);
+    (impl_->conn, res, "SELECT digest, http_time, COALESCE(etag, '') FROM "
+     URL_CACHE_TABLE " WHERE url = $1", url);
   if (res.ntuples() != 1) {
     return false;
   }
-  pg_response(res, 0, data);
+  pg_response(res, 0, digest, http_time, etag);
   return true;
 }
 
 void
 database::url_cache_update(const char *url,
-			   const std::vector<unsigned char> &data,
-			   long long time)
+			   const std::vector<unsigned char> &digest,
+			   long long time, const std::string &etag)
 {
   pgresult_handle res;
   pg_query
@@ -745,30 +1057,55 @@ database::url_cache_update(const char *url,
   if (res.ntuples() == 1) {
     pg_query
       (impl_->conn, res, "UPDATE " URL_CACHE_TABLE
-       " SET http_time = $2, data = $3, last_change = NOW() AT TIME ZONE 'UTC'"
-       " WHERE url = $1", url, time, data);
+       " SET http_time = $2, digest = $3, etag = NULLIF($4, ''),"
+       " last_change = NOW() AT TIME ZONE 'UTC'"
+       " WHERE url = $1", url, time, digest, etag);
   } else {
     pg_query
       (impl_->conn, res, "INSERT INTO " URL_CACHE_TABLE
-       " (url, http_time, data, last_change)"
-       " VALUES ($1, $2, $3, NOW() AT TIME ZONE 'UTC')", url, time, data);
+       " (url, http_time, digest, etag, last_change)"
+       " VALUES ($1, $2, $3, NULLIF($4, ''), NOW() AT TIME ZONE 'UTC')",
+       url, time, digest, etag);
   }
 }
 
 void
-database::referenced_package_digests
-  (std::vector<std::vector<unsigned char> > &digests)
+database::url_cache_digests(std::vector<std::vector<unsigned char> > &digests)
 {
   pgresult_handle res;
   res.execBinary
     (impl_->conn,
-     "SELECT digest FROM " PACKAGE_SET_MEMBER_TABLE
-     " JOIN " PACKAGE_DIGEST_TABLE " USING (package_id)"
-     " ORDER BY digest");
-  std::vector<unsigned char> digest;
-  for (int i = 0, end = res.ntuples(); i < end; ++i) {
-    pg_response(res, i, digest);
-    digests.push_back(digest);
+     "SELECT DISTINCT digest FROM " URL_CACHE_TABLE " ORDER BY digest");
+  pg_column(res, 0, digests);
+}
+
+void
+database::referenced_package_digests
+  (std::vector<std::vector<unsigned char> > &digests)
+{
+  // The cursor needs a transaction.
+  bool own_txn = impl_->conn.transactionStatus() == PQTRANS_IDLE;
+  if (own_txn) {
+    txn_begin();
+  }
+  try {
+    pg_cursor cursor
+      (impl_->conn, "referenced_package_digests",
+       "SELECT digest FROM " PACKAGE_SET_MEMBER_TABLE
+       " JOIN " PACKAGE_DIGEST_TABLE " USING (package_id)"
+       " ORDER BY digest");
+    pgresult_handle res;
+    while (cursor.fetch(res)) {
+      pg_column(res, 0, digests);
+    }
+  } catch (...) {
+    if (own_txn) {
+      txn_rollback();
+    }
+    throw;
+  }
+  if (own_txn) {
+    txn_commit();
   }
 }
 
@@ -802,83 +1139,301 @@ database::expire_java_classes()
      " WHERE j.class_id = jc.class_id LIMIT 1)");
 }
 
+void
+database::expire_rpm_capabilities()
+{
+  pgresult_handle res;
+  res.exec
+    (impl_->conn, "DELETE FROM symboldb.rpm_capability rc"
+     " WHERE NOT EXISTS (SELECT 1 FROM symboldb.package_dependency pd"
+     " WHERE pd.capability_id = rc.capability_id LIMIT 1)");
+}
+
+void
+database::expire_url_cache()
+{
+  pgresult_handle res;
+  res.exec
+    (impl_->conn, "DELETE FROM " URL_CACHE_TABLE
+     " WHERE last_change < NOW() AT TIME ZONE 'UTC' - INTERVAL '30 days'");
+}
+
 namespace {
   struct fc_entry {
     std::string file;
     std::string nevra;
   };
-}
 
-void
-database::print_elf_soname_conflicts(package_set_id set)
-{
-  struct dumper : update_elf_closure_conflicts {
-    database *db;
-    dumper(database *dbase)
-      : db(dbase)
+  // A soname which could not be resolved (if CHOICES is empty), or
+  // which is provided by multiple files.
+  struct soname_conflict {
+    database::file_id file;
+    std::string soname;
+    std::vector<database::file_id> choices;
+  };
+
+  struct soname_conflict_collector : update_elf_closure_conflicts {
+    std::vector<soname_conflict> conflicts;
+
+    void missing(database::file_id fid, const std::string &soname)
     {
+      conflicts.push_back(soname_conflict());
+      conflicts.back().file = fid;
+      conflicts.back().soname = soname;
     }
 
-    void missing(file_id fid, const std::string &soname)
+    void conflict(database::file_id fid, const std::string &soname,
+		  const std::vector<database::file_id> &choices)
+    {
+      missing(fid, soname);
+      conflicts.back().choices = choices;
+    }
+
+    bool skip_update()
+    {
+      return true;
+    }
+  };
+
+  typedef std::map<database::file_id, fc_entry> fc_map;
+
+  // Looks up the names of all files mentioned in CONFLICTS with a
+  // single query.
+  void
+  resolve_conflict_names(pgconn_handle &conn,
+			 const std::vector<soname_conflict> &conflicts,
+			 fc_map &names)
+  {
+    std::vector<int> ids;
+    for (std::vector<soname_conflict>::const_iterator
+	   p = conflicts.begin(), end = conflicts.end(); p != end; ++p) {
+      ids.push_back(p->file.value());
+      for (std::vector<database::file_id>::const_iterator
+	     q = p->choices.begin(), qend = p->choices.end(); q != qend; ++q) {
+	ids.push_back(q->value());
+      }
+    }
+    std::sort(ids.begin(), ids.end());
+    ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+    if (ids.empty()) {
+      return;
+    }
+
+    pgresult_handle res;
+    pg_query_binary
+      (conn, res,
+       "SELECT f.file_id, f.name, symboldb.nevra(p)"
+       " FROM symboldb.file f JOIN symboldb.package p USING (package_id)"
+       " WHERE f.file_id = ANY ($1)", ids);
+    std::vector<int> fid;
+    std::vector<std::string> file;
+    std::vector<std::string> nevra;
+    pg_column(res, 0, fid);
+    pg_column(res, 1, file);
+    pg_column(res, 2, nevra);
+    if (fid.size() != ids.size()) {
+      throw std::runtime_error("could not locate symboldb.file row");
+    }
+    for (size_t i = 0, end = fid.size(); i < end; ++i) {
+      fc_entry &entry(names[database::file_id(fid[i])]);
+      entry.file.swap(file[i]);
+      entry.nevra.swap(nevra[i]);
+    }
+  }
+
+  struct soname_conflict_less {
+    const fc_map &names;
+
+    soname_conflict_less(const fc_map &n)
+      : names(n)
     {
-      const fc_entry &entry(get_name(fid));
-      printf("missing: %s (%s) %s\n",
-	     entry.file.c_str(), entry.nevra.c_str(), soname.c_str());
     }
 
-    void conflict(file_id fid, const std::string &soname,
-		  const std::vector<file_id> &choices)
+    bool operator()(const soname_conflict &a, const soname_conflict &b) const
     {
-      {
-	const fc_entry &entry(get_name(fid));
-	printf("conflicts: %s (%s) %s\n",
-	       entry.file.c_str(), entry.nevra.c_str(), soname.c_str());
+      const fc_entry &ea(names.find(a.file)->second);
+      const fc_entry &eb(names.find(b.file)->second);
+      if (ea.file != eb.file) {
+	return ea.file < eb.file;
       }
+      if (ea.nevra != eb.nevra) {
+	return ea.nevra < eb.nevra;
+      }
+      return a.soname < b.soname;
+    }
+  };
+
+  void
+  print_json_file(const fc_entry &entry)
+  {
+    printf("\"file\":%s,\"nevra\":%s",
+	   json_quote(entry.file).c_str(), json_quote(entry.nevra).c_str());
+  }
+}
+
+database::report_format::report_format()
+  : sorted(false), json(false)
+{
+}
+
+void
+database::print_elf_soname_conflicts(package_set_id set,
+				     const report_format &format)
+{
+  soname_conflict_collector collector;
+  fc_map names;
+  pgresult_handle res;
+  res.exec(impl_->conn,
+	   "BEGIN TRANSACTION ISOLATION LEVEL REPEATABLE READ READ ONLY");
+  update_elf_closure(impl_->conn, set, &collector);
+  resolve_conflict_names(impl_->conn, collector.conflicts, names);
+  res.exec(impl_->conn, "ROLLBACK");
+
+  std::vector<soname_conflict> &conflicts(collector.conflicts);
+  if (format.sorted) {
+    std::stable_sort(conflicts.begin(), conflicts.end(),
+		     soname_conflict_less(names));
+  }
+  for (std::vector<soname_conflict>::const_iterator
+	 p = conflicts.begin(), end = conflicts.end(); p != end; ++p) {
+    const fc_entry &entry(names[p->file]);
+    if (format.json) {
+      printf("{\"type\":\"%s\",",
+	     p->choices.empty() ? "missing" : "conflict");
+      print_json_file(entry);
+      printf(",\"soname\":%s", json_quote(p->soname).c_str());
+      if (!p->choices.empty()) {
+	// The first choice is the chosen resolution.
+	fputs(",\"choices\":[", stdout);
+	for (std::vector<file_id>::const_iterator
+	       q = p->choices.begin(), qend = p->choices.end();
+	     q != qend; ++q) {
+	  fputs(q == p->choices.begin() ? "{" : ",{", stdout);
+	  print_json_file(names[*q]);
+	  putchar('}');
+	}
+	putchar(']');
+      }
+      fputs("}\n", stdout);
+    } else if (p->choices.empty()) {
+      printf("missing: %s (%s) %s\n",
+	     entry.file.c_str(), entry.nevra.c_str(), p->soname.c_str());
+    } else {
+      printf("conflicts: %s (%s) %s\n",
+	     entry.file.c_str(), entry.nevra.c_str(), p->soname.c_str());
       const char *first = "*";
       for (std::vector<file_id>::const_iterator
-	     p = choices.begin(), end = choices.end(); p != end; ++p) {
-	const fc_entry &entry(get_name(*p));
+	     q = p->choices.begin(), qend = p->choices.end();
+	   q != qend; ++q) {
+	const fc_entry &choice(names[*q]);
 	printf("  %s %s (%s)\n",
-	       first, entry.file.c_str(), entry.nevra.c_str());
+	       first, choice.file.c_str(), choice.nevra.c_str());
 	first = " ";
       }
     }
+  }
+}
 
-    bool skip_update()
-    {
-      return true;
-    }
-
-    typedef std::map<file_id, fc_entry> file_cache;
-    file_cache file_cache_;
+void
+database::print_symbol_collisions(package_set_id set,
+				  const symbol_collision_filter &filter,
+				  const report_format &format)
+{
+  std::vector<symbol_collision> collisions;
+  pgresult_handle res;
+  res.exec(impl_->conn,
+	   "BEGIN TRANSACTION ISOLATION LEVEL REPEATABLE READ READ ONLY");
+  find_symbol_collisions(impl_->conn, set, filter, collisions);
+  res.exec(impl_->conn, "ROLLBACK");
 
-    const fc_entry &get_name(file_id fid)
-    {
-      file_cache::iterator p = file_cache_.find(fid);
-      if (p != file_cache_.end()) {
-	return p->second;
+  for (std::vector<symbol_collision>::const_iterator
+	 p = collisions.begin(), end = collisions.end(); p != end; ++p) {
+    if (format.json) {
+      printf("{\"symbol\":%s,\"arch\":%s,\"definitions\":[",
+	     json_quote(p->name).c_str(), json_quote(p->arch).c_str());
+      for (std::vector<symbol_collision::definition>::const_iterator
+	     q = p->definitions.begin(), qend = p->definitions.end();
+	   q != qend; ++q) {
+	printf("%s{\"soname\":%s,\"file\":%s,\"nevra\":%s}",
+	       q == p->definitions.begin() ? "" : ",",
+	       json_quote(q->soname).c_str(), json_quote(q->file).c_str(),
+	       json_quote(q->nevra).c_str());
       }
+      fputs("]}\n", stdout);
+      continue;
+    }
+    printf("collision: %s (%s)\n", p->name.c_str(), p->arch.c_str());
+    for (std::vector<symbol_collision::definition>::const_iterator
+	   q = p->definitions.begin(), qend = p->definitions.end();
+	 q != qend; ++q) {
+      printf("  %s %s (%s)\n",
+	     q->soname.c_str(), q->file.c_str(), q->nevra.c_str());
+    }
+  }
+}
 
-      fc_entry &entry(file_cache_[fid]);
-      pgresult_handle res;
-      pg_query_binary
-	(db->impl_->conn, res,
-	 "SELECT f.name, symboldb.nevra(p)"
-	 " FROM symboldb.file f JOIN symboldb.package p USING (package_id)"
-	 " WHERE f.file_id = $1", fid.value());
-      if (res.ntuples() != 1) {
-	throw std::runtime_error("could not locate symboldb.file row");
-      }
-      pg_response(res, 0, entry.file, entry.nevra);
-      return entry;
+void
+database::print_symbol_definitions(package_set_id set,
+				   const std::vector<std::string> &names,
+				   const report_format &format)
+{
+  std::vector<symbol_definition_info> definitions;
+  pgresult_handle res;
+  res.exec(impl_->conn,
+	   "BEGIN TRANSACTION ISOLATION LEVEL REPEATABLE READ READ ONLY");
+  find_symbol_definitions(impl_->conn, set, names, definitions);
+  res.exec(impl_->conn, "ROLLBACK");
+
+  for (std::vector<symbol_definition_info>::const_iterator
+	 p = definitions.begin(), end = definitions.end(); p != end; ++p) {
+    if (format.json) {
+      printf("{\"symbol\":%s,\"version\":%s,\"arch\":%s,\"soname\":%s,"
+	     "\"file\":%s,\"nevra\":%s}\n",
+	     json_quote(p->name).c_str(), json_quote(p->version).c_str(),
+	     json_quote(p->arch).c_str(), json_quote(p->soname).c_str(),
+	     json_quote(p->file).c_str(), json_quote(p->nevra).c_str());
+      continue;
     }
-  } dumper(this);
+    printf("%s%s%s %s %s (%s)\n", p->name.c_str(),
+	   p->version.empty() ? "" : "@", p->version.c_str(),
+	   p->soname.empty() ? "-" : p->soname.c_str(),
+	   p->file.c_str(), p->nevra.c_str());
+  }
+}
 
+void
+database::print_abi_diff(package_set_id old_set, package_set_id new_set,
+			 const report_format &format)
+{
+  std::vector<abi_difference> differences;
   pgresult_handle res;
   res.exec(impl_->conn,
 	   "BEGIN TRANSACTION ISOLATION LEVEL REPEATABLE READ READ ONLY");
-  update_elf_closure(impl_->conn, set, &dumper);
+  diff_package_set_abi(impl_->conn, old_set, new_set, differences);
   res.exec(impl_->conn, "ROLLBACK");
+
+  for (std::vector<abi_difference>::const_iterator
+	 p = differences.begin(), end = differences.end(); p != end; ++p) {
+    const char *change = abi_difference::to_string(p->change);
+    if (format.json) {
+      printf("{\"change\":\"%s\",\"soname\":%s,\"arch\":%s",
+	     change, json_quote(p->soname).c_str(),
+	     json_quote(p->arch).c_str());
+      if (!p->symbol.empty()) {
+	printf(",\"symbol\":%s,\"version\":%s",
+	       json_quote(p->symbol).c_str(), json_quote(p->version).c_str());
+      }
+      fputs("}\n", stdout);
+      continue;
+    }
+    if (p->symbol.empty()) {
+      printf("%s: %s (%s)\n", change, p->soname.c_str(), p->arch.c_str());
+    } else {
+      printf("%s: %s (%s) %s%s%s\n", change,
+	     p->soname.c_str(), p->arch.c_str(), p->symbol.c_str(),
+	     p->version.empty() ? "" : "@", p->version.c_str());
+    }
+  }
 }
 
 void
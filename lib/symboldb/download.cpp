@@ -20,8 +20,14 @@
 #include <symboldb/database.hpp>
 #include <cxxll/curl_exception.hpp>
 #include <cxxll/curl_fetch_result.hpp>
+#include <cxxll/checksum.hpp>
+#include <cxxll/file_cache.hpp>
+#include <cxxll/hash.hpp>
+#include <cxxll/mmap_handle.hpp>
 #include <cxxll/vector_sink.hpp>
 
+#include <stdexcept>
+
 using namespace cxxll;
 
 download_options::download_options()
@@ -29,6 +35,52 @@ download_options::download_options()
 {
 }
 
+download_options::~download_options()
+{
+}
+
+static file_cache &
+url_cache(const download_options &opt)
+{
+  if (!opt.cache) {
+    throw std::logic_error("download_options::cache not set");
+  }
+  return *opt.cache;
+}
+
+bool
+download_cache_lookup(const download_options &opt, database &db,
+		      const char *url, mmap_handle &data,
+		      long long &http_time, std::string &etag)
+{
+  checksum csum;
+  csum.type = hash_sink::sha256;
+  csum.length = checksum::no_length;
+  std::string path;
+  if (!db.url_cache_fetch(url, csum.value, http_time, etag)
+      || !url_cache(opt).lookup_path(csum, path)) {
+    // A missing file is treated as a cache miss, so that the data is
+    // downloaded again.
+    return false;
+  }
+  data.map_read_only(path.c_str());
+  return true;
+}
+
+void
+download_cache_update(const download_options &opt, database &db,
+		      const char *url, const std::vector<unsigned char> &data,
+		      long long http_time, const std::string &etag)
+{
+  checksum csum;
+  csum.type = hash_sink::sha256;
+  csum.value = hash(csum.type, data);
+  csum.length = data.size();
+  std::string path;
+  url_cache(opt).add(csum, data, path);
+  db.url_cache_update(url, csum.value, http_time, etag);
+}
+
 void
 download(const download_options &opt, database &db,
 	 const char *url, sink *target)
@@ -37,8 +89,10 @@ download(const download_options &opt, database &db,
   case download_options::only_cache:
   case download_options::always_cache:
     {
-      std::vector<unsigned char> data;
-      if (db.url_cache_fetch(url, data)) {
+      mmap_handle data;
+      long long http_time;
+      std::string etag;
+      if (download_cache_lookup(opt, db, url, data, http_time, etag)) {
 	target->write(data.data(), data.size());
 	return;
       }
@@ -49,26 +103,33 @@ download(const download_options &opt, database &db,
     }
     break;
   case download_options::no_cache:
-    break;
   case download_options::check_cache:
-    {
-      vector_sink vsink;
-      curl_fetch_result r(&vsink);
-      r.head(url);
-      if (r.http_date > 0 && r.http_size >= 0
-	  && db.url_cache_fetch(url, static_cast<size_t>(r.http_size),
-				r.http_date, vsink.data)) {
-	target->write(vsink.data.data(), vsink.data.size());
-	return;
-      }
-    }
+    break;
   }
 
+  // In check_cache mode, revalidate the cached copy with a single
+  // conditional GET.  If the server reports no change, nothing is
+  // written to the target, and the cached data is used instead.
   curl_fetch_result r(target);
+  mmap_handle cached;
+  if (opt.cache_mode == download_options::check_cache) {
+    long long http_time;
+    std::string etag;
+    if (download_cache_lookup(opt, db, url, cached, http_time, etag)) {
+      if (http_time > 0) {
+	r.if_modified_since = http_time;
+      }
+      r.if_none_match = etag;
+    }
+  }
   r.get(url);
+  if (r.not_modified) {
+    target->write(cached.data(), cached.size());
+    return;
+  }
   if (opt.cache_mode != download_options::no_cache) {
     if (vector_sink *vsink = dynamic_cast<vector_sink *>(target)) {
-      db.url_cache_update(url, vsink->data, r.http_date);
+      download_cache_update(opt, db, url, vsink->data, r.http_date, r.etag);
     }
   }
 }
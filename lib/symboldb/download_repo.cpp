@@ -20,16 +20,29 @@
 #include <symboldb/options.hpp>
 #include <symboldb/database.hpp>
 #include <cxxll/package_set_consolidator.hpp>
+#include <cxxll/bounded_queue.hpp>
 #include <symboldb/repomd.hpp>
 #include <cxxll/file_cache.hpp>
 #include <symboldb/rpm_load.hpp>
 #include <cxxll/curl_exception.hpp>
 #include <cxxll/curl_exception_dump.hpp>
+#include <cxxll/curl_multi_fetch.hpp>
+#include <cxxll/curl_fetch_result.hpp>
+#include <cxxll/hash.hpp>
+#include <cxxll/mirror_set.hpp>
+#include <cxxll/mmap_handle.hpp>
+#include <cxxll/os_exception.hpp>
 #include <cxxll/regex_handle.hpp>
+#include <cxxll/string_support.hpp>
+#include <cxxll/rpm_file_layout.hpp>
+#include <cxxll/task.hpp>
+#include <cxxll/vector_sink.hpp>
 
 #include <algorithm>
 #include <cstdio>
+#include <memory>
 #include <set>
+#include <stdexcept>
 #include <vector>
 
 using namespace cxxll;
@@ -39,6 +52,13 @@ namespace {
     std::string name;
     std::string href;
     checksum csum;
+    rpm_package_info info;
+    unsigned long long header_end; // see repomd::primary::header_end()
+
+    // If href is located below the repository base URL, PATH is the
+    // remainder, which can be fetched from any of the MIRRORS.
+    std::tr1::shared_ptr<mirror_set> mirrors;
+    std::string path;
   };
 
   //////////////////////////////////////////////////////////////////////
@@ -72,110 +92,607 @@ namespace {
   //////////////////////////////////////////////////////////////////////
   // database_filter
 
+  // Removes URLs whose digest is already present in the database.
+  // The digests are looked up in bulk before filtering.
   struct database_filter {
     const symboldb_options &opt_;
-    database &db_;
+    const database::package_digest_map &known_;
     std::set<database::package_id> &pids_;
 
-    database_filter(const symboldb_options &, database &,
+    database_filter(const symboldb_options &,
+		    const database::package_digest_map &,
 		    std::set<database::package_id> &);
     bool operator()(const rpm_url &);
   };
 
   inline
-  database_filter::database_filter(const symboldb_options &opt, database &db,
+  database_filter::database_filter(const symboldb_options &opt,
+				   const database::package_digest_map &known,
 				   std::set<database::package_id> &pids)
-    : opt_(opt), db_(db), pids_(pids)
+    : opt_(opt), known_(known), pids_(pids)
   {
   }
 
   inline bool
   database_filter::operator()(const rpm_url &rurl)
   {
-    database::package_id pid = db_.package_by_digest(rurl.csum.value);
-    if (pid != database::package_id()) {
+    database::package_digest_map::const_iterator p =
+      known_.find(rurl.csum.value);
+    if (p != known_.end()) {
       if (opt_.output == symboldb_options::verbose) {
 	fprintf(stderr, "info: skipping %s\n", rurl.href.c_str());
       }
-      pids_.insert(pid);
+      pids_.insert(p->second);
       return true;
     }
     return false;
   }
 
   //////////////////////////////////////////////////////////////////////
-  // download_filter
+  // rpm_downloader
+
+  struct rpm_transfer;
 
-  struct download_filter : database_filter {
+  // An RPM file in the cache which is waiting to be loaded.
+  struct load_job {
+    rpm_transfer *transfer;
+    std::string path;
+    database::package_id pid;	// set by the loader, 0 on error
+    std::string error;		// set by the loader on exceptions
+  };
+
+  // Downloads the RPMs which are neither in the database nor in the
+  // RPM cache, and loads them if requested.  The downloads run
+  // concurrently, but all callbacks run on the calling thread, so
+  // they can use the database connection.  Downloaded RPMs are passed
+  // to loader threads through a bounded queue, so that loading
+  // overlaps with the remaining downloads.  Each loader has its own
+  // database connection.
+  struct rpm_downloader {
+    const symboldb_options &opt_;
+    database &db_;
+    std::set<database::package_id> &pids_;
     std::tr1::shared_ptr<file_cache> fcache_;
-    size_t &count_;
+    size_t count_;
     bool load_;
 
-    // Cache bypass for RPM downloads.
-    download_options dopts_no_cache_;
+    std::auto_ptr<bounded_queue<load_job> > jobs_;
+    std::auto_ptr<bounded_queue<load_job> > results_;
+    std::vector<std::tr1::shared_ptr<database> > loader_dbs_;
+    std::vector<std::tr1::shared_ptr<task> > loaders_;
+    size_t loaded_;
+    size_t load_failed_;
+
+    rpm_downloader(const symboldb_options &, database &,
+		   std::set<database::package_id> &, bool load);
+
+    // Processes all URLs.  URLs which were processed successfully are
+    // removed from the vector.
+    void run(std::vector<rpm_url> &);
+
+    // Queues the RPM file for loading (if requested), or marks the
+    // transfer as done.
+    void complete(rpm_transfer &, const std::string &rpm_path);
+
+    // Processes the results of finished loads.
+    void reap();
+
+    // Starts the loader threads.  COUNT is the number of transfers.
+    // The database connections of the loaders are opened first, so
+    // that connection errors are reported on the calling thread.
+    void start_loaders(size_t count);
+
+    // Waits for the loader threads to finish.  If ABORT, the queued
+    // loads are discarded.
+    void stop_loaders(bool abort);
+
+    static void load_worker(rpm_downloader *, database *) throw();
+
+    // Looks for a cached file of the same package with a different
+    // signature.  On success, stores its path in CACHED_PATH and the
+    // SHA-1 hash of its main header in HEADER_HASH, and returns true.
+    bool splice_source(const rpm_url &, std::string &cached_path,
+		       std::vector<unsigned char> &header_hash);
+
+    // Tries to reconstruct a re-signed RPM from HEADER (the new file
+    // up to the end of the main header, fetched with a range request)
+    // and the payload of the cached file found by splice_source().
+    // The main headers have to match.  On success, adds the file to
+    // the RPM cache, updates RPM_PATH and returns true.
+    bool splice(const rpm_url &, const std::vector<unsigned char> &header,
+		const std::string &cached_path,
+		const std::vector<unsigned char> &header_hash,
+		std::string &rpm_path);
+  };
 
-    download_filter(const symboldb_options &, database &,
-		    std::set<database::package_id> &,
-		    size_t &count, bool load);
-    bool operator()(const rpm_url &);
+  struct rpm_transfer : curl_multi_fetch::transfer {
+    rpm_downloader &downloader_;
+    const rpm_url &rurl_;
+    database::advisory_lock lock_;
+    std::auto_ptr<file_cache::add_sink> sink_;
+    long long offset_;		// resume offset of the current attempt
+    size_t mirror_;		// mirror index of the current attempt
+    std::vector<size_t> ranking_; // mirror indices of the candidate URLs
+    bool done_;
+
+    // If a cached file has a reusable payload, the first attempt
+    // only fetches the headers (see rpm_downloader::splice()).  If
+    // that fails, the transfer is restarted as a full download.
+    bool splicing_;		// the current attempt fetches the headers
+    bool splice_tried_;
+    std::string splice_path_;
+    std::vector<unsigned char> splice_hash_;
+    vector_sink header_;
+
+    rpm_transfer(rpm_downloader &, const rpm_url &);
+    sink *start();
+    long long resume_offset();
+    long long range_end();
+    void select_urls(std::vector<std::string> &);
+    void url_selected(size_t);
+    bool finished(const curl_fetch_result &);
+    void failed(const curl_exception &, bool retry);
+    bool restart();
   };
 
-  inline
-  download_filter::download_filter(const symboldb_options &opt, database &db,
-				   std::set<database::package_id> &pids,
-				   size_t &count, bool load)
-    : database_filter(opt, db, pids),
-      fcache_(opt.rpm_cache()), count_(count), load_(load)
+  rpm_downloader::rpm_downloader(const symboldb_options &opt, database &db,
+				 std::set<database::package_id> &pids,
+				 bool load)
+    : opt_(opt), db_(db), pids_(pids),
+      fcache_(opt.rpm_cache()), count_(0), load_(load),
+      loaded_(0), load_failed_(0)
   {
-    dopts_no_cache_.cache_mode = download_options::no_cache;
   }
 
-  inline bool
-  download_filter::operator()(const rpm_url &rurl)
+  void
+  rpm_downloader::run(std::vector<rpm_url> &urls)
   {
+    curl_multi_fetch fetch(opt_.download_limits());
+    std::vector<std::tr1::shared_ptr<rpm_transfer> > transfers;
+    transfers.reserve(urls.size());
+    for (std::vector<rpm_url>::const_iterator p = urls.begin(),
+	   end = urls.end(); p != end; ++p) {
+      transfers.push_back(std::tr1::shared_ptr<rpm_transfer>
+			  (new rpm_transfer(*this, *p)));
+      // --randomize keeps the shuffled order.
+      long long size = -1;
+      if (!opt_.randomize && p->csum.length != checksum::no_length) {
+	size = p->csum.length;
+      }
+      fetch.add(p->href.c_str(), size, transfers.back().get());
+    }
     try {
-      std::string rpm_path;
-      database::advisory_lock lock
-	(db_.lock_digest(rurl.csum.value.begin(), rurl.csum.value.end()));
-      if (database_filter::operator()(rurl)) {
+      if (load_) {
+	start_loaders(transfers.size());
+      }
+      fetch.run();
+    } catch (...) {
+      stop_loaders(true);
+      throw;
+    }
+    stop_loaders(false);
+
+    std::vector<rpm_url> failed;
+    for (size_t i = 0, end = urls.size(); i < end; ++i) {
+      if (!transfers[i]->done_) {
+	failed.push_back(urls[i]);
+      }
+    }
+    urls.swap(failed);
+  }
+
+  void
+  rpm_downloader::complete(rpm_transfer &transfer,
+			   const std::string &rpm_path)
+  {
+    if (!load_) {
+      transfer.done_ = true;
+      transfer.lock_.reset();
+      return;
+    }
+    // The digest lock is kept until the load has finished, see
+    // reap().
+    reap();
+    load_job job;
+    job.transfer = &transfer;
+    job.path = rpm_path;
+    jobs_->push(job);
+  }
+
+  void
+  rpm_downloader::reap()
+  {
+    if (!results_.get()) {
+      return;
+    }
+    load_job job;
+    while (results_->try_pop(job)) {
+      rpm_transfer &transfer(*job.transfer);
+      transfer.lock_.reset();
+      if (!job.error.empty()) {
+	throw std::runtime_error(job.error);
+      }
+      if (job.pid != database::package_id()) {
+	pids_.insert(job.pid);
+	transfer.done_ = true;
+	++loaded_;
+      } else {
+	++load_failed_;
+      }
+    }
+  }
+
+  void
+  rpm_downloader::start_loaders(size_t count)
+  {
+    for (unsigned i = 0; i < opt_.load_jobs; ++i) {
+      loader_dbs_.push_back(std::tr1::shared_ptr<database>(new database));
+    }
+    jobs_.reset(new bounded_queue<load_job>(2 * opt_.load_jobs));
+    // Each transfer results in at most one load, so pushing results
+    // never blocks.
+    results_.reset(new bounded_queue<load_job>(std::max(count, size_t(1))));
+    for (unsigned i = 0; i < opt_.load_jobs; ++i) {
+      loaders_.push_back(std::tr1::shared_ptr<task>
+			 (new task(std::tr1::bind(&load_worker, this,
+						  loader_dbs_[i].get()))));
+    }
+  }
+
+  void
+  rpm_downloader::stop_loaders(bool abort)
+  {
+    if (!jobs_.get()) {
+      return;
+    }
+    if (abort) {
+      load_job job;
+      while (jobs_->try_pop(job)) {
+      }
+    }
+    jobs_->close();
+    for (std::vector<std::tr1::shared_ptr<task> >::iterator
+	   p = loaders_.begin(), end = loaders_.end(); p != end; ++p) {
+      (*p)->wait();
+    }
+    loaders_.clear();
+    loader_dbs_.clear();
+    if (abort) {
+      return;
+    }
+    reap();
+    if (opt_.output != symboldb_options::quiet) {
+      bounded_queue<load_job>::statistics stats(jobs_->stats());
+      fprintf(stderr, "info: loaded %zu packages (%zu failed) with %u"
+	      " loaders, queue peak %zu\n",
+	      loaded_, load_failed_, opt_.load_jobs, stats.peak);
+      fprintf(stderr, "info: downloads waited %llu ms for loaders,"
+	      " loaders waited %llu ms for downloads\n",
+	      stats.push_wait_ms, stats.pop_wait_ms);
+    }
+  }
+
+  void
+  rpm_downloader::load_worker(rpm_downloader *self, database *db) throw()
+  {
+    bool failed = false;
+    load_job job;
+    while (self->jobs_->pop(job)) {
+      job.pid = database::package_id();
+      // After an exception, the connection state is unknown, and the
+      // main thread aborts the run, so the remaining jobs are only
+      // passed through.
+      if (!failed) {
+	try {
+	  rpm_package_info info;
+	  job.pid = rpm_load(self->opt_, *db, job.path.c_str(), info,
+			     &job.transfer->rurl_.csum);
+	} catch (std::exception &e) {
+	  job.error = e.what();
+	  failed = true;
+	}
+      }
+      self->results_->push(job);
+    }
+  }
+
+  bool
+  rpm_downloader::splice_source(const rpm_url &rurl, std::string &cached_path,
+				std::vector<unsigned char> &header_hash)
+  {
+    if (rurl.header_end == 0 || rurl.csum.length == checksum::no_length
+	|| rurl.header_end >= rurl.csum.length) {
+      return false;
+    }
+    std::vector<database::package_representation> reps;
+    db_.package_representations(rurl.info, reps);
+    for (std::vector<database::package_representation>::const_iterator
+	   p = reps.begin(), end = reps.end(); p != end; ++p) {
+      checksum csum;
+      csum.value = p->digest;
+      csum.length = p->length;
+      csum.type = p->digest.size() == 20 ? hash_sink::sha1 : hash_sink::sha256;
+      if (fcache_->lookup_path(csum, cached_path)) {
+	header_hash = p->hash;
 	return true;
-      } else if (!fcache_->lookup_path(rurl.csum, rpm_path)) {
-	if (opt_.output != symboldb_options::quiet) {
-	  if (rurl.csum.length != checksum::no_length) {
+      }
+    }
+    return false;
+  }
+
+  bool
+  rpm_downloader::splice(const rpm_url &rurl,
+			 const std::vector<unsigned char> &header,
+			 const std::string &cached_path,
+			 const std::vector<unsigned char> &header_hash,
+			 std::string &rpm_path)
+  {
+    try {
+      if (header.size() != rurl.header_end) {
+	return false;
+      }
+      mmap_handle cached;
+      cached.map_read_only(cached_path.c_str());
+      file_cache::add_sink sink(*fcache_, rurl.csum);
+      if (!rpm_splice(header, cached.data(), cached.size(), header_hash,
+		      rurl.csum.length, sink)) {
+	return false;
+      }
+      sink.finish(rpm_path);
+    } catch (file_cache::checksum_mismatch &e) {
+      fprintf(stderr, "warning: checksum mismatch for %s: %s\n",
+	      rurl.href.c_str(), e.what());
+      return false;
+    } catch (os_exception &e) {
+      fprintf(stderr, "warning: %s\n", e.what());
+      return false;
+    }
+    if (opt_.output != symboldb_options::quiet) {
+      fprintf(stderr, "info: reused payload for %s (%llu header bytes)\n",
+	      rurl.href.c_str(), rurl.header_end);
+    }
+    return true;
+  }
+
+  rpm_transfer::rpm_transfer(rpm_downloader &downloader, const rpm_url &rurl)
+    : downloader_(downloader), rurl_(rurl), offset_(0), mirror_(0),
+      done_(false), splicing_(false), splice_tried_(false)
+  {
+  }
+
+  sink *
+  rpm_transfer::start()
+  {
+    sink_.reset();
+    splicing_ = false;
+    try {
+      database &db(downloader_.db_);
+      lock_ = db.lock_digest(rurl_.csum.value.begin(), rurl_.csum.value.end());
+      // Another process may have loaded the package since the bulk
+      // lookup, so check again while holding the lock.
+      database::package_id pid = db.package_by_digest(rurl_.csum.value);
+      std::string rpm_path;
+      if (pid != database::package_id()) {
+	downloader_.pids_.insert(pid);
+	done_ = true;
+      } else if (downloader_.fcache_->lookup_path(rurl_.csum, rpm_path)) {
+	downloader_.complete(*this, rpm_path);
+	return NULL;
+      } else if (!splice_tried_
+		 && downloader_.splice_source(rurl_, splice_path_,
+					      splice_hash_)) {
+	splicing_ = true;
+	offset_ = 0;
+	header_.data.clear();
+	if (downloader_.opt_.output == symboldb_options::verbose) {
+	  fprintf(stderr, "info: fetching headers of %s (%llu bytes)\n",
+		  rurl_.href.c_str(), rurl_.header_end);
+	}
+	return &header_;
+      } else {
+	// Data from an interrupted attempt (possibly in an earlier
+	// run) is kept in a partial file and resumed.
+	sink_.reset(new file_cache::add_sink
+		    (*downloader_.fcache_, rurl_.csum, true));
+	offset_ = sink_->offset();
+	const symboldb_options &opt(downloader_.opt_);
+	if (opt.output != symboldb_options::quiet) {
+	  if (offset_ > 0) {
+	    fprintf(stderr, "info: resuming download of %s at byte %lld\n",
+		    rurl_.href.c_str(), offset_);
+	  } else if (rurl_.csum.length != checksum::no_length) {
 	    fprintf(stderr, "info: downloading %s (%llu bytes)\n",
-		    rurl.href.c_str(), rurl.csum.length);
+		    rurl_.href.c_str(), rurl_.csum.length);
 	  } else {
-	    fprintf(stderr, "info: downloading %s\n", rurl.href.c_str());
+	    fprintf(stderr, "info: downloading %s\n", rurl_.href.c_str());
 	  }
 	}
-	file_cache::add_sink sink(*fcache_, rurl.csum);
-	download(dopts_no_cache_, db_, rurl.href.c_str(), &sink);
-	sink.finish(rpm_path);
-	++count_;
+	return sink_.get();
       }
-
-      if (load_) {
-	rpm_package_info info;
-	database::package_id pid = rpm_load(opt_, db_, rpm_path.c_str(), info,
-					    &rurl.csum);
-	if (pid == database::package_id()) {
-	  return false;
-	}
-	pids_.insert(pid);
-      }
-      return true;
-    } catch (curl_exception &e) {
-      dump("error: ", e, stderr);
-      return false;
     } catch (file_cache::unsupported_hash &e) {
       fprintf(stderr, "error: unsupported hash for %s: %s\n",
-	      rurl.href.c_str(), e.what());
+	      rurl_.href.c_str(), e.what());
+    }
+    lock_.reset();
+    return NULL;
+  }
+
+  long long
+  rpm_transfer::resume_offset()
+  {
+    return offset_;
+  }
+
+  long long
+  rpm_transfer::range_end()
+  {
+    if (splicing_) {
+      return rurl_.header_end - 1;
+    }
+    return -1;
+  }
+
+  void
+  rpm_transfer::select_urls(std::vector<std::string> &urls)
+  {
+    // Each attempt goes to the currently preferred mirror, so a
+    // failed attempt is retried on a different mirror if possible.
+    // The next mirrors are used while the preferred one is busy.
+    // The transfer limit prevents more than CANDIDATES - 1 mirrors
+    // from being saturated at the same time, so further mirrors
+    // would never be selected.
+    if (rurl_.mirrors) {
+      curl_multi_fetch::limits limits(downloader_.opt_.download_limits());
+      size_t candidates = limits.transfers / limits.per_host + 1;
+      rurl_.mirrors->ranking(ranking_);
+      if (ranking_.size() > candidates) {
+	ranking_.resize(candidates);
+      }
+      urls.clear();
+      for (std::vector<size_t>::const_iterator
+	     p = ranking_.begin(), end = ranking_.end(); p != end; ++p) {
+	urls.push_back(rurl_.mirrors->url(*p) + rurl_.path);
+      }
+    }
+  }
+
+  void
+  rpm_transfer::url_selected(size_t index)
+  {
+    if (rurl_.mirrors) {
+      mirror_ = ranking_.at(index);
+    }
+  }
+
+  bool
+  rpm_transfer::finished(const curl_fetch_result &r)
+  {
+    std::string rpm_path;
+    if (splicing_) {
+      splice_tried_ = true;
+      if (downloader_.splice(rurl_, header_.data, splice_path_, splice_hash_,
+			     rpm_path)) {
+	splicing_ = false;
+	++downloader_.count_;
+	downloader_.complete(*this, rpm_path);
+	return true;
+      }
+      lock_.reset();
       return false;
+    }
+    try {
+      sink_->finish(rpm_path);
     } catch (file_cache::checksum_mismatch &e) {
       fprintf(stderr, "error: checksum mismatch for %s: %s\n",
-	      rurl.href.c_str(), e.what());
+	      rurl_.href.c_str(), e.what());
+      if (rurl_.mirrors) {
+	rurl_.mirrors->failure(mirror_);
+      }
+      sink_.reset();
+      lock_.reset();
+      return false;
+    }
+    if (rurl_.mirrors) {
+      rurl_.mirrors->success(mirror_, r.download_speed);
+    }
+    sink_.reset();
+    ++downloader_.count_;
+    downloader_.complete(*this, rpm_path);
+    return true;
+  }
+
+  void
+  rpm_transfer::failed(const curl_exception &e, bool retry)
+  {
+    if (splicing_) {
+      // Servers which do not support range requests end up here.
+      splice_tried_ = true;
+      if (downloader_.opt_.output == symboldb_options::verbose) {
+	dump("info: ", e, stderr);
+      }
+      lock_.reset();
+      return;
+    }
+    dump(retry ? "warning: " : "error: ", e, stderr);
+    if (rurl_.mirrors) {
+      rurl_.mirrors->failure(mirror_);
+    }
+    if (offset_ > 0 && (e.status() == 200 || e.status() == 416)) {
+      // The server ignored or rejected the range request, so the
+      // next attempt has to start from the beginning.
+      sink_->discard();
+    }
+    sink_.reset();
+    lock_.reset();
+  }
+
+  bool
+  rpm_transfer::restart()
+  {
+    // A failed splice falls back to a full download.
+    if (splicing_) {
+      splicing_ = false;
+      return true;
+    }
+    return false;
+  }
+
+  //////////////////////////////////////////////////////////////////////
+  // Repository state
+
+  // Records the revision and the primary.xml checksum of the
+  // repository, and the package name filter.
+  database::package_set_repository
+  repository_state(const symboldb_options &opt, const char *url,
+		   const repomd &rp)
+  {
+    database::package_set_repository state;
+    state.url = url;
+    state.revision = rp.revision;
+    state.exclude_name = opt.exclude_name_regexp();
+    for (std::vector<repomd::entry>::const_iterator p = rp.entries.begin(),
+	   end = rp.entries.end(); p != end; ++p) {
+      if (p->type == "primary" && ends_with(p->href, ".xml.gz")) {
+	state.primary_digest = p->checksum.value;
+	break;
+      }
+    }
+    return state;
+  }
+
+  struct url_less {
+    bool operator()(const database::package_set_repository &a,
+		    const database::package_set_repository &b) const
+    {
+      return a.url < b.url;
+    }
+  };
+
+  struct same_url {
+    bool operator()(const database::package_set_repository &a,
+		    const database::package_set_repository &b) const
+    {
+      return a.url == b.url;
+    }
+  };
+
+  // Returns true if both (sorted) vectors describe the same
+  // repository revisions, with the same package name filter.
+  bool
+  same_repositories(const std::vector<database::package_set_repository> &a,
+		    const std::vector<database::package_set_repository> &b)
+  {
+    if (a.size() != b.size()) {
       return false;
     }
+    for (size_t i = 0, end = a.size(); i < end; ++i) {
+      if (a[i].url != b[i].url || a[i].revision != b[i].revision
+	  || a[i].primary_digest != b[i].primary_digest
+	  || a[i].exclude_name != b[i].exclude_name) {
+	return false;
+      }
+    }
+    return true;
   }
 }
 
@@ -193,15 +710,45 @@ symboldb_download_repo(const symboldb_options &opt, database &db,
     }
   }
 
+  // Fetching repomd.xml is cheap.  If no repository of the package
+  // set has changed since the last update, nothing else needs to be
+  // done.
+  std::vector<repomd> repos;
+  std::vector<database::package_set_repository> states;
+  for (char **p = argv; *p; ++p) {
+    const char *url = *p;
+    repos.push_back(repomd());
+    repomd &rp(repos.back());
+    rp.acquire(opt.download(), db, url);
+    states.push_back(repository_state(opt, url, rp));
+  }
+  std::sort(states.begin(), states.end(), url_less());
+  states.erase(std::unique(states.begin(), states.end(), same_url()),
+	       states.end());
+  if (load && set != database::package_set_id()) {
+    std::vector<database::package_set_repository> recorded;
+    db.package_set_repositories(set, recorded);
+    if (same_repositories(states, recorded)) {
+      if (opt.output != symboldb_options::quiet) {
+	fprintf(stderr, "info: repositories of package set %s unchanged\n",
+		opt.set_name.c_str());
+      }
+      return 0;
+    }
+  }
+
   package_set_consolidator<rpm_url> pset;
 
-  for (; *argv; ++ argv) {
-    const char *url = *argv;
+  for (size_t i = 0; argv[i]; ++i) {
+    const char *url = argv[i];
     if (opt.output != symboldb_options::quiet) {
       fprintf(stderr, "info: processing repository %s\n", url);
     }
-    repomd rp;
-    rp.acquire(opt.download(), db, url);
+    const repomd &rp(repos.at(i));
+    if (opt.output != symboldb_options::quiet && rp.mirrors->size() > 1) {
+      fprintf(stderr, "info: using %zu mirrors, starting with %s\n",
+	      rp.mirrors->size(), rp.base_url.c_str());
+    }
     repomd::primary_xml primary_xml(rp, opt.download_always_cache(), db);
     repomd::primary primary(&primary_xml, rp.base_url.c_str());
     while (primary.next()) {
@@ -209,6 +756,12 @@ symboldb_download_repo(const symboldb_options &opt, database &db,
       rurl.name = primary.info().name;
       rurl.href = primary.href();
       rurl.csum = primary.checksum();
+      rurl.info = primary.info();
+      rurl.header_end = primary.header_end();
+      if (rurl.href.compare(0, rp.base_url.size(), rp.base_url) == 0) {
+	rurl.mirrors = rp.mirrors;
+	rurl.path = rurl.href.substr(rp.base_url.size());
+      }
       pset.add(primary.info(), rurl);
     }
   }
@@ -232,7 +785,15 @@ symboldb_download_repo(const symboldb_options &opt, database &db,
   }
 
   {
-    database_filter filter(opt, db, pids);
+    std::vector<std::vector<unsigned char> > digests;
+    digests.reserve(urls.size());
+    for (std::vector<rpm_url>::const_iterator p = urls.begin(),
+	   end = urls.end(); p != end; ++p) {
+      digests.push_back(p->csum.value);
+    }
+    database::package_digest_map known;
+    db.packages_by_digests(digests, known);
+    database_filter filter(opt, known, pids);
     std::vector<rpm_url>::iterator p = std::remove_if
       (urls.begin(), urls.end(), filter);
     urls.erase(p, urls.end());
@@ -245,20 +806,14 @@ symboldb_download_repo(const symboldb_options &opt, database &db,
 
   {
     size_t start_count = urls.size();
-    size_t download_count = 0;
-    download_filter filter(opt, db, pids, download_count, load);
-    for (unsigned iteration = 1;
-	 iteration <= 3 && !urls.empty(); ++iteration) {
-      if (opt.randomize) {
-	std::random_shuffle(urls.begin(), urls.end());
-      }
-      std::vector<rpm_url>::iterator p = std::remove_if
-	(urls.begin(), urls.end(), filter);
-      urls.erase(p, urls.end());
+    if (opt.randomize) {
+      std::random_shuffle(urls.begin(), urls.end());
     }
+    rpm_downloader downloader(opt, db, pids, load);
+    downloader.run(urls);
     if (opt.output != symboldb_options::quiet) {
       fprintf(stderr, "info: downloaded %zu of %zu packages\n",
-	      download_count, start_count);
+	      downloader.count_, start_count);
     }
   }
 
@@ -282,15 +837,11 @@ symboldb_download_repo(const symboldb_options &opt, database &db,
   }
 
   if (do_pset_update) {
-    db.txn_begin();
-    {
-      database::advisory_lock lock
-	(db.lock(database::PACKAGE_SET_LOCK_TAG, set.value()));
-      if (db.update_package_set(set, pids.begin(), pids.end())) {
-	finalize_package_set(opt, db, set);
-      }
-    }
-    db.txn_commit();
+    std::vector<database::package_id> members(pids.begin(), pids.end());
+    // After ignored download errors, the set is incomplete, and the
+    // next run has to try again.
+    replace_package_set(opt, db, set, members,
+			urls.empty() ? &states : NULL);
   }
 
   return 0;
@@ -305,3 +856,15 @@ finalize_package_set(const symboldb_options &opt, database &db,
   }
   db.update_package_set_caches(set);
 }
+
+bool
+replace_package_set
+  (const symboldb_options &opt, database &db, database::package_set_id set,
+   const std::vector<database::package_id> &pids,
+   const std::vector<database::package_set_repository> *repos)
+{
+  if (opt.output != symboldb_options::quiet) {
+    fprintf(stderr, "info: updating package set and caches\n");
+  }
+  return db.replace_package_set(set, pids, repos);
+}
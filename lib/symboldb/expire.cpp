@@ -28,6 +28,34 @@
 
 using namespace cxxll;
 
+// Partial downloads which have not been resumed for this many seconds
+// are discarded.
+static const unsigned partial_max_age = 7 * 24 * 60 * 60;
+
+// Removes the files in CACHE (located at PATH) whose digests do not
+// occur in REFERENCED (which must be sorted), and stale partial
+// files.
+static void
+expire_file_cache(file_cache &cache, const std::string &path,
+		  const std::vector<std::vector<unsigned char> > &referenced)
+{
+  typedef std::vector<std::vector<unsigned char> > digvec;
+  digvec fcdigests;
+  cache.digests(fcdigests);
+  std::sort(fcdigests.begin(), fcdigests.end());
+  digvec result;
+  std::set_difference(fcdigests.begin(), fcdigests.end(),
+		      referenced.begin(), referenced.end(),
+		      std::back_inserter(result));
+  fd_handle dir;
+  dir.open_directory(path.c_str());
+  for (digvec::iterator p = result.begin(), end = result.end();
+       p != end; ++p) {
+    dir.unlinkat(base16_encode(p->begin(), p->end()).c_str(), 0);
+  }
+  cache.expire_partial(partial_max_age);
+}
+
 void
 expire(const symboldb_options &opt, database &db)
 {
@@ -46,26 +74,27 @@ expire(const symboldb_options &opt, database &db)
   }
   db.expire_java_classes();
 
+  if (opt.output != symboldb_options::quiet) {
+    fprintf(stderr, "info: expiring RPM capabilities\n");
+  }
+  db.expire_rpm_capabilities();
+
   if (opt.output != symboldb_options::quiet) {
     fprintf(stderr, "info: expiring unused RPMs\n");
   }
   {
-    typedef std::vector<std::vector<unsigned char> > digvec;
-    std::tr1::shared_ptr<file_cache> fcache(opt.rpm_cache());
-    digvec fcdigests;
-    fcache->digests(fcdigests);
-    std::sort(fcdigests.begin(), fcdigests.end());
-    digvec dbdigests;
+    std::vector<std::vector<unsigned char> > dbdigests;
     db.referenced_package_digests(dbdigests);
-    digvec result;
-    std::set_difference(fcdigests.begin(), fcdigests.end(),
-			dbdigests.begin(), dbdigests.end(),
-			std::back_inserter(result));
-    fd_handle dir;
-    dir.open_directory(opt.rpm_cache_path().c_str());
-    for (digvec::iterator p = result.begin(), end = result.end();
-	 p != end; ++p) {
-      dir.unlinkat(base16_encode(p->begin(), p->end()).c_str(), 0);
-    }
+    expire_file_cache(*opt.rpm_cache(), opt.rpm_cache_path(), dbdigests);
+  }
+
+  if (opt.output != symboldb_options::quiet) {
+    fprintf(stderr, "info: expiring URL cache\n");
+  }
+  db.expire_url_cache();
+  {
+    std::vector<std::vector<unsigned char> > dbdigests;
+    db.url_cache_digests(dbdigests);
+    expire_file_cache(*opt.url_cache(), opt.url_cache_path(), dbdigests);
   }
 }
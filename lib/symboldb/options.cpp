@@ -21,11 +21,96 @@
 #include <cxxll/regex_handle.hpp>
 #include <cxxll/string_support.hpp>
 
+#include <cerrno>
+#include <cstdlib>
+
 using namespace cxxll;
 
+namespace {
+  // Symbols which are defined by many shared objects because they
+  // come from the toolchain or from plugin interfaces.
+  const char *const default_ignored_symbols[] = {
+    "_init",
+    "_fini",
+    "__bss_start",
+    "_edata",
+    "_end",
+    "crtstuff\\.c",
+    "deregister_tm_clones",
+    "__do_global_dtors_aux",
+    "__do_global_dtors_aux_fini_array_entry",
+    "__dso_handle",
+    "_DYNAMIC",
+    "kde_plugin_verification_data",
+    "qt_plugin_instance",
+    "qt_plugin_query_verification_data",
+    "__TMC_END__",
+    "__x86\\.get_pc_thunk\\.(bx|cx)",
+    "register_tm_clones",
+    "gst_plugin_desc",
+    "frame_dummy",
+    "__FRAME_END__",
+    "__frame_dummy_init_array_entry",
+    "_GLOBAL_OFFSET_TABLE_",
+    "__JCR_END__",
+    "__JCR_LIST__",
+    "kde_plugin_version",
+    "kdemain",
+    NULL
+  };
+
+  const char default_symbol_collision_path[] =
+    "^/usr/lib(|64)/[^/]*\\.so[^/]*$";
+
+  void
+  check_regexp(const char *option, const char *pattern)
+  {
+    try {
+      static_cast<void>(regex_handle(pattern));
+    } catch (regex_handle::error &e) {
+      throw symboldb_options::usage_error
+	(std::string("invalid ") + option + " regexp \"" + quote(pattern)
+	 + "\": " + e.what());
+    }
+  }
+
+  unsigned
+  parse_count(const char *option, const char *arg)
+  {
+    char *end;
+    errno = 0;
+    unsigned long value = strtoul(arg, &end, 10);
+    if (arg[0] < '0' || arg[0] > '9' || *end != '\0' || errno != 0
+	|| value == 0 || value > 1000) {
+      throw symboldb_options::usage_error
+	(std::string("invalid ") + option + " argument: " + quote(arg));
+    }
+    return value;
+  }
+
+  // Combines the expressions so that the result matches the strings
+  // which are completely matched by one of them.
+  void
+  combine_regexps(std::string &regexp, const std::vector<std::string> &parts)
+  {
+    for (std::vector<std::string>::const_iterator
+	   p = parts.begin(), end = parts.end(); p != end; ++p) {
+      if (!regexp.empty()) {
+	regexp += '|';
+      }
+      regexp += '(';
+      regexp += *p;
+      regexp += ')';
+    }
+  }
+}
+
 symboldb_options::symboldb_options()
-  : output(standard), no_net(false), ignore_download_errors(false),
-    randomize(false)
+  : symbol_collision_path_(default_symbol_collision_path),
+    output(standard), no_net(false), ignore_download_errors(false),
+    randomize(false), download_jobs(4), connections_per_host(2),
+    load_jobs(1),
+    default_ignore_symbols(true), sort_report(false), json_report(false)
 {
 }
 
@@ -36,34 +121,25 @@ symboldb_options::~symboldb_options()
 void
 symboldb_options::add_exclude_name(const char *pattern)
 {
-  try {
-    static_cast<void>(regex_handle(pattern));
-  } catch (regex_handle::error &e) {
-    throw usage_error("invalid --exclude-name regexp \"" + quote(pattern)
-		      + "\": " + e.what());
-  }
+  check_regexp("--exclude-name", pattern);
   exclude_names_.push_back(pattern);
 }
 
 regex_handle
 symboldb_options::exclude_name() const
 {
-  std::string regexp("^(");
-  bool first = true;
-  for (std::vector<std::string>::const_iterator
-	 p = exclude_names_.begin(), end = exclude_names_.end();
-       p != end; ++p) {
-    if (first) {
-      first = false;
-    } else {
-      regexp += '|';
-    }
-    regexp += '(';
-    regexp += *p;
-    regexp += ')';
+  return regex_handle(exclude_name_regexp().c_str());
+}
+
+std::string
+symboldb_options::exclude_name_regexp() const
+{
+  if (exclude_names_.empty()) {
+    return std::string();
   }
-  regexp += ")$";
-  return regex_handle(regexp.c_str());
+  std::string regexp;
+  combine_regexps(regexp, exclude_names_);
+  return "^(" + regexp + ")$";
 }
 
 bool
@@ -72,6 +148,69 @@ symboldb_options::exclude_name_present() const
   return !exclude_names_.empty();
 }
 
+void
+symboldb_options::add_ignore_symbol(const char *pattern)
+{
+  check_regexp("--ignore-symbol", pattern);
+  ignore_symbols_.push_back(pattern);
+}
+
+regex_handle
+symboldb_options::ignore_symbol() const
+{
+  std::vector<std::string> parts;
+  if (default_ignore_symbols) {
+    parts.assign(default_ignored_symbols,
+		 default_ignored_symbols
+		 + sizeof(default_ignored_symbols)
+		 / sizeof(default_ignored_symbols[0]) - 1);
+  }
+  parts.insert(parts.end(), ignore_symbols_.begin(), ignore_symbols_.end());
+  std::string regexp;
+  combine_regexps(regexp, parts);
+  return regex_handle(("^(" + regexp + ")$").c_str());
+}
+
+void
+symboldb_options::set_symbol_collision_path(const char *pattern)
+{
+  check_regexp("--symbol-collision-path", pattern);
+  symbol_collision_path_ = pattern;
+}
+
+regex_handle
+symboldb_options::symbol_collision_path() const
+{
+  return regex_handle(symbol_collision_path_.c_str());
+}
+
+void
+symboldb_options::set_download_jobs(const char *arg)
+{
+  download_jobs = parse_count("--download-jobs", arg);
+}
+
+void
+symboldb_options::set_connections_per_host(const char *arg)
+{
+  connections_per_host = parse_count("--connections-per-host", arg);
+}
+
+void
+symboldb_options::set_load_jobs(const char *arg)
+{
+  load_jobs = parse_count("--load-jobs", arg);
+}
+
+curl_multi_fetch::limits
+symboldb_options::download_limits() const
+{
+  curl_multi_fetch::limits limits;
+  limits.transfers = download_jobs;
+  limits.per_host = connections_per_host;
+  return limits;
+}
+
 download_options
 symboldb_options::download() const
 {
@@ -79,6 +218,7 @@ symboldb_options::download() const
   if (no_net) {
     d.cache_mode = download_options::only_cache;
   }
+  d.cache = url_cache();
   return d;
 }
 
@@ -93,11 +233,12 @@ symboldb_options::download_always_cache() const
   } else {
     d.cache_mode = download_options::always_cache;
   }
+  d.cache = url_cache();
   return d;
 }
 
-std::string
-symboldb_options::rpm_cache_path() const
+static std::string
+cache_subdirectory(const std::string &cache_path, const char *name)
 {
   std::string path;
   if (cache_path.empty()) {
@@ -106,18 +247,43 @@ symboldb_options::rpm_cache_path() const
   } else {
     path = cache_path;
   }
-  path += "/rpms";
+  path += '/';
+  path += name;
   return path;
 }
 
+static std::tr1::shared_ptr<file_cache>
+open_file_cache(const std::string &path)
+{
+  if (!make_directory_hierarchy(path.c_str(), 0700)) {
+    throw symboldb_options::usage_error
+      ("could not create cache directory: " + path);
+  }
+  return std::tr1::shared_ptr<file_cache>(new file_cache(path.c_str()));
+}
+
+std::string
+symboldb_options::rpm_cache_path() const
+{
+  return cache_subdirectory(cache_path, "rpms");
+}
+
 std::tr1::shared_ptr<file_cache>
 symboldb_options::rpm_cache() const
 {
-  std::string fcache_path(rpm_cache_path());
-  if (!make_directory_hierarchy(fcache_path.c_str(), 0700)) {
-    throw usage_error("could not create cache directory: " + rpm_cache_path());
-  }
-  return std::tr1::shared_ptr<file_cache>(new file_cache(fcache_path.c_str()));
+  return open_file_cache(rpm_cache_path());
+}
+
+std::string
+symboldb_options::url_cache_path() const
+{
+  return cache_subdirectory(cache_path, "urls");
+}
+
+std::tr1::shared_ptr<file_cache>
+symboldb_options::url_cache() const
+{
+  return open_file_cache(url_cache_path());
 }
 
 //////////////////////////////////////////////////////////////////////
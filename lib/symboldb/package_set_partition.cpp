@@ -0,0 +1,171 @@
+/*
+ * Copyright (C) 2013 Red Hat, Inc.
+ * Written by Florian Weimer <fweimer@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <symboldb/package_set_partition.hpp>
+#include <cxxll/pgresult_handle.hpp>
+#include <cxxll/pg_exception.hpp>
+#include <cxxll/pg_query.hpp>
+
+#include <stdio.h>
+
+using namespace cxxll;
+
+namespace {
+  // Returns the unqualified name of the partition.
+  std::string
+  partition_name(const char *parent, database::package_set_id id)
+  {
+    char buf[32];
+    snprintf(buf, sizeof(buf), "_%d", id.value());
+    return parent + std::string(buf);
+  }
+
+  // Runs the SQL command, discarding its result.
+  void
+  exec_sql(pgconn_handle &conn, const std::string &sql)
+  {
+    pgresult_handle res;
+    res.exec(conn, sql.c_str());
+  }
+
+  // Creates the table symboldb.NAME, with the columns of PARENT and
+  // the set_id constraint, but without indexes.
+  void
+  create_table(pgconn_handle &conn, const char *parent,
+	       database::package_set_id id, const std::string &name)
+  {
+    char check[64];
+    snprintf(check, sizeof(check), "CHECK (set_id = %d)", id.value());
+    exec_sql(conn, "CREATE TABLE symboldb." + name
+	     + " (LIKE symboldb." + parent + ", " + check + ")");
+  }
+
+  // Creates the indexes on symboldb.NAME.  The index names are
+  // derived from PREFIX.
+  void
+  create_indexes(pgconn_handle &conn, const std::string &name,
+		 const std::string &prefix, const char *const *indexed)
+  {
+    for (; *indexed; ++indexed) {
+      exec_sql(conn, "CREATE INDEX " + prefix + "_" + *indexed
+	       + " ON symboldb." + name + " (" + *indexed + ")");
+    }
+  }
+}
+
+std::string
+package_set_partition_create(pgconn_handle &conn, const char *parent,
+			     database::package_set_id id)
+{
+  std::string next(partition_name(parent, id) + "_next");
+  exec_sql(conn, "DROP TABLE IF EXISTS symboldb." + next);
+  create_table(conn, parent, id, next);
+  return "symboldb." + next;
+}
+
+void
+package_set_partition_replace(pgconn_handle &conn, const char *parent,
+			      database::package_set_id id,
+			      const char *const *indexed)
+{
+  // The new table is loaded and indexed before the old one is
+  // dropped, so that concurrent readers are blocked only briefly.
+  std::string name(partition_name(parent, id));
+  std::string next(name + "_next");
+  create_indexes(conn, next, next, indexed);
+  exec_sql(conn, "ANALYZE symboldb." + next);
+
+  // DROP TABLE and ALTER TABLE ... INHERIT take ACCESS EXCLUSIVE
+  // locks, including one on the parent table, which are held until
+  // the end of the transaction.  While the swap waits behind a
+  // long-running reader of the parent table, all other readers queue
+  // behind the swap.  Therefore, the swap gives up after a short lock
+  // timeout and is retried from a savepoint, letting the queued
+  // readers proceed in between.  The final attempt waits without a
+  // timeout.
+  pgresult_handle res;
+  res.exec(conn, "SELECT current_setting('lock_timeout')");
+  std::string lock_timeout(res.getvalue(0, 0));
+  const unsigned attempts = 5;
+  for (unsigned attempt = 1; ; ++attempt) {
+    exec_sql(conn, "SAVEPOINT partition_swap");
+    if (attempt < attempts) {
+      exec_sql(conn, "SET LOCAL lock_timeout = '2s'");
+    }
+    try {
+      exec_sql(conn, "DROP TABLE IF EXISTS symboldb." + name);
+      exec_sql(conn, "ALTER TABLE symboldb." + next + " RENAME TO " + name);
+      for (const char *const *p = indexed; *p; ++p) {
+	exec_sql(conn, "ALTER INDEX symboldb." + next + "_" + *p
+		 + " RENAME TO " + name + "_" + *p);
+      }
+      exec_sql(conn, "ALTER TABLE symboldb." + name
+	       + " INHERIT symboldb." + parent);
+    } catch (pg_exception &e) {
+      // 55P03 is lock_not_available.
+      if (attempt == attempts || e.sqlstate_ != "55P03") {
+	throw;
+      }
+      exec_sql(conn, "ROLLBACK TO SAVEPOINT partition_swap");
+      exec_sql(conn, "RELEASE SAVEPOINT partition_swap");
+      continue;
+    }
+    exec_sql(conn, "RELEASE SAVEPOINT partition_swap");
+    break;
+  }
+  // SET LOCAL survives RELEASE SAVEPOINT.
+  pg_query(conn, res, "SELECT set_config('lock_timeout', $1, TRUE)",
+	   lock_timeout);
+}
+
+std::string
+package_set_partition_ensure(pgconn_handle &conn, const char *parent,
+			     database::package_set_id id,
+			     const char *const *indexed)
+{
+  std::string name(partition_name(parent, id));
+  pgresult_handle res;
+  pg_query_binary(conn, res,
+		  "SELECT 1 FROM pg_tables"
+		  " WHERE schemaname = 'symboldb' AND tablename = $1",
+		  name);
+  if (res.ntuples() == 0) {
+    create_table(conn, parent, id, name);
+    create_indexes(conn, name, name, indexed);
+    exec_sql(conn, "ALTER TABLE symboldb." + name
+	     + " INHERIT symboldb." + parent);
+  }
+  return "symboldb." + name;
+}
+
+void
+package_set_delta_ids(const database::package_set_delta &delta,
+		      std::vector<int> &removed, std::vector<int> &added)
+{
+  removed.clear();
+  for (std::vector<database::package_id>::const_iterator
+	 p = delta.removed.begin(), end = delta.removed.end(); p != end; ++p) {
+    removed.push_back(p->value());
+  }
+  added.clear();
+  for (std::vector<database::package_id>::const_iterator
+	 p = delta.added.begin(), end = delta.added.end(); p != end; ++p) {
+    added.push_back(p->value());
+  }
+}
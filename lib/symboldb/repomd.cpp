@@ -23,8 +23,13 @@
 #include <cxxll/expat_minidom.hpp>
 #include <cxxll/string_support.hpp>
 #include <cxxll/curl_exception.hpp>
+#include <cxxll/curl_exception_dump.hpp>
+#include <cxxll/hash.hpp>
+#include <cxxll/metalink.hpp>
+#include <cxxll/mirror_set.hpp>
 
 #include <cerrno>
+#include <cstdio>
 #include <cstdlib>
 
 using namespace cxxll;
@@ -136,23 +141,79 @@ repomd::parse(const unsigned char *buffer, size_t length,
   return true;
 }
 
+namespace {
+  const char metalink_prefix[] = "metalink=";
+  const char mirrorlist_prefix[] = "mirrorlist=";
+  const char repomd_path[] = "repodata/repomd.xml";
+}
+
 void
 repomd::acquire(const download_options &opt, database &db, const char *url)
 {
-  std::string base_canon(url);
-  if (!base_canon.empty() && base_canon.at(base_canon.size() - 1) != '/') {
-    base_canon += '/';
+  std::string spec(url);
+  std::tr1::shared_ptr<mirror_set> ms(new mirror_set);
+  checksum expected;		// from the metalink, if any
+  if (starts_with(spec, metalink_prefix)) {
+    std::string mlurl(spec.substr(sizeof(metalink_prefix) - 1));
+    std::vector<unsigned char> data;
+    download(opt, db, mlurl.c_str(), data);
+    metalink ml;
+    std::string error;
+    if (!ml.parse(data.data(), data.size(), error)) {
+      throw curl_exception(error.c_str()).url(mlurl);
+    }
+    for (std::vector<std::string>::const_iterator p = ml.urls.begin(),
+	   end = ml.urls.end(); p != end; ++p) {
+      if (ends_with(*p, repomd_path)) {
+	ms->add(p->substr(0, p->size() - (sizeof(repomd_path) - 1)));
+      }
+    }
+    expected = ml.csum;
+  } else if (starts_with(spec, mirrorlist_prefix)) {
+    std::string mlurl(spec.substr(sizeof(mirrorlist_prefix) - 1));
+    std::vector<unsigned char> data;
+    download(opt, db, mlurl.c_str(), data);
+    ms->add_mirrorlist(data);
+  } else {
+    ms->add(spec);
   }
-  std::string mdurl(base_canon);
-  mdurl += "repodata/repomd.xml";
-  std::vector<unsigned char> data;
-  download(opt, db, mdurl.c_str(), data);
-  if (data.empty()) {
-    throw curl_exception("empty document").url(url);
+  if (ms->size() == 0) {
+    throw curl_exception("no mirrors found").url(url);
   }
-  std::string error;		// FIXME
-  if (!parse(data.data(), data.size(), error)) {
-    return throw curl_exception(error.c_str()).url(url);
+
+  // Try the mirrors in order of preference.  A mirror which serves a
+  // repomd.xml file which does not match the metalink is stale.
+  for (size_t i = 0; ; ++i) {
+    const std::string &base(ms->url(i));
+    std::string mdurl(base);
+    mdurl += repomd_path;
+    try {
+      std::vector<unsigned char> data;
+      download(opt, db, mdurl.c_str(), data);
+      if (data.empty()) {
+	throw curl_exception("empty document").url(mdurl);
+      }
+      if (!expected.value.empty()
+	  && ((expected.length != checksum::no_length
+	       && expected.length != data.size())
+	      || hash(expected.type, data) != expected.value)) {
+	throw curl_exception("repomd.xml does not match metalink")
+	  .url(mdurl);
+      }
+      std::string error;
+      if (!parse(data.data(), data.size(), error)) {
+	throw curl_exception(error.c_str()).url(mdurl);
+      }
+    } catch (curl_exception &e) {
+      ms->failure(i);
+      if (i + 1 == ms->size()) {
+	throw;
+      }
+      dump("warning: ", e, stderr);
+      continue;
+    }
+    base_url = base;
+    mirrors = ms;
+    return;
   }
-  base_url.swap(base_canon);
 }
@@ -30,6 +30,7 @@ struct repomd::primary::impl {
   rpm_package_info info_;
   std::string href_;
   cxxll::checksum checksum_;
+  unsigned long long header_end_;
 
   impl(source *src, const char *base_url)
     : source_(src), base_url_(base_url)
@@ -55,6 +56,7 @@ struct repomd::primary::impl {
     checksum_.type = hash_sink::sha256;
     checksum_.value.clear();
     checksum_.length = checksum::no_length;
+    header_end_ = 0;
   }
 
   void validate()
@@ -83,6 +85,12 @@ struct repomd::primary::impl {
 
     while (true) {
       if (source_.state() == expat_source::END) {
+	// Read the rest of the document, so that the underlying source
+	// reaches the end of the stream (and can verify its checksum).
+	while (source_.next())
+	  ;
+	return false;
+      } else if (source_.state() == expat_source::EOD) {
 	return false;
       } else if (source_.state() == expat_source::START
 		 && source_.name() == "package") {
@@ -183,6 +191,12 @@ struct repomd::primary::impl {
 	source_.next();
 	info_.source_rpm = source_.text_and_next();
 	source_.unnest();
+      } else if (source_.name() == "rpm:header-range") {
+	unsigned long long end;
+	if (parse_unsigned_long_long(strip(source_.attribute("end")), end)) {
+	  header_end_ = end;
+	}
+	source_.skip();
       } else {
 	source_.skip();
       }
@@ -235,3 +249,9 @@ repomd::primary::href() const
 {
   return impl_->href_;
 }
+
+unsigned long long
+repomd::primary::header_end() const
+{
+  return impl_->header_end_;
+}
@@ -19,32 +19,202 @@
 #include <symboldb/repomd.hpp>
 #include <symboldb/download.hpp>
 #include <cxxll/memory_range_source.hpp>
+#include <cxxll/mmap_handle.hpp>
 #include <cxxll/gunzip_source.hpp>
+#include <cxxll/pipe_source.hpp>
+#include <cxxll/tee_sink.hpp>
+#include <cxxll/vector_sink.hpp>
+#include <cxxll/task.hpp>
 #include <cxxll/string_support.hpp>
 #include <cxxll/url.hpp>
 #include <cxxll/curl_exception.hpp>
+#include <cxxll/curl_fetch_result.hpp>
 #include <cxxll/base16.hpp>
 
+#include <memory>
 #include <stdexcept>
 #include <vector>
 
 using namespace cxxll;
 
+// The compressed data is either served from the URL cache, or
+// downloaded by a background task which feeds the decompressor
+// through a pipe.  In the latter case, the checksum is computed
+// while downloading and verified once the end of the data has been
+// reached.
 struct repomd::primary_xml::impl {
   std::string url_;
-  std::tr1::shared_ptr<const std::vector<unsigned char> > compressed_;
-  memory_range_source mrsource_;
-  gunzip_source gzsource_;
-
-  impl(const std::string &url,
-       std::tr1::shared_ptr<const std::vector<unsigned char> > compressed)
-    : url_(url), compressed_(compressed),
-      mrsource_(compressed_->data(), compressed_->size()),
-      gzsource_(&mrsource_)
+  download_options opt_;
+  database &db_;
+  checksum checksum_;
+
+  // Data from the URL cache.
+  mmap_handle cached_;
+  long long cached_time_;
+  std::string cached_etag_;
+
+  // Filled by the download task.
+  pipe_source pipe_;
+  hash_sink hash_;
+  vector_sink cache_;
+  long long http_time_;
+  std::string etag_;
+  bool not_modified_;
+  std::tr1::shared_ptr<curl_exception> curl_error_;
+  std::string error_;
+  std::auto_ptr<task> task_;
+
+  std::auto_ptr<memory_range_source> mrsource_;
+  std::auto_ptr<gunzip_source> gzsource_;
+  bool finished_;
+
+  impl(const std::string &url, const download_options &opt, database &db,
+       const checksum &csum)
+    : url_(url), opt_(opt), db_(db), checksum_(csum),
+      cached_time_(-1), hash_(csum.type), http_time_(-1),
+      not_modified_(false), finished_(false)
   {
   }
+
+  ~impl()
+  {
+    if (task_.get() != NULL) {
+      // Stop the download if the caller did not read all the data.
+      pipe_.abort();
+      try {
+	task_->wait();
+      } catch (...) {
+      }
+    }
+  }
+
+  void start();
+  void fetch() throw();
+  void finish();
+  void rethrow();
+  void check_digest(const std::vector<unsigned char> &digest);
 };
 
+void
+repomd::primary_xml::impl::start()
+{
+  if (opt_.cache_mode != download_options::no_cache) {
+    bool cached = download_cache_lookup
+      (opt_, db_, url_.c_str(), cached_, cached_time_, cached_etag_);
+    switch (opt_.cache_mode) {
+    case download_options::only_cache:
+    case download_options::always_cache:
+      if (cached) {
+	// The complete data is available, so check it upfront.
+	{
+	  hash_sink h(checksum_.type);
+	  h.write(cached_.data(), cached_.size());
+	  std::vector<unsigned char> digest;
+	  h.digest(digest);
+	  check_digest(digest);
+	}
+	mrsource_.reset(new memory_range_source(cached_.data(), cached_.size()));
+	gzsource_.reset(new gunzip_source(mrsource_.get()));
+	finished_ = true;
+	return;
+      }
+      if (opt_.cache_mode == download_options::only_cache) {
+	throw curl_exception("URL not in cache and network access disabled")
+	  .url(url_);
+      }
+      break;
+    case download_options::no_cache:
+    case download_options::check_cache:
+      break;
+    }
+    if (!cached || opt_.cache_mode != download_options::check_cache) {
+      // Do not send validators for the cached copy.
+      cached_.reset();
+      cached_time_ = -1;
+      cached_etag_.clear();
+    }
+  }
+  gzsource_.reset(new gunzip_source(&pipe_));
+  task_.reset(new task(std::tr1::bind(&impl::fetch, this)));
+}
+
+void
+repomd::primary_xml::impl::fetch() throw()
+{
+  pipe_source::writer writer(pipe_);
+  try {
+    tee_sink checked(&hash_, &writer);
+    tee_sink cached(&checked, &cache_);
+    sink *target = &checked;
+    if (opt_.cache_mode != download_options::no_cache) {
+      target = &cached;
+    }
+    curl_fetch_result r(target);
+    if (cached_time_ > 0) {
+      r.if_modified_since = cached_time_;
+    }
+    r.if_none_match = cached_etag_;
+    r.get(url_.c_str());
+    if (r.not_modified) {
+      checked.write(cached_.data(), cached_.size());
+    }
+    http_time_ = r.http_date;
+    etag_ = r.etag;
+    not_modified_ = r.not_modified;
+  } catch (curl_exception &e) {
+    curl_error_.reset(new curl_exception(e));
+  } catch (std::exception &e) {
+    error_ = e.what();
+  }
+  writer.close();
+}
+
+void
+repomd::primary_xml::impl::rethrow()
+{
+  if (curl_error_) {
+    throw *curl_error_;
+  }
+  if (!error_.empty()) {
+    throw std::runtime_error(error_);
+  }
+}
+
+void
+repomd::primary_xml::impl::finish()
+{
+  // The decompressor may stop before the end of the pipe, so drain
+  // it, to make sure that the checksum covers all the data.
+  unsigned char buf[4096];
+  while (pipe_.read(buf, sizeof(buf)) > 0)
+    ;
+  task_->wait();
+  task_.reset();
+  rethrow();
+  std::vector<unsigned char> digest;
+  hash_.digest(digest);
+  check_digest(digest);
+  if (opt_.cache_mode != download_options::no_cache && !not_modified_) {
+    download_cache_update(opt_, db_, url_.c_str(), cache_.data,
+			  http_time_, etag_);
+  }
+}
+
+void
+repomd::primary_xml::impl::check_digest(const std::vector<unsigned char> &digest)
+{
+  if (digest != checksum_.value) {
+    std::string msg("compressed data does not match ");
+    msg += hash_sink::to_string(checksum_.type);
+    msg += " checksum (actual ";
+    msg += base16_encode(digest.begin(), digest.end());
+    msg += ", expected ";
+    msg += base16_encode(checksum_.value.begin(), checksum_.value.end());
+    msg += ')';
+    throw curl_exception(msg.c_str()).url(url_);
+  }
+}
+
 repomd::primary_xml::primary_xml(const repomd &rp,
 				 const download_options &opt, database &db)
 {
@@ -63,23 +233,8 @@ repomd::primary_xml::primary_xml(const repomd &rp,
 	}
       }
       std::string entry_url(url_combine_yum(rp.base_url.c_str(), p->href.c_str()));
-      std::tr1::shared_ptr<std::vector<unsigned char> > compressed
-	(new std::vector<unsigned char>());
-      download(dopt, db, entry_url.c_str(), *compressed);
-      std::vector<unsigned char> digest
-	(hash(p->checksum.type, *compressed));
-      if (digest != p->checksum.value) {
-	std::string msg("compressed data does not match ");
-	msg += hash_sink::to_string(p->checksum.type);
-	msg += " checksum (actual ";
-	msg += base16_encode(digest.begin(), digest.end());
-	msg += ", expected ";
-	msg += base16_encode(p->checksum.value.begin(),
-			     p->checksum.value.end());
-	msg += ')';
-	throw curl_exception(msg.c_str());
-      }
-      impl_.reset(new impl(entry_url, compressed));
+      impl_.reset(new impl(entry_url, dopt, db, p->checksum));
+      impl_->start();
       return;
     }
   }
@@ -100,5 +255,26 @@ repomd::primary_xml::url()
 size_t
 repomd::primary_xml::read(unsigned char *buf, size_t len)
 {
-  return impl_->gzsource_.read(buf, len);
+  size_t ret;
+  try {
+    ret = impl_->gzsource_->read(buf, len);
+  } catch (...) {
+    if (!impl_->finished_) {
+      // If the download ended before the decompressor failed, the
+      // download error (if any) is the more accurate report.
+      impl_->finished_ = true;
+      bool closed = impl_->pipe_.abort();
+      impl_->task_->wait();
+      impl_->task_.reset();
+      if (closed) {
+	impl_->rethrow();
+      }
+    }
+    throw;
+  }
+  if (ret == 0 && !impl_->finished_) {
+    impl_->finished_ = true;
+    impl_->finish();
+  }
+  return ret;
 }
@@ -39,8 +39,11 @@
 #include <cxxll/java_class.hpp>
 #include <cxxll/zip_file.hpp>
 #include <cxxll/os_exception.hpp>
+#include <cxxll/symbol_bloom.hpp>
 
+#include <algorithm>
 #include <map>
+#include <memory>
 #include <sstream>
 
 #include <cassert>
@@ -48,10 +51,42 @@
 
 #include <inttypes.h>
 #include <fcntl.h>
+#include <pthread.h>
 #include <unistd.h>
 
 using namespace cxxll;
 
+namespace {
+  // rpm_load() runs on several loader threads, but librpm and libelf
+  // are not documented to be thread-safe.  All calls into them
+  // (including the destructors of rpm_parser_state and elf_image) are
+  // serialized by this lock, so that only the database writes run
+  // concurrently.
+  pthread_mutex_t parser_lock = PTHREAD_MUTEX_INITIALIZER;
+
+  struct parser_guard {
+    parser_guard()
+    {
+      pthread_mutex_lock(&parser_lock);
+    }
+    ~parser_guard()
+    {
+      pthread_mutex_unlock(&parser_lock);
+    }
+  };
+
+  // Owns an object whose destructor calls into librpm or libelf.
+  template <class T>
+  struct parser_ptr {
+    std::auto_ptr<T> ptr;
+    ~parser_ptr()
+    {
+      parser_guard guard;
+      ptr.reset();
+    }
+  };
+}
+
 static void
 dump_def(const symboldb_options &opt, database &db,
 	 database::contents_id cid, const char *elf_path,
@@ -102,66 +137,165 @@ is_elf(const std::vector<unsigned char> data)
     && data.at(3) == 'F';
 }
 
-// Loads an ELF image.
+// Encodes the ABI-relevant attributes of an exported definition for
+// the symbol fingerprint.
+static std::string
+abi_key(const elf_symbol_definition &def)
+{
+  std::string key(def.symbol_name);
+  key += '\0';
+  key += def.vda_name;
+  key += '\0';
+  key += static_cast<char>(def.type);
+  key += static_cast<char>(def.binding);
+  key += def.visibility();
+  key += '\n';
+  return key;
+}
+
+// Sorts the vector and removes duplicates.  Versioned symbols can
+// appear multiple times.
+static void
+sort_unique(std::vector<std::string> &vec)
+{
+  std::sort(vec.begin(), vec.end());
+  vec.erase(std::unique(vec.begin(), vec.end()), vec.end());
+}
+
+// Computes the serialized symbol filter over the exported names.
+static void
+symbol_filter(std::vector<std::string> &names,
+	      std::vector<unsigned char> &result)
+{
+  sort_unique(names);
+  symbol_bloom filter(names.size());
+  for (std::vector<std::string>::const_iterator
+	 p = names.begin(), end = names.end(); p != end; ++p) {
+    filter.add(*p);
+  }
+  filter.serialize(result);
+}
+
+// Computes the fingerprint of the exported ABI from the ABI keys.
+// DSOs with the same exported symbols have the same fingerprint,
+// independent of the symbol table order.
+static void
+symbol_fingerprint(std::vector<std::string> &keys,
+		   std::vector<unsigned char> &result)
+{
+  sort_unique(keys);
+  hash_sink sink(hash_sink::sha256);
+  for (std::vector<std::string>::const_iterator
+	 p = keys.begin(), end = keys.end(); p != end; ++p) {
+    sink.write(reinterpret_cast<const unsigned char *>(p->data()),
+	       p->size());
+  }
+  sink.digest(result);
+}
+
+// Loads an ELF image.  The image is parsed completely under
+// parser_lock before the results are written.
 static void
 load_elf(const symboldb_options &opt, database &db,
 	 database::contents_id cid, const rpm_file_entry &file)
 {
-  try {
-    const char *elf_path = file.info->name.c_str();
-    elf_image image(file.contents.data(), file.contents.size());
-    {
-      elf_image::symbol_range symbols(image);
-      while (symbols.next()) {
-	if (symbols.definition()) {
-	  dump_def(opt, db, cid, elf_path, *symbols.definition());
-	} else if (symbols.reference()) {
-	  dump_ref(opt, db, cid, elf_path, *symbols.reference());
-	} else {
-	  throw std::logic_error("unknown elf_symbol type");
+  typedef std::tr1::shared_ptr<elf_symbol_definition> definition_ptr;
+  typedef std::tr1::shared_ptr<elf_symbol_reference> reference_ptr;
+  typedef elf_image::dynamic_section_range::kind dynamic_kind;
+  parser_ptr<elf_image> image;
+  std::vector<definition_ptr> definitions;
+  std::vector<reference_ptr> references;
+  std::vector<std::pair<dynamic_kind, std::string> > dynamic;
+  std::string error;
+  {
+    parser_guard guard;
+    try {
+      image.ptr.reset
+	(new elf_image(file.contents.data(), file.contents.size()));
+      {
+	elf_image::symbol_range symbols(*image.ptr);
+	while (symbols.next()) {
+	  if (symbols.definition()) {
+	    definitions.push_back(symbols.definition());
+	  } else if (symbols.reference()) {
+	    references.push_back(symbols.reference());
+	  } else {
+	    throw std::logic_error("unknown elf_symbol type");
+	  }
 	}
       }
+      {
+	elf_image::dynamic_section_range dyn(*image.ptr);
+	while (dyn.next()) {
+	  dynamic.push_back(std::make_pair(dyn.type(), dyn.value()));
+	}
+      }
+    } catch (elf_exception e) {
+      error = e.what();
     }
-    std::string soname;
-    bool soname_seen = false;
-    {
-      elf_image::dynamic_section_range dyn(image);
-      while (dyn.next()) {
-	switch (dyn.type()) {
-	case elf_image::dynamic_section_range::needed:
-	  db.add_elf_needed(cid, dyn.value().c_str());
-	  break;
-	case elf_image::dynamic_section_range::soname:
-	  if (soname_seen) {
-	    // The linker ignores some subsequent sonames, but
-	    // not all of them.  Multiple sonames are rare.
-	    if (dyn.value() != soname) {
-	      std::ostringstream out;
-	      out << "duplicate soname ignored: " << dyn.value()
-		  << ", previous soname: " << soname;
-	      db.add_elf_error(cid, out.str().c_str());
-	    }
-	  } else {
-	    soname = dyn.value();
-	    soname_seen = true;
-	  }
-	  break;
-	case elf_image::dynamic_section_range::rpath:
-	  db.add_elf_rpath(cid, dyn.value().c_str());
-	  break;
-	case elf_image::dynamic_section_range::runpath:
-	  db.add_elf_runpath(cid, dyn.value().c_str());
-	  break;
+  }
+
+  const char *elf_path = file.info->name.c_str();
+  std::vector<std::string> exported;
+  std::vector<std::string> abi;
+  for (std::vector<definition_ptr>::const_iterator
+	 p = definitions.begin(), end = definitions.end(); p != end; ++p) {
+    dump_def(opt, db, cid, elf_path, **p);
+    if ((*p)->exported()) {
+      exported.push_back((*p)->symbol_name);
+      abi.push_back(abi_key(**p));
+    }
+  }
+  for (std::vector<reference_ptr>::const_iterator
+	 p = references.begin(), end = references.end(); p != end; ++p) {
+    dump_ref(opt, db, cid, elf_path, **p);
+  }
+  if (!error.empty()) {
+    db.add_elf_error(cid, error.c_str());
+    return;
+  }
+
+  std::string soname;
+  bool soname_seen = false;
+  for (std::vector<std::pair<dynamic_kind, std::string> >::const_iterator
+	 p = dynamic.begin(), end = dynamic.end(); p != end; ++p) {
+    switch (p->first) {
+    case elf_image::dynamic_section_range::needed:
+      db.add_elf_needed(cid, p->second.c_str());
+      break;
+    case elf_image::dynamic_section_range::soname:
+      if (soname_seen) {
+	// The linker ignores some subsequent sonames, but
+	// not all of them.  Multiple sonames are rare.
+	if (p->second != soname) {
+	  std::ostringstream out;
+	  out << "duplicate soname ignored: " << p->second
+	      << ", previous soname: " << soname;
+	  db.add_elf_error(cid, out.str().c_str());
 	}
+      } else {
+	soname = p->second;
+	soname_seen = true;
       }
+      break;
+    case elf_image::dynamic_section_range::rpath:
+      db.add_elf_rpath(cid, p->second.c_str());
+      break;
+    case elf_image::dynamic_section_range::runpath:
+      db.add_elf_runpath(cid, p->second.c_str());
+      break;
     }
-    // We used to derive the soname from the file name, but because of
-    // hardlinks (and deduplication), we no longer can do this here.
-    const char *sonameptr = soname_seen ? soname.c_str() : NULL;
-    db.add_elf_image(cid, image, sonameptr);
-  } catch (elf_exception e) {
-    db.add_elf_error(cid, e.what());
   }
+  // We used to derive the soname from the file name, but because of
+  // hardlinks (and deduplication), we no longer can do this here.
+  const char *sonameptr = soname_seen ? soname.c_str() : NULL;
+  std::vector<unsigned char> filter;
+  symbol_filter(exported, filter);
+  std::vector<unsigned char> fingerprint;
+  symbol_fingerprint(abi, fingerprint);
+  // The header fields and the build ID have been read by the
+  // elf_image constructor.
+  db.add_elf_image(cid, *image.ptr, sonameptr, filter, fingerprint);
 }
 
 namespace {
@@ -379,7 +513,12 @@ static database::package_id
 load_rpm_internal(const symboldb_options &opt, database &db,
 		  const char *rpm_path, rpm_package_info &info)
 {
-  rpm_parser_state rpmst(rpm_path);
+  parser_ptr<rpm_parser_state> parser;
+  {
+    parser_guard guard;
+    parser.ptr.reset(new rpm_parser_state(rpm_path));
+  }
+  rpm_parser_state &rpmst(*parser.ptr);
   info = rpmst.package();
   // We can destroy the lock immediately because we are running in a
   // transaction.
@@ -398,12 +537,19 @@ load_rpm_internal(const symboldb_options &opt, database &db,
   if (opt.output != symboldb_options::quiet) {
     fprintf(stderr, "info: loading %s from %s\n", rpmst.nevra(), rpm_path);
   }
+  db.add_package_dependencies(pkg, rpmst.dependencies());
 
   inode_map inodes;
 
   // FIXME: We should not read arbitrary files into memory, only ELF
   // files.
-  while (rpmst.read_file(file)) {
+  while (true) {
+    {
+      parser_guard guard;
+      if (!rpmst.read_file(file)) {
+	break;
+      }
+    }
     if (opt.output == symboldb_options::verbose) {
       fprintf(stderr, "%s %s %s %s %" PRIu32 " 0%o %llu\n",
 	      rpmst.nevra(), file.info->name.c_str(),
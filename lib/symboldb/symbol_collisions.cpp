@@ -0,0 +1,258 @@
+/*
+ * Copyright (C) 2013 Red Hat, Inc.
+ * Written by Florian Weimer <fweimer@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <symboldb/symbol_collisions.hpp>
+#include <cxxll/pgresult_handle.hpp>
+#include <cxxll/pg_column.hpp>
+#include <cxxll/pg_cursor.hpp>
+#include <cxxll/string_pool.hpp>
+
+#include <algorithm>
+#include <tr1/unordered_map>
+
+using namespace cxxll;
+
+symbol_collision_filter::symbol_collision_filter
+  (const regex_handle &p, const regex_handle &i)
+  : path(p), ignore(i)
+{
+}
+
+bool
+symbol_collision::definition::operator<(const definition &other) const
+{
+  if (soname != other.soname) {
+    return soname < other.soname;
+  }
+  if (file != other.file) {
+    return file < other.file;
+  }
+  return nevra < other.nevra;
+}
+
+bool
+symbol_collision::operator<(const symbol_collision &other) const
+{
+  if (name != other.name) {
+    return name < other.name;
+  }
+  return arch < other.arch;
+}
+
+namespace {
+  struct file_info {
+    std::string name;
+    unsigned nevra;
+    int package;
+  };
+
+  // A shared object (identified by its contents) and the files in the
+  // package set which have this contents.
+  struct contents_info {
+    unsigned arch;
+    unsigned soname;
+    std::vector<unsigned> files;
+  };
+
+  struct dso_index {
+    string_pool arches;
+    string_pool sonames;
+    string_pool nevras;
+    std::vector<file_info> files;
+    std::vector<contents_info> contents;
+    std::vector<int> contents_ids;
+    std::tr1::unordered_map<int, unsigned> by_contents_id;
+  };
+
+  // Loads the shared objects in the package set whose path matches
+  // the filter.
+  void
+  load_dsos(pgconn_handle &conn, database::package_set_id set,
+	    const symbol_collision_filter &filter, dso_index &dsos)
+  {
+    pg_cursor cursor
+      (conn, "symbol_collisions_files",
+       "SELECT f.contents_id, ef.arch::text, ef.soname, f.name,"
+       " symboldb.nevra(p), p.package_id"
+       " FROM symboldb.package_set_member psm"
+       " JOIN symboldb.package p USING (package_id)"
+       " JOIN symboldb.file f USING (package_id)"
+       " JOIN symboldb.elf_file ef USING (contents_id)"
+       " WHERE psm.set_id = $1 AND ef.e_type = 3"
+       " AND ef.arch IS NOT NULL AND ef.soname IS NOT NULL", set.value());
+    pgresult_handle res;
+    std::vector<int> contents_id;
+    std::vector<unsigned> arch;
+    std::vector<unsigned> soname;
+    std::vector<std::string> name;
+    std::vector<unsigned> nevra;
+    std::vector<int> package;
+    while (cursor.fetch(res)) {
+      contents_id.clear();
+      pg_column(res, 0, contents_id);
+      arch.clear();
+      pg_column(res, 1, dsos.arches, arch);
+      soname.clear();
+      pg_column(res, 2, dsos.sonames, soname);
+      name.clear();
+      pg_column(res, 3, name);
+      nevra.clear();
+      pg_column(res, 4, dsos.nevras, nevra);
+      package.clear();
+      pg_column(res, 5, package);
+      for (size_t row = 0, end = contents_id.size(); row < end; ++row) {
+	if (!filter.path.match(name[row].c_str())) {
+	  continue;
+	}
+	std::pair<std::tr1::unordered_map<int, unsigned>::iterator, bool> ins
+	  (dsos.by_contents_id.insert
+	   (std::make_pair(contents_id[row], dsos.contents.size())));
+	if (ins.second) {
+	  contents_info info;
+	  info.arch = arch[row];
+	  info.soname = soname[row];
+	  dsos.contents.push_back(info);
+	  dsos.contents_ids.push_back(contents_id[row]);
+	}
+	dsos.contents[ins.first->second].files.push_back(dsos.files.size());
+	file_info file;
+	file.name.swap(name[row]);
+	file.nevra = nevra[row];
+	file.package = package[row];
+	dsos.files.push_back(file);
+      }
+    }
+  }
+
+  // Returns true if two of the definitions have different sonames
+  // and come from different packages.
+  bool
+  collides(const dso_index &dsos, const std::vector<unsigned> &definers)
+  {
+    for (size_t i = 0, end = definers.size(); i < end; ++i) {
+      const contents_info &a(dsos.contents[definers[i]]);
+      for (size_t j = i + 1; j < end; ++j) {
+	const contents_info &b(dsos.contents[definers[j]]);
+	if (a.soname == b.soname) {
+	  continue;
+	}
+	for (std::vector<unsigned>::const_iterator
+	       p = a.files.begin(), pend = a.files.end(); p != pend; ++p) {
+	  for (std::vector<unsigned>::const_iterator
+		 q = b.files.begin(), qend = b.files.end(); q != qend; ++q) {
+	    if (dsos.files[*p].package != dsos.files[*q].package) {
+	      return true;
+	    }
+	  }
+	}
+      }
+    }
+    return false;
+  }
+} // namespace
+
+void
+find_symbol_collisions(pgconn_handle &conn, database::package_set_id set,
+		       const symbol_collision_filter &filter,
+		       std::vector<symbol_collision> &result)
+{
+  dso_index dsos;
+  load_dsos(conn, set, filter, dsos);
+  if (dsos.contents.empty()) {
+    return;
+  }
+
+  // Hash aggregation on (symbol name, architecture).  Most symbols
+  // have a single definition, so only the first definer is stored in
+  // the hash table, and further definers go to a separate list.
+  typedef unsigned long long symbol_key;
+  typedef std::tr1::unordered_map<symbol_key, unsigned> first_map;
+  first_map first;
+  std::vector<std::pair<symbol_key, unsigned> > more;
+  string_pool names;
+  std::vector<bool> ignored;
+  {
+    pg_cursor cursor
+      (conn, "symbol_collisions_definitions",
+       "SELECT DISTINCT contents_id, name"
+       " FROM symboldb.elf_exported_definition"
+       " WHERE contents_id = ANY ($1)", dsos.contents_ids);
+    pgresult_handle res;
+    std::vector<int> contents_id;
+    std::vector<unsigned> name;
+    while (cursor.fetch(res)) {
+      contents_id.clear();
+      pg_column(res, 0, contents_id);
+      name.clear();
+      pg_column(res, 1, names, name);
+      while (ignored.size() < names.size()) {
+	ignored.push_back(filter.ignore.match(names[ignored.size()].c_str()));
+      }
+      for (size_t row = 0, end = contents_id.size(); row < end; ++row) {
+	if (ignored[name[row]]) {
+	  continue;
+	}
+	unsigned contents = dsos.by_contents_id[contents_id[row]];
+	symbol_key key = (static_cast<symbol_key>(name[row]) << 32)
+	  | dsos.contents[contents].arch;
+	std::pair<first_map::iterator, bool> ins
+	  (first.insert(std::make_pair(key, contents)));
+	if (!ins.second) {
+	  more.push_back(std::make_pair(key, contents));
+	}
+      }
+    }
+  }
+
+  std::sort(more.begin(), more.end());
+  size_t old_size = result.size();
+  std::vector<unsigned> definers;
+  for (size_t i = 0, end = more.size(); i < end; ) {
+    symbol_key key = more[i].first;
+    definers.clear();
+    definers.push_back(first[key]);
+    for (; i < end && more[i].first == key; ++i) {
+      definers.push_back(more[i].second);
+    }
+    if (!collides(dsos, definers)) {
+      continue;
+    }
+
+    result.push_back(symbol_collision());
+    symbol_collision &collision(result.back());
+    collision.name = names[key >> 32];
+    collision.arch = dsos.arches[key & 0xFFFFFFFFU];
+    for (std::vector<unsigned>::const_iterator
+	   p = definers.begin(), pend = definers.end(); p != pend; ++p) {
+      const contents_info &contents(dsos.contents[*p]);
+      for (std::vector<unsigned>::const_iterator
+	     q = contents.files.begin(), qend = contents.files.end();
+	   q != qend; ++q) {
+	const file_info &file(dsos.files[*q]);
+	symbol_collision::definition def;
+	def.soname = dsos.sonames[contents.soname];
+	def.file = file.name;
+	def.nevra = dsos.nevras[file.nevra];
+	collision.definitions.push_back(def);
+      }
+    }
+    std::sort(collision.definitions.begin(), collision.definitions.end());
+  }
+  std::sort(result.begin() + old_size, result.end());
+}
@@ -0,0 +1,133 @@
+/*
+ * Copyright (C) 2013 Red Hat, Inc.
+ * Written by Florian Weimer <fweimer@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <symboldb/symbol_definitions.hpp>
+#include <cxxll/pgresult_handle.hpp>
+#include <cxxll/pg_column.hpp>
+#include <cxxll/pg_cursor.hpp>
+#include <cxxll/symbol_bloom.hpp>
+
+#include <algorithm>
+
+using namespace cxxll;
+
+bool
+symbol_definition_info::operator<(const symbol_definition_info &other) const
+{
+  if (name != other.name) {
+    return name < other.name;
+  }
+  if (version != other.version) {
+    return version < other.version;
+  }
+  if (file != other.file) {
+    return file < other.file;
+  }
+  return nevra < other.nevra;
+}
+
+namespace {
+  // Returns the contents IDs of the ELF files in the package set whose
+  // symbol filter matches at least one of the probes.  Files without
+  // a filter are always included.
+  void
+  filter_candidates(pgconn_handle &conn, database::package_set_id set,
+		    const std::vector<symbol_bloom::probe> &probes,
+		    std::vector<int> &candidates)
+  {
+    pg_cursor cursor
+      (conn, "symbol_definitions_filters",
+       "SELECT ef.contents_id, COALESCE(ef.symbol_filter, '')"
+       " FROM symboldb.elf_file ef WHERE ef.contents_id IN"
+       " (SELECT f.contents_id FROM symboldb.package_set_member psm"
+       "  JOIN symboldb.file f USING (package_id) WHERE psm.set_id = $1)",
+       set.value());
+    pgresult_handle res;
+    std::vector<int> contents_id;
+    std::vector<std::vector<unsigned char> > filter;
+    while (cursor.fetch(res)) {
+      contents_id.clear();
+      pg_column(res, 0, contents_id);
+      filter.clear();
+      pg_column(res, 1, filter);
+      for (size_t row = 0, end = contents_id.size(); row < end; ++row) {
+	for (std::vector<symbol_bloom::probe>::const_iterator
+	       p = probes.begin(), pend = probes.end(); p != pend; ++p) {
+	  if (symbol_bloom::maybe_contains(filter[row], *p)) {
+	    candidates.push_back(contents_id[row]);
+	    break;
+	  }
+	}
+      }
+    }
+  }
+} // namespace
+
+void
+find_symbol_definitions(pgconn_handle &conn, database::package_set_id set,
+			const std::vector<std::string> &names,
+			std::vector<symbol_definition_info> &result)
+{
+  if (names.empty()) {
+    return;
+  }
+  std::vector<symbol_bloom::probe> probes;
+  for (std::vector<std::string>::const_iterator
+	 p = names.begin(), end = names.end(); p != end; ++p) {
+    probes.push_back(symbol_bloom::probe(*p));
+  }
+  std::vector<int> candidates;
+  filter_candidates(conn, set, probes, candidates);
+  if (candidates.empty()) {
+    return;
+  }
+
+  pg_cursor cursor
+    (conn, "symbol_definitions",
+     "SELECT DISTINCT ed.name, COALESCE(ed.version, ''), COALESCE(ef.arch::text, ''),"
+     " COALESCE(ef.soname, ''), f.name, symboldb.nevra(p)"
+     " FROM symboldb.elf_exported_definition ed"
+     " JOIN symboldb.elf_file ef USING (contents_id)"
+     " JOIN symboldb.file f USING (contents_id)"
+     " JOIN symboldb.package p USING (package_id)"
+     " JOIN symboldb.package_set_member psm USING (package_id)"
+     " WHERE ed.contents_id = ANY ($1) AND ed.name = ANY ($2)"
+     " AND psm.set_id = $3",
+     candidates, names, set.value());
+  pgresult_handle res;
+  std::vector<std::string> columns[6];
+  size_t old_size = result.size();
+  while (cursor.fetch(res)) {
+    for (int col = 0; col < 6; ++col) {
+      columns[col].clear();
+      pg_column(res, col, columns[col]);
+    }
+    for (size_t row = 0, end = columns[0].size(); row < end; ++row) {
+      result.push_back(symbol_definition_info());
+      symbol_definition_info &info(result.back());
+      info.name.swap(columns[0][row]);
+      info.version.swap(columns[1][row]);
+      info.arch.swap(columns[2][row]);
+      info.soname.swap(columns[3][row]);
+      info.file.swap(columns[4][row]);
+      info.nevra.swap(columns[5][row]);
+    }
+  }
+  std::sort(result.begin() + old_size, result.end());
+}
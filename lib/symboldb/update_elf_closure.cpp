@@ -17,15 +17,27 @@
  */
 
 #include <symboldb/update_elf_closure.hpp>
+#include <symboldb/package_set_partition.hpp>
 #include <cxxll/pgresult_handle.hpp>
 #include <cxxll/pgconn_handle.hpp>
 #include <cxxll/pg_exception.hpp>
 #include <cxxll/pg_query.hpp>
 #include <cxxll/pg_response.hpp>
+#include <cxxll/pg_column.hpp>
+#include <cxxll/pg_cursor.hpp>
+#include <cxxll/string_pool.hpp>
 #include <cxxll/string_support.hpp>
+#include <cxxll/task.hpp>
+#include <cxxll/transitive_closure.hpp>
 
+#include <algorithm>
+#include <iterator>
 #include <map>
-#include <set>
+#include <stdexcept>
+#include <string>
+#include <tr1/functional>
+#include <tr1/memory>
+#include <tr1/unordered_map>
 
 #include <cassert>
 #include <cstring>
@@ -90,8 +102,6 @@ namespace {
 
   typedef std::multimap<std::string, file_ref> soname_map;
   typedef std::map<std::string, soname_map> arch_soname_map;
-  typedef std::map<database::file_id, std::set<database::file_id> >
-    dependency_map;
 
   // Find the most suitable library for a particular SONAME reference.
   database::file_id
@@ -227,6 +237,118 @@ namespace {
     }
   }
 
+  // Dependency graph for a single architecture.  DT_NEEDED entries
+  // are always resolved within the same architecture, so the graphs
+  // for different architectures are independent.
+  struct arch_graph {
+    std::vector<int> files;	// node to file_id
+    std::vector<bool> output;	// false if the closure is not written
+    std::tr1::unordered_map<int, unsigned> nodes; // file_id to node
+    std::vector<directed_graph::edge> edges;
+    std::tr1::shared_ptr<transitive_closure> closure;
+    bool bad_alloc;
+    std::string error;
+
+    arch_graph()
+      : bad_alloc(false)
+    {
+    }
+
+    // Returns the node number for the file ID, adding it if
+    // necessary.
+    unsigned node(int fid);
+
+    // Computes the closure.  Errors are recorded in bad_alloc and
+    // error because this runs on a separate thread.
+    void compute() throw();
+
+    // Throws an exception if compute() failed.
+    void check() const;
+  };
+
+  unsigned
+  arch_graph::node(int fid)
+  {
+    std::pair<std::tr1::unordered_map<int, unsigned>::iterator, bool> result
+      (nodes.insert(std::make_pair(fid, static_cast<unsigned>(files.size()))));
+    if (result.second) {
+      files.push_back(fid);
+      output.push_back(true);
+    }
+    return result.first->second;
+  }
+
+  void
+  arch_graph::compute() throw()
+  {
+    try {
+      directed_graph graph(files.size(), edges);
+      std::vector<directed_graph::edge>().swap(edges);
+      closure.reset(new transitive_closure(graph));
+    } catch (std::bad_alloc &) {
+      bad_alloc = true;
+    } catch (std::exception &e) {
+      try {
+	error = e.what();
+      } catch (...) {
+	bad_alloc = true;
+      }
+    } catch (...) {
+      bad_alloc = true;
+    }
+  }
+
+  void
+  arch_graph::check() const
+  {
+    if (bad_alloc) {
+      throw std::bad_alloc();
+    }
+    if (!error.empty()) {
+      throw std::runtime_error(error);
+    }
+  }
+
+  typedef std::vector<std::tr1::shared_ptr<arch_graph> > arch_graph_list;
+
+  // Computes the closures, using one thread per architecture.  The
+  // last architecture is processed on the current thread.
+  void
+  compute_closures(arch_graph_list &graphs)
+  {
+    std::vector<arch_graph *> pending;
+    for (arch_graph_list::iterator p = graphs.begin(), end = graphs.end();
+	 p != end; ++p) {
+      if (*p) {
+	pending.push_back(p->get());
+      }
+    }
+    if (pending.empty()) {
+      return;
+    }
+    std::vector<std::tr1::shared_ptr<task> > tasks;
+    try {
+      for (size_t i = 0; i + 1 < pending.size(); ++i) {
+	tasks.push_back(std::tr1::shared_ptr<task>
+			(new task(std::tr1::bind(&arch_graph::compute,
+						 pending[i]))));
+      }
+    } catch (...) {
+      // The threads refer to the graphs, so they must finish first.
+      for (size_t i = 0; i < tasks.size(); ++i) {
+	tasks[i]->wait();
+      }
+      throw;
+    }
+    pending.back()->compute();
+    for (size_t i = 0; i < tasks.size(); ++i) {
+      tasks[i]->wait();
+    }
+    for (size_t i = 0; i < pending.size(); ++i) {
+      pending[i]->check();
+    }
+  }
+
   std::string synthesize_soname(const std::string &path)
   {
     size_t slash = path.rfind('/');
@@ -236,174 +358,567 @@ namespace {
       return std::string(path.begin() + slash + 1, path.end());
     }
   }
+  // Loads the SONAME providers returned by CURSOR.  The columns are
+  // architecture, SONAME (possibly empty), file ID, file name, and
+  // package name.
+  void
+  load_providers(pg_cursor &cursor, arch_soname_map &arch_soname)
+  {
+    pgresult_handle res;
+    string_pool strings;
+    std::vector<unsigned> arch;
+    std::vector<std::string> soname;
+    std::vector<int> fid;
+    std::vector<std::string> file_name;
+    std::vector<unsigned> pkg;
+    while (cursor.fetch(res)) {
+      arch.clear();
+      pg_column(res, 0, strings, arch);
+      soname.clear();
+      pg_column(res, 1, soname);
+      fid.clear();
+      pg_column(res, 2, fid);
+      file_name.clear();
+      pg_column(res, 3, file_name);
+      pkg.clear();
+      pg_column(res, 4, strings, pkg);
+
+      for (size_t row = 0, end = fid.size(); row < end; ++row) {
+	if (soname[row].empty()) {
+	  soname[row] = synthesize_soname(file_name[row]);
+	}
+	arch_soname[strings[arch[row]]].insert
+	  (std::make_pair(soname[row], file_ref(fid[row], file_name[row],
+						strings[pkg[row]])));
+      }
+    }
+    ignore_some_conflicts(arch_soname);
+  }
+
+  // Resolves the DT_NEEDED entries returned by CURSOR and adds the
+  // resulting edges to GRAPHS.  The columns are architecture, needed
+  // name, file ID, and file name.
+  void
+  load_needed(pg_cursor &cursor, const arch_soname_map &arch_soname,
+	      update_elf_closure_conflicts *conflicts,
+	      arch_graph_list &graphs)
+  {
+    pgresult_handle res;
+    string_pool strings;
+    std::vector<unsigned> arch;
+    std::vector<unsigned> needed_name;
+    std::vector<int> fid;
+    std::vector<std::string> needing_path;
+    while (cursor.fetch(res)) {
+      arch.clear();
+      pg_column(res, 0, strings, arch);
+      needed_name.clear();
+      pg_column(res, 1, strings, needed_name);
+      fid.clear();
+      pg_column(res, 2, fid);
+      needing_path.clear();
+      pg_column(res, 3, needing_path);
+
+      for (size_t row = 0, end = fid.size(); row < end; ++row) {
+	database::file_id needing_file(fid[row]);
+	database::file_id library =
+	  lookup(arch_soname, strings[arch[row]], strings[needed_name[row]],
+		 needing_file, needing_path[row].c_str(),
+		 conflicts);
+	if (library != database::file_id()) {
+	  if (graphs.size() <= arch[row]) {
+	    graphs.resize(arch[row] + 1);
+	  }
+	  std::tr1::shared_ptr<arch_graph> &graph(graphs[arch[row]]);
+	  if (!graph) {
+	    graph.reset(new arch_graph);
+	  }
+	  graph->edges.push_back
+	    (directed_graph::edge(graph->node(fid[row]),
+				  graph->node(library.value())));
+	}
+      }
+    }
+  }
+
+  // Columns of the closure tables which are indexed.
+  const char *const closure_indexed[] = {"file_id", "needed", NULL};
+
+  // Copies the closure of the nodes in GRAPHS which have their
+  // output flag set into TABLE.
+  void
+  upload_closure(pgconn_handle &conn, const std::string &table,
+		 database::package_set_id id, const arch_graph_list &graphs)
+  {
+    char setbuf[32];
+    snprintf(setbuf, sizeof(setbuf), "%d\t", id.value());
+    char *setend = setbuf + strlen(setbuf);
+
+    std::vector<char> upload;
+    pgresult_handle copy;
+    copy.exec(conn, ("COPY " + table + " FROM STDIN").c_str());
+    assert(copy.resultStatus() == PGRES_COPY_IN);
+    for (arch_graph_list::const_iterator p = graphs.begin(),
+	   end = graphs.end(); p != end; ++p) {
+      if (!*p) {
+	continue;
+      }
+      const arch_graph &graph(**p);
+      for (unsigned node = 0, node_end = graph.files.size();
+	   node < node_end; ++node) {
+	const std::vector<unsigned> &needed((*graph.closure)[node]);
+	if (needed.empty() || !graph.output[node]) {
+	  continue;
+	}
+	char filebuf[32];
+	snprintf(filebuf, sizeof(filebuf), "%d", graph.files[node]);
+	char *fileend = filebuf + strlen(filebuf);
+	for (std::vector<unsigned>::const_iterator
+	       q = needed.begin(), qend = needed.end(); q != qend; ++q) {
+	  char neededbuf[32];
+	  snprintf(neededbuf, sizeof(neededbuf), "%d", graph.files[*q]);
+	  char *neededend = neededbuf + strlen(neededbuf);
+	  upload.insert(upload.end(), setbuf, setend);
+	  upload.insert(upload.end(), filebuf, fileend);
+	  upload.push_back('\t');
+	  upload.insert(upload.end(), neededbuf, neededend);
+	  upload.push_back('\n');
+	  if (upload.size() > 128 * 1024) {
+	    conn.putCopyData(upload.data(), upload.size());
+	    upload.clear();
+	  }
+	}
+      }
+    }
+    if (!upload.empty()) {
+      conn.putCopyData(upload.data(), upload.size());
+    }
+    conn.putCopyEnd();
+    copy.getresult(conn);
+  }
+
+  // Replaces the closure partition of the package set with the
+  // closure in GRAPHS.
+  void
+  replace_partition(pgconn_handle &conn, database::package_set_id id,
+		    const arch_graph_list &graphs)
+  {
+    std::string next
+      (package_set_partition_create(conn, "elf_closure", id));
+    upload_closure(conn, next, id, graphs);
+    package_set_partition_replace(conn, "elf_closure", id, closure_indexed);
+  }
+
+  // Replaces the rows for FILES in the closure partition of the
+  // package set with the closure in GRAPHS.
+  void
+  update_partition(pgconn_handle &conn, database::package_set_id id,
+		   const arch_graph_list &graphs, const std::vector<int> &files)
+  {
+    std::string name(package_set_partition_ensure
+		     (conn, "elf_closure", id, closure_indexed));
+    pgresult_handle res;
+    res.exec(conn, "CREATE TEMPORARY TABLE update_elf_closure"
+	     " (LIKE symboldb.elf_closure) ON COMMIT DROP");
+    upload_closure(conn, "update_elf_closure", id, graphs);
+    res.exec(conn, "CREATE INDEX ON update_elf_closure (file_id, needed)");
+    res.exec(conn, "ANALYZE update_elf_closure");
+    pg_query(conn, res,
+	     ("DELETE FROM " + name + " ec"
+	      " WHERE file_id = ANY ($1)"
+	      " AND NOT EXISTS (SELECT 1 FROM update_elf_closure u"
+	      "  WHERE ec.file_id = u.file_id AND ec.needed = u.needed)")
+	     .c_str(), files);
+    pg_query(conn, res,
+	     ("INSERT INTO " + name + " SELECT * FROM update_elf_closure"
+	      " EXCEPT SELECT * FROM " + name
+	      + " WHERE file_id = ANY ($1)").c_str(), files);
+    res.exec(conn, "DROP TABLE update_elf_closure");
+  }
+
+  // Changes which affect more than 1/incremental_limit of the package
+  // set trigger a full update.
+  const size_t incremental_limit = 10;
 } // namespace
 
-void
-update_elf_closure(pgconn_handle &conn, database::package_set_id id,
-		   update_elf_closure_conflicts *conflicts)
+struct elf_closure_update::impl {
+  database::package_set_id set;
+  std::vector<int> members;	// sorted, as seen by the snapshot
+  std::vector<int> added;
+  std::vector<int> removed;
+  arch_graph_list graphs;
+
+  // If true, only the closure of the affected files is replaced.
+  bool incremental;
+  std::vector<int> affected;
+  std::vector<int> removed_files;
+
+  impl(pgconn_handle &, database::package_set_id,
+       const database::package_set_delta &);
+  void compute_full(pgconn_handle &, update_elf_closure_conflicts *);
+  void compute_incremental(pgconn_handle &);
+};
+
+namespace {
+  void
+  load_members(pgconn_handle &conn, database::package_set_id set,
+	       std::vector<int> &members)
+  {
+    pgresult_handle res;
+    pg_query_binary
+      (conn, res, "SELECT package_id FROM symboldb.package_set_member"
+       " WHERE set_id = $1 ORDER BY package_id", set.value());
+    members.clear();
+    pg_column(res, 0, members);
+  }
+}
+
+elf_closure_update::impl::impl(pgconn_handle &conn,
+			       database::package_set_id id,
+			       const database::package_set_delta &delta)
+  : set(id), incremental(false)
 {
   assert(conn.transactionStatus() == PQTRANS_INTRANS);
+  load_members(conn, set, members);
+  package_set_delta_ids(delta, removed, added);
+}
+
+void
+elf_closure_update::impl::compute_full(pgconn_handle &conn,
+				       update_elf_closure_conflicts *conflicts)
+{
   bool debug = false;
 
   // Obtain the list of SONAME providers.  There can be multiple DSOs
   // which have the same SONAME, and packages can conflict and install
   // different files at the same path.
-  pgresult_handle res;
-  pg_query_binary
-    (conn, res,
-     "SELECT ef.arch::text, COALESCE(ef.soname, ''), file_id, f.name, p.name"
-     " FROM symboldb.package_set_member psm"
-     " JOIN symboldb.package p USING (package_id)"
-     " JOIN symboldb.file f USING (package_id)"
-     " JOIN symboldb.elf_file ef USING (contents_id)"
-     " WHERE psm.set_id = $1 AND ef.e_type = 3", id.value());
-  // ef.e_type == ET_DYN is a restriction to DSOs.
-
   arch_soname_map arch_soname;
   {
-    std::string arch;
-    std::string soname;
-    int fid;
-    std::string file_name;
-    std::string pkg;
-    for (int row = 0, end = res.ntuples(); row < end; ++row) {
-      pg_response(res, row, arch, soname, fid, file_name, pkg);
-      if (soname.empty()) {
-	soname = synthesize_soname(file_name);
+    pg_cursor cursor
+      (conn, "update_elf_closure_providers",
+       "SELECT ef.arch::text, COALESCE(ef.soname, ''), file_id, f.name,"
+       " p.name"
+       " FROM " PACKAGE_SET_MEMBERS_AFTER_DELTA
+       " JOIN symboldb.package p USING (package_id)"
+       " JOIN symboldb.file f USING (package_id)"
+       " JOIN symboldb.elf_file ef USING (contents_id)"
+       " WHERE ef.e_type = 3", set.value(), removed, added);
+    // ef.e_type == ET_DYN is a restriction to DSOs.
+    load_providers(cursor, arch_soname);
+  }
+
+  {
+    pg_cursor cursor
+      (conn, "update_elf_closure_needed",
+       "SELECT ef.arch::text, en.name, file_id, f.name"
+       " FROM " PACKAGE_SET_MEMBERS_AFTER_DELTA
+       " JOIN symboldb.file f USING (package_id)"
+       " JOIN symboldb.elf_file ef USING (contents_id)"
+       " JOIN symboldb.elf_needed en USING (contents_id)",
+       set.value(), removed, added);
+    load_needed(cursor, arch_soname, conflicts, graphs);
+  }
+  arch_soname.clear();
+
+  if (conflicts && conflicts->skip_update()) {
+    return;
+  }
+
+  compute_closures(graphs);
+  if (debug) {
+    for (arch_graph_list::iterator p = graphs.begin(), end = graphs.end();
+	 p != end; ++p) {
+      if (*p) {
+	fprintf(stderr, "info: closure: %zu files, %u components\n",
+		(*p)->files.size(), (*p)->closure->components());
       }
-      arch_soname[arch].insert(std::make_pair(soname,
-					      file_ref(fid, file_name, pkg)));
     }
   }
+}
+
+void
+elf_closure_update::impl::compute_incremental(pgconn_handle &conn)
+{
+  incremental = true;
+  if (added.empty() && removed.empty()) {
+    return;
+  }
+  std::vector<int> changed(added);
+  changed.insert(changed.end(), removed.begin(), removed.end());
 
-  ignore_some_conflicts(arch_soname);
+  // SONAMEs whose providers have changed.
+  pgresult_handle res;
+  std::vector<std::string> sonames;
+  pg_query_binary
+    (conn, res,
+     "SELECT DISTINCT COALESCE(NULLIF(ef.soname, ''),"
+     " regexp_replace(f.name, '^.*/', ''))"
+     " FROM symboldb.file f JOIN symboldb.elf_file ef USING (contents_id)"
+     " WHERE f.package_id = ANY ($1) AND ef.e_type = 3", changed);
+  pg_column(res, 0, sonames);
+
+  // Files which are no longer part of the package set.
+  pg_query_binary
+    (conn, res,
+     "SELECT file_id FROM symboldb.file f"
+     " JOIN symboldb.elf_file USING (contents_id)"
+     " WHERE f.package_id = ANY ($1)", removed);
+  pg_column(res, 0, removed_files);
 
-  dependency_map closure;
+  // Files whose DT_NEEDED resolution may have changed: new files, and
+  // files which need one of the changed SONAMEs.
   pg_query_binary
     (conn, res,
-     "SELECT ef.arch::text, en.name, file_id, f.name"
-     " FROM symboldb.package_set_member psm"
+     "SELECT DISTINCT file_id FROM " PACKAGE_SET_MEMBERS_AFTER_DELTA
      " JOIN symboldb.file f USING (package_id)"
      " JOIN symboldb.elf_file ef USING (contents_id)"
      " JOIN symboldb.elf_needed en USING (contents_id)"
-     " WHERE psm.set_id = $1", id.value());
-  size_t elements = 0;
+     " WHERE psm.package_id = ANY ($3) OR en.name = ANY ($4)",
+     set.value(), removed, added, sonames);
+  pg_column(res, 0, affected);
+
+  // Files whose closure contains any of these files, or a removed
+  // file, are affected as well.  The stored closure is transitive,
+  // so one query finds all indirect dependencies.
+  {
+    std::vector<int> changed_files(affected);
+    changed_files.insert(changed_files.end(),
+			 removed_files.begin(), removed_files.end());
+    pg_query_binary(conn, res,
+		    "SELECT DISTINCT file_id FROM symboldb.elf_closure"
+		    " WHERE set_id = $1 AND needed = ANY ($2)",
+		    set.value(), changed_files);
+    pg_column(res, 0, affected);
+  }
+  std::sort(affected.begin(), affected.end());
+  affected.erase(std::unique(affected.begin(), affected.end()),
+		 affected.end());
+  std::sort(removed_files.begin(), removed_files.end());
+  {
+    std::vector<int> tmp;
+    std::set_difference(affected.begin(), affected.end(),
+			removed_files.begin(), removed_files.end(),
+			std::back_inserter(tmp));
+    affected.swap(tmp);
+  }
+
+  // Load the providers of the SONAMEs needed by the affected files.
+  arch_soname_map arch_soname;
   {
-    std::string arch;
-    std::string needed_name;
-    int fid;
-    std::string needing_path;
-    for (int row = 0, end = res.ntuples(); row < end; ++row) {
-      pg_response(res, row,
-		  arch, needed_name, fid, needing_path);
-      database::file_id needing_file(fid);
-      database::file_id library =
-	lookup(arch_soname, arch, needed_name,
-	       needing_file, needing_path.c_str(),
-	       conflicts);
-      if (library != database::file_id()) {
-	elements += closure[needing_file].insert(library).second;
+    std::vector<std::string> needed;
+    pg_query_binary
+      (conn, res,
+       "SELECT DISTINCT en.name FROM symboldb.file f"
+       " JOIN symboldb.elf_needed en USING (contents_id)"
+       " WHERE f.file_id = ANY ($1)", affected);
+    pg_column(res, 0, needed);
+    res.close();
+
+    pg_cursor cursor
+      (conn, "update_elf_closure_providers",
+       "SELECT ef.arch::text, COALESCE(ef.soname, ''), file_id, f.name,"
+       " p.name"
+       " FROM " PACKAGE_SET_MEMBERS_AFTER_DELTA
+       " JOIN symboldb.package p USING (package_id)"
+       " JOIN symboldb.file f USING (package_id)"
+       " JOIN symboldb.elf_file ef USING (contents_id)"
+       " WHERE ef.e_type = 3"
+       " AND COALESCE(NULLIF(ef.soname, ''),"
+       " regexp_replace(f.name, '^.*/', '')) = ANY ($4)",
+       set.value(), removed, added, needed);
+    load_providers(cursor, arch_soname);
+  }
+
+  {
+    pg_cursor cursor
+      (conn, "update_elf_closure_needed",
+       "SELECT ef.arch::text, en.name, file_id, f.name"
+       " FROM symboldb.file f"
+       " JOIN symboldb.elf_file ef USING (contents_id)"
+       " JOIN symboldb.elf_needed en USING (contents_id)"
+       " WHERE f.file_id = ANY ($1)", affected);
+    load_needed(cursor, arch_soname, NULL, graphs);
+  }
+  arch_soname.clear();
+
+  // Libraries which are not affected keep their stored closure,
+  // which is added to the graph as a set of direct edges.
+  {
+    std::tr1::unordered_map<int, arch_graph *> fixed;
+    for (arch_graph_list::iterator p = graphs.begin(), end = graphs.end();
+	 p != end; ++p) {
+      if (!*p) {
+	continue;
+      }
+      arch_graph &graph(**p);
+      for (unsigned node = 0, node_end = graph.files.size();
+	   node < node_end; ++node) {
+	if (!std::binary_search(affected.begin(), affected.end(),
+				graph.files[node])) {
+	  graph.output[node] = false;
+	  fixed[graph.files[node]] = &graph;
+	}
       }
     }
-  }
+    std::vector<int> fixed_files;
+    for (std::tr1::unordered_map<int, arch_graph *>::iterator
+	   p = fixed.begin(), end = fixed.end(); p != end; ++p) {
+      fixed_files.push_back(p->first);
+    }
 
-  // Compute the transitive closure.  Iterate until we reach a
-  // fixpoint.
-  int iteration = 0;
-  bool changed = true;
-  while (changed) {
-    if (debug) {
-      fprintf(stderr, "info: closure:"
-	      " iteration %d: %zu files, %zu dependencies\n",
-	      ++iteration, closure.size(), elements);
-    }
-
-    changed = false;
-    for (dependency_map::iterator
-	   needing = closure.begin(), needing_end = closure.end();
-	 needing != needing_end; ++needing) {
-      std::set<database::file_id> &needing_deps(needing->second);
-      for (std::set<database::file_id>::const_iterator
-	     needing_dep = needing_deps.begin(),
-	     needing_dep_end = needing_deps.end();
-	   needing_dep != needing_dep_end; ++needing_dep) {
-	dependency_map::const_iterator dep(closure.find(*needing_dep));
-	if (dep != closure.end()) {
-	  for (std::set<database::file_id>::const_iterator
-		 depdep = dep->second.begin(), depdep_end = dep->second.end();
-	       depdep != depdep_end; ++depdep) {
-	    bool new_element = needing_deps.insert(*depdep).second;
-	    elements += new_element;
-	    changed = changed || new_element;
-	  }
+    pg_cursor cursor
+      (conn, "update_elf_closure_fixed",
+       "SELECT file_id, needed FROM symboldb.elf_closure"
+       " WHERE set_id = $1 AND file_id = ANY ($2)",
+       set.value(), fixed_files);
+    std::vector<int> file;
+    std::vector<int> needed;
+    while (cursor.fetch(res)) {
+      file.clear();
+      pg_column(res, 0, file);
+      needed.clear();
+      pg_column(res, 1, needed);
+      for (size_t row = 0, end = file.size(); row < end; ++row) {
+	arch_graph &graph(*fixed[file[row]]);
+	unsigned target = graph.node(needed[row]);
+	if (!std::binary_search(affected.begin(), affected.end(),
+				needed[row])) {
+	  graph.output[target] = false;
 	}
+	graph.edges.push_back
+	  (directed_graph::edge(graph.node(file[row]), target));
       }
     }
   }
-  if (debug) {
-    fprintf(stderr, "info: closure: finished\n");
+
+  compute_closures(graphs);
+}
+
+elf_closure_update::elf_closure_update()
+{
+}
+
+elf_closure_update::~elf_closure_update()
+{
+}
+
+void
+elf_closure_update::compute(pgconn_handle &conn,
+			    database::package_set_id set,
+			    update_elf_closure_conflicts *conflicts)
+{
+  std::tr1::shared_ptr<impl> result
+    (new impl(conn, set, database::package_set_delta()));
+  result->compute_full(conn, conflicts);
+  impl_ = result;
+}
+
+void
+elf_closure_update::compute(pgconn_handle &conn,
+			    database::package_set_id set,
+			    const database::package_set_delta &delta)
+{
+  std::tr1::shared_ptr<impl> result(new impl(conn, set, delta));
+  size_t changes = delta.added.size() + delta.removed.size();
+  if (changes * incremental_limit > result->members.size()) {
+    result->compute_full(conn, NULL);
+  } else {
+    result->compute_incremental(conn);
   }
-  arch_soname.clear();
-  res.close();
+  impl_ = result;
+}
+
+bool
+elf_closure_update::current(pgconn_handle &conn) const
+{
+  assert(impl_);
+  std::vector<int> members;
+  load_members(conn, impl_->set, members);
+  return members == impl_->members;
+}
+
+void
+elf_closure_update::apply(pgconn_handle &conn) const
+{
+  assert(impl_);
+  assert(conn.transactionStatus() == PQTRANS_INTRANS);
+  if (!impl_->incremental) {
+    replace_partition(conn, impl_->set, impl_->graphs);
+    return;
+  }
+  if (!impl_->removed_files.empty()) {
+    pgresult_handle res;
+    pg_query(conn, res,
+	     "DELETE FROM symboldb.elf_closure"
+	     " WHERE set_id = $1 AND file_id = ANY ($2)",
+	     impl_->set.value(), impl_->removed_files);
+  }
+  if (!impl_->affected.empty()) {
+    update_partition(conn, impl_->set, impl_->graphs, impl_->affected);
+  }
+}
 
+void
+update_elf_closure(pgconn_handle &conn, database::package_set_id id,
+		   update_elf_closure_conflicts *conflicts)
+{
+  elf_closure_update closure;
+  closure.compute(conn, id, conflicts);
   if (conflicts && conflicts->skip_update()) {
     return;
   }
+  closure.apply(conn);
+}
 
-  // Load the closure into the database.
-  res.exec(conn, "CREATE TEMPORARY TABLE update_elf_closure ("
-	   " file_id INTEGER NOT NULL,"
-	   " needed INTEGER NOT NULL) ON COMMIT DROP");
+void
+resolve_elf_needed(pgconn_handle &conn, database::package_set_id id,
+		   const database::package_set_delta &delta,
+		   std::vector<std::pair<int, int> > &edges)
+{
+  assert(conn.transactionStatus() == PQTRANS_INTRANS);
+  std::vector<int> removed;
+  std::vector<int> added;
+  package_set_delta_ids(delta, removed, added);
+  arch_soname_map arch_soname;
   {
-    std::vector<char> upload;
-    pgresult_handle copy;
-    copy.exec(conn, "COPY update_elf_closure FROM STDIN");
-    assert(copy.resultStatus() == PGRES_COPY_IN);
-    for (dependency_map::iterator
-	   needing = closure.begin(), needing_end = closure.end();
-	 needing != needing_end; ++needing) {
-      char filebuf[32];
-      snprintf(filebuf, sizeof(filebuf), "%d", needing->first.value());
-      char *fileend = filebuf + strlen(filebuf);
-      std::set<database::file_id> &needing_deps(needing->second);
-      for (std::set<database::file_id>::const_iterator
-	     needing_dep = needing_deps.begin(),
-	     needing_dep_end = needing_deps.end();
-	   needing_dep != needing_dep_end; ++needing_dep) {
-	database::file_id needed(needing_dep->value());
-	char neededbuf[32];
-	snprintf(neededbuf, sizeof(neededbuf), "%d", needed.value());
-	char *neededend = neededbuf + strlen(neededbuf);
-	upload.insert(upload.end(), filebuf, fileend);
-	upload.push_back('\t');
-	upload.insert(upload.end(), neededbuf, neededend);
-	upload.push_back('\n');
-	if (upload.size() > 128 * 1024) {
-	  conn.putCopyData(upload.data(), upload.size());
-	  upload.clear();
-	}
-      }
+    pg_cursor cursor
+      (conn, "resolve_elf_needed_providers",
+       "SELECT ef.arch::text, COALESCE(ef.soname, ''), file_id, f.name,"
+       " p.name"
+       " FROM " PACKAGE_SET_MEMBERS_AFTER_DELTA
+       " JOIN symboldb.package p USING (package_id)"
+       " JOIN symboldb.file f USING (package_id)"
+       " JOIN symboldb.elf_file ef USING (contents_id)"
+       " WHERE ef.e_type = 3", id.value(), removed, added);
+    load_providers(cursor, arch_soname);
+  }
+
+  // The ordering keeps the dependencies of each file together.
+  arch_graph_list graphs;
+  {
+    pg_cursor cursor
+      (conn, "resolve_elf_needed_needed",
+       "SELECT ef.arch::text, en.name, file_id, f.name"
+       " FROM " PACKAGE_SET_MEMBERS_AFTER_DELTA
+       " JOIN symboldb.file f USING (package_id)"
+       " JOIN symboldb.elf_file ef USING (contents_id)"
+       " JOIN symboldb.elf_needed en USING (contents_id)"
+       " ORDER BY file_id, en.name", id.value(), removed, added);
+    load_needed(cursor, arch_soname, NULL, graphs);
+  }
+
+  for (arch_graph_list::const_iterator p = graphs.begin(),
+	 end = graphs.end(); p != end; ++p) {
+    if (!*p) {
+      continue;
     }
-    if (!upload.empty()) {
-      conn.putCopyData(upload.data(), upload.size());
+    const arch_graph &graph(**p);
+    for (std::vector<directed_graph::edge>::const_iterator
+	   q = graph.edges.begin(), qend = graph.edges.end(); q != qend; ++q) {
+      edges.push_back(std::make_pair(graph.files[q->first],
+				     graph.files[q->second]));
     }
-    conn.putCopyEnd();
-    copy.getresult(conn);
   }
-  res.exec(conn, "CREATE INDEX ON update_elf_closure (file_id, needed)");
-  res.exec(conn, "ANALYZE update_elf_closure");
-  pg_query(conn, res,
-	   "DELETE FROM symboldb.elf_closure ec"
-	   " WHERE set_id = $1"
-	   " AND NOT EXISTS (SELECT 1 FROM update_elf_closure u"
-	   "  WHERE ec.file_id = u.file_id AND ec.needed = u.needed)",
-	   id.value());
-  pg_query(conn, res,
-	   "INSERT INTO symboldb.elf_closure (set_id, file_id, needed)"
-	   " SELECT $1, * FROM (SELECT * FROM update_elf_closure"
-	   " EXCEPT SELECT file_id, needed FROM symboldb.elf_closure"
-	   " WHERE set_id = $1) x", id.value());
-  res.exec(conn, "DROP TABLE update_elf_closure");
 }
 
 //////////////////////////////////////////////////////////////////////
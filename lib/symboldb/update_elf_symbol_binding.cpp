@@ -0,0 +1,309 @@
+/*
+ * Copyright (C) 2013 Red Hat, Inc.
+ * Written by Florian Weimer <fweimer@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <symboldb/update_elf_symbol_binding.hpp>
+#include <symboldb/update_elf_closure.hpp>
+#include <symboldb/package_set_partition.hpp>
+#include <cxxll/pgresult_handle.hpp>
+#include <cxxll/pg_column.hpp>
+#include <cxxll/pg_copy.hpp>
+#include <cxxll/pg_cursor.hpp>
+#include <cxxll/string_pool.hpp>
+
+#include <algorithm>
+#include <climits>
+#include <cstring>
+#include <tr1/unordered_map>
+
+#include <assert.h>
+#include <stdio.h>
+
+using namespace cxxll;
+
+namespace {
+  const char *const binding_indexed[] = {"file_id", "name", "provider", NULL};
+
+  // Interned symbol name and version.  Version 0 is the empty
+  // version, which unversioned references use.
+  typedef std::pair<unsigned, unsigned> symbol_key;
+
+  // Shared objects in the package set which define each symbol.
+  class definition_index {
+    typedef std::vector<std::pair<symbol_key, int> > entries_type;
+    entries_type entries_;
+  public:
+    typedef entries_type::const_iterator const_iterator;
+
+    void add(symbol_key key, int file)
+    {
+      entries_.push_back(std::make_pair(key, file));
+    }
+
+    // Must be called after the last add() and before find().
+    void finish()
+    {
+      std::sort(entries_.begin(), entries_.end());
+      entries_.erase(std::unique(entries_.begin(), entries_.end()),
+		     entries_.end());
+    }
+
+    // Returns the definitions of KEY, sorted by file ID.
+    std::pair<const_iterator, const_iterator> find(symbol_key key) const
+    {
+      return std::equal_range
+	(entries_.begin(), entries_.end(), std::make_pair(key, 0),
+	 key_less());
+    }
+
+  private:
+    struct key_less {
+      bool operator()(const std::pair<symbol_key, int> &a,
+		      const std::pair<symbol_key, int> &b) const
+      {
+	return a.first < b.first;
+      }
+    };
+  };
+
+  // Resolved DT_NEEDED dependencies, in DT_NEEDED order per file.
+  class needed_graph {
+    std::vector<std::pair<int, int> > edges_;
+    typedef std::tr1::unordered_map<int, std::pair<size_t, size_t> >
+      ranges_type;
+    ranges_type ranges_;
+  public:
+    needed_graph(pgconn_handle &conn, database::package_set_id set,
+		 const database::package_set_delta &delta)
+    {
+      resolve_elf_needed(conn, set, delta, edges_);
+      for (size_t i = 0, end = edges_.size(); i < end; ) {
+	size_t j = i + 1;
+	while (j < end && edges_[j].first == edges_[i].first) {
+	  ++j;
+	}
+	ranges_[edges_[i].first] = std::make_pair(i, j);
+	i = j;
+      }
+    }
+
+    // Appends the direct dependencies of FILE to RESULT.
+    void needed(int file, std::vector<int> &result) const
+    {
+      ranges_type::const_iterator p = ranges_.find(file);
+      if (p != ranges_.end()) {
+	for (size_t i = p->second.first; i < p->second.second; ++i) {
+	  result.push_back(edges_[i].second);
+	}
+      }
+    }
+  };
+
+  // The shared objects searched for the undefined symbols of a file:
+  // its dependencies in breadth-first order, as the dynamic linker
+  // loads them.  The scope of a shared object is approximated by its
+  // own dependencies because the main program is not known.
+  class lookup_scope {
+    std::vector<int> order_;
+    std::tr1::unordered_map<int, unsigned> position_;
+  public:
+    void compute(const needed_graph &graph, int file)
+    {
+      order_.clear();
+      position_.clear();
+      position_[file] = 0;	// not part of the scope
+      std::vector<int> queue;
+      graph.needed(file, queue);
+      for (size_t i = 0; i < queue.size(); ++i) {
+	int lib = queue[i];
+	if (position_.insert(std::make_pair(lib, order_.size() + 1)).second) {
+	  order_.push_back(lib);
+	  graph.needed(lib, queue);
+	}
+      }
+      position_.erase(file);
+    }
+
+    // Returns the first file in the scope which defines KEY, or 0.
+    int resolve(const definition_index &defs, symbol_key key) const
+    {
+      std::pair<definition_index::const_iterator,
+		definition_index::const_iterator> range(defs.find(key));
+      if (range.first == range.second) {
+	return 0;
+      }
+      if (static_cast<size_t>(range.second - range.first) <= order_.size()) {
+	unsigned best = UINT_MAX;
+	int provider = 0;
+	for (; range.first != range.second; ++range.first) {
+	  std::tr1::unordered_map<int, unsigned>::const_iterator p =
+	    position_.find(range.first->second);
+	  if (p != position_.end() && p->second < best) {
+	    best = p->second;
+	    provider = p->first;
+	  }
+	}
+	return provider;
+      }
+      // Symbols with many definitions (such as _end).
+      for (std::vector<int>::const_iterator p = order_.begin(),
+	     end = order_.end(); p != end; ++p) {
+	if (std::binary_search(range.first, range.second,
+			       std::make_pair(key, *p))) {
+	  return *p;
+	}
+      }
+      return 0;
+    }
+  };
+
+  // Loads the exported definitions of the shared objects in the
+  // package set.  Definitions of the default version are also entered
+  // without version, for unversioned references.
+  void
+  load_definitions(pgconn_handle &conn, database::package_set_id set,
+		   const std::vector<int> &removed,
+		   const std::vector<int> &added,
+		   string_pool &names, string_pool &versions,
+		   definition_index &defs)
+  {
+    pg_cursor cursor
+      (conn, "elf_symbol_binding_definitions",
+       "SELECT file_id, ed.name, COALESCE(ed.version, ''),"
+       " ed.primary_version::integer"
+       " FROM " PACKAGE_SET_MEMBERS_AFTER_DELTA
+       " JOIN symboldb.file f USING (package_id)"
+       " JOIN symboldb.elf_file ef USING (contents_id)"
+       " JOIN symboldb.elf_exported_definition ed USING (contents_id)"
+       " WHERE ef.e_type = 3", set.value(), removed, added);
+    pgresult_handle res;
+    std::vector<int> file;
+    std::vector<unsigned> name;
+    std::vector<unsigned> version;
+    std::vector<int> primary;
+    while (cursor.fetch(res)) {
+      file.clear();
+      pg_column(res, 0, file);
+      name.clear();
+      pg_column(res, 1, names, name);
+      version.clear();
+      pg_column(res, 2, versions, version);
+      primary.clear();
+      pg_column(res, 3, primary);
+      for (size_t row = 0, end = file.size(); row < end; ++row) {
+	defs.add(symbol_key(name[row], version[row]), file[row]);
+	if (version[row] != 0 && primary[row]) {
+	  defs.add(symbol_key(name[row], 0), file[row]);
+	}
+      }
+    }
+    defs.finish();
+  }
+} // namespace
+
+void
+prepare_elf_symbol_binding(pgconn_handle &conn, database::package_set_id set,
+			   const database::package_set_delta &delta)
+{
+  assert(conn.transactionStatus() == PQTRANS_INTRANS);
+  std::vector<int> removed;
+  std::vector<int> added;
+  package_set_delta_ids(delta, removed, added);
+
+  // Version 0 is the empty version.
+  string_pool names;
+  string_pool versions;
+  versions.intern("");
+  definition_index defs;
+  load_definitions(conn, set, removed, added, names, versions, defs);
+  needed_graph graph(conn, set, delta);
+
+  std::string table
+    (package_set_partition_create(conn, "elf_symbol_binding", set));
+
+  // The references are processed in chunks.  The COPY for each chunk
+  // has to wait until the chunk has been fetched because the
+  // connection cannot be used for anything else during COPY.
+  pg_cursor cursor
+    (conn, "elf_symbol_binding_references",
+     "SELECT file_id, er.name, COALESCE(er.version, '')"
+     " FROM " PACKAGE_SET_MEMBERS_AFTER_DELTA
+     " JOIN symboldb.file f USING (package_id)"
+     " JOIN symboldb.elf_reference er USING (contents_id)"
+     " ORDER BY file_id", set.value(), removed, added);
+  pgresult_handle res;
+  std::vector<int> file;
+  std::vector<unsigned> name;
+  std::vector<unsigned> version;
+  std::vector<char> rows;
+  lookup_scope scope;
+  int scope_file = 0;
+  char setbuf[32];
+  snprintf(setbuf, sizeof(setbuf), "%d\t", set.value());
+  while (cursor.fetch(res)) {
+    file.clear();
+    pg_column(res, 0, file);
+    name.clear();
+    pg_column(res, 1, names, name);
+    version.clear();
+    pg_column(res, 2, versions, version);
+    res.close();
+
+    rows.clear();
+    for (size_t row = 0, end = file.size(); row < end; ++row) {
+      if (file[row] != scope_file) {
+	scope.compute(graph, file[row]);
+	scope_file = file[row];
+      }
+      symbol_key key(name[row], version[row]);
+      int provider = scope.resolve(defs, key);
+      rows.insert(rows.end(), setbuf, setbuf + strlen(setbuf));
+      pg_copy_append(rows, file[row]);
+      rows.push_back('\t');
+      pg_copy_append(rows, names[key.first].c_str());
+      rows.push_back('\t');
+      if (key.second == 0) {
+	pg_copy_append_null(rows);
+      } else {
+	pg_copy_append(rows, versions[key.second].c_str());
+      }
+      rows.push_back('\t');
+      if (provider == 0) {
+	pg_copy_append_null(rows);
+      } else {
+	pg_copy_append(rows, provider);
+      }
+      rows.push_back('\n');
+    }
+    pg_copy_rows(conn, table, rows);
+  }
+}
+
+void
+replace_elf_symbol_binding(pgconn_handle &conn, database::package_set_id set)
+{
+  package_set_partition_replace(conn, "elf_symbol_binding", set,
+				binding_indexed);
+}
+
+void
+update_elf_symbol_binding(pgconn_handle &conn, database::package_set_id set)
+{
+  prepare_elf_symbol_binding(conn, set, database::package_set_delta());
+  replace_elf_symbol_binding(conn, set);
+}
@@ -0,0 +1,218 @@
+/*
+ * Copyright (C) 2013 Red Hat, Inc.
+ * Written by Florian Weimer <fweimer@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <symboldb/update_java_class_closure.hpp>
+#include <symboldb/package_set_partition.hpp>
+#include <cxxll/pgresult_handle.hpp>
+#include <cxxll/pg_column.hpp>
+#include <cxxll/pg_copy.hpp>
+#include <cxxll/pg_cursor.hpp>
+#include <cxxll/string_pool.hpp>
+
+#include <algorithm>
+#include <tr1/unordered_set>
+
+#include <assert.h>
+#include <stdio.h>
+
+using namespace cxxll;
+
+namespace {
+  const char *const closure_indexed[] = {"file_id", "name", "provider", NULL};
+
+  // Files in the package set which provide each class, as (interned
+  // class name, file ID) pairs.
+  class provider_index {
+    typedef std::vector<std::pair<unsigned, int> > entries_type;
+    entries_type entries_;
+  public:
+    typedef entries_type::const_iterator const_iterator;
+
+    provider_index(pgconn_handle &conn, database::package_set_id set,
+		   const std::vector<int> &removed,
+		   const std::vector<int> &added, string_pool &names)
+    {
+      pg_cursor cursor
+	(conn, "java_class_closure_providers",
+	 "SELECT file_id, jc.name"
+	 " FROM " PACKAGE_SET_MEMBERS_AFTER_DELTA
+	 " JOIN symboldb.file f USING (package_id)"
+	 " JOIN symboldb.java_class_contents jcc USING (contents_id)"
+	 " JOIN symboldb.java_class jc USING (class_id)",
+	 set.value(), removed, added);
+      pgresult_handle res;
+      std::vector<int> file;
+      std::vector<unsigned> name;
+      while (cursor.fetch(res)) {
+	file.clear();
+	pg_column(res, 0, file);
+	name.clear();
+	pg_column(res, 1, names, name);
+	for (size_t row = 0, end = file.size(); row < end; ++row) {
+	  entries_.push_back(std::make_pair(name[row], file[row]));
+	}
+      }
+      std::sort(entries_.begin(), entries_.end());
+      entries_.erase(std::unique(entries_.begin(), entries_.end()),
+		     entries_.end());
+    }
+
+    // Returns the providers of the class NAME, sorted by file ID.
+    std::pair<const_iterator, const_iterator> find(unsigned name) const
+    {
+      return std::equal_range
+	(entries_.begin(), entries_.end(), std::make_pair(name, 0),
+	 name_less());
+    }
+
+  private:
+    struct name_less {
+      bool operator()(const std::pair<unsigned, int> &a,
+		      const std::pair<unsigned, int> &b) const
+      {
+	return a.first < b.first;
+      }
+    };
+  };
+
+  // Array types are referenced by their descriptor, such as
+  // "[Ljava/lang/Runnable;".  Returns the element class name in
+  // RESULT, or false for arrays of primitive types.
+  bool
+  element_class(const std::string &name, std::string &result)
+  {
+    size_t pos = name.find_first_not_of('[');
+    if (pos == 0) {
+      result = name;
+      return true;
+    }
+    if (pos != std::string::npos && name[pos] == 'L'
+	&& name.size() > pos + 2 && name[name.size() - 1] == ';') {
+      result.assign(name, pos + 1, name.size() - pos - 2);
+      return true;
+    }
+    return false;
+  }
+
+  void
+  append_row(std::vector<char> &rows, const char *setbuf,
+	     int file, const std::string &name, int provider)
+  {
+    pg_copy_append(rows, setbuf);
+    rows.push_back('\t');
+    pg_copy_append(rows, file);
+    rows.push_back('\t');
+    pg_copy_append(rows, name.c_str());
+    rows.push_back('\t');
+    if (provider == 0) {
+      pg_copy_append_null(rows);
+    } else {
+      pg_copy_append(rows, provider);
+    }
+    rows.push_back('\n');
+  }
+} // namespace
+
+void
+prepare_java_class_closure(pgconn_handle &conn, database::package_set_id set,
+			   const database::package_set_delta &delta)
+{
+  assert(conn.transactionStatus() == PQTRANS_INTRANS);
+  std::vector<int> removed;
+  std::vector<int> added;
+  package_set_delta_ids(delta, removed, added);
+
+  string_pool names;
+  provider_index providers(conn, set, removed, added, names);
+
+  std::string table
+    (package_set_partition_create(conn, "java_class_closure", set));
+
+  // A JAR file contains many classes which reference the same
+  // classes, so the references are deduplicated per file.  As in
+  // prepare_elf_symbol_binding(), each chunk is copied after it has
+  // been fetched completely.
+  pg_cursor cursor
+    (conn, "java_class_closure_references",
+     "SELECT file_id, jcr.name"
+     " FROM " PACKAGE_SET_MEMBERS_AFTER_DELTA
+     " JOIN symboldb.file f USING (package_id)"
+     " JOIN symboldb.java_class_contents jcc USING (contents_id)"
+     " JOIN symboldb.java_class_reference jcr USING (class_id)"
+     " ORDER BY file_id", set.value(), removed, added);
+  pgresult_handle res;
+  std::vector<int> file;
+  std::vector<std::string> name;
+  std::vector<char> rows;
+  std::tr1::unordered_set<std::string> seen;
+  int current_file = 0;
+  std::string class_name;
+  char setbuf[32];
+  snprintf(setbuf, sizeof(setbuf), "%d", set.value());
+  while (cursor.fetch(res)) {
+    file.clear();
+    pg_column(res, 0, file);
+    name.clear();
+    pg_column(res, 1, name);
+    res.close();
+
+    rows.clear();
+    for (size_t row = 0, end = file.size(); row < end; ++row) {
+      if (file[row] != current_file) {
+	seen.clear();
+	current_file = file[row];
+      }
+      if (!element_class(name[row], class_name)
+	  || !seen.insert(class_name).second) {
+	continue;
+      }
+      unsigned index;
+      if (!names.find(class_name, index)) {
+	append_row(rows, setbuf, current_file, class_name, 0);
+	continue;
+      }
+      std::pair<provider_index::const_iterator,
+		provider_index::const_iterator> range(providers.find(index));
+      if (std::binary_search(range.first, range.second,
+			     std::make_pair(index, current_file))) {
+	// Provided by the referencing file itself.
+	continue;
+      }
+      for (; range.first != range.second; ++range.first) {
+	append_row(rows, setbuf, current_file, class_name,
+		   range.first->second);
+      }
+    }
+    pg_copy_rows(conn, table, rows);
+  }
+}
+
+void
+replace_java_class_closure(pgconn_handle &conn, database::package_set_id set)
+{
+  package_set_partition_replace(conn, "java_class_closure", set,
+				closure_indexed);
+}
+
+void
+update_java_class_closure(pgconn_handle &conn, database::package_set_id set)
+{
+  prepare_java_class_closure(conn, set, database::package_set_delta());
+  replace_java_class_closure(conn, set);
+}
@@ -0,0 +1,382 @@
+/*
+ * Copyright (C) 2013 Red Hat, Inc.
+ * Written by Florian Weimer <fweimer@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <symboldb/update_rpm_closure.hpp>
+#include <symboldb/package_set_partition.hpp>
+#include <cxxll/pgresult_handle.hpp>
+#include <cxxll/pg_column.hpp>
+#include <cxxll/pg_copy.hpp>
+#include <cxxll/pg_cursor.hpp>
+#include <cxxll/rpm_dependency.hpp>
+#include <cxxll/string_support.hpp>
+#include <cxxll/transitive_closure.hpp>
+
+#include <algorithm>
+#include <tr1/unordered_map>
+
+#include <assert.h>
+
+using namespace cxxll;
+
+namespace {
+  const char *const provider_indexed[] =
+    {"package_id", "capability_id", "provider", NULL};
+  const char *const closure_indexed[] = {"package_id", "needed", NULL};
+
+  // Dense node numbers for the packages in the set.
+  struct package_nodes {
+    std::vector<int> packages;
+    std::tr1::unordered_map<int, unsigned> nodes;
+
+    unsigned node(int package)
+    {
+      std::pair<std::tr1::unordered_map<int, unsigned>::iterator, bool> ins
+	(nodes.insert(std::make_pair(package, packages.size())));
+      if (ins.second) {
+	packages.push_back(package);
+      }
+      return ins.first->second;
+    }
+  };
+
+  // The versioned Provides of the package set, indexed by capability
+  // ID.  The capability names are not needed for the comparison.
+  typedef std::vector<std::pair<unsigned, rpm_dependency> > provider_list;
+  typedef std::tr1::unordered_map<int, provider_list> provide_map;
+
+  void
+  load_provides(pgconn_handle &conn, database::package_set_id set,
+		const std::vector<int> &removed, const std::vector<int> &added,
+		package_nodes &nodes, provide_map &provides)
+  {
+    pg_cursor cursor
+      (conn, "rpm_closure_provides",
+       "SELECT package_id, capability_id, COALESCE(op, ''),"
+       " COALESCE(version, '')"
+       " FROM " PACKAGE_SET_MEMBERS_AFTER_DELTA
+       " JOIN symboldb.package_dependency pd USING (package_id)"
+       " WHERE pd.kind = 'provides'", set.value(), removed, added);
+    pgresult_handle res;
+    std::vector<int> package;
+    std::vector<int> capability;
+    std::vector<std::string> op;
+    std::vector<std::string> version;
+    while (cursor.fetch(res)) {
+      package.clear();
+      pg_column(res, 0, package);
+      capability.clear();
+      pg_column(res, 1, capability);
+      op.clear();
+      pg_column(res, 2, op);
+      version.clear();
+      pg_column(res, 3, version);
+      for (size_t row = 0, end = package.size(); row < end; ++row) {
+	provider_list &list(provides[capability[row]]);
+	list.push_back(std::make_pair(nodes.node(package[row]),
+				      rpm_dependency()));
+	rpm_dependency &dep(list.back().second);
+	dep.kind = rpm_dependency::provide;
+	dep.set_op(op[row]);
+	dep.version.swap(version[row]);
+      }
+    }
+  }
+
+  struct require_entry {
+    unsigned node;
+    int capability;
+    rpm_dependency dep;
+  };
+
+  // Loads the Requires of the package set.  Requirements on
+  // rpmlib(...) features are satisfied by RPM itself and skipped.
+  void
+  load_requires(pgconn_handle &conn, database::package_set_id set,
+		const std::vector<int> &removed, const std::vector<int> &added,
+		package_nodes &nodes, std::vector<require_entry> &requirements)
+  {
+    pg_cursor cursor
+      (conn, "rpm_closure_requires",
+       "SELECT package_id, capability_id, rc.name, COALESCE(op, ''),"
+       " COALESCE(version, '')"
+       " FROM " PACKAGE_SET_MEMBERS_AFTER_DELTA
+       " JOIN symboldb.package_dependency pd USING (package_id)"
+       " JOIN symboldb.rpm_capability rc USING (capability_id)"
+       " WHERE pd.kind = 'requires'", set.value(), removed, added);
+    pgresult_handle res;
+    std::vector<int> package;
+    std::vector<int> capability;
+    std::vector<std::string> name;
+    std::vector<std::string> op;
+    std::vector<std::string> version;
+    while (cursor.fetch(res)) {
+      package.clear();
+      pg_column(res, 0, package);
+      capability.clear();
+      pg_column(res, 1, capability);
+      name.clear();
+      pg_column(res, 2, name);
+      op.clear();
+      pg_column(res, 3, op);
+      version.clear();
+      pg_column(res, 4, version);
+      for (size_t row = 0, end = package.size(); row < end; ++row) {
+	if (starts_with(name[row], "rpmlib(")) {
+	  continue;
+	}
+	requirements.push_back(require_entry());
+	require_entry &req(requirements.back());
+	req.node = nodes.node(package[row]);
+	req.capability = capability[row];
+	req.dep.capability.swap(name[row]);
+	req.dep.set_op(op[row]);
+	req.dep.version.swap(version[row]);
+      }
+    }
+  }
+
+  // Packages which contain each required path, as (path, node) pairs
+  // sorted by path.
+  typedef std::vector<std::pair<std::string, unsigned> > file_provider_list;
+
+  void
+  load_file_provides(pgconn_handle &conn, database::package_set_id set,
+		     const std::vector<int> &removed,
+		     const std::vector<int> &added, package_nodes &nodes,
+		     const std::vector<require_entry> &requirements,
+		     file_provider_list &result)
+  {
+    std::vector<std::string> paths;
+    for (std::vector<require_entry>::const_iterator
+	   p = requirements.begin(), end = requirements.end(); p != end; ++p) {
+      if (starts_with(p->dep.capability, "/")) {
+	paths.push_back(p->dep.capability);
+      }
+    }
+    std::sort(paths.begin(), paths.end());
+    paths.erase(std::unique(paths.begin(), paths.end()), paths.end());
+    if (paths.empty()) {
+      return;
+    }
+
+    pgresult_handle res;
+    pg_query_binary
+      (conn, res,
+       "SELECT name, package_id FROM " PACKAGE_SET_MEMBERS_AFTER_DELTA
+       " JOIN (SELECT package_id, name FROM symboldb.file"
+       "  UNION ALL SELECT package_id, name FROM symboldb.directory"
+       "  UNION ALL SELECT package_id, name FROM symboldb.symlink) f"
+       " USING (package_id)"
+       " WHERE f.name = ANY ($4)", set.value(), removed, added, paths);
+    std::vector<std::string> name;
+    std::vector<int> package;
+    pg_column(res, 0, name);
+    pg_column(res, 1, package);
+    for (size_t row = 0, end = name.size(); row < end; ++row) {
+      result.push_back(std::make_pair(std::string(), nodes.node(package[row])));
+      result.back().first.swap(name[row]);
+    }
+    std::sort(result.begin(), result.end());
+    result.erase(std::unique(result.begin(), result.end()), result.end());
+  }
+
+  // Provider node of unresolved requirements.
+  const unsigned unresolved = ~0U;
+
+  struct provider_row {
+    unsigned node;
+    int capability;
+    unsigned provider;		// node or unresolved
+
+    bool operator<(const provider_row &other) const
+    {
+      if (node != other.node) {
+	return node < other.node;
+      }
+      if (capability != other.capability) {
+	return capability < other.capability;
+      }
+      return provider < other.provider;
+    }
+
+    bool operator==(const provider_row &other) const
+    {
+      return node == other.node && capability == other.capability
+	&& provider == other.provider;
+    }
+  };
+
+  void
+  resolve(const std::vector<require_entry> &requirements,
+	  const provide_map &provides, const file_provider_list &files,
+	  std::vector<provider_row> &rows)
+  {
+    for (std::vector<require_entry>::const_iterator
+	   p = requirements.begin(), end = requirements.end(); p != end; ++p) {
+      provider_row row;
+      row.node = p->node;
+      row.capability = p->capability;
+      bool found = false;
+      if (starts_with(p->dep.capability, "/")) {
+	file_provider_list::const_iterator q = std::lower_bound
+	  (files.begin(), files.end(), std::make_pair(p->dep.capability, 0U));
+	for (; q != files.end() && q->first == p->dep.capability; ++q) {
+	  found = true;
+	  if (q->second != p->node) {
+	    row.provider = q->second;
+	    rows.push_back(row);
+	  }
+	}
+      }
+      provide_map::const_iterator q = provides.find(p->capability);
+      if (q != provides.end()) {
+	for (provider_list::const_iterator
+	       r = q->second.begin(), rend = q->second.end(); r != rend; ++r) {
+	  if (p->dep.overlaps(r->second)) {
+	    found = true;
+	    if (r->first != p->node) {
+	      row.provider = r->first;
+	      rows.push_back(row);
+	    }
+	  }
+	}
+      }
+      if (!found) {
+	row.provider = unresolved;
+	rows.push_back(row);
+      }
+    }
+    std::sort(rows.begin(), rows.end());
+    rows.erase(std::unique(rows.begin(), rows.end()), rows.end());
+  }
+
+  void
+  write_providers(pgconn_handle &conn, const std::string &table,
+		  database::package_set_id set, const package_nodes &nodes,
+		  const std::vector<provider_row> &rows)
+  {
+    std::vector<char> buf;
+    for (size_t i = 0, end = rows.size(); i < end; ) {
+      buf.clear();
+      // Chunks keep the client-side buffer small.
+      for (size_t chunk_end = std::min(end, i + 65536); i < chunk_end; ++i) {
+	const provider_row &row(rows[i]);
+	pg_copy_append(buf, set.value());
+	buf.push_back('\t');
+	pg_copy_append(buf, nodes.packages[row.node]);
+	buf.push_back('\t');
+	pg_copy_append(buf, row.capability);
+	buf.push_back('\t');
+	if (row.provider == unresolved) {
+	  pg_copy_append_null(buf);
+	} else {
+	  pg_copy_append(buf, nodes.packages[row.provider]);
+	}
+	buf.push_back('\n');
+      }
+      pg_copy_rows(conn, table, buf);
+    }
+  }
+
+  void
+  write_closure(pgconn_handle &conn, const std::string &table,
+		database::package_set_id set, const package_nodes &nodes,
+		const std::vector<provider_row> &rows)
+  {
+    std::vector<directed_graph::edge> edges;
+    for (std::vector<provider_row>::const_iterator
+	   p = rows.begin(), end = rows.end(); p != end; ++p) {
+      if (p->provider != unresolved) {
+	edges.push_back(directed_graph::edge(p->node, p->provider));
+      }
+    }
+    directed_graph graph(nodes.packages.size(), edges);
+    edges.clear();
+    transitive_closure closure(graph);
+
+    std::vector<char> buf;
+    for (unsigned node = 0, end = nodes.packages.size(); node < end; ++node) {
+      const std::vector<unsigned> &needed(closure[node]);
+      for (std::vector<unsigned>::const_iterator
+	     p = needed.begin(), pend = needed.end(); p != pend; ++p) {
+	if (*p == node) {
+	  continue;
+	}
+	pg_copy_append(buf, set.value());
+	buf.push_back('\t');
+	pg_copy_append(buf, nodes.packages[node]);
+	buf.push_back('\t');
+	pg_copy_append(buf, nodes.packages[*p]);
+	buf.push_back('\n');
+      }
+      if (buf.size() > 1024 * 1024) {
+	pg_copy_rows(conn, table, buf);
+	buf.clear();
+      }
+    }
+    pg_copy_rows(conn, table, buf);
+  }
+} // namespace
+
+void
+prepare_rpm_closure(pgconn_handle &conn, database::package_set_id set,
+		    const database::package_set_delta &delta)
+{
+  assert(conn.transactionStatus() == PQTRANS_INTRANS);
+  std::vector<int> removed;
+  std::vector<int> added;
+  package_set_delta_ids(delta, removed, added);
+
+  package_nodes nodes;
+  provide_map provides;
+  load_provides(conn, set, removed, added, nodes, provides);
+  std::vector<require_entry> requirements;
+  load_requires(conn, set, removed, added, nodes, requirements);
+  file_provider_list files;
+  load_file_provides(conn, set, removed, added, nodes, requirements, files);
+
+  std::vector<provider_row> rows;
+  resolve(requirements, provides, files, rows);
+  requirements.clear();
+  provides.clear();
+  files.clear();
+
+  write_providers
+    (conn, package_set_partition_create(conn, "package_require_provider", set),
+     set, nodes, rows);
+  write_closure
+    (conn, package_set_partition_create(conn, "package_install_closure", set),
+     set, nodes, rows);
+}
+
+void
+replace_rpm_closure(pgconn_handle &conn, database::package_set_id set)
+{
+  package_set_partition_replace(conn, "package_require_provider", set,
+				provider_indexed);
+  package_set_partition_replace(conn, "package_install_closure", set,
+				closure_indexed);
+}
+
+void
+update_rpm_closure(pgconn_handle &conn, database::package_set_id set)
+{
+  prepare_rpm_closure(conn, set, database::package_set_delta());
+  replace_rpm_closure(conn, set);
+}
@@ -94,6 +94,51 @@ CREATE INDEX ON symboldb.package_digest (package_id);
 COMMENT ON table symboldb.package_digest IS
   'SHA-1 and SHA-256 hashes of multiple representations of the same RPM package';
 
+CREATE TABLE symboldb.rpm_capability (
+  capability_id SERIAL NOT NULL PRIMARY KEY,
+  name TEXT NOT NULL UNIQUE CHECK (LENGTH(name) > 0) COLLATE "C"
+);
+COMMENT ON TABLE symboldb.rpm_capability IS
+  'interned names of RPM capabilities';
+
+CREATE FUNCTION symboldb.intern_rpm_capability (TEXT) RETURNS INTEGER
+LANGUAGE plpgsql AS $$
+DECLARE
+  cid INTEGER;
+BEGIN
+  LOOP
+    SELECT capability_id INTO cid
+      FROM symboldb.rpm_capability WHERE name = $1;
+    IF FOUND THEN
+      RETURN cid;
+    END IF;
+    BEGIN
+      INSERT INTO symboldb.rpm_capability (name) VALUES ($1)
+        RETURNING capability_id INTO cid;
+      RETURN cid;
+    EXCEPTION WHEN unique_violation THEN
+      -- Inserted concurrently.  Try the lookup again.
+    END;
+  END LOOP;
+END;
+$$;
+
+CREATE TYPE symboldb.rpm_dependency_kind AS ENUM ('requires', 'provides');
+
+CREATE TABLE symboldb.package_dependency (
+  package_id INTEGER NOT NULL
+    REFERENCES symboldb.package ON DELETE CASCADE,
+  kind symboldb.rpm_dependency_kind NOT NULL,
+  capability_id INTEGER NOT NULL REFERENCES symboldb.rpm_capability,
+  op TEXT CHECK (op IN ('<', '<=', '=', '>=', '>')),
+  version TEXT CHECK (LENGTH(version) > 0) COLLATE "C",
+  CHECK ((op IS NULL) = (version IS NULL))
+);
+CREATE INDEX ON symboldb.package_dependency (package_id);
+CREATE INDEX ON symboldb.package_dependency (capability_id);
+COMMENT ON TABLE symboldb.package_dependency IS
+  'Requires and Provides entries of RPM packages';
+
 CREATE TABLE symboldb.package_set (
   set_id SERIAL NOT NULL PRIMARY KEY,
   name TEXT NOT NULL UNIQUE COLLATE "C"
@@ -107,6 +152,22 @@ CREATE TABLE symboldb.package_set_member (
 CREATE INDEX ON symboldb.package_set_member (set_id);
 CREATE INDEX ON symboldb.package_set_member (package_id);
 
+CREATE TABLE symboldb.package_set_repository (
+  set_id INTEGER NOT NULL
+    REFERENCES symboldb.package_set ON DELETE CASCADE,
+  url TEXT NOT NULL COLLATE "C",
+  revision TEXT NOT NULL,
+  primary_digest BYTEA NOT NULL,
+  exclude_name TEXT NOT NULL,
+  PRIMARY KEY (set_id, url)
+);
+COMMENT ON TABLE symboldb.package_set_repository IS
+  'repositories from which the package set was last updated';
+COMMENT ON COLUMN symboldb.package_set_repository.primary_digest IS
+  'checksum of the primary.xml file, as listed in repomd.xml';
+COMMENT ON COLUMN symboldb.package_set_repository.exclude_name IS
+  'combined --exclude-name regular expression, or empty';
+
 CREATE TABLE symboldb.file_contents (
   contents_id SERIAL NOT NULL PRIMARY KEY,
   mode INTEGER NOT NULL CHECK (mode >= 0),
@@ -218,7 +279,15 @@ CREATE TABLE symboldb.elf_file (
   e_machine symboldb.elf_short NOT NULL,
   arch symboldb.elf_arch,
   soname TEXT COLLATE "C",
-  build_id BYTEA CHECK (LENGTH(build_id) > 0)
+  build_id BYTEA CHECK (LENGTH(build_id) > 0),
+  -- Blocked Bloom filter over the names of exported symbols, see
+  -- cxxll::symbol_bloom.  NULL for files loaded before the filter
+  -- was introduced.
+  symbol_filter BYTEA
+    CHECK (LENGTH(symbol_filter) > 0 AND LENGTH(symbol_filter) % 8 = 0),
+  -- SHA-256 hash over the sorted exported symbols (name, version,
+  -- type, binding, visibility).  Equal fingerprints mean equal ABIs.
+  symbol_fingerprint BYTEA CHECK (LENGTH(symbol_fingerprint) = 32)
 );
 
 CREATE TABLE symboldb.elf_definition (
@@ -239,6 +308,16 @@ CREATE TABLE symboldb.elf_definition (
 CREATE INDEX ON symboldb.elf_definition (contents_id);
 CREATE INDEX ON symboldb.elf_definition (name, version);
 
+-- Definitions which can be bound by other objects (binding <>
+-- STB_LOCAL, section <> SHN_UNDEF, default or protected visibility).
+-- This has to match cxxll::elf_symbol_definition::exported(), which
+-- selects the symbols for elf_file.symbol_filter and
+-- elf_file.symbol_fingerprint.
+CREATE VIEW symboldb.elf_exported_definition AS
+  SELECT * FROM symboldb.elf_definition
+  WHERE binding <> 0 AND section <> 0
+  AND visibility IN ('default', 'protected');
+
 CREATE TABLE symboldb.elf_reference (
   contents_id INTEGER NOT NULL
     REFERENCES symboldb.file_contents ON DELETE CASCADE,
@@ -279,14 +358,69 @@ CREATE TABLE symboldb.elf_error (
   message TEXT
 );
 
+-- The closure of each package set is stored in a separate table,
+-- symboldb.elf_closure_<set_id>, which inherits from this one.
+-- Recomputing the closure replaces that table as a whole.
 CREATE TABLE symboldb.elf_closure (
-  set_id INTEGER NOT NULL REFERENCES symboldb.package_set
-    ON DELETE CASCADE,
-  file_id INTEGER NOT NULL REFERENCES symboldb.file,
-  needed INTEGER NOT NULL REFERENCES symboldb.file
+  set_id INTEGER NOT NULL,
+  file_id INTEGER NOT NULL,
+  needed INTEGER NOT NULL
+);
+COMMENT ON TABLE symboldb.elf_closure IS
+  'files needed by an ELF file, per package set (partitioned by set_id)';
+
+
+-- Resolution of undefined symbols to the shared objects which define
+-- them.  Partitioned by package set, like symboldb.elf_closure.
+CREATE TABLE symboldb.elf_symbol_binding (
+  set_id INTEGER NOT NULL,
+  file_id INTEGER NOT NULL,
+  name TEXT NOT NULL COLLATE "C",
+  version TEXT COLLATE "C",
+  provider INTEGER
+);
+COMMENT ON TABLE symboldb.elf_symbol_binding IS
+  'undefined symbols of ELF files and their definitions, per package set';
+COMMENT ON COLUMN symboldb.elf_symbol_binding.provider IS
+  'file ID of the defining shared object, NULL if unresolved';
+
+-- Requires of the packages in a package set, resolved to the
+-- packages which satisfy them.  Partitioned by package set, like
+-- symboldb.elf_closure.
+CREATE TABLE symboldb.package_require_provider (
+  set_id INTEGER NOT NULL,
+  package_id INTEGER NOT NULL,
+  capability_id INTEGER NOT NULL,
+  provider INTEGER
 );
-CREATE INDEX ON symboldb.elf_closure (file_id);
-CREATE INDEX ON symboldb.elf_closure (needed);
+COMMENT ON TABLE symboldb.package_require_provider IS
+  'packages satisfying the requirements of a package, per package set';
+COMMENT ON COLUMN symboldb.package_require_provider.provider IS
+  'package ID of a provider (one row per provider), NULL if unresolved';
+
+-- Transitive closure of symboldb.package_require_provider.
+CREATE TABLE symboldb.package_install_closure (
+  set_id INTEGER NOT NULL,
+  package_id INTEGER NOT NULL,
+  needed INTEGER NOT NULL
+);
+COMMENT ON TABLE symboldb.package_install_closure IS
+  'packages which may be needed to install a package, per package set';
+
+CREATE FUNCTION symboldb.drop_package_set_partitions () RETURNS TRIGGER
+LANGUAGE plpgsql AS $$
+BEGIN
+  EXECUTE 'DROP TABLE IF EXISTS symboldb.elf_closure_' || OLD.set_id
+    || ', symboldb.elf_symbol_binding_' || OLD.set_id
+    || ', symboldb.java_class_closure_' || OLD.set_id
+    || ', symboldb.package_require_provider_' || OLD.set_id
+    || ', symboldb.package_install_closure_' || OLD.set_id;
+  RETURN OLD;
+END;
+$$;
+CREATE TRIGGER drop_package_set_partitions
+  AFTER DELETE ON symboldb.package_set
+  FOR EACH ROW EXECUTE PROCEDURE symboldb.drop_package_set_partitions();
 
 -- Java classes.
 
@@ -348,15 +482,34 @@ CREATE TABLE symboldb.java_class_contents (
 );
 CREATE INDEX ON symboldb.java_class_contents (class_id);
 
+-- Resolution of Java class references to the files which provide the
+-- referenced classes.  Partitioned by package set, like
+-- symboldb.elf_closure.
+CREATE TABLE symboldb.java_class_closure (
+  set_id INTEGER NOT NULL,
+  file_id INTEGER NOT NULL,
+  name TEXT NOT NULL COLLATE "C",
+  provider INTEGER
+);
+COMMENT ON TABLE symboldb.java_class_closure IS
+  'classes referenced by Java files and their providers, per package set';
+COMMENT ON COLUMN symboldb.java_class_closure.provider IS
+  'file ID of a providing file (one row per provider), NULL if missing';
+
 -- URL cache (mainly for raw repository metadata).
 
 CREATE TABLE symboldb.url_cache (
   url TEXT NOT NULL PRIMARY KEY CHECK (url LIKE '%:%') COLLATE "C",
   http_time BIGINT NOT NULL,
-  data BYTEA,
+  digest BYTEA NOT NULL CHECK (LENGTH(digest) = 32),
+  etag TEXT,
   last_change TIMESTAMP WITHOUT TIME ZONE
 );
 COMMENT ON TABLE symboldb.url_cache IS 'cache for URL downloads';
+COMMENT ON COLUMN symboldb.url_cache.digest IS
+  'SHA-256 digest of the data, which is stored in the file system';
+COMMENT ON COLUMN symboldb.url_cache.etag IS
+  'entity tag sent by the server, used for conditional requests';
 
 -- Formatting file modes.
 
@@ -40,6 +40,7 @@
 #include <cxxll/curl_exception_dump.hpp>
 #include <cxxll/file_handle.hpp>
 #include <symboldb/get_file.hpp>
+#include <symboldb/symbol_collisions.hpp>
 
 #include <getopt.h>
 #include <stdio.h>
@@ -132,15 +133,7 @@ do_update_set(const symboldb_options &opt, database &db, char **argv)
     ids = psc.values();
   }
 
-  db.txn_begin();
-  {
-    database::advisory_lock lock
-      (db.lock(database::PACKAGE_SET_LOCK_TAG, set.value()));
-    if (db.update_package_set(set, ids)) {
-      finalize_package_set(opt, db, set);
-    }
-  }
-  db.txn_commit();
+  replace_package_set(opt, db, set, ids, NULL);
   return 0;
 }
 
@@ -228,12 +221,79 @@ do_show_stale_cached_rpms(const symboldb_options &opt, database &db)
   return 0;
 }
 
+static database::report_format
+report_format(const symboldb_options &opt)
+{
+  database::report_format format;
+  format.sorted = opt.sort_report;
+  format.json = opt.json_report;
+  return format;
+}
+
 static int
 do_show_soname_conflicts(const symboldb_options &opt, database &db)
 {
   database::package_set_id pset = db.lookup_package_set(opt.set_name.c_str());
   if (pset > database::package_set_id()) {
-    db.print_elf_soname_conflicts(pset);
+    db.print_elf_soname_conflicts(pset, report_format(opt));
+    return 0;
+  } else {
+    fprintf(stderr, "error: invalid package set: %s\n", opt.set_name.c_str());
+    return 1;
+  }
+}
+
+static int
+do_show_symbol_definitions(const symboldb_options &opt, database &db,
+			   char **argv)
+{
+  database::package_set_id pset = db.lookup_package_set(opt.set_name.c_str());
+  if (pset > database::package_set_id()) {
+    std::vector<std::string> names;
+    for (; *argv; ++argv) {
+      names.push_back(*argv);
+    }
+    db.print_symbol_definitions(pset, names, report_format(opt));
+    return 0;
+  } else {
+    fprintf(stderr, "error: invalid package set: %s\n", opt.set_name.c_str());
+    return 1;
+  }
+}
+
+static int
+do_diff_sets(const symboldb_options &opt, database &db)
+{
+  size_t comma = opt.set_name.find(',');
+  if (comma == std::string::npos || comma == 0
+      || comma + 1 == opt.set_name.size()) {
+    fprintf(stderr, "error: expected two package sets: %s\n",
+	    opt.set_name.c_str());
+    return 1;
+  }
+  std::string names[2] = {opt.set_name.substr(0, comma),
+			  opt.set_name.substr(comma + 1)};
+  database::package_set_id psets[2];
+  for (int i = 0; i < 2; ++i) {
+    psets[i] = db.lookup_package_set(names[i].c_str());
+    if (psets[i] == database::package_set_id()) {
+      fprintf(stderr, "error: invalid package set: %s\n", names[i].c_str());
+      return 1;
+    }
+  }
+  db.print_abi_diff(psets[0], psets[1], report_format(opt));
+  return 0;
+}
+
+static int
+do_show_symbol_collisions(const symboldb_options &opt, database &db)
+{
+  database::package_set_id pset = db.lookup_package_set(opt.set_name.c_str());
+  if (pset > database::package_set_id()) {
+    db.print_symbol_collisions
+      (pset, symbol_collision_filter(opt.symbol_collision_path(),
+				     opt.ignore_symbol()),
+       report_format(opt));
     return 0;
   } else {
     fprintf(stderr, "error: invalid package set: %s\n", opt.set_name.c_str());
@@ -315,14 +375,26 @@ usage(const char *progname, const char *error = NULL)
 "  %1$s --show-source-packages [OPTIONS] URL...\n"
 "  %1$s --show-stale-cached-rpms [OPTIONS]\n"
 "  %1$s --show-soname-conflicts=PACKAGE-SET [OPTIONS]\n"
+"  %1$s --show-symbol-collisions=PACKAGE-SET [OPTIONS]\n"
+"  %1$s --show-symbol-definitions=PACKAGE-SET [OPTIONS] SYMBOL...\n"
+"  %1$s --diff-sets=OLD-SET,NEW-SET [OPTIONS]\n"
 "\nOptions:\n"
 "  --randomize            perform downloads in random order\n"
+"  --download-jobs=N      download up to N RPMs concurrently (default 4)\n"
+"  --connections-per-host=N   limit concurrent downloads per host (default 2)\n"
+"  --load-jobs=N          load up to N downloaded RPMs concurrently (default 1)\n"
 "  --exclude-name=REGEXP  exclude packages whose name matches REGEXP\n"
 "  --quiet, -q            less output\n"
 "  --cache=DIR, -C        path to the cache (default: ~/.cache/symboldb)\n"
 "  --ignore-download-errors   process repositories with download errors\n"
+"  --ignore-symbol=REGEXP     do not report symbol collisions for REGEXP\n"
+"  --no-default-ignore-symbols  report collisions for toolchain symbols\n"
+"  --symbol-collision-path=REGEXP  check shared objects matching REGEXP\n"
+"  --sort                 sort reports by file name\n"
+"  --json                 print reports as one JSON object per line\n"
 "  --no-net, -N           disable most network access\n"
-"  --verbose, -v          more verbose output\n\n",
+"  --verbose, -v          more verbose output\n\n"
+"Repository URLs can be given as metalink=URL or mirrorlist=URL.\n\n",
 	  progname);
   exit(2);
 }
@@ -345,6 +417,9 @@ namespace {
       show_source_packages,
       show_stale_cached_rpms,
       show_soname_conflicts,
+      show_symbol_collisions,
+      show_symbol_definitions,
+      diff_sets,
       expire,
       run_example,
     } type;
@@ -355,6 +430,14 @@ namespace {
       exclude_name,
       ignore_download_errors,
       randomize,
+      ignore_symbol,
+      no_default_ignore_symbols,
+      symbol_collision_path,
+      sort_report,
+      json_report,
+      download_jobs,
+      connections_per_host,
+      load_jobs,
     } type;
   }
 }
@@ -382,6 +465,11 @@ main(int argc, char **argv)
        command::show_stale_cached_rpms},
       {"show-soname-conflicts", required_argument, 0,
        command::show_soname_conflicts},
+      {"show-symbol-collisions", required_argument, 0,
+       command::show_symbol_collisions},
+      {"show-symbol-definitions", required_argument, 0,
+       command::show_symbol_definitions},
+      {"diff-sets", required_argument, 0, command::diff_sets},
       {"expire", no_argument, 0, command::expire},
       {"run-example", no_argument, 0, command::run_example},
       {"exclude-name", required_argument, 0, options::exclude_name},
@@ -390,6 +478,17 @@ main(int argc, char **argv)
       {"no-net", no_argument, 0, 'N'},
       {"ignore-download-errors", no_argument, 0,
        options::ignore_download_errors},
+      {"ignore-symbol", required_argument, 0, options::ignore_symbol},
+      {"no-default-ignore-symbols", no_argument, 0,
+       options::no_default_ignore_symbols},
+      {"symbol-collision-path", required_argument, 0,
+       options::symbol_collision_path},
+      {"sort", no_argument, 0, options::sort_report},
+      {"json", no_argument, 0, options::json_report},
+      {"download-jobs", required_argument, 0, options::download_jobs},
+      {"connections-per-host", required_argument, 0,
+       options::connections_per_host},
+      {"load-jobs", required_argument, 0, options::load_jobs},
       {"verbose", no_argument, 0, 'v'},
       {"quiet", no_argument, 0, 'q'},
       {0, 0, 0, 0}
@@ -415,6 +514,9 @@ main(int argc, char **argv)
       case command::update_set:
       case command::update_set_from_repo:
       case command::show_soname_conflicts:
+      case command::show_symbol_collisions:
+      case command::show_symbol_definitions:
+      case command::diff_sets:
 	if (optarg[0] == '\0') {
 	  usage(argv[0], "invalid package set name");
 	}
@@ -444,6 +546,30 @@ main(int argc, char **argv)
       case options::ignore_download_errors:
 	opt.ignore_download_errors = true;
 	break;
+      case options::ignore_symbol:
+	opt.add_ignore_symbol(optarg);
+	break;
+      case options::no_default_ignore_symbols:
+	opt.default_ignore_symbols = false;
+	break;
+      case options::symbol_collision_path:
+	opt.set_symbol_collision_path(optarg);
+	break;
+      case options::sort_report:
+	opt.sort_report = true;
+	break;
+      case options::json_report:
+	opt.json_report = true;
+	break;
+      case options::download_jobs:
+	opt.set_download_jobs(optarg);
+	break;
+      case options::connections_per_host:
+	opt.set_connections_per_host(optarg);
+	break;
+      case options::load_jobs:
+	opt.set_load_jobs(optarg);
+	break;
       default:
 	usage(argv[0]);
       }
@@ -457,12 +583,15 @@ main(int argc, char **argv)
     case command::download_repo:
     case command::load_repo:
     case command::run_example:
+    case command::show_symbol_definitions:
       if (argc == optind) {
 	usage(argv[0]);
       }
       break;
     case command::create_schema:
     case command::show_soname_conflicts:
+    case command::show_symbol_collisions:
+    case command::diff_sets:
     case command::expire:
       if (argc != optind) {
 	usage(argv[0]);
@@ -519,6 +648,12 @@ main(int argc, char **argv)
       return do_show_stale_cached_rpms(opt, db);
     case command::show_soname_conflicts:
       return do_show_soname_conflicts(opt, db);
+    case command::show_symbol_collisions:
+      return do_show_symbol_collisions(opt, db);
+    case command::show_symbol_definitions:
+      return do_show_symbol_definitions(opt, db, argv + optind);
+    case command::diff_sets:
+      return do_diff_sets(opt, db);
     case command::expire:
       expire(opt, db);
       return 0;
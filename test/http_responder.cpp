@@ -0,0 +1,462 @@
+/*
+ * Copyright (C) 2013 Red Hat, Inc.
+ * Written by Florian Weimer <fweimer@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "http_responder.hpp"
+
+#include <cxxll/fd_handle.hpp>
+#include <cxxll/os_exception.hpp>
+#include <cxxll/task.hpp>
+
+#include <map>
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+using namespace cxxll;
+
+namespace {
+  // Serializes access to a mutex in its scope.
+  struct mutex_guard {
+    pthread_mutex_t &mutex_;
+    explicit mutex_guard(pthread_mutex_t &mutex)
+      : mutex_(mutex)
+    {
+      pthread_mutex_lock(&mutex_);
+    }
+    ~mutex_guard()
+    {
+      pthread_mutex_unlock(&mutex_);
+    }
+  };
+
+  struct resource {
+    std::vector<unsigned char> data;
+    std::string etag;
+  };
+
+  struct connection {
+    fd_handle fd;
+    std::string request;	// received so far
+    std::string response;	// set once the request is complete
+    long long due;		// time of the response, in milliseconds
+    connection()
+      : due(-1)
+    {
+    }
+  };
+
+  long long
+  now()
+  {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000LL + ts.tv_nsec / 1000000;
+  }
+
+  // Returns the value of the header NAME (including the colon), or
+  // an empty string.
+  std::string
+  header_value(const std::string &request, const char *name)
+  {
+    size_t namelen = strlen(name);
+    size_t pos = request.find("\r\n");
+    while (pos != std::string::npos) {
+      pos += 2;
+      size_t end = request.find("\r\n", pos);
+      if (end == std::string::npos) {
+	break;
+      }
+      if (end - pos > namelen
+	  && strncasecmp(request.c_str() + pos, name, namelen) == 0) {
+	size_t start = request.find_first_not_of(" \t", pos + namelen);
+	if (start != std::string::npos && start < end) {
+	  return request.substr(start, end - start);
+	}
+      }
+      pos = end;
+    }
+    return std::string();
+  }
+
+  void
+  append_status(std::string &response, const char *status)
+  {
+    response += "HTTP/1.1 ";
+    response += status;
+    response += "\r\nConnection: close\r\n";
+  }
+
+  void
+  append_number(std::string &response, const char *name, long long value)
+  {
+    char buf[64];
+    snprintf(buf, sizeof(buf), "%s: %lld\r\n", name, value);
+    response += buf;
+  }
+}
+
+struct http_responder::impl {
+  mutable pthread_mutex_t lock;
+  std::map<std::string, resource> resources;
+  std::vector<std::string> requests;
+  unsigned delay;
+  bool ignore_ranges;
+  unsigned concurrent;
+  unsigned max_concurrent;
+
+  fd_handle listener;
+  fd_handle wake_read;
+  fd_handle wake_write;
+  unsigned short port;
+  std::tr1::shared_ptr<task> thread;
+
+  impl();
+  ~impl();
+
+  void run() throw();
+  void loop();
+  void respond(connection &);
+  void send(connection &);
+};
+
+http_responder::impl::impl()
+  : delay(0), ignore_ranges(false), concurrent(0), max_concurrent(0),
+    port(0)
+{
+  pthread_mutex_init(&lock, NULL);
+  int fds[2];
+  if (pipe2(fds, O_CLOEXEC) != 0) {
+    throw os_exception().function(pipe2);
+  }
+  wake_read.reset(fds[0]);
+  wake_write.reset(fds[1]);
+
+  listener.reset(socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0));
+  if (listener.get() < 0) {
+    throw os_exception().function(socket);
+  }
+  struct sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  socklen_t addrlen = sizeof(addr);
+  if (bind(listener.get(), reinterpret_cast<sockaddr *>(&addr), addrlen) != 0) {
+    throw os_exception().function(bind).fd(listener.get());
+  }
+  if (listen(listener.get(), 16) != 0) {
+    throw os_exception().function(listen).fd(listener.get());
+  }
+  if (getsockname(listener.get(),
+		  reinterpret_cast<sockaddr *>(&addr), &addrlen) != 0) {
+    throw os_exception().function(getsockname).fd(listener.get());
+  }
+  port = ntohs(addr.sin_port);
+  thread.reset(new task(std::tr1::bind(&impl::run, this)));
+}
+
+http_responder::impl::~impl()
+{
+  if (thread) {
+    char c = 0;
+    while (write(wake_write.get(), &c, 1) < 0 && errno == EINTR)
+      ;
+    thread->wait();
+  }
+  pthread_mutex_destroy(&lock);
+}
+
+void
+http_responder::impl::run() throw()
+{
+  try {
+    loop();
+  } catch (std::exception &e) {
+    fprintf(stderr, "error: http_responder: %s\n", e.what());
+    abort();
+  }
+}
+
+void
+http_responder::impl::loop()
+{
+  std::vector<std::tr1::shared_ptr<connection> > connections;
+  while (true) {
+    std::vector<pollfd> fds;
+    pollfd pfd;
+    pfd.fd = wake_read.get();
+    pfd.events = POLLIN;
+    pfd.revents = 0;
+    fds.push_back(pfd);
+    pfd.fd = listener.get();
+    fds.push_back(pfd);
+    long long next = -1;
+    for (size_t i = 0; i < connections.size(); ++i) {
+      connection &conn(*connections[i]);
+      pfd.fd = conn.fd.get();
+      if (conn.due < 0) {
+	pfd.events = POLLIN;
+      } else {
+	// Only the timeout matters until the response is sent.
+	pfd.events = 0;
+	if (next < 0 || conn.due < next) {
+	  next = conn.due;
+	}
+      }
+      fds.push_back(pfd);
+    }
+    int timeout = -1;
+    if (next >= 0) {
+      long long remaining = next - now();
+      timeout = remaining > 0 ? static_cast<int>(remaining) : 0;
+    }
+    int ret = poll(&fds.front(), fds.size(), timeout);
+    if (ret < 0) {
+      if (errno == EINTR) {
+	continue;
+      }
+      throw os_exception().function(poll);
+    }
+    if (fds[0].revents != 0) {
+      return;
+    }
+
+    // Process the existing connections first, so that the indices in
+    // fds remain valid.
+    std::vector<std::tr1::shared_ptr<connection> > remaining;
+    for (size_t i = 0; i < connections.size(); ++i) {
+      connection &conn(*connections[i]);
+      bool closed = false;
+      if (conn.due < 0 && fds[i + 2].revents != 0) {
+	char buf[4096];
+	ssize_t count = read(conn.fd.get(), buf, sizeof(buf));
+	if (count <= 0) {
+	  closed = true;
+	} else {
+	  conn.request.append(buf, count);
+	  if (conn.request.find("\r\n\r\n") != std::string::npos) {
+	    respond(conn);
+	  }
+	}
+      }
+      if (!closed && conn.due >= 0 && conn.due <= now()) {
+	send(conn);
+	closed = true;
+      }
+      if (!closed) {
+	remaining.push_back(connections[i]);
+      }
+    }
+    connections.swap(remaining);
+
+    if (fds[1].revents != 0) {
+      int fd = accept4(listener.get(), NULL, NULL, SOCK_CLOEXEC);
+      if (fd >= 0) {
+	std::tr1::shared_ptr<connection> conn(new connection);
+	conn->fd.reset(fd);
+	connections.push_back(conn);
+      } else if (errno != EINTR && errno != EAGAIN && errno != ECONNABORTED) {
+	throw os_exception().function(accept4).fd(listener.get());
+      }
+    }
+  }
+}
+
+void
+http_responder::impl::respond(connection &conn)
+{
+  const std::string &request(conn.request);
+  std::string path;
+  if (request.compare(0, 4, "GET ") == 0) {
+    size_t end = request.find(' ', 4);
+    if (end != std::string::npos) {
+      path = request.substr(4, end - 4);
+    }
+  }
+  std::string range(header_value(request, "Range:"));
+  std::string if_none_match(header_value(request, "If-None-Match:"));
+
+  mutex_guard guard(lock);
+  if (range.empty()) {
+    requests.push_back(path);
+  } else {
+    requests.push_back(path + " " + range);
+  }
+  ++concurrent;
+  if (concurrent > max_concurrent) {
+    max_concurrent = concurrent;
+  }
+  conn.due = now() + delay;
+
+  std::string &response(conn.response);
+  std::map<std::string, resource>::const_iterator p = resources.find(path);
+  if (p == resources.end()) {
+    append_status(response, "404 Not Found");
+    append_number(response, "Content-Length", 0);
+    response += "\r\n";
+    return;
+  }
+  const resource &res(p->second);
+  long long size = res.data.size();
+  std::string etag;
+  if (!res.etag.empty()) {
+    etag = "ETag: " + res.etag + "\r\n";
+    if (if_none_match == res.etag) {
+      append_status(response, "304 Not Modified");
+      response += etag;
+      response += "\r\n";
+      return;
+    }
+  }
+
+  // Only "bytes=FIRST-" and "bytes=FIRST-LAST" are supported.
+  // Anything else results in the whole resource.
+  long long first = 0;
+  long long last = size - 1;
+  bool partial = false;
+  if (!ignore_ranges && range.compare(0, 6, "bytes=") == 0) {
+    const char *start = range.c_str() + 6;
+    char *endptr;
+    long long f = strtoll(start, &endptr, 10);
+    if (endptr != start && *endptr == '-') {
+      long long l = last;
+      if (endptr[1] != '\0') {
+	l = strtoll(endptr + 1, NULL, 10);
+      }
+      if (f >= size) {
+	append_status(response, "416 Requested Range Not Satisfiable");
+	char buf[64];
+	snprintf(buf, sizeof(buf), "Content-Range: bytes */%lld\r\n", size);
+	response += buf;
+	append_number(response, "Content-Length", 0);
+	response += "\r\n";
+	return;
+      }
+      if (f <= l) {
+	partial = true;
+	first = f;
+	if (l < last) {
+	  last = l;
+	}
+      }
+    }
+  }
+
+  if (partial) {
+    append_status(response, "206 Partial Content");
+    char buf[128];
+    snprintf(buf, sizeof(buf), "Content-Range: bytes %lld-%lld/%lld\r\n",
+	     first, last, size);
+    response += buf;
+  } else {
+    append_status(response, "200 OK");
+  }
+  response += etag;
+  append_number(response, "Content-Length", last - first + 1);
+  response += "\r\n";
+  response.append(res.data.begin() + first, res.data.begin() + last + 1);
+}
+
+void
+http_responder::impl::send(connection &conn)
+{
+  {
+    mutex_guard guard(lock);
+    --concurrent;
+  }
+  // The client may close the connection early (after a response it
+  // does not expect, for instance), so errors are ignored.
+  const char *p = conn.response.data();
+  size_t remaining = conn.response.size();
+  while (remaining > 0) {
+    ssize_t ret = ::send(conn.fd.get(), p, remaining, MSG_NOSIGNAL);
+    if (ret < 0) {
+      if (errno == EINTR) {
+	continue;
+      }
+      break;
+    }
+    p += ret;
+    remaining -= ret;
+  }
+}
+
+http_responder::http_responder()
+  : impl_(new impl)
+{
+}
+
+http_responder::~http_responder()
+{
+}
+
+std::string
+http_responder::url(const char *path) const
+{
+  char buf[64];
+  snprintf(buf, sizeof(buf), "http://127.0.0.1:%u", impl_->port);
+  return buf + std::string(path);
+}
+
+void
+http_responder::add(const char *path, const std::vector<unsigned char> &data,
+		    const char *etag)
+{
+  mutex_guard guard(impl_->lock);
+  resource &res(impl_->resources[path]);
+  res.data = data;
+  res.etag = etag;
+}
+
+void
+http_responder::delay(unsigned milliseconds)
+{
+  mutex_guard guard(impl_->lock);
+  impl_->delay = milliseconds;
+}
+
+void
+http_responder::ignore_ranges(bool ignore)
+{
+  mutex_guard guard(impl_->lock);
+  impl_->ignore_ranges = ignore;
+}
+
+std::vector<std::string>
+http_responder::requests() const
+{
+  mutex_guard guard(impl_->lock);
+  return impl_->requests;
+}
+
+unsigned
+http_responder::max_concurrent() const
+{
+  mutex_guard guard(impl_->lock);
+  return impl_->max_concurrent;
+}
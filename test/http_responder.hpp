@@ -0,0 +1,68 @@
+/*
+ * Copyright (C) 2013 Red Hat, Inc.
+ * Written by Florian Weimer <fweimer@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <tr1/memory>
+
+// Minimal HTTP server on the loopback interface, for testing HTTP
+// clients.  Requests are processed on a separate thread, and the
+// connection is closed after each response.  Only GET requests for
+// the resources registered with add() are answered; everything else
+// results in 404 responses.
+class http_responder {
+  struct impl;
+  std::tr1::shared_ptr<impl> impl_;
+  http_responder(const http_responder &); // not implemented
+  http_responder &operator=(const http_responder &); // not implemented
+public:
+  // Starts listening on an ephemeral port.  Throws os_exception.
+  http_responder();
+
+  // Stops the server thread and closes all connections.
+  ~http_responder();
+
+  // Returns the URL of PATH (which starts with "/") on this server.
+  std::string url(const char *path) const;
+
+  // Serves DATA at PATH.  Range requests are answered with 206 (or
+  // 416 if the range starts beyond the end).  If ETAG is not empty,
+  // it is sent with the response, and matching If-None-Match
+  // requests result in 304.
+  void add(const char *path, const std::vector<unsigned char> &data,
+	   const char *etag = "");
+
+  // Delays each response by the specified number of milliseconds,
+  // so that concurrent requests overlap.
+  void delay(unsigned milliseconds);
+
+  // If set, Range headers are ignored, and the whole resource is
+  // sent with status 200.
+  void ignore_ranges(bool);
+
+  // Returns the received requests, in order.  Each element consists
+  // of the path, followed by a space and the value of the Range
+  // header if the request contained one.
+  std::vector<std::string> requests() const;
+
+  // Returns the maximum number of requests which were received, but
+  // not yet answered, at the same time.
+  unsigned max_concurrent() const;
+};
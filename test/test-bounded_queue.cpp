@@ -0,0 +1,94 @@
+/*
+ * Copyright (C) 2013 Red Hat, Inc.
+ * Written by Florian Weimer <fweimer@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <cxxll/bounded_queue.hpp>
+#include <cxxll/task.hpp>
+
+#include "test.hpp"
+
+using namespace cxxll;
+
+namespace {
+  struct producer {
+    bounded_queue<unsigned> *queue;
+    unsigned count;
+
+    static void callback(producer *p) throw()
+    {
+      for (unsigned i = 1; i <= p->count; ++i) {
+	p->queue->push(i);
+      }
+      p->queue->close();
+    }
+  };
+}
+
+static void
+test()
+{
+  {
+    bounded_queue<unsigned> queue(4);
+    producer p;
+    p.queue = &queue;
+    p.count = 10000;
+    task t(std::tr1::bind(producer::callback, &p));
+    unsigned long long sum = 0;
+    unsigned expected = 1;
+    unsigned value;
+    bool ordered = true;
+    while (queue.pop(value)) {
+      ordered = ordered && value == expected;
+      ++expected;
+      sum += value;
+    }
+    t.wait();
+    CHECK(ordered);
+    CHECK(sum == 10000ULL * 10001 / 2);
+    CHECK(queue.stats().peak <= 4);
+    CHECK(queue.stats().peak > 0);
+    CHECK(!queue.pop(value));
+  }
+
+  {
+    bounded_queue<unsigned> queue(2);
+    unsigned value = 0;
+    CHECK(!queue.try_pop(value));
+    queue.push(17);
+    queue.push(18);
+    CHECK(queue.try_pop(value));
+    CHECK(value == 17);
+    queue.close();
+    CHECK(queue.pop(value));
+    CHECK(value == 18);
+    CHECK(!queue.pop(value));
+    try {
+      queue.push(19);
+      CHECK(false);
+    } catch (std::logic_error &) {
+    }
+    CHECK(queue.stats().peak == 2);
+  }
+
+  try {
+    bounded_queue<unsigned> queue(0);
+    CHECK(false);
+  } catch (std::logic_error &) {
+  }
+}
+
+static test_register t("bounded_queue", test);
@@ -0,0 +1,480 @@
+/*
+ * Copyright (C) 2013 Red Hat, Inc.
+ * Written by Florian Weimer <fweimer@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <cxxll/curl_multi_fetch.hpp>
+#include <cxxll/curl_exception.hpp>
+#include <cxxll/curl_fetch_result.hpp>
+#include <cxxll/os.hpp>
+#include <cxxll/read_file.hpp>
+#include <cxxll/url.hpp>
+#include <cxxll/vector_sink.hpp>
+
+#include "http_responder.hpp"
+#include "test.hpp"
+
+#include <algorithm>
+
+#include <stdio.h>
+
+using namespace cxxll;
+
+namespace {
+  struct recording_transfer : curl_multi_fetch::transfer {
+    std::vector<std::string> &starts_;
+    std::string name_;
+    vector_sink sink_;
+    unsigned reject_;		// number of attempts to reject
+    bool skip_;
+    long long offset_;		// for resume_offset()
+    long long range_end_;	// for range_end(), until restart()
+    std::vector<std::string> urls_; // for select_urls(), by attempt
+    std::vector<std::string> candidates_; // for the later attempts
+    std::vector<std::string> offered_; // from the last select_urls()
+    std::vector<std::string> selected_; // by url_selected()
+    unsigned finished_;
+    unsigned failed_;
+    unsigned restarts_;		// number of restarts to request
+    bool last_retry_;
+    int last_status_;		// HTTP status of the last failure
+    std::vector<std::string> *ends_; // records finished transfers
+
+    recording_transfer(std::vector<std::string> &starts, const char *name)
+      : starts_(starts), name_(name), reject_(0), skip_(false),
+	offset_(0), range_end_(-1), finished_(0), failed_(0), restarts_(0),
+	last_retry_(false), last_status_(0), ends_(NULL)
+    {
+    }
+
+    sink *start()
+    {
+      starts_.push_back(name_);
+      if (skip_) {
+	return NULL;
+      }
+      sink_.data.clear();
+      return &sink_;
+    }
+
+    long long resume_offset()
+    {
+      return offset_;
+    }
+
+    long long range_end()
+    {
+      return range_end_;
+    }
+
+    void select_urls(std::vector<std::string> &urls)
+    {
+      size_t attempt = finished_ + failed_;
+      if (attempt < urls_.size()) {
+	urls.assign(1, urls_[attempt]);
+      } else if (!candidates_.empty()) {
+	urls = candidates_;
+      }
+      offered_ = urls;
+    }
+
+    void url_selected(size_t index)
+    {
+      selected_.push_back(offered_.at(index));
+    }
+
+    bool finished(const curl_fetch_result &)
+    {
+      ++finished_;
+      if (ends_ != NULL) {
+	ends_->push_back(name_);
+      }
+      if (reject_ > 0) {
+	--reject_;
+	return false;
+      }
+      return true;
+    }
+
+    void failed(const curl_exception &e, bool retry)
+    {
+      ++failed_;
+      last_retry_ = retry;
+      last_status_ = e.status();
+    }
+
+    bool restart()
+    {
+      if (restarts_ > 0) {
+	--restarts_;
+	range_end_ = -1;
+	return true;
+      }
+      return false;
+    }
+  };
+
+  std::string
+  file_url(const char *name)
+  {
+    return "file://" + current_directory() + "/test/data/" + name;
+  }
+
+  std::vector<unsigned char>
+  file_data(const char *name)
+  {
+    std::vector<unsigned char> data;
+    read_file((std::string("test/data/") + name).c_str(), data);
+    return data;
+  }
+}
+
+static void
+test()
+{
+  COMPARE_STRING(url_host("http://example.com/repo"), "example.com");
+  COMPARE_STRING(url_host("https://user@example.com:8443"),
+		 "example.com:8443");
+  COMPARE_STRING(url_host("ftp://example.com?x=/y"), "example.com");
+  COMPARE_STRING(url_host("file:///tmp/x"), "");
+  COMPARE_STRING(url_host("/tmp/x"), "");
+
+  static const char *const files[] = {
+    "primary.xml", "test.zip", "JavaClass.class",
+    "unzip-6.0-7.fc18.x86_64.rpm"
+  };
+  const unsigned count = sizeof(files) / sizeof(files[0]);
+
+  curl_multi_fetch::limits limits;
+  limits.transfers = 1;		// makes the start order deterministic
+  limits.retry_delay = 1;
+  curl_multi_fetch fetch(limits);
+  std::vector<std::string> starts;
+  std::vector<std::tr1::shared_ptr<recording_transfer> > transfers;
+  for (unsigned i = 0; i < count; ++i) {
+    transfers.push_back(std::tr1::shared_ptr<recording_transfer>
+			(new recording_transfer(starts, files[i])));
+    fetch.add(file_url(files[i]).c_str(), file_data(files[i]).size(),
+	      transfers.back().get());
+  }
+  transfers.at(1)->reject_ = 1;
+
+  recording_transfer missing(starts, "missing");
+  fetch.add(file_url("does-not-exist").c_str(), -1, &missing);
+  recording_transfer skipped(starts, "skipped");
+  skipped.skip_ = true;
+  fetch.add(file_url("primary.xml").c_str(), -1, &skipped);
+
+  fetch.run();
+
+  for (unsigned i = 0; i < count; ++i) {
+    CHECK(transfers.at(i)->sink_.data == file_data(files[i]));
+    CHECK(transfers.at(i)->failed_ == 0);
+  }
+  CHECK(transfers.at(0)->finished_ == 1);
+  CHECK(transfers.at(1)->finished_ == 2);
+  CHECK(missing.finished_ == 0);
+  CHECK(missing.failed_ == limits.attempts);
+  CHECK(!missing.last_retry_);
+  CHECK(skipped.finished_ == 0);
+  CHECK(skipped.failed_ == 0);
+
+  // Largest first.  Retries and the transfers of unknown size come
+  // later.
+  CHECK(starts.size() == count + 2 + 1 + limits.attempts - 1);
+  COMPARE_STRING(starts.at(0), "unzip-6.0-7.fc18.x86_64.rpm");
+  COMPARE_STRING(starts.at(1), "primary.xml");
+  COMPARE_STRING(starts.at(2), "JavaClass.class");
+  COMPARE_STRING(starts.at(3), "test.zip");
+
+  {
+    // Resumed transfers only receive the remaining data.
+    curl_multi_fetch fetch(limits);
+    std::vector<std::string> starts;
+    recording_transfer resumed(starts, "primary.xml");
+    resumed.offset_ = 100;
+    fetch.add(file_url("primary.xml").c_str(), -1, &resumed);
+    fetch.run();
+    std::vector<unsigned char> expected(file_data("primary.xml"));
+    expected.erase(expected.begin(), expected.begin() + 100);
+    CHECK(resumed.sink_.data == expected);
+    CHECK(resumed.finished_ == 1);
+    CHECK(resumed.failed_ == 0);
+  }
+
+  {
+    // Failover to a different URL after an error.
+    curl_multi_fetch fetch(limits);
+    std::vector<std::string> starts;
+    recording_transfer failover(starts, "primary.xml");
+    failover.urls_.push_back(file_url("does-not-exist"));
+    failover.urls_.push_back(file_url("primary.xml"));
+    fetch.add("http://unused.invalid/", -1, &failover);
+    fetch.run();
+    CHECK(failover.sink_.data == file_data("primary.xml"));
+    CHECK(failover.failed_ == 1);
+    CHECK(failover.finished_ == 1);
+  }
+
+  {
+    // The per-host limit applies to the URL returned by select_urls().
+    // Both transfers end up on the same (empty) host, so the second
+    // one is only started after the first one has finished.
+    curl_multi_fetch::limits host_limits(limits);
+    host_limits.transfers = 2;
+    host_limits.per_host = 1;
+    curl_multi_fetch fetch(host_limits);
+    std::vector<std::string> events;
+    recording_transfer first(events, "first");
+    first.ends_ = &events;
+    recording_transfer second(events, "second");
+    second.ends_ = &events;
+    second.urls_.push_back(file_url("test.zip"));
+    fetch.add(file_url("primary.xml").c_str(), 2, &first);
+    fetch.add("http://unused.invalid/", 1, &second);
+    fetch.run();
+    CHECK(second.sink_.data == file_data("test.zip"));
+    CHECK(events.size() == 4);
+    COMPARE_STRING(events.at(0), "first");
+    COMPARE_STRING(events.at(1), "first");
+    COMPARE_STRING(events.at(2), "second");
+    COMPARE_STRING(events.at(3), "second");
+  }
+
+  {
+    // A rejected prefix is followed by a restart which fetches the
+    // whole file, even if no attempts remain.
+    curl_multi_fetch::limits single(limits);
+    single.attempts = 1;
+    curl_multi_fetch fetch(single);
+    std::vector<std::string> starts;
+    recording_transfer prefix(starts, "primary.xml");
+    prefix.range_end_ = 99;
+    prefix.reject_ = 1;
+    prefix.restarts_ = 1;
+    fetch.add(file_url("primary.xml").c_str(), -1, &prefix);
+    fetch.run();
+    CHECK(prefix.sink_.data == file_data("primary.xml"));
+    CHECK(prefix.finished_ == 2);
+    CHECK(prefix.failed_ == 0);
+    CHECK(starts.size() == 2);
+  }
+
+  {
+    // Range requests for a prefix.
+    vector_sink sink;
+    curl_fetch_result r(&sink);
+    r.range_end = 99;
+    r.get(file_url("primary.xml").c_str());
+    std::vector<unsigned char> expected(file_data("primary.xml"));
+    expected.resize(100);
+    CHECK(sink.data == expected);
+  }
+
+  {
+    // Range requests over HTTP.
+    http_responder server;
+    std::vector<unsigned char> data(file_data("primary.xml"));
+    server.add("/primary.xml", data);
+    curl_multi_fetch::limits single(limits);
+    single.attempts = 1;
+    curl_multi_fetch fetch(single);
+    std::vector<std::string> starts;
+    recording_transfer resumed(starts, "resumed");
+    resumed.offset_ = 100;
+    fetch.add(server.url("/primary.xml").c_str(), 3, &resumed);
+    recording_transfer prefix(starts, "prefix");
+    prefix.range_end_ = 99;
+    fetch.add(server.url("/primary.xml").c_str(), 2, &prefix);
+    recording_transfer beyond(starts, "beyond");
+    beyond.offset_ = data.size();
+    fetch.add(server.url("/primary.xml").c_str(), 1, &beyond);
+    fetch.run();
+
+    CHECK(resumed.finished_ == 1);
+    CHECK(std::equal(resumed.sink_.data.begin(), resumed.sink_.data.end(),
+		     data.begin() + 100));
+    CHECK(resumed.sink_.data.size() == data.size() - 100);
+    CHECK(prefix.finished_ == 1);
+    CHECK(prefix.sink_.data.size() == 100);
+    CHECK(std::equal(prefix.sink_.data.begin(), prefix.sink_.data.end(),
+		     data.begin()));
+    // A resumed transfer of a file which has become shorter.
+    CHECK(beyond.finished_ == 0);
+    CHECK(beyond.failed_ == 1);
+    CHECK(beyond.last_status_ == 416);
+
+    std::vector<std::string> requests(server.requests());
+    CHECK(requests.size() == 3);
+    COMPARE_STRING(requests.at(0), "/primary.xml bytes=100-");
+    COMPARE_STRING(requests.at(1), "/primary.xml bytes=0-99");
+    char expected[64];
+    snprintf(expected, sizeof(expected), "/primary.xml bytes=%llu-",
+	     static_cast<unsigned long long>(data.size()));
+    COMPARE_STRING(requests.at(2), expected);
+  }
+
+  {
+    // A server which ignores range requests.  Prefix requests are
+    // aborted before any data is written, and resumed transfers
+    // fail.
+    http_responder server;
+    server.ignore_ranges(true);
+    server.add("/primary.xml", file_data("primary.xml"));
+    curl_multi_fetch::limits single(limits);
+    single.attempts = 1;
+    curl_multi_fetch fetch(single);
+    std::vector<std::string> starts;
+    recording_transfer prefix(starts, "prefix");
+    prefix.range_end_ = 99;
+    fetch.add(server.url("/primary.xml").c_str(), 2, &prefix);
+    recording_transfer resumed(starts, "resumed");
+    resumed.offset_ = 100;
+    fetch.add(server.url("/primary.xml").c_str(), 1, &resumed);
+    fetch.run();
+    CHECK(prefix.finished_ == 0);
+    CHECK(prefix.failed_ == 1);
+    CHECK(prefix.last_status_ == 200);
+    CHECK(prefix.sink_.data.empty());
+    CHECK(resumed.finished_ == 0);
+    CHECK(resumed.failed_ == 1);
+    CHECK(resumed.last_status_ == 200);
+  }
+
+  {
+    // Conditional requests with If-None-Match.
+    http_responder server;
+    server.add("/repomd.xml", file_data("primary.xml"), "\"v1\"");
+    vector_sink sink;
+    curl_fetch_result r(&sink);
+    r.get(server.url("/repomd.xml").c_str());
+    CHECK(sink.data == file_data("primary.xml"));
+    COMPARE_STRING(r.etag, "\"v1\"");
+    CHECK(!r.not_modified);
+
+    vector_sink unchanged_sink;
+    curl_fetch_result unchanged(&unchanged_sink);
+    unchanged.if_none_match = r.etag;
+    unchanged.get(server.url("/repomd.xml").c_str());
+    CHECK(unchanged.not_modified);
+    CHECK(unchanged_sink.data.empty());
+
+    vector_sink changed_sink;
+    curl_fetch_result changed(&changed_sink);
+    changed.if_none_match = "\"v0\"";
+    changed.get(server.url("/repomd.xml").c_str());
+    CHECK(!changed.not_modified);
+    CHECK(changed_sink.data == file_data("primary.xml"));
+    COMPARE_STRING(changed.etag, "\"v1\"");
+  }
+
+  {
+    // The per-host limit applies to each server separately.  The
+    // delayed responses make the requests overlap.
+    http_responder first, second;
+    first.delay(50);
+    second.delay(50);
+    first.add("/test.zip", file_data("test.zip"));
+    second.add("/test.zip", file_data("test.zip"));
+    curl_multi_fetch::limits host_limits(limits);
+    host_limits.transfers = 4;
+    host_limits.per_host = 1;
+    curl_multi_fetch fetch(host_limits);
+    std::vector<std::string> starts;
+    std::vector<std::tr1::shared_ptr<recording_transfer> > transfers;
+    for (unsigned i = 0; i < 4; ++i) {
+      transfers.push_back(std::tr1::shared_ptr<recording_transfer>
+			  (new recording_transfer(starts, "test.zip")));
+      http_responder &server(i % 2 == 0 ? first : second);
+      fetch.add(server.url("/test.zip").c_str(), -1, transfers.back().get());
+    }
+    fetch.run();
+    for (unsigned i = 0; i < 4; ++i) {
+      CHECK(transfers.at(i)->sink_.data == file_data("test.zip"));
+    }
+    CHECK(first.requests().size() == 2);
+    CHECK(second.requests().size() == 2);
+    CHECK(first.max_concurrent() == 1);
+    CHECK(second.max_concurrent() == 1);
+  }
+
+  {
+    // Two mirrors are used concurrently if the preferred one has
+    // reached the per-host limit.
+    http_responder preferred, other;
+    preferred.delay(100);
+    other.delay(100);
+    preferred.add("/test.zip", file_data("test.zip"));
+    other.add("/test.zip", file_data("test.zip"));
+    curl_multi_fetch::limits host_limits(limits);
+    host_limits.transfers = 2;
+    host_limits.per_host = 1;
+    curl_multi_fetch fetch(host_limits);
+    std::vector<std::string> events;
+    std::vector<std::tr1::shared_ptr<recording_transfer> > transfers;
+    static const char *const names[] = {"0", "1", "2", "3"};
+    for (unsigned i = 0; i < 4; ++i) {
+      transfers.push_back(std::tr1::shared_ptr<recording_transfer>
+			  (new recording_transfer(events, names[i])));
+      recording_transfer &t(*transfers.back());
+      t.ends_ = &events;
+      t.candidates_.push_back(preferred.url("/test.zip"));
+      t.candidates_.push_back(other.url("/test.zip"));
+      fetch.add("http://unused.invalid/", -1, &t);
+    }
+    fetch.run();
+    for (unsigned i = 0; i < 4; ++i) {
+      CHECK(transfers.at(i)->sink_.data == file_data("test.zip"));
+      CHECK(transfers.at(i)->selected_.size() == 1);
+    }
+    // The first transfer goes to the preferred mirror, and the
+    // second one starts on the other mirror before the first one has
+    // finished.
+    COMPARE_STRING(transfers.at(0)->selected_.at(0),
+		   preferred.url("/test.zip"));
+    COMPARE_STRING(transfers.at(1)->selected_.at(0), other.url("/test.zip"));
+    CHECK(events.size() == 8);
+    COMPARE_STRING(events.at(0), "0");
+    COMPARE_STRING(events.at(1), "1");
+    CHECK(preferred.max_concurrent() == 1);
+    CHECK(other.max_concurrent() == 1);
+    CHECK(preferred.requests().size() + other.requests().size() == 4);
+    CHECK(!preferred.requests().empty());
+    CHECK(!other.requests().empty());
+  }
+
+  {
+    // Failover to a different host after an HTTP error.
+    http_responder broken, working;
+    working.add("/primary.xml", file_data("primary.xml"));
+    curl_multi_fetch fetch(limits);
+    std::vector<std::string> starts;
+    recording_transfer failover(starts, "primary.xml");
+    failover.urls_.push_back(broken.url("/primary.xml"));
+    failover.urls_.push_back(working.url("/primary.xml"));
+    fetch.add("http://unused.invalid/", -1, &failover);
+    fetch.run();
+    CHECK(failover.sink_.data == file_data("primary.xml"));
+    CHECK(failover.failed_ == 1);
+    CHECK(failover.last_status_ == 404);
+    CHECK(failover.finished_ == 1);
+    CHECK(broken.requests().size() == 1);
+    CHECK(working.requests().size() == 1);
+  }
+}
+
+static test_register t("curl_multi_fetch", test);
@@ -0,0 +1,76 @@
+/*
+ * Copyright (C) 2013 Red Hat, Inc.
+ * Written by Florian Weimer <fweimer@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <cxxll/curl_pool.hpp>
+#include <cxxll/curl_handle.hpp>
+#include <cxxll/curl_fetch_result.hpp>
+#include <cxxll/os.hpp>
+#include <cxxll/read_file.hpp>
+#include <cxxll/vector_sink.hpp>
+
+#include "test.hpp"
+
+using namespace cxxll;
+
+static void
+test()
+{
+  curl_pool pool(2);
+  CHECK(pool.idle() == 0);
+  CURL *first;
+  {
+    curl_pool::lease a(pool, "http://example.com/a");
+    first = a->raw;
+    CHECK(first != NULL);
+  }
+  CHECK(pool.idle() == 1);
+
+  // Handles are reused for the same host only.
+  {
+    curl_pool::lease a(pool, "http://example.com/b");
+    CHECK(a->raw == first);
+    CHECK(pool.idle() == 0);
+    curl_pool::lease b(pool, "http://example.org/b");
+    CHECK(b->raw != first);
+  }
+  CHECK(pool.idle() == 2);
+
+  // Surplus handles are closed.
+  {
+    curl_pool::lease a(pool, "http://example.com/1");
+    curl_pool::lease b(pool, "http://example.com/2");
+    curl_pool::lease c(pool, "http://example.com/3");
+    CHECK(pool.idle() == 1);
+  }
+  CHECK(pool.idle() == 3);
+
+  // Repeated requests through the global pool.
+  std::string url("file://" + current_directory() + "/test/data/primary.xml");
+  std::vector<unsigned char> reference;
+  read_file("test/data/primary.xml", reference);
+  for (int i = 0; i < 3; ++i) {
+    vector_sink vsink;
+    curl_fetch_result r(&vsink);
+    r.get(url.c_str());
+    CHECK(vsink.data == reference);
+  }
+  CHECK(curl_pool::global().idle() >= 1);
+}
+
+static test_register t("curl_pool", test);
@@ -19,7 +19,10 @@
 #include <symboldb/database.hpp>
 #include <symboldb/download.hpp>
 
+#include <cxxll/base16.hpp>
+#include <cxxll/checksum.hpp>
 #include <cxxll/fd_handle.hpp>
+#include <cxxll/file_cache.hpp>
 #include <cxxll/fd_source.hpp>
 #include <cxxll/os.hpp>
 #include <cxxll/pg_testdb.hpp>
@@ -31,6 +34,8 @@
 
 #include "test.hpp"
 
+#include <string.h>
+
 using namespace cxxll;
 
 static void
@@ -56,9 +61,13 @@ test()
     reference.swap(vsink.data);
   }
 
+  std::string cache_path(make_temporary_directory("/tmp/test-download-"));
+  std::tr1::shared_ptr<file_cache> cache(new file_cache(cache_path.c_str()));
+
   database db(testdb.directory().c_str(), DBNAME);
   download_options opt;
   opt.cache_mode = download_options::only_cache;
+  opt.cache = cache;
   std::string url("file://");
   url += current_directory();
   url += '/';
@@ -74,8 +83,20 @@ test()
   }
 
   opt = download_options();
+  opt.cache = cache;
   download(opt, db, url.c_str(), result);
   CHECK(result == reference);
+  {
+    // The data is stored in the file system, not the database.
+    std::vector<std::vector<unsigned char> > digests;
+    cache->digests(digests);
+    CHECK(digests.size() == 1);
+    CHECK(digests.at(0) == hash(hash_sink::sha256, reference));
+    digests.clear();
+    db.url_cache_digests(digests);
+    CHECK(digests.size() == 1);
+    CHECK(digests.at(0) == hash(hash_sink::sha256, reference));
+  }
 
   // FIXME: We should check somehow that this does not hit the
   // original file:/// URL.
@@ -84,6 +105,38 @@ test()
   download(opt, db, url.c_str(), result);
   CHECK(result == reference);
 
+  // The file has not changed, so the conditional request should
+  // result in the (altered) cached copy.
+  {
+    static const char cached[] = "cached";
+    std::vector<unsigned char> data(cached, cached + strlen(cached));
+    checksum csum;
+    csum.type = hash_sink::sha256;
+    csum.value = hash(csum.type, data);
+    csum.length = data.size();
+    std::string path;
+    cache->add(csum, data, path);
+    testdb.exec_test_sql
+      (DBNAME, ("UPDATE symboldb.url_cache SET digest = decode('"
+		+ base16_encode(csum.value.begin(), csum.value.end())
+		+ "', 'hex')").c_str());
+  }
+  opt.cache_mode = download_options::check_cache;
+  result.clear();
+  download(opt, db, url.c_str(), result);
+  COMPARE_STRING(std::string(result.begin(), result.end()), "cached");
+
+  // An outdated modification time causes a fresh download, which
+  // replaces the cached copy.
+  testdb.exec_test_sql(DBNAME, "UPDATE symboldb.url_cache SET http_time = 1");
+  result.clear();
+  download(opt, db, url.c_str(), result);
+  CHECK(result == reference);
+  opt.cache_mode = download_options::only_cache;
+  result.clear();
+  download(opt, db, url.c_str(), result);
+  CHECK(result == reference);
+
   // Make sure that we do not hit the database.
   testdb.exec_test_sql(DBNAME, "DROP TABLE symboldb.url_cache");
 
@@ -91,6 +144,8 @@ test()
   result.clear();
   download(opt, db, url.c_str(), result);
   CHECK(result == reference);
+
+  remove_directory_tree(cache_path.c_str());
 }
 
 static test_register t("download", test);
@@ -24,6 +24,7 @@
 #include "test.hpp"
 
 #include <errno.h>
+#include <sys/time.h>
 #include <unistd.h>
 
 using namespace cxxll;
@@ -85,6 +86,75 @@ test()
     COMPARE_STRING(path, "abc");
     CHECK(access(old_path.c_str(), R_OK) == -1 && errno == ENOENT);
     CHECK(access((old_path + ".tmp").c_str(), R_OK) == -1 && errno == ENOENT);
+
+    // Resumed additions.
+    --csum.value.front();
+    std::string part_path(old_path + ".part");
+    {
+      file_cache::add_sink sink(fc, csum, true);
+      CHECK(sink.offset() == 0);
+      sink.write(data.data(), 2);
+      CHECK(sink.offset() == 2);
+    }
+    CHECK(access(part_path.c_str(), R_OK) == 0);
+    {
+      file_cache::add_sink sink(fc, csum, true);
+      CHECK(sink.offset() == 2);
+      sink.write(data.data() + 2, data.size() - 2);
+      sink.finish(path);
+    }
+    COMPARE_STRING(path, old_path);
+    CHECK(access(path.c_str(), R_OK) == 0);
+    CHECK(access(part_path.c_str(), R_OK) == -1 && errno == ENOENT);
+    CHECK(unlink(path.c_str()) == 0);
+
+    {
+      file_cache::add_sink sink(fc, csum, true);
+      sink.write(data.data(), 2);
+      sink.discard();
+      CHECK(sink.offset() == 0);
+      sink.write(data.data() + 1, 1);
+    }
+    {
+      // The corrupted prefix is detected by the final check.
+      file_cache::add_sink sink(fc, csum, true);
+      CHECK(sink.offset() == 1);
+      sink.write(data.data() + 1, data.size() - 1);
+      try {
+	sink.finish(path);
+	CHECK(0 && "missing exception");
+      } catch (file_cache::checksum_mismatch &e) {
+	COMPARE_STRING(e.what(), "digest");
+      }
+    }
+    CHECK(access(part_path.c_str(), R_OK) == -1 && errno == ENOENT);
+    CHECK(access(old_path.c_str(), R_OK) == -1 && errno == ENOENT);
+
+    // Expiry of partial files.
+    {
+      file_cache::add_sink sink(fc, csum, true);
+      sink.write(data.data(), 2);
+    }
+    CHECK(fc.expire_partial(3600) == 0);
+    CHECK(access(part_path.c_str(), R_OK) == 0);
+    digests.clear();
+    fc.digests(digests);
+    CHECK(digests.empty());
+    {
+      struct timeval times[2] = {};
+      times[0].tv_sec = times[1].tv_sec = time(NULL) - 7200;
+      CHECK(utimes(part_path.c_str(), times) == 0);
+    }
+    CHECK(fc.expire_partial(3600) == 1);
+    CHECK(access(part_path.c_str(), R_OK) == -1 && errno == ENOENT);
+    {
+      file_cache::add_sink sink(fc, csum, true);
+      sink.write(data.data(), 2);
+    }
+    fc.add(csum, data, path);
+    CHECK(fc.expire_partial(3600) == 1);
+    CHECK(access(part_path.c_str(), R_OK) == -1 && errno == ENOENT);
+    CHECK(access(path.c_str(), R_OK) == 0);
   } catch (...) {
     remove_directory_tree(tempdir.c_str());
     throw;
@@ -0,0 +1,82 @@
+/*
+ * Copyright (C) 2013 Red Hat, Inc.
+ * Written by Florian Weimer <fweimer@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <cxxll/metalink.hpp>
+#include <cxxll/base16.hpp>
+
+#include "test.hpp"
+
+#include <cstring>
+
+using namespace cxxll;
+
+static void
+test()
+{
+  static const char document[] =
+    "<?xml version=\"1.0\" encoding=\"utf-8\"?>\n"
+    "<metalink version=\"3.0\" xmlns=\"http://www.metalinker.org/\""
+    " xmlns:mm0=\"http://fedorahosted.org/mirrormanager\">\n"
+    " <files>\n"
+    "  <file name=\"repomd.xml\">\n"
+    "   <mm0:timestamp>1363015384</mm0:timestamp>\n"
+    "   <size>4232</size>\n"
+    "   <verification>\n"
+    "    <hash type=\"md5\">00112233445566778899aabbccddeeff</hash>\n"
+    "    <hash type=\"sha256\">"
+    "000102030405060708090a0b0c0d0e0f101112131415161718191a1b1c1d1e1f"
+    "</hash>\n"
+    "    <hash type=\"sha1\">000102030405060708090a0b0c0d0e0f10111213</hash>\n"
+    "    <hash type=\"sha512\">00</hash>\n"
+    "   </verification>\n"
+    "   <resources maxconnections=\"1\">\n"
+    "    <url protocol=\"http\" type=\"http\" location=\"US\""
+    " preference=\"99\">http://b.example/repodata/repomd.xml</url>\n"
+    "    <url protocol=\"http\" type=\"http\" location=\"DE\""
+    " preference=\"100\">http://a.example/repodata/repomd.xml</url>\n"
+    "    <url protocol=\"http\" type=\"http\" location=\"US\""
+    " preference=\"99\">http://c.example/repodata/repomd.xml</url>\n"
+    "   </resources>\n"
+    "  </file>\n"
+    " </files>\n"
+    "</metalink>\n";
+  metalink ml;
+  std::string error;
+  CHECK(ml.parse(reinterpret_cast<const unsigned char *>(document),
+		 strlen(document), error));
+  COMPARE_STRING(error, "");
+  COMPARE_STRING(ml.name, "repomd.xml");
+  CHECK(ml.csum.type == hash_sink::sha256);
+  CHECK(ml.csum.length == 4232);
+  COMPARE_STRING(base16_encode(ml.csum.value.begin(), ml.csum.value.end()),
+		 "000102030405060708090a0b0c0d0e0f"
+		 "101112131415161718191a1b1c1d1e1f");
+  CHECK(ml.urls.size() == 3);
+  if (ml.urls.size() == 3) {
+    COMPARE_STRING(ml.urls.at(0), "http://a.example/repodata/repomd.xml");
+    COMPARE_STRING(ml.urls.at(1), "http://b.example/repodata/repomd.xml");
+    COMPARE_STRING(ml.urls.at(2), "http://c.example/repodata/repomd.xml");
+  }
+
+  static const char other[] = "<repomd/>";
+  CHECK(!ml.parse(reinterpret_cast<const unsigned char *>(other),
+		  strlen(other), error));
+  COMPARE_STRING(error, "invalid root element");
+}
+
+static test_register t("metalink", test);
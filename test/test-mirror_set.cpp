@@ -0,0 +1,111 @@
+/*
+ * Copyright (C) 2013 Red Hat, Inc.
+ * Written by Florian Weimer <fweimer@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <cxxll/mirror_set.hpp>
+
+#include "test.hpp"
+
+#include <cstring>
+#include <stdexcept>
+
+using namespace cxxll;
+
+static void
+test()
+{
+  {
+    static const char list[] =
+      "# comment\n"
+      "http://a.example/repo\n"
+      "\n"
+      "  http://b.example/repo/  \n"
+      "not-a-url\n"
+      "ftp://c.example/repo";
+    mirror_set mirrors;
+    mirrors.add_mirrorlist
+      (std::vector<unsigned char>(list, list + strlen(list)));
+    CHECK(mirrors.size() == 3);
+    COMPARE_STRING(mirrors.url(0), "http://a.example/repo/");
+    COMPARE_STRING(mirrors.url(1), "http://b.example/repo/");
+    COMPARE_STRING(mirrors.url(2), "ftp://c.example/repo/");
+  }
+
+  {
+    mirror_set mirrors;
+    for (int i = 0; i < 5; ++i) {
+      mirrors.add("http://mirror.example/");
+    }
+    // Unmeasured mirrors are probed in order, up to a limit.
+    CHECK(mirrors.select() == 0);
+    mirrors.success(0, 1000);
+    CHECK(mirrors.select() == 1);
+    mirrors.success(1, 3000);
+    CHECK(mirrors.select() == 2);
+    mirrors.success(2, 2000);
+    CHECK(mirrors.select() == 1);
+    CHECK(mirrors.throughput(1) == 3000);
+
+    // Smoothing.
+    mirrors.success(1, 1000);
+    CHECK(mirrors.throughput(1) == 2500);
+    CHECK(mirrors.select() == 1);
+    mirrors.success(1, 0);
+    CHECK(mirrors.select() == 2);
+
+    // Failover after an error.  The remaining mirrors are probed
+    // first.
+    mirrors.failure(2);
+    CHECK(mirrors.failures(2) == 1);
+    CHECK(mirrors.select() == 3);
+    mirrors.failure(3);
+    CHECK(mirrors.select() == 4);
+    mirrors.failure(4);
+    CHECK(mirrors.select() == 1);
+    mirrors.failure(1);
+    CHECK(mirrors.select() == 0);
+    mirrors.failure(0);
+    CHECK(mirrors.select() == 2);
+    mirrors.success(0, 10);
+    CHECK(mirrors.failures(0) == 0);
+    CHECK(mirrors.select() == 0);
+
+    // The full ranking, used when the preferred mirror is busy.
+    // Mirror 3 is still probed before the measured mirrors with the
+    // same number of failures, but mirror 4 is beyond the probe
+    // limit.
+    std::vector<size_t> order;
+    mirrors.ranking(order);
+    CHECK(order.size() == 5);
+    CHECK(order.at(0) == 0);
+    CHECK(order.at(1) == 3);
+    CHECK(order.at(2) == 2);
+    CHECK(order.at(3) == 1);
+    CHECK(order.at(4) == 4);
+  }
+
+  {
+    mirror_set mirrors;
+    try {
+      mirrors.select();
+      CHECK(false);
+    } catch (std::logic_error &) {
+    }
+  }
+}
+
+static test_register t("mirror_set", test);
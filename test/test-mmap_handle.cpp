@@ -0,0 +1,57 @@
+/*
+ * Copyright (C) 2013 Red Hat, Inc.
+ * Written by Florian Weimer <fweimer@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <cxxll/mmap_handle.hpp>
+#include <cxxll/os_exception.hpp>
+#include <cxxll/read_file.hpp>
+
+#include "test.hpp"
+
+using namespace cxxll;
+
+static void
+test()
+{
+  static const char FILE[] = "test/data/primary.xml";
+  std::vector<unsigned char> reference;
+  read_file(FILE, reference);
+
+  mmap_handle map;
+  CHECK(map.data() == NULL);
+  CHECK(map.size() == 0);
+  map.map_read_only(FILE);
+  CHECK(map.size() == reference.size());
+  CHECK(std::equal(reference.begin(), reference.end(), map.data()));
+  map.reset();
+  CHECK(map.data() == NULL);
+  CHECK(map.size() == 0);
+
+  map.map_read_only("/dev/null");
+  CHECK(map.data() == NULL);
+  CHECK(map.size() == 0);
+
+  try {
+    map.map_read_only("/nonexistent");
+    CHECK(false);
+  } catch (os_exception &e) {
+    COMPARE_STRING(e.path(), "/nonexistent");
+  }
+}
+
+static test_register t("mmap_handle", test);
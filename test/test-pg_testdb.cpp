@@ -22,6 +22,9 @@
 #include <cxxll/pg_exception.hpp>
 #include <cxxll/pg_query.hpp>
 #include <cxxll/pg_response.hpp>
+#include <cxxll/pg_column.hpp>
+#include <cxxll/pg_cursor.hpp>
+#include <cxxll/string_pool.hpp>
 
 #include "test.hpp"
 
@@ -551,6 +554,176 @@ test()
 		     std::string("\x00\x40\x7f\x80\xff", 5));
     }
 
+    // Arrays
+    {
+      std::vector<int> ti;
+      pg_query_binary(h, r, "SELECT $1, COALESCE(array_length($1, 1), 0)",
+		      ti);
+      std::vector<int> ti2(1, 17);
+      int count = -1;
+      pg_response(r, 0, ti2, count);
+      CHECK(ti2.empty());
+      CHECK(count == 0);
+      ti.push_back(1);
+      ti.push_back(-2);
+      ti.push_back(0x03040506);
+      pg_query(h, r, "SELECT $1::text", ti);
+      COMPARE_STRING(r.getvalue(0, 0), "{1,-2,50595078}");
+      pg_query_binary(h, r, "SELECT $1", ti);
+      pg_response(r, 0, ti2);
+      CHECK(ti2 == ti);
+      r.execBinary(h, "SELECT ARRAY[4, 5]::int[]");
+      pg_response(r, 0, ti2);
+      CHECK(ti2.size() == 2);
+      CHECK(ti2.at(0) == 4);
+      CHECK(ti2.at(1) == 5);
+      try {
+	r.execBinary(h, "SELECT ARRAY[4, NULL]::int[]");
+	pg_response(r, 0, ti2);
+	CHECK(false);
+      } catch (pg_exception &e) {
+	COMPARE_STRING(e.what(), "NULL element in array column");
+      }
+      try {
+	r.exec(h, "SELECT ARRAY[4, 5]::int[]");
+	pg_response(r, 0, ti2);
+	CHECK(false);
+      } catch (pg_exception &e) {
+	COMPARE_STRING(e.what(), "format mismatch for array column");
+      }
+
+      std::vector<long long> tl;
+      tl.push_back(0xa1a2a3a4a5a6a7a8LL);
+      tl.push_back(1);
+      pg_query(h, r, "SELECT $1::text", tl);
+      COMPARE_STRING(r.getvalue(0, 0), "{-6799692559826901080,1}");
+      std::vector<long long> tl2;
+      pg_query_binary(h, r, "SELECT $1", tl);
+      pg_response(r, 0, tl2);
+      CHECK(tl2 == tl);
+
+      std::vector<std::string> ts;
+      ts.push_back("");
+      ts.push_back("abc");
+      ts.push_back("\"");
+      pg_query(h, r, "SELECT $1::text", ts);
+      COMPARE_STRING(r.getvalue(0, 0), "{\"\",abc,\"\\\"\"}");
+      std::vector<std::string> ts2;
+      pg_query_binary(h, r, "SELECT $1", ts);
+      pg_response(r, 0, ts2);
+      CHECK(ts2 == ts);
+
+      std::vector<std::vector<unsigned char> > tb;
+      tb.push_back(std::vector<unsigned char>());
+      tb.push_back(std::vector<unsigned char>(2, 0xff));
+      pg_query(h, r, "SELECT $1::text", tb);
+      COMPARE_STRING(r.getvalue(0, 0), "{\"\\\\x\",\"\\\\xffff\"}");
+      std::vector<std::vector<unsigned char> > tb2;
+      pg_query_binary(h, r, "SELECT $1", tb);
+      pg_response(r, 0, tb2);
+      CHECK(tb2 == tb);
+    }
+
+    // Column decoders
+    {
+      const char *query = "SELECT i, i::int8, i::text, decode(i::text, 'hex'),"
+	" CASE WHEN i % 2 = 0 THEN 'even' ELSE 'odd' END"
+	" FROM generate_series(10, 13) i";
+      for (int binary = 0; binary <= 1; ++binary) {
+	if (binary) {
+	  r.execBinary(h, query);
+	} else {
+	  r.exec(h, query);
+	}
+	std::vector<int> ti(1, -1);
+	pg_column(r, 0, ti);
+	CHECK(ti.size() == 5);
+	CHECK(ti.at(0) == -1);
+	CHECK(ti.at(1) == 10);
+	CHECK(ti.at(4) == 13);
+	std::vector<long long> tl;
+	pg_column(r, 1, tl);
+	CHECK(tl.size() == 4);
+	CHECK(tl.at(3) == 13);
+	std::vector<std::string> ts;
+	pg_column(r, 2, ts);
+	CHECK(ts.size() == 4);
+	COMPARE_STRING(ts.at(2), "12");
+	std::vector<std::vector<unsigned char> > tb;
+	pg_column(r, 3, tb);
+	CHECK(tb.size() == 4);
+	CHECK(tb.at(1).size() == 1);
+	CHECK(tb.at(1).at(0) == 0x11);
+	string_pool pool;
+	pool.intern("odd");
+	std::vector<unsigned> ids;
+	pg_column(r, 4, pool, ids);
+	CHECK(pool.size() == 2);
+	CHECK(ids.size() == 4);
+	CHECK(ids.at(0) == 1);
+	CHECK(ids.at(1) == 0);
+	CHECK(ids.at(2) == 1);
+	CHECK(ids.at(3) == 0);
+	if (binary) {
+	  try {
+	    pg_column(r, 2, ti);
+	    CHECK(false);
+	  } catch (pg_exception &e) {
+	    COMPARE_STRING(e.what(), "format mismatch for column");
+	  }
+	}
+      }
+      r.execBinary(h, "SELECT NULL::int");
+      try {
+	std::vector<int> ti;
+	pg_column(r, 0, ti);
+	CHECK(false);
+      } catch (pg_exception &e) {
+	COMPARE_STRING(e.what(), "NULL value in non-null column");
+      }
+    }
+
+    // Cursors
+    {
+      try {
+	pg_cursor cursor(h, "test_cursor", "SELECT 1");
+	CHECK(false);
+      } catch (pg_exception &e) {
+	COMPARE_STRING(e.what(), "cursor requires a transaction");
+      }
+      r.exec(h, "BEGIN");
+      {
+	pg_cursor cursor(h, "test_cursor",
+			 "SELECT i FROM generate_series($1, $2) i", 1, 25);
+	std::vector<int> values;
+	unsigned chunks = 0;
+	while (cursor.fetch(r, 10)) {
+	  CHECK(r.ntuples() <= 10);
+	  pg_column(r, 0, values);
+	  ++chunks;
+	}
+	CHECK(chunks == 3);
+	CHECK(values.size() == 25);
+	CHECK(values.front() == 1);
+	CHECK(values.back() == 25);
+	CHECK(!cursor.fetch(r, 10));
+      }
+      {
+	// Exactly one chunk, followed by an empty fetch.
+	pg_cursor cursor(h, "test_cursor",
+			 "SELECT i FROM generate_series(1, 10) i");
+	CHECK(cursor.fetch(r, 10));
+	CHECK(r.ntuples() == 10);
+	CHECK(!cursor.fetch(r, 10));
+      }
+      {
+	// The destructor closes the cursor, so the name can be
+	// reused.
+	pg_cursor cursor(h, "test_cursor", "SELECT 1");
+      }
+      r.exec(h, "COMMIT");
+    }
+
     // Result order.
     {
       int t1, t2, t3, t4, t5, t6, t7, t8, t9;
@@ -0,0 +1,90 @@
+/*
+ * Copyright (C) 2013 Red Hat, Inc.
+ * Written by Florian Weimer <fweimer@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <cxxll/pipe_source.hpp>
+#include <cxxll/source_sink.hpp>
+#include <cxxll/task.hpp>
+#include <cxxll/vector_sink.hpp>
+
+#include "test.hpp"
+
+#include <stdexcept>
+
+using namespace cxxll;
+
+namespace {
+  struct producer {
+    pipe_source *pipe;
+    const std::vector<unsigned char> *data;
+    size_t chunk;
+    bool failed;
+
+    static void callback(producer *p) throw()
+    {
+      try {
+	pipe_source::writer w(*p->pipe);
+	for (size_t i = 0; i < p->data->size(); i += p->chunk) {
+	  size_t len = std::min(p->chunk, p->data->size() - i);
+	  w.write(p->data->data() + i, len);
+	}
+	w.close();
+      } catch (std::runtime_error &) {
+	p->failed = true;
+      }
+    }
+  };
+}
+
+static void
+test()
+{
+  std::vector<unsigned char> data;
+  for (unsigned i = 0; i < 100000; ++i) {
+    data.push_back(static_cast<unsigned char>(i * 7 + (i >> 8)));
+  }
+
+  static const size_t chunks[] = {1, 13, 4096, 100000};
+  for (size_t j = 0; j < sizeof(chunks) / sizeof(chunks[0]); ++j) {
+    pipe_source pipe(1000);
+    producer p = {&pipe, &data, chunks[j], false};
+    task t(std::tr1::bind(&producer::callback, &p));
+    vector_sink vsink;
+    copy_source_to_sink(pipe, vsink);
+    t.wait();
+    CHECK(!p.failed);
+    CHECK(vsink.data == data);
+    unsigned char buf[1];
+    CHECK(pipe.read(buf, sizeof(buf)) == 0);
+  }
+
+  {
+    // Aborting the pipe unblocks the writer.
+    pipe_source pipe(1000);
+    producer p = {&pipe, &data, 4096, false};
+    task t(std::tr1::bind(&producer::callback, &p));
+    unsigned char buf[10];
+    CHECK(pipe.read(buf, sizeof(buf)) == sizeof(buf));
+    CHECK(std::equal(buf, buf + sizeof(buf), data.begin()));
+    pipe.abort();
+    t.wait();
+    CHECK(p.failed);
+  }
+}
+
+static test_register t("pipe_source", test);
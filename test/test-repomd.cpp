@@ -47,6 +47,7 @@ test_primary()
   COMPARE_STRING(primary.href(),
 		 "test/data/Packages/o/opensm-libs-3.3.15-3.fc18.x86_64.rpm");
   COMPARE_STRING(primary.info().source_rpm, "opensm-3.3.15-3.fc18.src.rpm");
+  CHECK(primary.header_end() == 8104);
 
   CHECK(primary.next());
   COMPARE_STRING(primary.info().name, "bind");
@@ -62,6 +63,7 @@ test_primary()
   COMPARE_STRING(primary.href(),
 		 "test/data/Packages/b/bind-9.9.2-5.P1.fc18.x86_64.rpm");
   COMPARE_STRING(primary.info().source_rpm, "bind-9.9.2-5.P1.fc18.src.rpm");
+  CHECK(primary.header_end() == 100140);
 
   CHECK(primary.next());
   COMPARE_STRING(primary.info().name, "oniguruma");
@@ -77,6 +79,7 @@ test_primary()
   COMPARE_STRING(primary.href(),
 		 "http://example.com/root/Packages/o/oniguruma-5.9.2-4.fc18.i686.rpm");
   COMPARE_STRING(primary.info().source_rpm, "oniguruma-5.9.2-4.fc18.src.rpm");
+  CHECK(primary.header_end() == 5900);
 
   CHECK(!primary.next());
 }
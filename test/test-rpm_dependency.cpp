@@ -0,0 +1,63 @@
+/*
+ * Copyright (C) 2013 Red Hat, Inc.
+ * Written by Florian Weimer <fweimer@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <cxxll/rpm_dependency.hpp>
+#include "test.hpp"
+
+using namespace cxxll;
+
+static rpm_dependency
+dep(const char *op, const char *version)
+{
+  rpm_dependency d;
+  CHECK(d.set_op(op));
+  d.version = version;
+  return d;
+}
+
+static void
+test()
+{
+  COMPARE_STRING(dep("", "").op(), "");
+  COMPARE_STRING(dep("<", "1").op(), "<");
+  COMPARE_STRING(dep("<=", "1").op(), "<=");
+  COMPARE_STRING(dep("=", "1").op(), "=");
+  COMPARE_STRING(dep(">=", "1").op(), ">=");
+  COMPARE_STRING(dep(">", "1").op(), ">");
+  {
+    rpm_dependency d;
+    CHECK(!d.set_op("=>"));
+  }
+
+  CHECK(dep("", "").overlaps(dep("=", "1.0-1")));
+  CHECK(dep(">=", "1.0").overlaps(dep("", "")));
+  CHECK(dep(">=", "1.0").overlaps(dep("=", "1.1-1")));
+  CHECK(!dep(">=", "2.0").overlaps(dep("=", "1.9-1")));
+  CHECK(dep("=", "1.0").overlaps(dep("=", "1.0-3")));
+  CHECK(!dep("=", "1.0-2").overlaps(dep("=", "1.0-3")));
+  CHECK(dep("<", "1.0").overlaps(dep(">", "0.5")));
+  CHECK(!dep("<", "1.0").overlaps(dep(">=", "1.0")));
+  CHECK(dep("<=", "1.0").overlaps(dep(">=", "1.0")));
+  CHECK(dep(">=", "1.0").overlaps(dep("=", "1:0.5-1")));
+  CHECK(!dep(">=", "1:1.0").overlaps(dep("=", "0.5-1")));
+  CHECK(dep("=", "0:1.0-1").overlaps(dep("=", "1.0-1")));
+  CHECK(!dep(">=", "10:1.0").overlaps(dep("=", "9:2.0-1")));
+}
+
+static test_register t("rpm_dependency", test);
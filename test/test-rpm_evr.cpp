@@ -0,0 +1,67 @@
+/*
+ * Copyright (C) 2013 Red Hat, Inc.
+ * Written by Florian Weimer <fweimer@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <cxxll/rpm_evr.hpp>
+#include "test.hpp"
+
+using namespace cxxll;
+
+static int
+compare(const char *a, const char *b, bool release_optional = false)
+{
+  return rpm_evr(a).compare(rpm_evr(b), release_optional);
+}
+
+static void
+test()
+{
+  {
+    rpm_evr evr("1.0-2.fc18");
+    COMPARE_STRING(evr.epoch, "0");
+    COMPARE_STRING(evr.version, "1.0");
+    COMPARE_STRING(evr.release, "2.fc18");
+  }
+  {
+    rpm_evr evr("12:1.0");
+    COMPARE_STRING(evr.epoch, "12");
+    COMPARE_STRING(evr.version, "1.0");
+    COMPARE_STRING(evr.release, "");
+  }
+  {
+    rpm_evr evr("1:1.0-beta-3");
+    COMPARE_STRING(evr.epoch, "1");
+    COMPARE_STRING(evr.version, "1.0-beta");
+    COMPARE_STRING(evr.release, "3");
+  }
+
+  CHECK(compare("1.0-1", "1.0-1") == 0);
+  CHECK(compare("0:1.0-1", "1.0-1") == 0);
+  CHECK(compare("1.0-1", "1.0-2") < 0);
+  CHECK(compare("1.10-1", "1.9-1") > 0);
+  CHECK(compare("1:1.0-1", "2.0-1") > 0);
+  CHECK(compare("9:2.0-1", "10:1.0-1") < 0);
+  CHECK(compare("1.0", "1.0-1") < 0);
+  CHECK(compare("1.0", "1.0-1", true) == 0);
+  CHECK(compare("1.0-2", "1.0-1", true) > 0);
+  CHECK(compare("1.1", "1.0-1", true) > 0);
+
+  CHECK(rpm_evr("1.0-1") < rpm_evr("1.0-2"));
+  CHECK(!(rpm_evr("1.0-2") < rpm_evr("1.0-2")));
+  CHECK(rpm_evr("9:1.0-1") < rpm_evr("10:0.1-1"));
+}
+
+static test_register t("rpm_evr", test);
@@ -0,0 +1,204 @@
+/*
+ * Copyright (C) 2013 Red Hat, Inc.
+ * Written by Florian Weimer <fweimer@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <cxxll/rpm_file_layout.hpp>
+#include <cxxll/curl_exception.hpp>
+#include <cxxll/curl_fetch_result.hpp>
+#include <cxxll/curl_multi_fetch.hpp>
+#include <cxxll/hash.hpp>
+#include <cxxll/read_file.hpp>
+#include <cxxll/vector_sink.hpp>
+
+#include "http_responder.hpp"
+#include "test.hpp"
+
+#include <stdio.h>
+
+using namespace cxxll;
+
+namespace {
+  // Follows the protocol of the RPM downloader: the first attempt
+  // only fetches the headers and tries to splice them onto the
+  // payload of CACHED.  If that fails, the transfer is restarted as a
+  // full download.
+  struct splice_transfer : curl_multi_fetch::transfer {
+    const std::vector<unsigned char> &cached_;
+    std::vector<unsigned char> main_header_hash_;
+    unsigned long long header_end_;
+    unsigned long long length_;
+    bool splicing_;
+    bool spliced_;
+    vector_sink header_;
+    vector_sink result_;
+
+    splice_transfer(const std::vector<unsigned char> &cached,
+		    unsigned long long header_end, unsigned long long length)
+      : cached_(cached), header_end_(header_end), length_(length),
+	splicing_(true), spliced_(false)
+    {
+      rpm_file_layout layout;
+      layout.parse(cached.data(), cached.size());
+      main_header_hash_ = hash
+	(hash_sink::sha1,
+	 std::vector<unsigned char>(cached.begin() + layout.header_start,
+				    cached.begin() + layout.payload_start));
+    }
+
+    sink *start()
+    {
+      header_.data.clear();
+      result_.data.clear();
+      return splicing_ ? &header_ : &result_;
+    }
+
+    long long range_end()
+    {
+      return splicing_ ? header_end_ - 1 : -1;
+    }
+
+    bool finished(const curl_fetch_result &)
+    {
+      if (splicing_) {
+	spliced_ = rpm_splice(header_.data, cached_.data(), cached_.size(),
+			      main_header_hash_, length_, result_);
+	return spliced_;
+      }
+      return true;
+    }
+
+    void failed(const curl_exception &, bool)
+    {
+    }
+
+    bool restart()
+    {
+      if (splicing_) {
+	splicing_ = false;
+	return true;
+      }
+      return false;
+    }
+  };
+}
+
+static void
+test()
+{
+  std::vector<unsigned char> data;
+  read_file("test/data/unzip-6.0-7.fc18.x86_64.rpm", data);
+  rpm_file_layout layout;
+  CHECK(layout.parse(data.data(), data.size()));
+  CHECK(layout.header_start == 1384);
+  CHECK(layout.payload_start == 14688);
+  // xz-compressed payload.
+  CHECK(data.at(layout.payload_start) == 0xfd);
+  CHECK(data.at(layout.payload_start + 1) == '7');
+
+  // The main header is sufficient.
+  rpm_file_layout prefix;
+  CHECK(prefix.parse(data.data(), layout.payload_start));
+  CHECK(prefix.header_start == layout.header_start);
+  CHECK(prefix.payload_start == layout.payload_start);
+  CHECK(!prefix.parse(data.data(), layout.payload_start - 1));
+  CHECK(!prefix.parse(data.data(), layout.header_start));
+  CHECK(!prefix.parse(data.data(), 50));
+
+  {
+    // Splice a re-signed header onto the cached payload.  Only the
+    // signature header differs.
+    std::vector<unsigned char> resigned(data);
+    resigned.at(layout.header_start - 16) ^= 1;
+    std::vector<unsigned char> main_header
+      (data.begin() + layout.header_start, data.begin() + layout.payload_start);
+    std::vector<unsigned char> main_header_hash
+      (hash(hash_sink::sha1, main_header));
+    std::vector<unsigned char> header
+      (resigned.begin(), resigned.begin() + layout.payload_start);
+    vector_sink result;
+    CHECK(rpm_splice(header, data.data(), data.size(), main_header_hash,
+		     resigned.size(), result));
+    CHECK(hash(hash_sink::sha256, result.data)
+	  == hash(hash_sink::sha256, resigned));
+    CHECK(result.data != data);
+
+    // The length has to match.
+    vector_sink wrong_length;
+    CHECK(!rpm_splice(header, data.data(), data.size(), main_header_hash,
+		      resigned.size() + 1, wrong_length));
+    CHECK(wrong_length.data.empty());
+
+    // A different main header cannot be used with the cached payload.
+    std::vector<unsigned char> changed(resigned);
+    changed.at(layout.payload_start - 1) ^= 1;
+    header.assign(changed.begin(), changed.begin() + layout.payload_start);
+    vector_sink rejected;
+    CHECK(!rpm_splice(header, data.data(), data.size(), main_header_hash,
+		      changed.size(), rejected));
+    CHECK(rejected.data.empty());
+
+    // The header is incomplete.
+    header.pop_back();
+    CHECK(!rpm_splice(header, data.data(), data.size(), main_header_hash,
+		      resigned.size(), rejected));
+    CHECK(rejected.data.empty());
+  }
+
+  {
+    // Downloads over HTTP.  A re-signed file is spliced after
+    // fetching its headers only, and a file with a different main
+    // header falls back to a full download.
+    std::vector<unsigned char> resigned(data);
+    resigned.at(layout.header_start - 16) ^= 1;
+    std::vector<unsigned char> changed(resigned);
+    changed.at(layout.payload_start - 1) ^= 1;
+    http_responder server;
+    server.add("/resigned.rpm", resigned);
+    server.add("/changed.rpm", changed);
+    curl_multi_fetch::limits limits;
+    limits.transfers = 1;
+    curl_multi_fetch fetch(limits);
+    splice_transfer spliced(data, layout.payload_start, resigned.size());
+    fetch.add(server.url("/resigned.rpm").c_str(), 2, &spliced);
+    splice_transfer full(data, layout.payload_start, changed.size());
+    fetch.add(server.url("/changed.rpm").c_str(), 1, &full);
+    fetch.run();
+
+    CHECK(spliced.spliced_);
+    CHECK(hash(hash_sink::sha256, spliced.result_.data)
+	  == hash(hash_sink::sha256, resigned));
+    CHECK(!full.spliced_);
+    CHECK(hash(hash_sink::sha256, full.result_.data)
+	  == hash(hash_sink::sha256, changed));
+
+    char range[64];
+    snprintf(range, sizeof(range), " bytes=0-%llu", layout.payload_start - 1);
+    std::vector<std::string> requests(server.requests());
+    CHECK(requests.size() == 3);
+    COMPARE_STRING(requests.at(0), "/resigned.rpm" + std::string(range));
+    COMPARE_STRING(requests.at(1), "/changed.rpm" + std::string(range));
+    COMPARE_STRING(requests.at(2), "/changed.rpm");
+  }
+
+  data.at(layout.header_start) = 0;
+  CHECK(!prefix.parse(data.data(), data.size()));
+  data.at(0) = 0;
+  CHECK(!prefix.parse(data.data(), data.size()));
+}
+
+static test_register t("rpm_file_layout", test);
@@ -21,6 +21,12 @@
 
 #include <symboldb/database.hpp>
 #include <symboldb/update_elf_closure.hpp>
+#include <symboldb/update_elf_symbol_binding.hpp>
+#include <symboldb/update_java_class_closure.hpp>
+#include <symboldb/update_rpm_closure.hpp>
+#include <symboldb/abi_diff.hpp>
+#include <symboldb/symbol_collisions.hpp>
+#include <symboldb/symbol_definitions.hpp>
 #include <cxxll/dir_handle.hpp>
 #include <cxxll/pg_testdb.hpp>
 #include <cxxll/pgconn_handle.hpp>
@@ -35,6 +41,10 @@
 #include <symboldb/options.hpp>
 #include <symboldb/get_file.hpp>
 
+#include <algorithm>
+#include <cstdlib>
+#include <functional>
+
 #include "test.hpp"
 
 using namespace cxxll;
@@ -437,6 +447,65 @@ test()
     r1.exec(dbh, "SELECT * FROM symboldb.package_set_member");
     CHECK(r1.ntuples() == static_cast<int>(pids.size()));
 
+    {
+      std::vector<database::package_set_repository> repos;
+      db.package_set_repositories(pset, repos);
+      CHECK(repos.empty());
+      repos.resize(2);
+      repos.at(0).url = "metalink=http://example.com/metalink";
+      repos.at(0).revision = "1363015384";
+      repos.at(0).primary_digest.assign(32, 1);
+      repos.at(1).url = "http://example.com/repo";
+      repos.at(1).primary_digest.assign(32, 2);
+      repos.at(1).exclude_name = "^((.*-debuginfo))$";
+      db.replace_package_set_repositories(pset, repos);
+      db.replace_package_set_repositories(pset, repos);
+      std::vector<database::package_set_repository> repos2;
+      db.package_set_repositories(pset, repos2);
+      CHECK(repos2.size() == 2);
+      if (repos2.size() == 2) {
+	COMPARE_STRING(repos2.at(0).url, repos.at(1).url);
+	COMPARE_STRING(repos2.at(0).revision, "");
+	CHECK(repos2.at(0).primary_digest == repos.at(1).primary_digest);
+	COMPARE_STRING(repos2.at(1).url, repos.at(0).url);
+	COMPARE_STRING(repos2.at(1).revision, repos.at(0).revision);
+	CHECK(repos2.at(1).primary_digest == repos.at(0).primary_digest);
+	COMPARE_STRING(repos2.at(0).exclude_name, repos.at(1).exclude_name);
+	COMPARE_STRING(repos2.at(1).exclude_name, "");
+      }
+
+      // Changing the members discards the recorded repositories.
+      db.txn_begin();
+      CHECK(!db.update_package_set(pset, pids));
+      db.txn_commit();
+      repos2.clear();
+      db.package_set_repositories(pset, repos2);
+      CHECK(repos2.size() == 2);
+      db.txn_begin();
+      CHECK(db.update_package_set(pset, pids.begin() + 1, pids.end()));
+      CHECK(db.update_package_set(pset, pids));
+      db.txn_commit();
+      repos2.clear();
+      db.package_set_repositories(pset, repos2);
+      CHECK(repos2.empty());
+
+      // replace_package_set() records them together with the members,
+      // also if the members do not change.
+      std::vector<database::package_id> rest(pids.begin() + 1, pids.end());
+      CHECK(db.replace_package_set(pset, rest, &repos));
+      repos2.clear();
+      db.package_set_repositories(pset, repos2);
+      CHECK(repos2.size() == 2);
+      CHECK(db.replace_package_set(pset, pids, NULL));
+      repos2.clear();
+      db.package_set_repositories(pset, repos2);
+      CHECK(repos2.empty());
+      CHECK(!db.replace_package_set(pset, pids, &repos));
+      repos2.clear();
+      db.package_set_repositories(pset, repos2);
+      CHECK(repos2.size() == 2);
+    }
+
     db.txn_begin();
     CHECK(db.update_package_set(pset, pids.begin() + 1, pids.end()));
     CHECK(!db.update_package_set(pset, pids.begin() + 1, pids.end()));
@@ -474,6 +543,350 @@ test()
     update_elf_closure(dbh, pset, NULL);
     r1.exec(dbh, "COMMIT");
 
+    // Removing and re-adding a package must restore the closure.
+    {
+      const char *closure_sql =
+	"SELECT string_agg(file_id || ':' || needed, ','"
+	" ORDER BY file_id, needed) FROM symboldb.elf_closure";
+      r1.exec(dbh, closure_sql);
+      std::string closure(r1.getvalue(0, 0));
+      CHECK(!closure.empty());
+
+      std::vector<database::package_id> members;
+      r1.exec(dbh, "SELECT package_id FROM symboldb.package_set_member"
+	      " ORDER BY package_id");
+      for (int row = 0, end = r1.ntuples(); row < end; ++row) {
+	members.push_back(database::package_id(atoi(r1.getvalue(row, 0))));
+      }
+      CHECK(members.size() > 1);
+      std::vector<database::package_id> smaller(members.begin() + 1,
+						members.end());
+
+      database::package_set_delta delta;
+      db.txn_begin();
+      CHECK(db.update_package_set(pset, smaller, delta));
+      CHECK(delta.added.empty());
+      CHECK(delta.removed.size() == 1);
+      CHECK(delta.removed.front() == members.front());
+      CHECK(db.update_package_set(pset, members, delta));
+      CHECK(delta.added.size() == 1);
+      CHECK(delta.added.front() == members.front());
+      CHECK(delta.removed.empty());
+      CHECK(!db.update_package_set(pset, members, delta));
+      CHECK(delta.added.empty());
+      CHECK(delta.removed.empty());
+      db.txn_rollback();
+
+      // The incremental update, computed from a snapshot outside the
+      // lock, has to match a full recomputation.
+      CHECK(db.replace_package_set(pset, smaller));
+      CHECK(!db.replace_package_set(pset, smaller));
+      r1.exec(dbh, "SELECT COUNT(*) FROM symboldb.package_set_member");
+      CHECK(atoi(r1.getvalue(0, 0)) == static_cast<int>(smaller.size()));
+      r1.exec(dbh, closure_sql);
+      std::string smaller_closure(r1.getvalue(0, 0));
+      CHECK(smaller_closure != closure);
+      r1.exec(dbh, "BEGIN");
+      update_elf_closure(dbh, pset, NULL);
+      r1.exec(dbh, "COMMIT");
+      r1.exec(dbh, closure_sql);
+      COMPARE_STRING(r1.getvalue(0, 0), smaller_closure);
+      CHECK(db.replace_package_set(pset, members));
+      r1.exec(dbh, closure_sql);
+      COMPARE_STRING(r1.getvalue(0, 0), closure);
+
+      // Each package set has its own closure partition, which is
+      // dropped together with the set.
+      const char *count_sql = "SELECT COUNT(*) FROM symboldb.elf_closure";
+      r1.exec(dbh, count_sql);
+      int rows = atoi(r1.getvalue(0, 0));
+      db.txn_begin();
+      database::package_set_id pset2(db.create_package_set("test-set-2"));
+      db.txn_commit();
+      CHECK(db.replace_package_set(pset2, members));
+      r1.exec(dbh, count_sql);
+      CHECK(atoi(r1.getvalue(0, 0)) == 2 * rows);
+      char pset2str[32];
+      snprintf(pset2str, sizeof(pset2str), "%d", pset2.value());
+      const char *partition_sql =
+	"SELECT COUNT(*) FROM pg_tables WHERE schemaname = 'symboldb'"
+	" AND tablename = 'elf_closure_' || $1";
+      const char *params[] = {pset2str};
+      r1.execParams(dbh, partition_sql, params);
+      COMPARE_STRING(r1.getvalue(0, 0), "1");
+      r1.execParams(dbh, "DELETE FROM symboldb.package_set"
+		    " WHERE set_id = $1", params);
+      r1.execParams(dbh, partition_sql, params);
+      COMPARE_STRING(r1.getvalue(0, 0), "0");
+      r1.exec(dbh, count_sql);
+      CHECK(atoi(r1.getvalue(0, 0)) == rows);
+      r1.exec(dbh, closure_sql);
+      COMPARE_STRING(r1.getvalue(0, 0), closure);
+    }
+
+    // Symbol bindings.  Every reference gets a row, and resolved
+    // references point to a definition in the closure of the file.
+    r1.exec(dbh, "BEGIN");
+    update_elf_symbol_binding(dbh, pset);
+    r1.exec(dbh, "COMMIT");
+    r1.exec(dbh, "SELECT COUNT(*), COUNT(provider)"
+	    " FROM symboldb.elf_symbol_binding");
+    CHECK(atoi(r1.getvalue(0, 0)) > 0);
+    CHECK(atoi(r1.getvalue(0, 1)) > 0);
+    r1.exec(dbh, "SELECT (SELECT COUNT(*) FROM symboldb.elf_symbol_binding)"
+	    " = (SELECT COUNT(*) FROM symboldb.package_set_member"
+	    " JOIN symboldb.file USING (package_id)"
+	    " JOIN symboldb.elf_reference USING (contents_id))");
+    COMPARE_STRING(r1.getvalue(0, 0), "t");
+    r1.exec(dbh, "SELECT COUNT(*) FROM symboldb.elf_symbol_binding b"
+	    " WHERE provider IS NOT NULL"
+	    " AND (NOT EXISTS (SELECT 1 FROM symboldb.elf_closure ec"
+	    "  WHERE ec.set_id = b.set_id AND ec.file_id = b.file_id"
+	    "  AND ec.needed = b.provider)"
+	    " OR NOT EXISTS (SELECT 1 FROM symboldb.file f"
+	    "  JOIN symboldb.elf_definition ed USING (contents_id)"
+	    "  WHERE f.file_id = b.provider AND ed.name = b.name))");
+    COMPARE_STRING(r1.getvalue(0, 0), "0");
+
+    // Java class closure.  The JDK is not part of the package set, so
+    // references to its classes are unresolved.
+    r1.exec(dbh, "BEGIN");
+    update_java_class_closure(dbh, pset);
+    r1.exec(dbh, "COMMIT");
+    r1.exec(dbh, "SELECT COUNT(*) FROM symboldb.java_class_closure"
+	    " WHERE provider IS NULL AND name LIKE 'java/lang/%'");
+    CHECK(atoi(r1.getvalue(0, 0)) > 0);
+    r1.exec(dbh, "SELECT COUNT(*) FROM symboldb.java_class_closure c"
+	    " WHERE provider = file_id OR (provider IS NOT NULL"
+	    " AND NOT EXISTS (SELECT 1 FROM symboldb.file f"
+	    "  JOIN symboldb.java_class_contents USING (contents_id)"
+	    "  JOIN symboldb.java_class jc USING (class_id)"
+	    "  WHERE f.file_id = c.provider AND jc.name = c.name))");
+    COMPARE_STRING(r1.getvalue(0, 0), "0");
+
+    // RPM dependencies.  glibc is not part of the package set, so
+    // some requirements are unresolved.
+    r1.exec(dbh, "SELECT op, version FROM symboldb.package_dependency"
+	    " JOIN symboldb.rpm_capability rc USING (capability_id)"
+	    " JOIN symboldb.package p USING (package_id)"
+	    " WHERE symboldb.nevra(p) = 'sysvinit-tools-2.88-9.dsf.fc18.x86_64'"
+	    " AND kind = 'provides' AND rc.name = 'sysvinit-tools'");
+    CHECK(r1.ntuples() == 1);
+    COMPARE_STRING(r1.getvalue(0, 0), "=");
+    COMPARE_STRING(r1.getvalue(0, 1), "2.88-9.dsf.fc18");
+    r1.exec(dbh, "BEGIN");
+    update_rpm_closure(dbh, pset);
+    r1.exec(dbh, "COMMIT");
+    r1.exec(dbh, "SELECT COUNT(*) FROM symboldb.package_require_provider"
+	    " WHERE provider IS NULL");
+    CHECK(atoi(r1.getvalue(0, 0)) > 0);
+    r1.exec(dbh, "SELECT COUNT(*) FROM symboldb.package_require_provider r"
+	    " WHERE provider IS NOT NULL AND (provider = package_id"
+	    " OR NOT EXISTS (SELECT 1 FROM symboldb.package_install_closure c"
+	    "  WHERE c.package_id = r.package_id AND c.needed = r.provider))");
+    COMPARE_STRING(r1.getvalue(0, 0), "0");
+
+    // Symbol collisions, without path or symbol restrictions.
+    {
+      std::vector<symbol_collision> collisions;
+      r1.exec(dbh, "BEGIN");
+      find_symbol_collisions
+	(dbh, pset, symbol_collision_filter(regex_handle(".*"),
+					    regex_handle("^$")),
+	 collisions);
+      r1.exec(dbh, "ROLLBACK");
+      for (std::vector<symbol_collision>::iterator
+	     p = collisions.begin(), end = collisions.end(); p != end; ++p) {
+	CHECK(p->definitions.size() >= 2);
+	CHECK(p->definitions.front().soname != p->definitions.back().soname);
+      }
+      CHECK(std::adjacent_find(collisions.begin(), collisions.end(),
+			       std::not2(std::less<symbol_collision>()))
+	    == collisions.end());
+    }
+
+    // Symbol definitions through the symbol filters.  All exported
+    // definitions of the symbol must be found.
+    r1.exec(dbh, "SELECT COUNT(*) FROM symboldb.elf_file"
+	    " WHERE symbol_filter IS NULL");
+    COMPARE_STRING(r1.getvalue(0, 0), "0");
+    {
+      char psetstr[32];
+      snprintf(psetstr, sizeof(psetstr), "%d", pset.value());
+      const char *params[] = {psetstr};
+      r1.execParams(dbh, "SELECT ed.name"
+		    " FROM symboldb.package_set_member psm"
+		    " JOIN symboldb.file f USING (package_id)"
+		    " JOIN symboldb.elf_definition ed USING (contents_id)"
+		    " WHERE psm.set_id = $1 AND ed.binding <> 0"
+		    " AND ed.section <> 0 AND ed.visibility = 'default'"
+		    " ORDER BY ed.name DESC LIMIT 1", params);
+      CHECK(r1.ntuples() == 1);
+      std::vector<std::string> names;
+      names.push_back(r1.getvalue(0, 0));
+      names.push_back("symboldb_no_such_symbol");
+      const char *params2[] = {psetstr, names.front().c_str()};
+      r1.execParams(dbh, "SELECT COUNT(*) FROM (SELECT DISTINCT"
+		    " ed.version, f.name, psm.package_id"
+		    " FROM symboldb.package_set_member psm"
+		    " JOIN symboldb.file f USING (package_id)"
+		    " JOIN symboldb.elf_definition ed USING (contents_id)"
+		    " WHERE psm.set_id = $1 AND ed.name = $2"
+		    " AND ed.binding <> 0 AND ed.section <> 0"
+		    " AND ed.visibility IN ('default', 'protected')) x",
+		    params2);
+      std::vector<symbol_definition_info> definitions;
+      r1.exec(dbh, "BEGIN");
+      find_symbol_definitions(dbh, pset, names, definitions);
+      r1.exec(dbh, "ROLLBACK");
+      CHECK(definitions.size() == strtoul(r1.getvalue(0, 0), NULL, 10));
+      CHECK(!definitions.empty());
+      for (std::vector<symbol_definition_info>::iterator
+	     p = definitions.begin(), end = definitions.end(); p != end; ++p) {
+	COMPARE_STRING(p->name, names.front());
+      }
+    }
+
+    // ABI differences.  A set does not differ from itself, and
+    // compared to an empty set, every shared object is added.
+    r1.exec(dbh, "SELECT COUNT(*) FROM symboldb.elf_file"
+	    " WHERE symbol_fingerprint IS NULL");
+    COMPARE_STRING(r1.getvalue(0, 0), "0");
+    {
+      db.txn_begin();
+      database::package_set_id empty(db.create_package_set("test-set-empty"));
+      db.txn_commit();
+      std::vector<abi_difference> diff;
+      r1.exec(dbh, "BEGIN");
+      diff_package_set_abi(dbh, pset, pset, diff);
+      CHECK(diff.empty());
+      diff_package_set_abi(dbh, empty, pset, diff);
+      r1.exec(dbh, "ROLLBACK");
+      r1.exec(dbh, "SELECT COUNT(DISTINCT (soname, arch))"
+	      " FROM symboldb.package_set_member"
+	      " JOIN symboldb.file USING (package_id)"
+	      " JOIN symboldb.elf_file USING (contents_id)"
+	      " WHERE e_type = 3 AND soname IS NOT NULL AND arch IS NOT NULL");
+      CHECK(diff.size() == strtoul(r1.getvalue(0, 0), NULL, 10));
+      CHECK(!diff.empty());
+      for (std::vector<abi_difference>::iterator
+	     p = diff.begin(), end = diff.end(); p != end; ++p) {
+	CHECK(p->change == abi_difference::added);
+	CHECK(p->symbol.empty());
+      }
+      r1.exec(dbh, "DELETE FROM symboldb.package_set"
+	      " WHERE name = 'test-set-empty'");
+    }
+
+    // Two different shared objects with the same soname.  The
+    // executables are turned into shared objects with synthetic
+    // symbols, and the changes are rolled back afterwards.
+    {
+      r1.exec(dbh, "BEGIN");
+      r1.exec(dbh, "SELECT ef.contents_id FROM symboldb.package p"
+	      " JOIN symboldb.file f USING (package_id)"
+	      " JOIN symboldb.elf_file ef USING (contents_id)"
+	      " WHERE f.name = '/sbin/killall5' AND symboldb.nevra(p)"
+	      " IN ('sysvinit-tools-2.88-6.dsf.fc17.x86_64',"
+	      " 'sysvinit-tools-2.88-9.dsf.fc18.x86_64')"
+	      " ORDER BY p.release");
+      CHECK(r1.ntuples() == 2);
+      std::string old_contents(r1.getvalue(0, 0));
+      std::string new_contents(r1.getvalue(1, 0));
+      CHECK(old_contents != new_contents);
+      {
+	const char *params[] = {old_contents.c_str(), new_contents.c_str()};
+	r1.execParams(dbh, "UPDATE symboldb.elf_file SET e_type = 3,"
+		      " soname = 'libsymboldb-test.so.1',"
+		      " symbol_fingerprint = CASE contents_id"
+		      "  WHEN $1::integer THEN decode(repeat('01', 32), 'hex')"
+		      "  ELSE decode(repeat('02', 32), 'hex') END"
+		      " WHERE contents_id IN ($1, $2)", params);
+	r1.execParams(dbh, "DELETE FROM symboldb.elf_definition"
+		      " WHERE contents_id IN ($1, $2)", params);
+	// The definitions of "same" differ only in their order.
+	r1.execParams(dbh, "INSERT INTO symboldb.elf_definition"
+		      " (contents_id, name, version, primary_version,"
+		      " symbol_type, binding, section, visibility)"
+		      " SELECT $1::integer, name, version, version IS NOT NULL,"
+		      " symbol_type, binding, 1,"
+		      " visibility::symboldb.elf_visibility"
+		      " FROM (VALUES"
+		      " ('same', NULL, 2, 1, 'default'),"
+		      " ('same', NULL, 1, 1, 'default'),"
+		      " ('retyped', NULL, 2, 1, 'default'),"
+		      " ('dropped', 'V1', 2, 1, 'default'),"
+		      " ('multi', NULL, 2, 1, 'default'),"
+		      " ('multi', NULL, 1, 1, 'default'))"
+		      " x (name, version, symbol_type, binding, visibility)"
+		      " UNION ALL"
+		      " SELECT $2::integer, name, version, version IS NOT NULL,"
+		      " symbol_type, binding, 1,"
+		      " visibility::symboldb.elf_visibility"
+		      " FROM (VALUES"
+		      " ('same', NULL, 1, 1, 'default'),"
+		      " ('same', NULL, 2, 1, 'default'),"
+		      " ('retyped', NULL, 1, 1, 'default'),"
+		      " ('new', NULL, 2, 2, 'default'),"
+		      " ('multi', NULL, 2, 1, 'default'),"
+		      " ('internal', NULL, 2, 1, 'hidden'))"
+		      " x (name, version, symbol_type, binding, visibility)",
+		      params);
+      }
+      r1.exec(dbh, "INSERT INTO symboldb.package_set (name)"
+	      " VALUES ('test-abi-old'), ('test-abi-new')");
+      r1.exec(dbh, "INSERT INTO symboldb.package_set_member"
+	      " SELECT ps.set_id, p.package_id"
+	      " FROM symboldb.package_set ps, symboldb.package p"
+	      " WHERE (ps.name = 'test-abi-old' AND symboldb.nevra(p)"
+	      "  = 'sysvinit-tools-2.88-6.dsf.fc17.x86_64')"
+	      " OR (ps.name = 'test-abi-new' AND symboldb.nevra(p)"
+	      "  = 'sysvinit-tools-2.88-9.dsf.fc18.x86_64')");
+      r1.exec(dbh, "SELECT set_id FROM symboldb.package_set"
+	      " JOIN symboldb.package_set_member USING (set_id)"
+	      " WHERE name IN ('test-abi-old', 'test-abi-new') ORDER BY name");
+      CHECK(r1.ntuples() == 2);
+      database::package_set_id new_set(atoi(r1.getvalue(0, 0)));
+      database::package_set_id old_set(atoi(r1.getvalue(1, 0)));
+
+      std::vector<abi_difference> diff;
+      diff_package_set_abi(dbh, old_set, new_set, diff);
+      std::vector<abi_difference> test_diff;
+      for (std::vector<abi_difference>::iterator
+	     p = diff.begin(), end = diff.end(); p != end; ++p) {
+	if (p->soname == "libsymboldb-test.so.1") {
+	  test_diff.push_back(*p);
+	}
+      }
+      CHECK(test_diff.size() == 4);
+      if (test_diff.size() == 4) {
+	COMPARE_STRING(test_diff[0].symbol, "dropped");
+	COMPARE_STRING(test_diff[0].version, "V1");
+	CHECK(test_diff[0].change == abi_difference::removed);
+	COMPARE_STRING(test_diff[1].symbol, "multi");
+	CHECK(test_diff[1].change == abi_difference::changed);
+	COMPARE_STRING(test_diff[2].symbol, "new");
+	CHECK(test_diff[2].change == abi_difference::added);
+	COMPARE_STRING(test_diff[3].symbol, "retyped");
+	CHECK(test_diff[3].change == abi_difference::changed);
+	for (int i = 0; i < 4; ++i) {
+	  COMPARE_STRING(test_diff[i].arch, "x86_64");
+	}
+      }
+
+      // With equal fingerprints, the symbols are not compared.
+      r1.exec(dbh, "UPDATE symboldb.elf_file"
+	      " SET symbol_fingerprint = decode(repeat('01', 32), 'hex')"
+	      " WHERE soname = 'libsymboldb-test.so.1'");
+      diff.clear();
+      diff_package_set_abi(dbh, old_set, new_set, diff);
+      for (std::vector<abi_difference>::iterator
+	     p = diff.begin(), end = diff.end(); p != end; ++p) {
+	CHECK(p->soname != "libsymboldb-test.so.1");
+      }
+      r1.exec(dbh, "ROLLBACK");
+    }
+
     std::vector<std::vector<unsigned char> > digests;
     db.referenced_package_digests(digests);
     CHECK(digests.size() == 10); // 5 packages with 2 digests each
@@ -483,6 +896,18 @@ test()
       digest.resize(32);
       CHECK(db.package_by_digest(digest).value() == 0);
     }
+    {
+      std::vector<std::vector<unsigned char> > lookup(digests);
+      lookup.push_back(std::vector<unsigned char>(32));
+      database::package_digest_map known;
+      db.packages_by_digests(lookup, known);
+      CHECK(known.size() == digests.size());
+      for (std::vector<std::vector<unsigned char> >::iterator
+	     p = digests.begin(), end = digests.end(); p != end; ++p) {
+	CHECK(known[*p] == db.package_by_digest(*p));
+      }
+      CHECK(known.find(lookup.back()) == known.end());
+    }
 
     // Test get_file().
     {
@@ -515,6 +940,7 @@ test()
     db.expire_packages();
     db.expire_file_contents();
     db.expire_java_classes();
+    db.expire_rpm_capabilities();
     db.txn_rollback();
 
     test_java_class(db, dbh);
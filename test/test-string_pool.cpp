@@ -0,0 +1,61 @@
+/*
+ * Copyright (C) 2013 Red Hat, Inc.
+ * Written by Florian Weimer <fweimer@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <cxxll/string_pool.hpp>
+#include "test.hpp"
+
+#include <cstdio>
+
+using namespace cxxll;
+
+static void
+test()
+{
+  string_pool pool;
+  CHECK(pool.size() == 0);
+  unsigned index = 17;
+  CHECK(!pool.find("", index));
+  CHECK(index == 17);
+  CHECK(pool.intern("x86_64") == 0);
+  CHECK(pool.intern("i686") == 1);
+  CHECK(pool.intern(std::string("x86_64")) == 0);
+  CHECK(pool.intern("", 0) == 2);
+  CHECK(pool.intern("i686x", 4) == 1);
+  CHECK(pool.size() == 3);
+  COMPARE_STRING(pool[0], "x86_64");
+  COMPARE_STRING(pool[1], "i686");
+  COMPARE_STRING(pool[2], "");
+  CHECK(pool.find("i686", index));
+  CHECK(index == 1);
+  CHECK(!pool.find("i386", index));
+  CHECK(index == 1);
+
+  // Interned strings are not moved when the pool grows.
+  const std::string *first = &pool[0];
+  for (unsigned i = 0; i < 1000; ++i) {
+    char buf[16];
+    snprintf(buf, sizeof(buf), "%u", i);
+    CHECK(pool.intern(buf) == i + 3);
+  }
+  CHECK(&pool[0] == first);
+  COMPARE_STRING(pool[0], "x86_64");
+  COMPARE_STRING(pool[1002], "999");
+}
+
+static test_register t("string_pool", test);
@@ -36,6 +36,22 @@ test()
   COMPARE_STRING(quote("a\200b"), "a\\x80b");
   COMPARE_STRING(quote(std::string("a\000b\377c", 6)), "a\\x00b\\xffc\\x00");
 
+  COMPARE_STRING(json_quote(""), "\"\"");
+  COMPARE_STRING(json_quote("a b"), "\"a b\"");
+  COMPARE_STRING(json_quote("a\"b\\c"), "\"a\\\"b\\\\c\"");
+  COMPARE_STRING(json_quote("a\tb\n"), "\"a\\tb\\n\"");
+  COMPARE_STRING(json_quote(std::string("\000\037\177", 3)),
+		 "\"\\u0000\\u001f\\u007f\"");
+  COMPARE_STRING(json_quote("\303\244"), "\"\303\244\"");
+  COMPARE_STRING(json_quote("\360\237\230\200"), "\"\360\237\230\200\"");
+  // ISO-8859-1, truncated, overlong and surrogate sequences.
+  COMPARE_STRING(json_quote("libf\366\366.so"),
+		 "\"libf\\ufffd\\ufffd.so\"");
+  COMPARE_STRING(json_quote("a\303"), "\"a\\ufffd\"");
+  COMPARE_STRING(json_quote("\300\257"), "\"\\ufffd\\ufffd\"");
+  COMPARE_STRING(json_quote("\355\240\200"),
+		 "\"\\ufffd\\ufffd\\ufffd\"");
+
   CHECK(fnv("abc") == fnv(std::string("abc")));
   CHECK(fnv("abc") != fnv(std::string("abc", 4)));
   CHECK((fnv("abc") & 7) != (fnv(std::string("abd", 4)) & 7));
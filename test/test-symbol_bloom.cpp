@@ -0,0 +1,89 @@
+/*
+ * Copyright (C) 2013 Red Hat, Inc.
+ * Written by Florian Weimer <fweimer@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <cxxll/symbol_bloom.hpp>
+#include "test.hpp"
+
+#include <cstdio>
+
+using namespace cxxll;
+
+static std::string
+name(const char *prefix, unsigned i)
+{
+  char buf[32];
+  snprintf(buf, sizeof(buf), "%s%u", prefix, i);
+  return buf;
+}
+
+static void
+test()
+{
+  {
+    symbol_bloom empty(0);
+    std::vector<unsigned char> bytes;
+    empty.serialize(bytes);
+    CHECK(bytes.size() == 8);
+    CHECK(!empty.maybe_contains(symbol_bloom::probe("malloc")));
+    CHECK(!symbol_bloom::maybe_contains
+	  (bytes, symbol_bloom::probe("malloc")));
+  }
+
+  // Empty and malformed serialized filters match everything.
+  {
+    std::vector<unsigned char> bytes;
+    CHECK(symbol_bloom::maybe_contains(bytes, symbol_bloom::probe("x")));
+    bytes.resize(7);
+    CHECK(symbol_bloom::maybe_contains(bytes, symbol_bloom::probe("x")));
+  }
+
+  const unsigned count = 2000;
+  symbol_bloom filter(count);
+  for (unsigned i = 0; i < count; ++i) {
+    filter.add(name("sym", i));
+  }
+  std::vector<unsigned char> bytes;
+  filter.serialize(bytes);
+  CHECK(bytes.size() == 3000);
+  for (unsigned i = 0; i < count; ++i) {
+    symbol_bloom::probe p(name("sym", i));
+    CHECK(filter.maybe_contains(p));
+    CHECK(symbol_bloom::maybe_contains(bytes, p));
+  }
+  unsigned false_positives = 0;
+  for (unsigned i = 0; i < 10000; ++i) {
+    symbol_bloom::probe p(name("other", i));
+    CHECK(filter.maybe_contains(p) == symbol_bloom::maybe_contains(bytes, p));
+    false_positives += filter.maybe_contains(p);
+  }
+  CHECK(false_positives < 400);
+
+  // The serialized format is stored in the database.
+  symbol_bloom one(1);
+  one.add("malloc");
+  one.serialize(bytes);
+  CHECK(bytes.size() == 8);
+  unsigned bits = 0;
+  for (unsigned i = 0; i < bytes.size(); ++i) {
+    bits += __builtin_popcount(bytes[i]);
+  }
+  CHECK(bits >= 1 && bits <= 4);
+}
+
+static test_register t("symbol_bloom", test);
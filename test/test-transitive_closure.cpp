@@ -0,0 +1,147 @@
+/*
+ * Copyright (C) 2013 Red Hat, Inc.
+ * Written by Florian Weimer <fweimer@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <cxxll/transitive_closure.hpp>
+#include "test.hpp"
+
+#include <cstdlib>
+#include <set>
+#include <stdexcept>
+
+using namespace cxxll;
+
+namespace {
+  typedef directed_graph::edge edge;
+
+  // Reference implementation: iterate until a fixpoint is reached.
+  std::vector<std::set<unsigned> >
+  naive_closure(unsigned nodes, const std::vector<edge> &edges)
+  {
+    std::vector<std::set<unsigned> > result(nodes);
+    for (std::vector<edge>::const_iterator p = edges.begin(),
+	   end = edges.end(); p != end; ++p) {
+      result[p->first].insert(p->second);
+    }
+    bool changed = true;
+    while (changed) {
+      changed = false;
+      for (unsigned v = 0; v < nodes; ++v) {
+	std::set<unsigned> deps(result[v]);
+	for (std::set<unsigned>::iterator p = deps.begin(), end = deps.end();
+	     p != end; ++p) {
+	  for (std::set<unsigned>::iterator q = result[*p].begin(),
+		 qend = result[*p].end(); q != qend; ++q) {
+	    changed = result[v].insert(*q).second || changed;
+	  }
+	}
+      }
+    }
+    return result;
+  }
+
+  void
+  compare(unsigned nodes, const std::vector<edge> &edges)
+  {
+    directed_graph graph(nodes, edges);
+    transitive_closure closure(graph);
+    std::vector<std::set<unsigned> > expected(naive_closure(nodes, edges));
+    for (unsigned v = 0; v < nodes; ++v) {
+      std::set<unsigned> actual(closure[v].begin(), closure[v].end());
+      CHECK(actual.size() == closure[v].size());
+      CHECK(actual == expected[v]);
+      for (const unsigned *p = graph.begin(v), *end = graph.end(v);
+	   p != end; ++p) {
+	CHECK(closure.component(*p) <= closure.component(v));
+      }
+    }
+  }
+}
+
+static void
+test()
+{
+  {
+    std::vector<edge> edges;
+    directed_graph graph(0, edges);
+    CHECK(graph.size() == 0);
+    transitive_closure closure(graph);
+    CHECK(closure.components() == 0);
+  }
+  {
+    std::vector<edge> edges;
+    edges.push_back(edge(0, 1));
+    edges.push_back(edge(1, 2));
+    edges.push_back(edge(0, 1));
+    edges.push_back(edge(3, 3));
+    directed_graph graph(5, edges);
+    CHECK(graph.size() == 5);
+    CHECK(graph.end(0) - graph.begin(0) == 1);
+    CHECK(graph.end(2) - graph.begin(2) == 0);
+    transitive_closure closure(graph);
+    CHECK(closure.components() == 5);
+    CHECK(closure[0].size() == 2);
+    CHECK(closure[0].at(0) == 1);
+    CHECK(closure[0].at(1) == 2);
+    CHECK(closure[1].size() == 1);
+    CHECK(closure[2].empty());
+    CHECK(closure[3].size() == 1); // self loop
+    CHECK(closure[4].empty());
+    compare(5, edges);
+  }
+  {
+    // Two cycles connected by an edge.
+    std::vector<edge> edges;
+    edges.push_back(edge(0, 1));
+    edges.push_back(edge(1, 0));
+    edges.push_back(edge(1, 2));
+    edges.push_back(edge(2, 3));
+    edges.push_back(edge(3, 4));
+    edges.push_back(edge(4, 2));
+    transitive_closure closure(directed_graph(5, edges));
+    CHECK(closure.components() == 2);
+    CHECK(closure[0].size() == 5);
+    CHECK(closure[2].size() == 3);
+    CHECK(closure.component(0) == closure.component(1));
+    CHECK(closure.component(2) < closure.component(0));
+    compare(5, edges);
+  }
+  {
+    std::vector<edge> edges;
+    edges.push_back(edge(0, 5));
+    try {
+      directed_graph graph(5, edges);
+      CHECK(false);
+    } catch (std::logic_error &) {
+    }
+  }
+
+  // Random graphs.
+  srand(1);
+  for (unsigned round = 0; round < 200; ++round) {
+    unsigned nodes = 1 + rand() % 40;
+    unsigned count = rand() % (nodes * 3);
+    std::vector<edge> edges;
+    for (unsigned i = 0; i < count; ++i) {
+      edges.push_back(edge(rand() % nodes, rand() % nodes));
+    }
+    compare(nodes, edges);
+  }
+}
+
+static test_register t("transitive_closure", test);
@@ -19,6 +19,8 @@
 #include <cxxll/utf8.hpp>
 #include "test.hpp"
 
+#include <cstring>
+
 using namespace cxxll;
 
 static void
@@ -47,6 +49,19 @@ test()
     }
   }
 
+  {
+    const char *s = "a\303\244\342\202\254\360\237\230\200\303";
+    const char *end = s + strlen(s);
+    CHECK(utf8_character_length(s, s) == 0);
+    CHECK(utf8_character_length(s, end) == 1);
+    CHECK(utf8_character_length(s + 1, end) == 2);
+    CHECK(utf8_character_length(s + 2, end) == 0);
+    CHECK(utf8_character_length(s + 3, end) == 3);
+    CHECK(utf8_character_length(s + 3, s + 5) == 0);
+    CHECK(utf8_character_length(s + 6, end) == 4);
+    CHECK(utf8_character_length(s + 10, end) == 0);
+  }
+
   COMPARE_STRING(latin1_to_utf8(""), "");
   COMPARE_STRING(latin1_to_utf8("test"), "test");
   COMPARE_STRING(latin1_to_utf8("\200"), "\302\200");